@@ -25,42 +25,158 @@ def EntryPoint(registry, out_dir):
   registry.SubRespire(StartBuilds, build_targets=build_outputs)
 
 
+# The posix context switch implementations.  'asm' is only available on the
+# architectures that platform/posix/context_asm.cc has been written for.
+POSIX_CONTEXT_BACKEND_SOURCES = {
+  'asm': 'platform/posix/context_asm.cc',
+  'ucontext': 'platform/posix/context.cc',
+}
+
+
+def DefaultPosixContextBackend(platform):
+  if platform == 'jetson':
+    return 'asm'
+  if platform == 'raspi':
+    return 'ucontext'
+  if os.uname()[4] in ['x86_64', 'aarch64']:
+    return 'asm'
+  return 'ucontext'
+
+
 def Build(registry, out_dir, configured_toolchain, platform='host',
-          googletest_modules=None):
+          googletest_modules=None, context_backend='default'):
   if not os.path.exists(out_dir):
     os.makedirs(out_dir)
 
   if platform == 'host':
     platform = sys.platform
 
+  context_backends = []
+  platform_test_sources = []
+  platform_benchmark_sources = []
   if platform == 'win32':
     platform_sources = [
       'platform/win32/context.cc',
       'platform/win32/file_system.cc',
+      'platform/win32/futex.cc',
+      'platform/win32/stack_allocator.cc',
       'platform/win32/subprocess.cc',
     ]
   elif platform == 'raspi' or 'linux' in platform or platform == 'jetson':
     platform_sources = [
-      'platform/posix/context.cc',
+      'platform/async_file_io.h',
+      'platform/command_cache.h',
+      'platform/directory_iterator.h',
+      'platform/file_status.h',
+      'platform/io_reactor.h',
+      'platform/process.h',
+      'platform/process_pool.h',
+      'platform/zygote.h',
+      'platform/linux/async_file_io.cc',
+      'platform/linux/command_cache.cc',
+      'platform/linux/directory_iterator.cc',
+      'platform/linux/file_status.cc',
+      'platform/linux/io_reactor.cc',
+      'platform/linux/process.cc',
+      'platform/linux/process_pool.cc',
+      'platform/linux/remove_directory_tree.cc',
+      'platform/linux/zygote.cc',
+      'platform/posix/stack_allocator.cc',
       'platform/posix/subprocess.cc',
       'platform/unix/file_system.cc',
+      'platform/unix/futex.cc',
     ]
+    platform_test_sources = [
+      'platform/async_file_io_test.cc',
+      'platform/command_cache_test.cc',
+      'platform/directory_iterator_test.cc',
+      'platform/file_status_test.cc',
+      'platform/file_system_test.cc',
+      'platform/io_reactor_test.cc',
+      'platform/process_pool_test.cc',
+      'platform/process_test.cc',
+      'platform/remove_directory_tree_test.cc',
+      'platform/zygote_test.cc',
+    ]
+    platform_benchmark_sources = [
+      'platform/async_file_io_benchmark.cc',
+      'platform/directory_iterator_benchmark.cc',
+      'platform/file_status_benchmark.cc',
+      'platform/io_reactor_benchmark.cc',
+      'platform/map_file_benchmark.cc',
+      'platform/process_benchmark.cc',
+      'platform/remove_directory_tree_benchmark.cc',
+    ]
+    if context_backend == 'default':
+      context_backend = DefaultPosixContextBackend(platform)
+    context_backends = ['ucontext']
+    if DefaultPosixContextBackend(platform) == 'asm':
+      context_backends.append('asm')
 
-  platform_lib = modules.StaticLibraryModule(
-      'platform_lib', registry, out_dir, configured_toolchain,
+  # Shared by the platform and stdext libraries.
+  murmurhash_lib = modules.StaticLibraryModule(
+      'murmurhash_lib', registry, out_dir, configured_toolchain,
       sources=[
-        'platform/context.h',
-        'platform/file_system.h',
-        'platform/subprocess.h',
-      ] + platform_sources,
+        'stdext/murmurhash/MurmurHash3.cpp',
+        'stdext/murmurhash/MurmurHash3.h',
+      ],
       public_include_paths=['.'])
 
+  def MakePlatformLib(name, context_backend):
+    context_sources = []
+    if context_backend:
+      context_sources = [POSIX_CONTEXT_BACKEND_SOURCES[context_backend]]
+    return modules.StaticLibraryModule(
+        name, registry, out_dir, configured_toolchain,
+        sources=[
+          'platform/context.h',
+          'platform/context_trace.cc',
+          'platform/context_trace.h',
+          'platform/fiber_pool.cc',
+          'platform/fiber_pool.h',
+          'platform/fiber_scheduler.cc',
+          'platform/fiber_scheduler.h',
+          'platform/fiber_sync.cc',
+          'platform/fiber_sync.h',
+          'platform/file_system.h',
+          'platform/futex.h',
+          'platform/stack_allocator.h',
+          'platform/stack_profiler.cc',
+          'platform/stack_profiler.h',
+          'platform/subprocess.h',
+          'platform/timer_wheel.cc',
+          'platform/timer_wheel.h',
+        ] + platform_sources + context_sources,
+        public_include_paths=['.'],
+        module_dependencies=[murmurhash_lib])
+
+  platform_lib = MakePlatformLib(
+      'platform_lib', context_backend if context_backends else None)
+
+  # Build a benchmark for each available context backend so that they can be
+  # compared against each other.
+  context_benchmarks = []
+  for backend in context_backends:
+    if backend == context_backend:
+      backend_platform_lib = platform_lib
+    else:
+      backend_platform_lib = MakePlatformLib(
+          'platform_lib_' + backend, backend)
+    context_benchmarks.append(modules.ExecutableModule(
+        'context_benchmark_' + backend, registry, out_dir,
+        configured_toolchain,
+        sources = [
+          'platform/context_benchmark.cc',
+        ],
+        module_dependencies=[backend_platform_lib]))
+
   stdext_lib = modules.StaticLibraryModule(
       'stdext_lib', registry, out_dir, configured_toolchain,
       sources=[
         'stdext/align.h',
-        'stdext/murmurhash/MurmurHash3.cpp',
-        'stdext/murmurhash/MurmurHash3.h',
+        'stdext/function_ref.h',
+        'stdext/generator.h',
+        'stdext/inplace_function.h',
         'stdext/numeric.h',
         'stdext/optional.h',
         'stdext/span.h',
@@ -68,17 +184,22 @@ def Build(registry, out_dir, configured_toolchain, platform='host',
         'stdext/type_id.h',
         'stdext/types.h',
         'stdext/variant.h',
+        'stdext/work_stealing_deque.h',
       ],
       public_include_paths=['.'],
-      module_dependencies=[platform_lib])
+      module_dependencies=[platform_lib, murmurhash_lib])
 
   if googletest_modules:
     stdext_tests = modules.ExecutableModule(
         'stdext_tests', registry, out_dir, configured_toolchain,
         sources = [
           'stdext/file_system_test.cc',
+          'stdext/function_ref_test.cc',
+          'stdext/generator_test.cc',
+          'stdext/inplace_function_test.cc',
           'stdext/span_test.cc',
           'stdext/variant_test.cc',
+          'stdext/work_stealing_deque_test.cc',
         ],
         module_dependencies=[
           stdext_lib,
@@ -98,7 +219,14 @@ def Build(registry, out_dir, configured_toolchain, platform='host',
         'platform_tests', registry, out_dir, configured_toolchain,
         sources = [
           'platform/context_test.cc',
-        ],
+          'platform/context_trace_test.cc',
+          'platform/fiber_pool_test.cc',
+          'platform/fiber_scheduler_test.cc',
+          'platform/fiber_sync_test.cc',
+          'platform/stack_allocator_test.cc',
+          'platform/stack_profiler_test.cc',
+          'platform/timer_wheel_test.cc',
+        ] + platform_test_sources,
         module_dependencies=[
           platform_lib,
           googletest_modules['gtest_main'],
@@ -113,7 +241,48 @@ def Build(registry, out_dir, configured_toolchain, platform='host',
         timestamp_file=run_platform_tests_timestamp_file,
         command=[platform_tests.GetOutputFiles()[0]])
 
-  output_modules = {'stdext_lib': stdext_lib}
+  # The fiber layer microbenchmarks, which report their results as JSON so
+  # that they can be compared across commits.
+  platform_benchmarks = modules.ExecutableModule(
+      'platform_benchmarks', registry, out_dir, configured_toolchain,
+      sources = [
+        'platform/platform_benchmarks.cc',
+      ],
+      module_dependencies=[platform_lib])
+
+  fiber_scheduler_benchmark = modules.ExecutableModule(
+      'fiber_scheduler_benchmark', registry, out_dir, configured_toolchain,
+      sources = [
+        'platform/fiber_scheduler_benchmark.cc',
+      ],
+      module_dependencies=[platform_lib])
+
+  fiber_sync_benchmark = modules.ExecutableModule(
+      'fiber_sync_benchmark', registry, out_dir, configured_toolchain,
+      sources = [
+        'platform/fiber_sync_benchmark.cc',
+      ],
+      module_dependencies=[platform_lib])
+
+  # Benchmarks for features which are only available on some platforms.
+  platform_specific_benchmarks = []
+  for source in platform_benchmark_sources:
+    platform_specific_benchmarks.append(modules.ExecutableModule(
+        os.path.splitext(os.path.basename(source))[0], registry, out_dir,
+        configured_toolchain,
+        sources = [
+          source,
+        ],
+        module_dependencies=[platform_lib]))
+
+  output_modules = {
+    'stdext_lib': stdext_lib,
+    'context_benchmarks': context_benchmarks,
+    'fiber_scheduler_benchmark': fiber_scheduler_benchmark,
+    'fiber_sync_benchmark': fiber_sync_benchmark,
+    'platform_specific_benchmarks': platform_specific_benchmarks,
+    'platform_benchmarks': platform_benchmarks,
+  }
   if googletest_modules:
     output_modules.update({
       'stdext_tests': stdext_tests,
@@ -128,6 +297,14 @@ def StartBuilds(registry, build_targets):
   for output_file in build_targets['stdext_lib'].GetOutputFiles():
     registry.Build(output_file)
 
+  for benchmark in (build_targets['context_benchmarks'] +
+                    [build_targets['platform_benchmarks'],
+                     build_targets['fiber_scheduler_benchmark'],
+                     build_targets['fiber_sync_benchmark']] +
+                    build_targets['platform_specific_benchmarks']):
+    for output_file in benchmark.GetOutputFiles():
+      registry.Build(output_file)
+
   registry.Build(build_targets['run_stdext_tests'])
 
   registry.Build(build_targets['run_platform_tests'])
@@ -0,0 +1,79 @@
+#ifndef __PLATFORM_ASYNC_FILE_IO_H__
+#define __PLATFORM_ASYNC_FILE_IO_H__
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace platform {
+
+// Performs file system calls which would otherwise block the calling thread,
+// such as reads of regular files (for which readiness based polling, as in
+// IoReactor, does not help).  When called from a FiberScheduler fiber, only
+// the fiber is suspended while the call is in progress, so that a single
+// worker thread can keep many I/O requests outstanding.  Plain threads block
+// as usual.
+//
+// Requests are executed with io_uring when the kernel supports it.  Requests
+// made while the ring is busy are batched, so that one io_uring_enter() call
+// submits the requests of many fibers.  Where io_uring is unavailable, a pool
+// of threads makes the equivalent system calls instead.
+//
+// Every call returns what the equivalent system call would, except that
+// failures are reported by returning a negated errno value rather than
+// setting errno, since errno is thread local and a fiber may resume on a
+// different thread.  Only available on Linux.
+class AsyncFileIo {
+ public:
+  // Implementation details, defined in the .cc file.
+  class Backend;
+  struct Request;
+
+  enum BackendType {
+    kIoUring,
+    kThreadPool,
+  };
+
+  struct Options {
+    Options();
+
+    // The number of io_uring submission queue entries.  Also limits the
+    // number of requests in flight at once.
+    unsigned queue_depth;
+
+    // The number of threads to use if io_uring is unavailable.
+    int num_fallback_threads;
+
+    // Use the thread pool even if io_uring is available.
+    bool force_thread_pool;
+  };
+
+  AsyncFileIo();
+  explicit AsyncFileIo(const Options& options);
+  AsyncFileIo(const AsyncFileIo&) = delete;
+  AsyncFileIo& operator=(const AsyncFileIo&) = delete;
+
+  // Waits for outstanding requests to complete.
+  ~AsyncFileIo();
+
+  BackendType backend_type() const;
+
+  ssize_t Read(int fd, void* buffer, size_t size, off_t offset);
+  ssize_t Write(int fd, const void* buffer, size_t size, off_t offset);
+  int OpenAt(int directory_fd, const char* path, int flags, mode_t mode);
+  int Statx(int directory_fd, const char* path, int flags, unsigned mask,
+            struct statx* result);
+  int Fsync(int fd, bool data_only);
+
+ private:
+  int64_t Execute(Request* request);
+
+  std::unique_ptr<Backend> backend_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_ASYNC_FILE_IO_H__
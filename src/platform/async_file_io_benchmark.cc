@@ -0,0 +1,95 @@
+#include "platform/async_file_io.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "platform/fiber_scheduler.h"
+#include "stdext/file_system.h"
+
+// Measures random 4KiB read IOPS from fibers on a single worker thread, with
+// an increasing number of reads outstanding, for each AsyncFileIo backend.
+
+using platform::AsyncFileIo;
+using platform::FiberScheduler;
+
+namespace {
+
+const size_t kBlockSize = 4096;
+const int kNumBlocks = 16 * 1024;
+const int kReadsPerMeasurement = 100000;
+
+double MeasureIops(AsyncFileIo* io, int fd, int num_fibers) {
+  FiberScheduler::Options options;
+  options.num_workers = 1;
+  FiberScheduler scheduler(options);
+
+  int reads_per_fiber = kReadsPerMeasurement / num_fibers;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < num_fibers; ++i) {
+    fibers.push_back(scheduler.Spawn([io, fd, i, reads_per_fiber]() {
+      std::minstd_rand random(i);
+      std::vector<char> block(kBlockSize);
+      for (int j = 0; j < reads_per_fiber; ++j) {
+        off_t offset = (random() % kNumBlocks) * kBlockSize;
+        io->Read(fd, block.data(), kBlockSize, offset);
+      }
+    }));
+  }
+  for (auto& fiber : fibers) {
+    scheduler.Join(fiber);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return static_cast<double>(reads_per_fiber) * num_fibers / seconds;
+}
+
+}  // namespace
+
+int main() {
+  stdext::file_system::TemporaryDirectory temp_dir;
+  if (temp_dir.error()) {
+    fprintf(stderr, "Could not create a temporary directory.\n");
+    return 1;
+  }
+
+  // Reads are served from the page cache, so this measures the per request
+  // overhead rather than the storage device.
+  std::string path =
+      stdext::file_system::Join(temp_dir.path(), "blocks").str();
+  int fd = open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+  std::vector<char> block(kBlockSize, 'x');
+  for (int i = 0; i < kNumBlocks; ++i) {
+    if (pwrite(fd, block.data(), kBlockSize, i * kBlockSize) !=
+        static_cast<ssize_t>(kBlockSize)) {
+      fprintf(stderr, "Could not write the test file.\n");
+      return 1;
+    }
+  }
+
+  for (int force_thread_pool = 0; force_thread_pool < 2;
+       ++force_thread_pool) {
+    AsyncFileIo::Options options;
+    options.force_thread_pool = force_thread_pool;
+    AsyncFileIo io(options);
+    printf("%s backend, random %zu byte reads on one worker\n",
+           io.backend_type() == AsyncFileIo::kIoUring ? "io_uring"
+                                                     : "thread pool",
+           kBlockSize);
+    for (int num_fibers = 1; num_fibers <= 256; num_fibers *= 4) {
+      printf("  %3d fibers: %10.0f reads/s\n", num_fibers,
+             MeasureIops(&io, fd, num_fibers));
+    }
+  }
+
+  close(fd);
+  return 0;
+}
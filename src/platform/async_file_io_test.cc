@@ -0,0 +1,182 @@
+#include "platform/async_file_io.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "platform/fiber_scheduler.h"
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::AsyncFileIo;
+using platform::FiberScheduler;
+
+namespace {
+FiberScheduler::Options OptionsWithWorkers(int num_workers) {
+  FiberScheduler::Options options;
+  options.num_workers = num_workers;
+  return options;
+}
+
+// Returns the descriptors of every io_uring in the process.
+std::set<int> IoUringDescriptors() {
+  std::set<int> fds;
+  DIR* dir = opendir("/proc/self/fd");
+  while (struct dirent* dirent = dir ? readdir(dir) : nullptr) {
+    std::string link = std::string("/proc/self/fd/") + dirent->d_name;
+    char target[64];
+    ssize_t size = readlink(link.c_str(), target, sizeof(target) - 1);
+    if (size > 0 && std::string(target, size) == "anon_inode:[io_uring]") {
+      fds.insert(atoi(dirent->d_name));
+    }
+  }
+  if (dir) {
+    closedir(dir);
+  }
+  return fds;
+}
+
+// Runs each test against both backends.  The io_uring tests are skipped if
+// the kernel does not support it.
+class AsyncFileIoTest
+    : public testing::TestWithParam<AsyncFileIo::BackendType> {
+ protected:
+  void SetUp() override {
+    AsyncFileIo::Options options;
+    options.force_thread_pool = GetParam() == AsyncFileIo::kThreadPool;
+    io_.reset(new AsyncFileIo(options));
+    if (io_->backend_type() != GetParam()) {
+      GTEST_SKIP();
+    }
+    ASSERT_FALSE(temp_dir_.error());
+  }
+
+  std::string TempPath(const char* name) {
+    return stdext::file_system::Join(temp_dir_.path(), name).str();
+  }
+
+  stdext::file_system::TemporaryDirectory temp_dir_;
+  std::unique_ptr<AsyncFileIo> io_;
+};
+}  // namespace
+
+TEST_P(AsyncFileIoTest, FileRoundTripFromFiber) {
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  std::string path = TempPath("file");
+
+  auto fiber = scheduler.Spawn([&]() {
+    int fd = io_->OpenAt(AT_FDCWD, path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC,
+                         0644);
+    ASSERT_LE(0, fd);
+    EXPECT_EQ(5, io_->Write(fd, "hello", 5, 0));
+    EXPECT_EQ(6, io_->Write(fd, " world", 6, 5));
+    EXPECT_EQ(0, io_->Fsync(fd, true));
+    EXPECT_EQ(0, io_->Fsync(fd, false));
+
+    char buffer[32] = {0};
+    EXPECT_EQ(5, io_->Read(fd, buffer, 5, 6));
+    EXPECT_STREQ("world", buffer);
+
+    struct statx info;
+    EXPECT_EQ(0, io_->Statx(AT_FDCWD, path.c_str(), 0, STATX_SIZE, &info));
+    EXPECT_EQ(11u, info.stx_size);
+    close(fd);
+  });
+  scheduler.Join(fiber);
+}
+
+TEST_P(AsyncFileIoTest, ThreadsCanMakeRequests) {
+  std::string path = TempPath("file");
+  int fd = io_->OpenAt(AT_FDCWD, path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC,
+                       0644);
+  ASSERT_LE(0, fd);
+  EXPECT_EQ(3, io_->Write(fd, "abc", 3, 0));
+  char buffer[4] = {0};
+  EXPECT_EQ(3, io_->Read(fd, buffer, 3, 0));
+  EXPECT_STREQ("abc", buffer);
+  close(fd);
+}
+
+TEST_P(AsyncFileIoTest, ErrorsAreReturnedNegated) {
+  std::string path = TempPath("does_not_exist");
+  EXPECT_EQ(-ENOENT, io_->OpenAt(AT_FDCWD, path.c_str(), O_RDONLY, 0));
+
+  struct statx info;
+  EXPECT_EQ(-ENOENT,
+            io_->Statx(AT_FDCWD, path.c_str(), 0, STATX_SIZE, &info));
+
+  char byte;
+  EXPECT_EQ(-EBADF, io_->Read(-1, &byte, 1, 0));
+}
+
+TEST_P(AsyncFileIoTest, ManyFibersReadConcurrently) {
+  const int kNumBlocks = 256;
+  const size_t kBlockSize = 4096;
+  std::string path = TempPath("blocks");
+
+  int fd = open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+  ASSERT_LE(0, fd);
+  for (int i = 0; i < kNumBlocks; ++i) {
+    std::vector<char> block(kBlockSize, static_cast<char>(i));
+    ASSERT_EQ(static_cast<ssize_t>(kBlockSize),
+              pwrite(fd, block.data(), kBlockSize, i * kBlockSize));
+  }
+
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+  std::atomic<int> num_correct(0);
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < kNumBlocks; ++i) {
+    fibers.push_back(scheduler.Spawn([&, i]() {
+      std::vector<char> block(kBlockSize);
+      ssize_t result = io_->Read(fd, block.data(), kBlockSize, i * kBlockSize);
+      if (result == static_cast<ssize_t>(kBlockSize) &&
+          block == std::vector<char>(kBlockSize, static_cast<char>(i))) {
+        ++num_correct;
+      }
+    }));
+  }
+  for (auto& fiber : fibers) {
+    scheduler.Join(fiber);
+  }
+  close(fd);
+
+  EXPECT_EQ(kNumBlocks, num_correct.load());
+}
+
+TEST(AsyncFileIoTests, RingFailureFailsRequests) {
+  std::set<int> other_ring_fds = IoUringDescriptors();
+  AsyncFileIo io;
+  if (io.backend_type() != AsyncFileIo::kIoUring) {
+    GTEST_SKIP();
+  }
+
+  // Replace the ring with something else, so that io_uring_enter() fails
+  // with EOPNOTSUPP the next time that the ring thread calls it.
+  int ring_fd = -1;
+  for (int fd : IoUringDescriptors()) {
+    if (!other_ring_fds.count(fd)) {
+      ring_fd = fd;
+    }
+  }
+  ASSERT_LE(0, ring_fd);
+  int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  ASSERT_EQ(ring_fd, dup3(null_fd, ring_fd, O_CLOEXEC));
+
+  char byte;
+  EXPECT_EQ(-EOPNOTSUPP, io.Read(null_fd, &byte, 1, 0));
+  // Later requests fail straight away.
+  EXPECT_EQ(-EOPNOTSUPP, io.Read(null_fd, &byte, 1, 0));
+  close(null_fd);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Backends, AsyncFileIoTest,
+    testing::Values(AsyncFileIo::kIoUring, AsyncFileIo::kThreadPool));
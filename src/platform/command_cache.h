@@ -0,0 +1,110 @@
+#ifndef __PLATFORM_COMMAND_CACHE_H__
+#define __PLATFORM_COMMAND_CACHE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stdext/file_system.h"
+#include "stdext/optional.h"
+
+namespace platform {
+
+// Memoizes system commands whose output depends only on the command, some of
+// the environment and some input files.  Only available on Linux.
+//
+// Each command is keyed by a MurmurHash3_x64_128 digest of its command
+// string, the current directory, the values of the environment variables it
+// names, and a fingerprint of each of its inputs.  Its exit status and output are stored
+// in a file named after the key in the cache's directory, and on a later
+// call with the same key are replayed from there instead of running the
+// command again.
+//
+// Any number of processes may share a directory.  Entries are written to a
+// temporary file and renamed into place, so that readers only ever see whole
+// entries, and a process which finds the directory larger than its size
+// limit evicts the least recently used entries.
+class CommandCache {
+ public:
+  struct Options {
+    Options() : max_size_bytes(256 * 1024 * 1024), cache_failures(false) {}
+
+    // Once the entries add up to more than this, the least recently used are
+    // evicted.
+    uint64_t max_size_bytes;
+
+    // Whether to store the results of commands which exit with a non-zero
+    // status.  Those killed by signals are never stored.
+    bool cache_failures;
+  };
+
+  struct Input {
+    enum Fingerprint {
+      // The file's size and modification time.  Cheap, but a change which
+      // keeps the size and is made within the file system's timestamp
+      // resolution goes unnoticed.
+      kSizeAndModificationTime,
+      // A hash of the file's contents.
+      kContents,
+    };
+
+    Input(const stdext::file_system::Path& path,
+          Fingerprint fingerprint = kSizeAndModificationTime)
+        : path(path), fingerprint(fingerprint) {}
+
+    stdext::file_system::Path path;
+    Fingerprint fingerprint;
+  };
+
+  struct Command {
+    explicit Command(const std::string& command) : command(command) {}
+
+    // Run with "/bin/sh -c", as by SystemCommand().
+    std::string command;
+    // The names of the environment variables which the command depends on.
+    // The command still runs with the whole of this process's environment.
+    std::vector<std::string> environment_variables;
+    // Files which the command reads.  A missing file is part of the key too.
+    std::vector<Input> inputs;
+  };
+
+  struct Result {
+    // As returned by waitpid().
+    int status;
+    std::string stdout_data;
+    std::string stderr_data;
+    // Whether this was replayed from the cache.
+    bool cached;
+  };
+
+  // Uses |directory|, which is created if it does not exist yet.
+  explicit CommandCache(const stdext::file_system::Path& directory,
+                        const Options& options = Options());
+
+  // Replays the stored result of |command|, or runs it and stores its
+  // result.  Errors in reading or writing the cache only cause the command
+  // to be run.  Returns nothing, with errno set, if the command could not be
+  // run.
+  stdext::optional<Result> Run(const Command& command);
+
+ private:
+  // Returns the hex digest which names |command|'s entry, and fills |key|
+  // with the data it is a digest of.  Returns an empty string if the current
+  // directory is unknown, in which case the command is not cached.
+  std::string ComputeKey(const Command& command, std::string* key) const;
+
+  bool Load(const std::string& entry, const std::string& key, Result* result);
+  void Store(const std::string& entry, const std::string& key,
+             const Result& result);
+
+  // Removes the least recently used entries until the directory is within
+  // its size limit.
+  void Evict();
+
+  const stdext::file_system::Path directory_;
+  const Options options_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_COMMAND_CACHE_H__
@@ -0,0 +1,219 @@
+#include "platform/command_cache.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::CommandCache;
+
+namespace {
+void WriteFile(const std::string& path, const std::string& contents) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+            write(fd, contents.data(), contents.size()));
+  close(fd);
+}
+
+size_t CountLines(const std::string& path) {
+  std::string contents;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  char buffer[4096];
+  ssize_t size;
+  while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, size);
+  }
+  close(fd);
+  return std::count(contents.begin(), contents.end(), '\n');
+}
+
+class CommandCacheTests : public ::testing::Test {
+ protected:
+  void SetUp() override { ASSERT_FALSE(directory_.error()); }
+
+  std::string FilePath(const char* name) const {
+    return std::string(directory_.path().c_str()) + "/" + name;
+  }
+
+  // A command which prints |output| and logs each time it actually runs.
+  CommandCache::Command LoggedCommand(const std::string& output) const {
+    return CommandCache::Command(
+        "echo run >> " + FilePath("log") + "; echo " + output +
+        "; echo error >&2");
+  }
+
+  stdext::file_system::TemporaryDirectory directory_;
+};
+}  // namespace
+
+TEST_F(CommandCacheTests, ReplaysStoredResults) {
+  CommandCache cache(FilePath("cache"));
+  CommandCache::Command command = LoggedCommand("hello");
+
+  stdext::optional<CommandCache::Result> first = cache.Run(command);
+  ASSERT_TRUE(first);
+  EXPECT_FALSE(first->cached);
+  EXPECT_EQ(0, first->status);
+  EXPECT_EQ("hello\n", first->stdout_data);
+  EXPECT_EQ("error\n", first->stderr_data);
+
+  stdext::optional<CommandCache::Result> second = cache.Run(command);
+  ASSERT_TRUE(second);
+  EXPECT_TRUE(second->cached);
+  EXPECT_EQ(0, second->status);
+  EXPECT_EQ("hello\n", second->stdout_data);
+  EXPECT_EQ("error\n", second->stderr_data);
+  EXPECT_EQ(1u, CountLines(FilePath("log")));
+
+  // Another cache on the same directory, as in another process, shares the
+  // entries.
+  CommandCache other_cache(FilePath("cache"));
+  EXPECT_TRUE(other_cache.Run(command)->cached);
+  EXPECT_FALSE(other_cache.Run(LoggedCommand("other"))->cached);
+}
+
+TEST_F(CommandCacheTests, KeyIncludesNamedEnvironmentVariables) {
+  CommandCache cache(FilePath("cache"));
+  CommandCache::Command command = LoggedCommand("hello");
+  command.environment_variables.push_back("COMMAND_CACHE_TEST_VARIABLE");
+
+  unsetenv("COMMAND_CACHE_TEST_VARIABLE");
+  EXPECT_FALSE(cache.Run(command)->cached);
+  setenv("COMMAND_CACHE_TEST_VARIABLE", "", 1);
+  EXPECT_FALSE(cache.Run(command)->cached);
+  setenv("COMMAND_CACHE_TEST_VARIABLE", "value", 1);
+  EXPECT_FALSE(cache.Run(command)->cached);
+  EXPECT_TRUE(cache.Run(command)->cached);
+  unsetenv("COMMAND_CACHE_TEST_VARIABLE");
+  EXPECT_TRUE(cache.Run(command)->cached);
+}
+
+TEST_F(CommandCacheTests, KeyIncludesInputs) {
+  CommandCache cache(FilePath("cache"));
+  CommandCache::Command command = LoggedCommand("hello");
+  command.inputs.emplace_back(FilePath("by_time"));
+  command.inputs.emplace_back(FilePath("by_contents"),
+                              CommandCache::Input::kContents);
+
+  // Missing inputs are part of the key too.
+  EXPECT_FALSE(cache.Run(command)->cached);
+  EXPECT_TRUE(cache.Run(command)->cached);
+
+  WriteFile(FilePath("by_time"), "1");
+  WriteFile(FilePath("by_contents"), "1");
+  EXPECT_FALSE(cache.Run(command)->cached);
+  EXPECT_TRUE(cache.Run(command)->cached);
+
+  WriteFile(FilePath("by_time"), "22");
+  EXPECT_FALSE(cache.Run(command)->cached);
+
+  // Only the contents matter for a hashed input.
+  WriteFile(FilePath("by_contents"), "2");
+  EXPECT_FALSE(cache.Run(command)->cached);
+  WriteFile(FilePath("by_contents"), "2");
+  EXPECT_TRUE(cache.Run(command)->cached);
+}
+
+TEST_F(CommandCacheTests, KeyIncludesCurrentDirectory) {
+  ASSERT_EQ(0, mkdir(FilePath("a").c_str(), 0755));
+  ASSERT_EQ(0, mkdir(FilePath("b").c_str(), 0755));
+  WriteFile(FilePath("a/input"), "a");
+  WriteFile(FilePath("b/input"), "b");
+  CommandCache cache(FilePath("cache"));
+  // Only the current directory tells the two apart.
+  CommandCache::Command command("cat input");
+
+  char old_directory[4096];
+  ASSERT_NE(nullptr, getcwd(old_directory, sizeof(old_directory)));
+  ASSERT_EQ(0, chdir(FilePath("a").c_str()));
+  EXPECT_EQ("a", cache.Run(command)->stdout_data);
+  EXPECT_TRUE(cache.Run(command)->cached);
+  ASSERT_EQ(0, chdir(FilePath("b").c_str()));
+  stdext::optional<CommandCache::Result> result = cache.Run(command);
+  EXPECT_FALSE(result->cached);
+  EXPECT_EQ("b", result->stdout_data);
+  ASSERT_EQ(0, chdir(old_directory));
+}
+
+TEST_F(CommandCacheTests, FailuresAreOnlyStoredIfAsked) {
+  CommandCache::Command command("echo run >> " + FilePath("log") + "; exit 3");
+
+  CommandCache cache(FilePath("cache"));
+  EXPECT_EQ(3, WEXITSTATUS(cache.Run(command)->status));
+  EXPECT_FALSE(cache.Run(command)->cached);
+
+  CommandCache::Options options;
+  options.cache_failures = true;
+  CommandCache failure_cache(FilePath("failure_cache"), options);
+  EXPECT_FALSE(failure_cache.Run(command)->cached);
+  stdext::optional<CommandCache::Result> result = failure_cache.Run(command);
+  EXPECT_TRUE(result->cached);
+  EXPECT_EQ(3, WEXITSTATUS(result->status));
+  EXPECT_EQ(3u, CountLines(FilePath("log")));
+}
+
+TEST_F(CommandCacheTests, EvictsLeastRecentlyUsedEntries) {
+  CommandCache::Options options;
+  options.max_size_bytes = 2500;
+  CommandCache cache(FilePath("cache"), options);
+  auto make_command = [](const char* name) {
+    // Each entry is a little over 1000 bytes.
+    return CommandCache::Command(std::string("head -c 1000 /dev/zero; echo ") +
+                                 name);
+  };
+
+  EXPECT_FALSE(cache.Run(make_command("first"))->cached);
+  EXPECT_FALSE(cache.Run(make_command("second"))->cached);
+  // Using the first entry makes the second the least recently used.
+  EXPECT_TRUE(cache.Run(make_command("first"))->cached);
+  EXPECT_FALSE(cache.Run(make_command("third"))->cached);
+
+  EXPECT_TRUE(cache.Run(make_command("first"))->cached);
+  EXPECT_TRUE(cache.Run(make_command("third"))->cached);
+  EXPECT_FALSE(cache.Run(make_command("second"))->cached);
+}
+
+TEST_F(CommandCacheTests, CanBeSharedByProcesses) {
+  const int kNumProcesses = 4;
+  const int kNumCommands = 10;
+  std::vector<pid_t> children;
+  for (int i = 0; i < kNumProcesses; ++i) {
+    pid_t pid = fork();
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+      CommandCache cache(FilePath("cache"));
+      bool ok = true;
+      for (int j = 0; j < kNumCommands; ++j) {
+        std::string output = std::to_string(j);
+        stdext::optional<CommandCache::Result> result =
+            cache.Run(CommandCache::Command("echo " + output));
+        ok = ok && result && result->stdout_data == output + "\n";
+      }
+      _exit(ok ? 0 : 1);
+    }
+    children.push_back(pid);
+  }
+  for (pid_t child : children) {
+    int status;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    EXPECT_EQ(0, status);
+  }
+
+  CommandCache cache(FilePath("cache"));
+  for (int j = 0; j < kNumCommands; ++j) {
+    EXPECT_TRUE(cache.Run(CommandCache::Command(
+        "echo " + std::to_string(j)))->cached);
+  }
+}
@@ -2,7 +2,13 @@
 #define __PLATFORM_CONTEXT_H__
 
 #include <cassert>
+#include <cstddef>
 #include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "platform/stack_allocator.h"
 
 namespace platform {
 
@@ -17,13 +23,62 @@ struct Context;
 Context* SwitchToContext(Context* destination_context,
                          void* context_data);
 
-// Function called with the previous context we switched from passed in as
-// a parameter.  The return value of this function is the context to switch to
-// afterwards.  The value |context_data| will be stored in the created
-// |Context| object and made available through the GetContextData() function.
-typedef std::function<Context* (Context*)> FiberMain;
+// The lowest level entry point for a new context.  It is called on the new
+// context's stack with the context that we switched from and the |arg| that
+// was passed to SwitchToNewContext().  The return value is the context to
+// switch to afterwards, at which point the new context's stack is freed.
+typedef Context* (*RawFiberMain)(Context* previous_context, void* arg);
+
+// Creates a new context, with a stack of at least |stack_size| bytes obtained
+// from |stack_allocator|, and switches to it, calling
+// |entry_point(previous_context, arg)|.  Returns the context that we
+// eventually switch back from, or null if the new context could not be
+// created.  The value |context_data| will be stored in the returned |Context|
+// object and made available through the GetContextData() function.
+Context* SwitchToNewContext(StackAllocator* stack_allocator,
+                            size_t stack_size, void* context_data,
+                            RawFiberMain entry_point, void* arg);
+
+namespace internal {
+// Runs on the new context's stack.  The entry point is moved (or copied, if
+// it was passed as an lvalue) out of the creator's frame, which is only
+// guaranteed to be alive until the first switch, and into this frame at the
+// top of the new stack.
+template <typename FiberFunction>
+Context* RunFiberFunction(Context* previous_context, void* arg) {
+  typedef typename std::remove_reference<FiberFunction>::type Referenced;
+  typename std::decay<FiberFunction>::type entry_point(
+      std::forward<FiberFunction>(*static_cast<Referenced*>(arg)));
+  return entry_point(previous_context);
+}
+}  // namespace internal
+
+// As above, but the entry point is any callable taking the previous context
+// and returning the context to switch to afterwards.  The callable is
+// constructed directly on the new context's stack, so creating a context
+// never allocates memory other than the stack itself.
+template <typename FiberFunction>
+Context* SwitchToNewContext(StackAllocator* stack_allocator,
+                            size_t stack_size, void* context_data,
+                            FiberFunction&& entry_point) {
+  return SwitchToNewContext(
+      stack_allocator, stack_size, context_data,
+      &internal::RunFiberFunction<FiberFunction&&>,
+      const_cast<void*>(static_cast<const void*>(std::addressof(entry_point))));
+}
+
+// As above, with the stack obtained from StackAllocator::GetDefault().
+template <typename FiberFunction>
 Context* SwitchToNewContext(size_t stack_size, void* context_data,
-                            const FiberMain& entry_point);
+                            FiberFunction&& entry_point) {
+  return SwitchToNewContext(
+      StackAllocator::GetDefault(), stack_size, context_data,
+      std::forward<FiberFunction>(entry_point));
+}
+
+// A type-erased entry point, for code which needs to store one before
+// creating its context.
+typedef std::function<Context* (Context*)> FiberMain;
 
 // Extracts the context data stored with the Context, passed in through the
 // |context_data| parameter by either the SwitchContext() function or the
@@ -1,5 +1,7 @@
 #include "platform/context.h"
 
+#include <memory>
+
 #include "third_party/googletest/googletest/include/gtest/gtest.h"
 
 using platform::Context;
@@ -156,4 +158,39 @@ TEST(ContextTests, SmallSwitchRing) {
       SwitchToNewContext(kDefaultStackSize, nullptr, ring_function);
   EXPECT_EQ(nullptr, prev_context);
   EXPECT_EQ(kRingSize * 3, foo);
-}
\ No newline at end of file
+}
+
+TEST(ContextTests, EntryPointCanBeMoveOnly) {
+  std::unique_ptr<int> foo(new int(1));
+  int result = 0;
+
+  Context* prev_context = SwitchToNewContext(
+      kDefaultStackSize, nullptr,
+      [foo = std::move(foo), &result](Context* context) {
+        result = *foo;
+        return context;
+      });
+
+  EXPECT_EQ(nullptr, prev_context);
+  EXPECT_EQ(1, result);
+}
+
+TEST(ContextTests, EntryPointIsConstructedOnNewStack) {
+  // Large enough that std::function would have had to allocate it.
+  int captures[16] = {0};
+  const void* captures_address = nullptr;
+  const void* stack_variable_address = nullptr;
+
+  SwitchToNewContext(kDefaultStackSize, nullptr, [&, captures](
+      Context* context) {
+    int stack_variable = 0;
+    captures_address = &captures;
+    stack_variable_address = &stack_variable;
+    return context;
+  });
+
+  // Both live in the new stack, within a few frames of each other.
+  intptr_t distance = reinterpret_cast<intptr_t>(captures_address) -
+                      reinterpret_cast<intptr_t>(stack_variable_address);
+  EXPECT_LT(std::abs(distance), 1024);
+}
@@ -0,0 +1,411 @@
+#include "platform/context_trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(_MSC_VER)
+#define PLATFORM_NOINLINE __declspec(noinline)
+#else
+#define PLATFORM_NOINLINE __attribute__((noinline))
+#endif
+
+namespace platform {
+
+namespace internal {
+std::atomic<bool> g_context_tracing_enabled(false);
+}  // namespace internal
+
+namespace {
+
+// The fields of a ContextTraceEvent, other than the thread, stored as atomic
+// words so that they can be read while they are being overwritten.
+struct Slot {
+  std::atomic<uint64_t> timestamp;
+  std::atomic<uint64_t> type;
+  std::atomic<uintptr_t> from;
+  std::atomic<uintptr_t> to;
+  std::atomic<uintptr_t> from_data;
+  std::atomic<uintptr_t> to_data;
+};
+
+// A ring buffer written only by its thread.  |head| counts every event ever
+// written, and the event numbered n lives in slot n % capacity.
+struct ThreadBuffer {
+  ThreadBuffer(uint32_t thread, size_t capacity)
+      : thread(thread), mask(capacity - 1), slots(new Slot[capacity]),
+        head(0) {}
+
+  const uint32_t thread;
+  const uint64_t mask;
+  std::unique_ptr<Slot[]> slots;
+  std::atomic<uint64_t> head;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  // The capacity of new buffers, a power of two.
+  size_t events_per_thread = 128 * 1024;
+};
+
+// Buffers outlive their threads, so that threads which have exited still
+// show up in the trace.  The registry is never destroyed, since threads may
+// still be recording during static destruction.
+Registry* GetRegistry() {
+  static Registry* registry = new Registry();
+  return registry;
+}
+
+thread_local ThreadBuffer* tl_buffer = nullptr;
+
+// The calling context may be resumed on a different thread, so as with
+// FiberScheduler's CurrentWorker(), the address of |tl_buffer| must be
+// recomputed on every call.
+PLATFORM_NOINLINE ThreadBuffer* CurrentThreadBuffer() {
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  if (!tl_buffer) {
+    Registry* registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    registry->buffers.emplace_back(new ThreadBuffer(
+        static_cast<uint32_t>(registry->buffers.size() + 1),
+        registry->events_per_thread));
+    tl_buffer = registry->buffers.back().get();
+  }
+  return tl_buffer;
+}
+
+uint64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t RoundUpToPowerOfTwo(size_t value) {
+  size_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+// Appends the events still held by |buffer| to |events|.  Slots may be
+// overwritten while they are being copied, so the head is read again
+// afterwards, and any event which may have been overwritten is dropped, as
+// with a seqlock.
+void CopyEvents(const ThreadBuffer& buffer,
+                std::vector<ContextTraceEvent>* events) {
+  const uint64_t capacity = buffer.mask + 1;
+  const uint64_t end = buffer.head.load(std::memory_order_acquire);
+  const uint64_t begin = end > capacity ? end - capacity : 0;
+
+  std::vector<ContextTraceEvent> copied;
+  copied.reserve(end - begin);
+  for (uint64_t i = begin; i < end; ++i) {
+    const Slot& slot = buffer.slots[i & buffer.mask];
+    ContextTraceEvent event;
+    event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    event.type = static_cast<ContextTraceEvent::Type>(
+        slot.type.load(std::memory_order_relaxed));
+    event.thread = buffer.thread;
+    event.from = reinterpret_cast<const Context*>(
+        slot.from.load(std::memory_order_relaxed));
+    event.to = reinterpret_cast<const Context*>(
+        slot.to.load(std::memory_order_relaxed));
+    event.from_data = reinterpret_cast<void*>(
+        slot.from_data.load(std::memory_order_relaxed));
+    event.to_data = reinterpret_cast<void*>(
+        slot.to_data.load(std::memory_order_relaxed));
+    copied.push_back(event);
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t after = buffer.head.load(std::memory_order_relaxed);
+  // The event numbered |after| may be half written into the slot of the
+  // event numbered |after| - |capacity|.
+  const uint64_t first_valid =
+      after + 1 > capacity ? after + 1 - capacity : 0;
+  for (uint64_t i = std::max(begin, first_valid); i < end; ++i) {
+    events->push_back(copied[i - begin]);
+  }
+}
+
+// A stretch of time that a context ran on a thread.
+struct Slice {
+  uint32_t thread;
+  uint64_t start;
+  uint64_t end;
+  bool tag_known;
+  void* tag;
+};
+
+// Walks through |events| in order, keeping track of what is running on each
+// thread, and calls |on_slice| for each slice as it ends.  Adds up running
+// and ready time into |summaries|.
+template <typename OnSlice>
+void Replay(const std::vector<ContextTraceEvent>& events,
+            std::unordered_map<void*, ContextTraceSummary>* summaries,
+            OnSlice on_slice) {
+  struct Running {
+    bool open = false;
+    Slice slice;
+  };
+  std::unordered_map<uint32_t, Running> threads;
+  std::unordered_map<void*, uint64_t> ready_since;
+
+  auto summary_for = [summaries](void* tag) -> ContextTraceSummary& {
+    ContextTraceSummary& summary = (*summaries)[tag];
+    summary.tag = tag;
+    return summary;
+  };
+
+  // Called once the tag of a slice is known.
+  auto start_run = [&](void* tag, uint64_t start) {
+    ContextTraceSummary& summary = summary_for(tag);
+    ++summary.num_runs;
+    auto ready = ready_since.find(tag);
+    if (ready != ready_since.end()) {
+      if (start > ready->second) {
+        summary.ready_ns += start - ready->second;
+      }
+      ready_since.erase(ready);
+    }
+  };
+
+  auto learn_tag = [&](Slice* slice, void* tag) {
+    if (!slice->tag_known) {
+      slice->tag_known = true;
+      slice->tag = tag;
+      start_run(tag, slice->start);
+    }
+  };
+
+  auto close = [&](Running* running, uint64_t end) {
+    if (!running->open) {
+      return;
+    }
+    running->open = false;
+    running->slice.end = end;
+    if (running->slice.tag_known) {
+      summary_for(running->slice.tag).running_ns +=
+          end - running->slice.start;
+    }
+    on_slice(running->slice);
+  };
+
+  auto open = [&](Running* running, uint32_t thread, uint64_t start,
+                  bool tag_known, void* tag) {
+    running->open = true;
+    running->slice.thread = thread;
+    running->slice.start = start;
+    running->slice.end = start;
+    running->slice.tag_known = false;
+    running->slice.tag = nullptr;
+    if (tag_known) {
+      learn_tag(&running->slice, tag);
+    }
+  };
+
+  for (const ContextTraceEvent& event : events) {
+    Running* running = &threads[event.thread];
+    switch (event.type) {
+      case ContextTraceEvent::kSwitch:
+      case ContextTraceEvent::kNewContext:
+        if (running->open) {
+          learn_tag(&running->slice, event.from_data);
+        }
+        close(running, event.timestamp);
+        open(running, event.thread, event.timestamp,
+             event.type == ContextTraceEvent::kSwitch, event.to_data);
+        break;
+      case ContextTraceEvent::kExit:
+        close(running, event.timestamp);
+        open(running, event.thread, event.timestamp, true, event.to_data);
+        break;
+      case ContextTraceEvent::kTag:
+        if (running->open && !running->slice.tag_known) {
+          learn_tag(&running->slice, event.from_data);
+        } else if (!running->open || running->slice.tag != event.from_data) {
+          // A context which is reused for other work, such as a pooled
+          // fiber, starts a new slice under its new tag.
+          close(running, event.timestamp);
+          open(running, event.thread, event.timestamp, true, event.from_data);
+        }
+        break;
+      case ContextTraceEvent::kReady:
+        ready_since.emplace(event.to_data, event.timestamp);
+        break;
+    }
+  }
+
+  // Whatever is still running is cut off at the end of the trace.
+  if (!events.empty()) {
+    uint64_t last = events.back().timestamp;
+    for (auto& thread : threads) {
+      close(&thread.second, last);
+    }
+  }
+}
+
+void PrintMicroseconds(FILE* file, uint64_t nanoseconds) {
+  fprintf(file, "%" PRIu64 ".%03" PRIu64, nanoseconds / 1000,
+          nanoseconds % 1000);
+}
+
+}  // namespace
+
+namespace internal {
+
+void RecordContextTraceEvent(ContextTraceEvent::Type type,
+                             const Context* from, const Context* to,
+                             void* from_data, void* to_data) {
+  ThreadBuffer* buffer = CurrentThreadBuffer();
+  uint64_t head = buffer->head.load(std::memory_order_relaxed);
+  // Orders the previous event's head update before the stores below, so
+  // that a reader which sees any of them also sees that this slot is being
+  // reused.
+  std::atomic_thread_fence(std::memory_order_release);
+
+  Slot& slot = buffer->slots[head & buffer->mask];
+  slot.timestamp.store(Now(), std::memory_order_relaxed);
+  slot.type.store(type, std::memory_order_relaxed);
+  slot.from.store(reinterpret_cast<uintptr_t>(from),
+                  std::memory_order_relaxed);
+  slot.to.store(reinterpret_cast<uintptr_t>(to), std::memory_order_relaxed);
+  slot.from_data.store(reinterpret_cast<uintptr_t>(from_data),
+                       std::memory_order_relaxed);
+  slot.to_data.store(reinterpret_cast<uintptr_t>(to_data),
+                     std::memory_order_relaxed);
+
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+}  // namespace internal
+
+void StartContextTracing(size_t events_per_thread) {
+  Registry* registry = GetRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    // One slot is always treated as being overwritten; see CopyEvents().
+    registry->events_per_thread = RoundUpToPowerOfTwo(events_per_thread + 1);
+  }
+  internal::g_context_tracing_enabled.store(true);
+}
+
+void StopContextTracing() {
+  internal::g_context_tracing_enabled.store(false);
+}
+
+void ClearContextTrace() {
+  Registry* registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry->mutex);
+  for (auto& buffer : registry->buffers) {
+    buffer->head.store(0);
+  }
+}
+
+std::vector<ContextTraceEvent> CollectContextTrace() {
+  std::vector<ContextTraceEvent> events;
+  {
+    Registry* registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    for (auto& buffer : registry->buffers) {
+      CopyEvents(*buffer, &events);
+    }
+  }
+  std::stable_sort(events.begin(), events.end(),
+                   [](const ContextTraceEvent& a, const ContextTraceEvent& b) {
+                     return a.timestamp < b.timestamp;
+                   });
+  return events;
+}
+
+std::vector<ContextTraceSummary> SummarizeContextTrace(
+    const std::vector<ContextTraceEvent>& events) {
+  std::unordered_map<void*, ContextTraceSummary> summaries;
+  Replay(events, &summaries, [](const Slice&) {});
+
+  std::vector<ContextTraceSummary> results;
+  results.reserve(summaries.size());
+  for (const auto& summary : summaries) {
+    results.push_back(summary.second);
+  }
+  std::sort(results.begin(), results.end(),
+            [](const ContextTraceSummary& a, const ContextTraceSummary& b) {
+              return a.running_ns > b.running_ns;
+            });
+  return results;
+}
+
+bool WriteContextTrace(const std::vector<ContextTraceEvent>& events,
+                       const char* path) {
+  // Slices are gathered first, since their arguments include the summaries
+  // of the whole trace.
+  std::unordered_map<void*, ContextTraceSummary> summaries;
+  std::vector<Slice> slices;
+  Replay(events, &summaries,
+         [&slices](const Slice& slice) { slices.push_back(slice); });
+
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+
+  const uint64_t origin = events.empty() ? 0 : events.front().timestamp;
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool first = true;
+
+  std::vector<uint32_t> threads;
+  for (const ContextTraceEvent& event : events) {
+    threads.push_back(event.thread);
+  }
+  std::sort(threads.begin(), threads.end());
+  threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+  for (uint32_t thread : threads) {
+    fprintf(file,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%" PRIu32 ",\"args\":{\"name\":\"thread %" PRIu32
+            "\"}}",
+            first ? "" : ",", thread, thread);
+    first = false;
+  }
+
+  for (const Slice& slice : slices) {
+    fprintf(file, "%s\n{\"name\":\"", first ? "" : ",");
+    first = false;
+    if (slice.tag_known) {
+      fprintf(file, "%p", slice.tag);
+    } else {
+      fprintf(file, "unknown");
+    }
+    fprintf(file, "\",\"cat\":\"context\",\"ph\":\"X\",\"pid\":1,"
+                  "\"tid\":%" PRIu32 ",\"ts\":", slice.thread);
+    PrintMicroseconds(file, slice.start - origin);
+    fprintf(file, ",\"dur\":");
+    PrintMicroseconds(file, slice.end - slice.start);
+    if (slice.tag_known) {
+      const ContextTraceSummary& summary = summaries[slice.tag];
+      fprintf(file,
+              ",\"args\":{\"running_ns\":%" PRIu64 ",\"ready_ns\":%" PRIu64
+              ",\"num_runs\":%" PRIu64 "}",
+              summary.running_ns, summary.ready_ns, summary.num_runs);
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "\n]}\n");
+
+  bool success = !ferror(file);
+  if (fclose(file) != 0) {
+    success = false;
+  }
+  return success;
+}
+
+bool FlushContextTrace(const char* path) {
+  return WriteContextTrace(CollectContextTrace(), path);
+}
+
+}  // namespace platform
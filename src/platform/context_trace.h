@@ -0,0 +1,145 @@
+#ifndef __PLATFORM_CONTEXT_TRACE_H__
+#define __PLATFORM_CONTEXT_TRACE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace platform {
+
+struct Context;
+
+// An opt-in record of every context switch, for finding out after the fact
+// which context was running on which thread, for how long, and who switched
+// to whom.
+//
+// While tracing is enabled, SwitchToContext() and SwitchToNewContext() append
+// an event to a ring buffer owned by the calling thread.  Only the owning
+// thread writes to a buffer, so recording never takes a lock; once a buffer
+// is full the oldest events are overwritten.  While tracing is disabled, the
+// cost to a context switch is a single load and branch.
+//
+// Contexts are identified by the |context_data| tags passed when they switch
+// out, so callers which want readable traces should tag their contexts
+// consistently (FiberScheduler tags each fiber's context with its Fiber*).
+struct ContextTraceEvent {
+  enum Type : uint32_t {
+    // |from| switched to |to|, which was a suspended context.
+    kSwitch,
+    // |from| switched to a newly created context, whose tag is not yet known.
+    kNewContext,
+    // A context returned from its entry point and switched to |to|.  |from|
+    // is null.
+    kExit,
+    // The running context announced its tag, in |from_data|, through
+    // TraceContextTag().
+    kTag,
+    // The context tagged |to_data| became ready to run, as reported through
+    // TraceContextReady().  It may be recorded on any thread.
+    kReady,
+  };
+
+  // Nanoseconds on std::chrono::steady_clock.
+  uint64_t timestamp;
+  Type type;
+  // A small number identifying the thread that recorded the event, starting
+  // at 1.
+  uint32_t thread;
+  // The context being suspended and the one being resumed.  These are only
+  // meaningful as identifiers: a context suspended as |from| is later resumed
+  // as |to|.
+  const Context* from;
+  const Context* to;
+  // The tags of the two contexts.
+  void* from_data;
+  void* to_data;
+};
+
+// Time spent by one tagged context, derived from a trace.
+struct ContextTraceSummary {
+  void* tag;
+  // Time spent running on a thread.  This is wall time between switches,
+  // which includes any time the thread itself was descheduled.
+  uint64_t running_ns;
+  // Time between the context being reported ready and it next being
+  // switched to.
+  uint64_t ready_ns;
+  // The number of times the context was switched to.
+  uint64_t num_runs;
+};
+
+namespace internal {
+extern std::atomic<bool> g_context_tracing_enabled;
+
+void RecordContextTraceEvent(ContextTraceEvent::Type type,
+                             const Context* from, const Context* to,
+                             void* from_data, void* to_data);
+}  // namespace internal
+
+inline bool IsContextTracingEnabled() {
+  bool enabled =
+      internal::g_context_tracing_enabled.load(std::memory_order_relaxed);
+#if defined(__GNUC__)
+  return __builtin_expect(enabled, false);
+#else
+  return enabled;
+#endif
+}
+
+// Starts recording.  Threads which have not recorded any events yet get ring
+// buffers which hold at least the newest |events_per_thread| events.
+void StartContextTracing(size_t events_per_thread = 64 * 1024);
+
+// Stops recording.  Switches which are already in progress may still record
+// their events.
+void StopContextTracing();
+
+// Discards every recorded event.  Must not be called while any thread may be
+// switching contexts with tracing enabled.
+void ClearContextTrace();
+
+// Records that the running context is identified by |tag| from now on.
+// Contexts learn their tags only when they first switch out, so this lets a
+// new context be named in the trace from the start, and lets a context which
+// is reused for different work be renamed.
+inline void TraceContextTag(void* tag) {
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(
+        ContextTraceEvent::kTag, nullptr, nullptr, tag, nullptr);
+  }
+}
+
+// Records that the context tagged |tag| is ready to run, so that the time
+// until it runs is reported as ready time.
+inline void TraceContextReady(void* tag) {
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(
+        ContextTraceEvent::kReady, nullptr, nullptr, nullptr, tag);
+  }
+}
+
+// Returns a copy of the events currently held by every thread's buffer,
+// ordered by timestamp.  This may be called while tracing is enabled, in
+// which case events recorded during the call may or may not be included.
+std::vector<ContextTraceEvent> CollectContextTrace();
+
+// Adds up the running and ready time of each tag in |events|, which must be
+// ordered by timestamp.  Results are ordered by decreasing running time.
+std::vector<ContextTraceSummary> SummarizeContextTrace(
+    const std::vector<ContextTraceEvent>& events);
+
+// Writes |events| to |path| in the Chrome trace event JSON format, which can
+// be loaded by chrome://tracing and by Perfetto.  Each thread gets a track
+// with one slice per stretch of time a context ran on it, and the summary of
+// each tag is attached to its slices.  Returns false if the file could not
+// be written.
+bool WriteContextTrace(const std::vector<ContextTraceEvent>& events,
+                       const char* path);
+
+// Collects the recorded events and writes them to |path|.
+bool FlushContextTrace(const char* path);
+
+}  // namespace platform
+
+#endif  // __PLATFORM_CONTEXT_TRACE_H__
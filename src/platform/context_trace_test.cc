@@ -0,0 +1,185 @@
+#include "platform/context_trace.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "platform/context.h"
+#include "platform/fiber_scheduler.h"
+#include "platform/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::ClearContextTrace;
+using platform::CollectContextTrace;
+using platform::Context;
+using platform::ContextTraceEvent;
+using platform::ContextTraceSummary;
+using platform::FiberScheduler;
+using platform::StartContextTracing;
+using platform::StopContextTracing;
+using platform::SummarizeContextTrace;
+using platform::SwitchToContext;
+using platform::SwitchToNewContext;
+using platform::WriteContextTrace;
+
+namespace {
+const int kStackSize = 16 * 1024;
+
+// Returns the events which mention |tag| as either side of a switch.
+std::vector<ContextTraceEvent> EventsWithTag(
+    const std::vector<ContextTraceEvent>& events, void* tag) {
+  std::vector<ContextTraceEvent> result;
+  for (const ContextTraceEvent& event : events) {
+    if (event.from_data == tag || event.to_data == tag) {
+      result.push_back(event);
+    }
+  }
+  return result;
+}
+
+// Switches back and forth |num_round_trips| times between the calling
+// context, tagged |main_tag|, and a new context tagged |new_tag|.
+void PingPong(int num_round_trips, int* main_tag, int* new_tag) {
+  Context* other = SwitchToNewContext(
+      kStackSize, main_tag, [num_round_trips, new_tag](Context* context) {
+        for (int i = 1; i < num_round_trips; ++i) {
+          context = SwitchToContext(context, new_tag);
+        }
+        return context;
+      });
+  for (int i = 1; i < num_round_trips; ++i) {
+    other = SwitchToContext(other, main_tag);
+  }
+  EXPECT_EQ(nullptr, other);
+}
+}  // namespace
+
+TEST(ContextTraceTests, NothingIsRecordedWhileDisabled) {
+  int main_tag = 0;
+  int new_tag = 0;
+  PingPong(10, &main_tag, &new_tag);
+  EXPECT_TRUE(EventsWithTag(CollectContextTrace(), &main_tag).empty());
+}
+
+TEST(ContextTraceTests, RecordsEverySwitch) {
+  int main_tag = 0;
+  int new_tag = 0;
+  StartContextTracing();
+  PingPong(3, &main_tag, &new_tag);
+  StopContextTracing();
+
+  std::vector<ContextTraceEvent> events =
+      EventsWithTag(CollectContextTrace(), &main_tag);
+  ASSERT_EQ(6u, events.size());
+
+  EXPECT_EQ(ContextTraceEvent::kNewContext, events[0].type);
+  EXPECT_EQ(&main_tag, events[0].from_data);
+  for (int i = 1; i < 5; ++i) {
+    EXPECT_EQ(ContextTraceEvent::kSwitch, events[i].type);
+    void* from_tag = i % 2 ? static_cast<void*>(&new_tag) : &main_tag;
+    void* to_tag = i % 2 ? static_cast<void*>(&main_tag) : &new_tag;
+    EXPECT_EQ(from_tag, events[i].from_data);
+    EXPECT_EQ(to_tag, events[i].to_data);
+    // Each switch resumes the context suspended by the one before it.
+    EXPECT_EQ(events[i - 1].from, events[i].to);
+  }
+  EXPECT_EQ(ContextTraceEvent::kExit, events[5].type);
+  EXPECT_EQ(&main_tag, events[5].to_data);
+  EXPECT_EQ(events[4].from, events[5].to);
+
+  for (size_t i = 1; i < events.size(); ++i) {
+    EXPECT_LE(events[i - 1].timestamp, events[i].timestamp);
+    EXPECT_EQ(events[0].thread, events[i].thread);
+  }
+  ClearContextTrace();
+}
+
+TEST(ContextTraceTests, RingBuffersKeepTheNewestEvents) {
+  int main_tag = 0;
+  int new_tag = 0;
+  // The buffer size applies to threads which record their first event after
+  // tracing starts.
+  StartContextTracing(15);
+  std::thread thread([&main_tag, &new_tag]() {
+    PingPong(100, &main_tag, &new_tag);
+  });
+  thread.join();
+  StopContextTracing();
+  // Restores the default size for threads created by later tests.
+  StartContextTracing();
+  StopContextTracing();
+
+  std::vector<ContextTraceEvent> events =
+      EventsWithTag(CollectContextTrace(), &main_tag);
+  ASSERT_EQ(15u, events.size());
+  EXPECT_EQ(ContextTraceEvent::kExit, events.back().type);
+  ClearContextTrace();
+}
+
+TEST(ContextTraceTests, ReportsRunningAndReadyTimePerFiber) {
+  const int kNumYields = 5;
+  FiberScheduler::Options options;
+  options.num_workers = 1;
+  FiberScheduler scheduler(options);
+
+  ClearContextTrace();
+  StartContextTracing();
+  FiberScheduler::Fiber* fibers[2] = {nullptr, nullptr};
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> spawned;
+  for (int i = 0; i < 2; ++i) {
+    spawned.push_back(scheduler.Spawn([&fibers, i]() {
+      fibers[i] = FiberScheduler::CurrentFiber();
+      for (int j = 0; j < kNumYields; ++j) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        FiberScheduler::YieldFiber();
+      }
+    }));
+  }
+  for (auto& fiber : spawned) {
+    scheduler.Join(fiber);
+  }
+  StopContextTracing();
+
+  std::vector<ContextTraceEvent> events = CollectContextTrace();
+  std::vector<ContextTraceSummary> summaries = SummarizeContextTrace(events);
+  for (FiberScheduler::Fiber* fiber : fibers) {
+    const ContextTraceSummary* summary = nullptr;
+    for (const ContextTraceSummary& candidate : summaries) {
+      if (candidate.tag == fiber) {
+        summary = &candidate;
+      }
+    }
+    ASSERT_NE(nullptr, summary);
+    EXPECT_EQ(static_cast<uint64_t>(kNumYields + 1), summary->num_runs);
+    EXPECT_LE(static_cast<uint64_t>(kNumYields) * 100 * 1000,
+              summary->running_ns);
+    // Each fiber waits while the other one sleeps.
+    EXPECT_LE(static_cast<uint64_t>(kNumYields - 1) * 100 * 1000,
+              summary->ready_ns);
+  }
+
+  auto directory = platform::MakeTemporaryDirectory();
+  ASSERT_TRUE(directory);
+  std::string path = *directory + platform::kPathSeparator + "trace.json";
+  ASSERT_TRUE(WriteContextTrace(events, path.c_str()));
+
+  FILE* file = fopen(path.c_str(), "r");
+  ASSERT_NE(nullptr, file);
+  std::string contents;
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.append(buffer, size);
+  }
+  fclose(file);
+  EXPECT_EQ(0u, contents.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, contents.find("\"ph\":\"X\""));
+  EXPECT_NE(std::string::npos, contents.find("\"thread_name\""));
+  EXPECT_EQ("]}\n", contents.substr(contents.size() - 3));
+
+  EXPECT_FALSE(WriteContextTrace(
+      events, (*directory + "/missing/trace.json").c_str()));
+  platform::RemoveDirectoryTree(directory->c_str());
+  ClearContextTrace();
+}
@@ -0,0 +1,134 @@
+#ifndef __PLATFORM_DIRECTORY_ITERATOR_H__
+#define __PLATFORM_DIRECTORY_ITERATOR_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace platform {
+
+// One entry of a directory, as returned by getdents64().
+struct DirectoryEntry {
+  enum Type {
+    // The file system does not say, so the entry must be stat()ed to find
+    // out.
+    kUnknown,
+    kRegular,
+    kDirectory,
+    kSymlink,
+    kOther,
+  };
+
+  // Only valid until the next call to DirectoryReader::Next().
+  const char* name;
+  uint64_t inode;
+  Type type;
+};
+
+// Reads the entries of a directory in large batches with getdents64(), rather
+// than one at a time as readdir() appears to.  One reader, and its buffer,
+// may be used for many directories in turn.  Only available on Linux.
+class DirectoryReader {
+ public:
+  static const size_t kDefaultBufferSize = 64 * 1024;
+
+  explicit DirectoryReader(size_t buffer_size = kDefaultBufferSize);
+  DirectoryReader(const DirectoryReader&) = delete;
+  DirectoryReader& operator=(const DirectoryReader&) = delete;
+  ~DirectoryReader();
+
+  // Opens the directory |path|, relative to |directory_fd| if it is not
+  // absolute, in place of any which is already open.  Symbolic links are not
+  // followed.  Returns false, with error() set, on failure.
+  bool Open(int directory_fd, const char* path);
+  void Close();
+
+  // Takes ownership of the open directory |fd|, in place of any which is
+  // already open.
+  void Reset(int fd);
+
+  // Closes the reader, but leaves its directory open, and returns the
+  // directory's descriptor for the caller to close.
+  int Release();
+
+  // The errno value of the last failure, or 0.
+  int error() const { return error_; }
+
+  // The open directory, relative to which its entries can be opened with
+  // openat() or stat()ed with fstatat() without building their paths.
+  int fd() const { return fd_; }
+
+  // Returns the next entry other than "." and "..", or null once there are
+  // no more or if reading fails, in which case error() is set.
+  const DirectoryEntry* Next();
+
+ private:
+  int fd_;
+  int error_;
+  std::unique_ptr<char[]> buffer_;
+  size_t buffer_size_;
+  size_t position_;
+  size_t end_;
+  DirectoryEntry entry_;
+};
+
+// Opens the directory |path| below |directory_fd| one component at a time,
+// so that it works however long the path is, and fails with ELOOP if any
+// component is a symbolic link.  An empty path opens |directory_fd| again.
+// Returns the new descriptor, or -1 with errno set.
+int OpenDirectoryBeneath(int directory_fd, const std::string& path);
+
+// Returns how many directory descriptors a walk or removal of a tree may keep
+// open at once: a quarter of the process's limit on open descriptors, but no
+// more than 256.
+int MaxHeldDirectoryDescriptors();
+
+// An entry found by WalkDirectoryTree().
+struct WalkEntry {
+  // The directory containing the entry, and its path relative to the root of
+  // the walk, which is empty for the root itself.
+  int directory_fd;
+  const std::string& directory_path;
+
+  // Its type is never kUnknown, since WalkDirectoryTree() stat()s the
+  // entries which the file system gives no type for.
+  const DirectoryEntry& entry;
+
+  // 1 for the entries of the root.
+  int depth;
+};
+
+// Called for each entry below the root.  For directories, returns whether to
+// walk the directory's entries as well; ignored for other entries.
+typedef std::function<bool(const WalkEntry& entry)> WalkCallback;
+
+struct WalkOptions {
+  WalkOptions()
+      : num_threads(1), buffer_size(DirectoryReader::kDefaultBufferSize) {}
+
+  // The number of threads, including the calling one, between which
+  // subdirectories are shared out.  With more than one, |callback| is called
+  // from all of them at once.
+  int num_threads;
+
+  size_t buffer_size;
+};
+
+// Walks the tree below the directory |root|, calling |callback| for every
+// entry in it, without following symbolic links.  Each directory is read with
+// a DirectoryReader, and opened relative to its parent with openat(), so that
+// paths are only built for directories and never looked up whole.  There is
+// no limit on the depth of the tree, or on the length of its paths.  Parents
+// are only kept open while MaxHeldDirectoryDescriptors() allows, beyond which
+// directories are opened one component at a time from their nearest open
+// ancestor.
+// Directories which can not be read are skipped.  Returns 0 if every
+// directory was read, and otherwise the errno value of one which was not.
+int WalkDirectoryTree(const char* root, const WalkCallback& callback,
+                      const WalkOptions& options = WalkOptions());
+
+}  // namespace platform
+
+#endif  // __PLATFORM_DIRECTORY_ITERATOR_H__
@@ -0,0 +1,84 @@
+#include "platform/directory_iterator.h"
+
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "platform/test_directory_tree.h"
+#include "stdext/file_system.h"
+
+// Compares walking a directory tree with nftw() against walking it with
+// WalkDirectoryTree() on varying numbers of threads.  Pass a directory as the
+// second argument to walk that instead of a generated tree.
+
+using platform::MakeTestDirectoryTree;
+using platform::WalkDirectoryTree;
+using platform::WalkEntry;
+using platform::WalkOptions;
+
+namespace {
+
+template <typename Function>
+double MeasureSeconds(Function function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+long nftw_count = 0;
+
+int CountNftwEntry(const char*, const struct stat*, int, struct FTW*) {
+  ++nftw_count;
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int fanout = 10;
+  if (argc > 1) {
+    fanout = atoi(argv[1]);
+  }
+  stdext::file_system::TemporaryDirectory temporary_directory;
+  std::string root;
+  if (argc > 2) {
+    root = argv[2];
+  } else {
+    root = temporary_directory.path().str();
+    if (!MakeTestDirectoryTree(root, fanout, 3)) {
+      printf("Could not make a tree in %s\n", root.c_str());
+      return 1;
+    }
+  }
+
+  printf("Walking %s\n", root.c_str());
+  double nftw_seconds = MeasureSeconds([&]() {
+    nftw(root.c_str(), CountNftwEntry, 64, FTW_PHYS);
+  });
+  // nftw() also counts the root.
+  printf("  nftw():                         %8.1f ms (%ld entries)\n",
+         nftw_seconds * 1000, nftw_count - 1);
+
+  for (int num_threads : {1, 2, 4, 8}) {
+    WalkOptions options;
+    options.num_threads = num_threads;
+    std::atomic<long> count(0);
+    double seconds = MeasureSeconds([&]() {
+      WalkDirectoryTree(root.c_str(),
+                        [&count](const WalkEntry&) {
+                          ++count;
+                          return true;
+                        },
+                        options);
+    });
+    printf("  WalkDirectoryTree(), %d threads: %8.1f ms (%.1fx, %ld entries)\n",
+           num_threads, seconds * 1000, nftw_seconds / seconds, count.load());
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+#include "platform/directory_iterator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "platform/test_directory_tree.h"
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::DirectoryEntry;
+using platform::DirectoryReader;
+using platform::MakeTestDirectoryTree;
+using platform::WalkDirectoryTree;
+using platform::WalkEntry;
+using platform::WalkOptions;
+
+namespace {
+void WriteFile(const std::string& path) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_LE(0, fd);
+  close(fd);
+}
+
+// Returns the relative path and type of every entry found by the walk.
+std::map<std::string, DirectoryEntry::Type> Walk(const std::string& root,
+                                                 int num_threads) {
+  std::mutex mutex;
+  std::map<std::string, DirectoryEntry::Type> entries;
+  WalkOptions options;
+  options.num_threads = num_threads;
+  EXPECT_EQ(0, WalkDirectoryTree(
+                   root.c_str(),
+                   [&](const WalkEntry& entry) {
+                     std::string path =
+                         entry.directory_path.empty()
+                             ? std::string(entry.entry.name)
+                             : entry.directory_path + "/" + entry.entry.name;
+                     std::lock_guard<std::mutex> lock(mutex);
+                     EXPECT_TRUE(entries.emplace(path, entry.entry.type).second);
+                     return true;
+                   },
+                   options));
+  return entries;
+}
+}  // namespace
+
+TEST(DirectoryIteratorTests, WalksEveryEntry) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string root = directory.path().str();
+  ASSERT_TRUE(MakeTestDirectoryTree(root, 3, 3));
+  ASSERT_EQ(0, symlink("dir0", (root + "/link").c_str()));
+
+  std::map<std::string, DirectoryEntry::Type> entries = Walk(root, 1);
+  // 3 files and 3 directories in each directory but the deepest, which only
+  // hold 3 files, and the link.
+  EXPECT_EQ(3u * 2 + 9 * 2 + 27 * 2 + 81 + 1, entries.size());
+  EXPECT_EQ(DirectoryEntry::kDirectory, entries["dir0"]);
+  EXPECT_EQ(DirectoryEntry::kRegular, entries["dir0/dir1/dir2/file0"]);
+  // Links are reported but not followed.
+  EXPECT_EQ(DirectoryEntry::kSymlink, entries["link"]);
+  EXPECT_EQ(0u, entries.count("link/file0"));
+
+  EXPECT_EQ(entries, Walk(root, 4));
+}
+
+TEST(DirectoryIteratorTests, CallbackPrunesDirectories) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string root = directory.path().str();
+  ASSERT_TRUE(MakeTestDirectoryTree(root, 2, 2));
+
+  std::set<std::string> paths;
+  EXPECT_EQ(0, WalkDirectoryTree(root.c_str(), [&](const WalkEntry& entry) {
+    paths.insert(entry.directory_path + "/" + entry.entry.name);
+    EXPECT_EQ(entry.directory_path.empty() ? 1 : 2, entry.depth);
+    return std::string(entry.entry.name) != "dir1" &&
+           entry.directory_path.empty();
+  }));
+  EXPECT_EQ((std::set<std::string>{"/file0", "/file1", "/dir0", "/dir1",
+                                   "dir0/file0", "dir0/file1", "dir0/dir0",
+                                   "dir0/dir1"}),
+            paths);
+}
+
+TEST(DirectoryIteratorTests, WalksDeepTrees) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  // Deep enough that the deepest paths are longer than PATH_MAX.
+  const int kDepth = 500;
+  int fd = open(directory.path().c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_LE(0, fd);
+  for (int i = 0; i < kDepth; ++i) {
+    ASSERT_EQ(0, mkdirat(fd, "directory", 0755));
+    int next = openat(fd, "directory", O_RDONLY | O_DIRECTORY);
+    close(fd);
+    ASSERT_LE(0, next);
+    fd = next;
+  }
+  close(fd);
+
+  for (int num_threads : {1, 3}) {
+    int max_depth = 0;
+    WalkOptions options;
+    options.num_threads = num_threads;
+    std::mutex mutex;
+    EXPECT_EQ(0, WalkDirectoryTree(directory.path().c_str(),
+                                   [&](const WalkEntry& entry) {
+                                     std::lock_guard<std::mutex> lock(mutex);
+                                     max_depth =
+                                         std::max(max_depth, entry.depth);
+                                     return true;
+                                   },
+                                   options));
+    EXPECT_EQ(kDepth, max_depth);
+  }
+}
+
+TEST(DirectoryIteratorTests, WalksDeepTreesWithFewDescriptors) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  // Every level has subdirectories besides the next level, which may be
+  // left waiting for their parent while the next level is walked.
+  const int kDepth = 300;
+  int fd = open(directory.path().c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_LE(0, fd);
+  for (int i = 0; i < kDepth; ++i) {
+    for (const char* name : {"a", "b", "c"}) {
+      ASSERT_EQ(0, mkdirat(fd, name, 0755));
+    }
+    ASSERT_EQ(0, mkdirat(fd, "next", 0755));
+    int next = openat(fd, "next", O_RDONLY | O_DIRECTORY);
+    close(fd);
+    ASSERT_LE(0, next);
+    fd = next;
+  }
+  close(fd);
+
+  struct rlimit old_limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &old_limit));
+  struct rlimit limit = old_limit;
+  limit.rlim_cur = 64;
+  ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+  for (int num_threads : {1, 3}) {
+    WalkOptions options;
+    options.num_threads = num_threads;
+    std::atomic<int> num_directories(0);
+    EXPECT_EQ(0, WalkDirectoryTree(directory.path().c_str(),
+                                   [&](const WalkEntry&) {
+                                     ++num_directories;
+                                     return true;
+                                   },
+                                   options));
+    EXPECT_EQ(kDepth * 4, num_directories.load());
+  }
+  EXPECT_EQ(0, setrlimit(RLIMIT_NOFILE, &old_limit));
+}
+
+TEST(DirectoryIteratorTests, ReportsMissingRoot) {
+  EXPECT_EQ(ENOENT, WalkDirectoryTree("/does/not/exist",
+                                      [](const WalkEntry&) { return true; }));
+}
+
+TEST(DirectoryIteratorTests, ReaderCanBeReused) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string root = directory.path().str();
+  ASSERT_EQ(0, mkdir((root + "/a").c_str(), 0755));
+  ASSERT_EQ(0, mkdir((root + "/b").c_str(), 0755));
+  // More entries than fit in the smallest buffer at once.
+  for (int i = 0; i < 500; ++i) {
+    WriteFile(root + "/b/file_with_a_long_name_" + std::to_string(i));
+  }
+
+  DirectoryReader reader(1);
+  ASSERT_TRUE(reader.Open(AT_FDCWD, (root + "/a").c_str()));
+  EXPECT_EQ(nullptr, reader.Next());
+  EXPECT_EQ(0, reader.error());
+
+  ASSERT_TRUE(reader.Open(AT_FDCWD, (root + "/b").c_str()));
+  std::set<std::string> names;
+  while (const DirectoryEntry* entry = reader.Next()) {
+    EXPECT_TRUE(names.insert(entry->name).second);
+  }
+  EXPECT_EQ(0, reader.error());
+  EXPECT_EQ(500u, names.size());
+
+  EXPECT_FALSE(reader.Open(AT_FDCWD, (root + "/b/file_with_a_long_name_0")
+                                         .c_str()));
+  EXPECT_EQ(ENOTDIR, reader.error());
+  EXPECT_EQ(nullptr, reader.Next());
+}
@@ -0,0 +1,65 @@
+#include "platform/fiber_pool.h"
+
+#include <cassert>
+
+namespace platform {
+
+namespace {
+
+// The body of every pooled fiber.  While parked, the fiber's context is
+// tagged with its |job|, which is where the next call to Start() puts the
+// next task.  A job without a task tells the fiber to exit.
+Context* RunPooledFiber(FiberPool::Job job, Context* starter) {
+  while (job.task_main) {
+    Context* next = job.task_main(starter, job.arg);
+    job.task_main = nullptr;
+    starter = SwitchToContext(next, &job);
+  }
+  return starter;
+}
+
+FiberPool::Job* ParkedJob(Context* parked_fiber) {
+  return static_cast<FiberPool::Job*>(GetContextData(parked_fiber));
+}
+
+}  // namespace
+
+FiberPool::~FiberPool() {
+  for (Context* fiber : idle_fibers_) {
+    Destroy(fiber);
+  }
+}
+
+Context* FiberPool::Start(TaskMain task_main, void* arg,
+                          void* context_data) {
+  assert(task_main);
+  Job job = {task_main, arg};
+  if (!idle_fibers_.empty()) {
+    Context* fiber = idle_fibers_.back();
+    idle_fibers_.pop_back();
+    *ParkedJob(fiber) = job;
+    return SwitchToContext(fiber, context_data);
+  }
+
+  return SwitchToNewContext(
+      options_.stack_allocator, options_.stack_size, context_data,
+      [job](Context* starter) { return RunPooledFiber(job, starter); });
+}
+
+void FiberPool::Park(Context* parked_fiber) {
+  assert(parked_fiber);
+  if (idle_fibers_.size() < options_.max_idle_fibers) {
+    idle_fibers_.push_back(parked_fiber);
+  } else {
+    Destroy(parked_fiber);
+  }
+}
+
+void FiberPool::Destroy(Context* parked_fiber) {
+  ParkedJob(parked_fiber)->task_main = nullptr;
+  Context* finished = SwitchToContext(parked_fiber, nullptr);
+  assert(!finished);
+  (void)finished;
+}
+
+}  // namespace platform
@@ -0,0 +1,161 @@
+#ifndef __PLATFORM_FIBER_POOL_H__
+#define __PLATFORM_FIBER_POOL_H__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "platform/context.h"
+#include "platform/stack_allocator.h"
+
+namespace platform {
+
+// Keeps fibers alive between tasks, so that running a short task on its own
+// stack costs two context switches rather than a stack allocation, a new
+// context and its teardown.
+//
+// Each fiber in the pool runs a loop which runs a task, parks the fiber, and
+// waits to be handed the next task.  A fiber is parked by switching back out
+// of it once its task is done; the context it switched back from is then
+// returned to the pool with Park().
+//
+// This class is not thread safe, but a fiber taken from one pool may be
+// parked in another, and the fibers may be resumed on any thread.
+class FiberPool {
+ public:
+  struct Options {
+    Options()
+        : stack_size(64 * 1024),
+          stack_allocator(StackAllocator::GetDefault()),
+          max_idle_fibers(64) {}
+
+    size_t stack_size;
+    StackAllocator* stack_allocator;
+
+    // Fibers parked beyond this many are destroyed.
+    size_t max_idle_fibers;
+  };
+
+  // The entry point of a task.  It is called on a pooled fiber with the
+  // context that started it, and returns the context to switch to once the
+  // task is done, at which point the fiber parks itself.
+  typedef Context* (*TaskMain)(Context* starter, void* arg);
+
+  FiberPool() : FiberPool(Options()) {}
+  explicit FiberPool(const Options& options) : options_(options) {}
+  FiberPool(const FiberPool&) = delete;
+  FiberPool& operator=(const FiberPool&) = delete;
+
+  // Destroys the idle fibers.  Fibers which are running tasks are not owned
+  // by the pool.
+  ~FiberPool();
+
+  // Runs |task| to completion on a pooled fiber and returns its result.
+  // The task may switch to other contexts, but must not resume the caller of
+  // run() other than by returning.  If there is no idle fiber and a new one
+  // can not be created, the task is run on the caller's stack instead.
+  template <typename Task>
+  typename std::result_of<Task&()>::type run(Task&& task);
+
+  // Switches to an idle fiber, or to a new one if there are none, which
+  // calls |task_main(starter, arg)|.  As with SwitchToContext(), returns the
+  // context that is eventually switched back from, tagged with
+  // |context_data|.  Once the task is done this is the parked fiber, which
+  // must be passed to Park() before anything else is done with it.  Returns
+  // null if a new fiber was needed and could not be created.
+  Context* Start(TaskMain task_main, void* arg, void* context_data);
+
+  // Makes |parked_fiber| available to Start(), or destroys it if the pool
+  // already has as many idle fibers as it may keep.
+  void Park(Context* parked_fiber);
+
+  size_t num_idle_fibers() const { return idle_fibers_.size(); }
+
+  // Where a parked fiber keeps its next task.
+  struct Job {
+    TaskMain task_main;
+    void* arg;
+  };
+
+ private:
+  static void Destroy(Context* parked_fiber);
+
+  const Options options_;
+  std::vector<Context*> idle_fibers_;
+};
+
+namespace internal {
+// Holds the result of a task run through FiberPool::run().
+template <typename Result>
+class PoolTaskResult {
+ public:
+  template <typename Task>
+  void Run(Task* task) { new (&storage_) Result((*task)()); }
+
+  Result Take() {
+    Result* result = reinterpret_cast<Result*>(&storage_);
+    Result value(std::move(*result));
+    result->~Result();
+    return value;
+  }
+
+ private:
+  typename std::aligned_storage<sizeof(Result), alignof(Result)>::type
+      storage_;
+};
+
+template <typename Result>
+class PoolTaskResult<Result&> {
+ public:
+  template <typename Task>
+  void Run(Task* task) { result_ = &(*task)(); }
+  Result& Take() { return *result_; }
+
+ private:
+  Result* result_;
+};
+
+template <>
+class PoolTaskResult<void> {
+ public:
+  template <typename Task>
+  void Run(Task* task) { (*task)(); }
+  void Take() {}
+};
+
+template <typename Task, typename Result>
+struct PoolTask {
+  static Context* Main(Context* starter, void* arg) {
+    PoolTask* pool_task = static_cast<PoolTask*>(arg);
+    pool_task->result.Run(pool_task->task);
+    return starter;
+  }
+
+  Task* task;
+  PoolTaskResult<Result> result;
+};
+}  // namespace internal
+
+template <typename Task>
+typename std::result_of<Task&()>::type FiberPool::run(Task&& task) {
+  typedef typename std::result_of<Task&()>::type Result;
+  static_assert(!std::is_rvalue_reference<Result>::value,
+                "Tasks may not return rvalue references.");
+  typedef typename std::remove_reference<Task>::type TaskType;
+
+  internal::PoolTask<TaskType, Result> pool_task;
+  pool_task.task = &task;
+  Context* parked_fiber =
+      Start(&internal::PoolTask<TaskType, Result>::Main, &pool_task, nullptr);
+  if (!parked_fiber) {
+    return task();
+  }
+  Park(parked_fiber);
+  return pool_task.result.Take();
+}
+
+}  // namespace platform
+
+#endif  // __PLATFORM_FIBER_POOL_H__
@@ -0,0 +1,139 @@
+#include "platform/fiber_pool.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::Context;
+using platform::FiberPool;
+using platform::SwitchToContext;
+
+namespace {
+FiberPool::Options OptionsWithMaxIdleFibers(size_t max_idle_fibers) {
+  FiberPool::Options options;
+  options.stack_size = 16 * 1024;
+  options.max_idle_fibers = max_idle_fibers;
+  return options;
+}
+
+// Returns an address on the calling fiber's stack.
+uintptr_t StackAddress() {
+  volatile char local = 0;
+  return reinterpret_cast<uintptr_t>(&local);
+}
+}  // namespace
+
+TEST(FiberPoolTests, RunReturnsTheTaskResult) {
+  FiberPool pool;
+  EXPECT_EQ(42, pool.run([]() { return 42; }));
+  EXPECT_EQ("pooled", pool.run([]() { return std::string("pooled"); }));
+
+  std::unique_ptr<int> moved = pool.run([]() {
+    return std::unique_ptr<int>(new int(7));
+  });
+  ASSERT_TRUE(moved);
+  EXPECT_EQ(7, *moved);
+
+  int value = 1;
+  int& reference = pool.run([&value]() -> int& { return value; });
+  EXPECT_EQ(&value, &reference);
+
+  bool ran = false;
+  pool.run([&ran]() { ran = true; });
+  EXPECT_TRUE(ran);
+}
+
+TEST(FiberPoolTests, TasksRunOnAnotherStack) {
+  FiberPool pool;
+  uintptr_t caller = StackAddress();
+  uintptr_t task = pool.run([]() { return StackAddress(); });
+  uintptr_t distance = caller > task ? caller - task : task - caller;
+  EXPECT_LT(4096u, distance);
+}
+
+TEST(FiberPoolTests, TasksRunInlineWithoutAStack) {
+  FiberPool::Options options;
+  // Far more than can be mapped.
+  options.stack_size = static_cast<size_t>(1) << 62;
+  FiberPool pool(options);
+  uintptr_t caller = StackAddress();
+  uintptr_t task = pool.run([]() { return StackAddress(); });
+  uintptr_t distance = caller > task ? caller - task : task - caller;
+  EXPECT_GT(4096u, distance);
+  EXPECT_EQ(0u, pool.num_idle_fibers());
+
+  bool ran = false;
+  pool.run([&ran]() { ran = true; });
+  EXPECT_TRUE(ran);
+}
+
+TEST(FiberPoolTests, ReusesParkedFibers) {
+  FiberPool pool(OptionsWithMaxIdleFibers(1));
+  EXPECT_EQ(0u, pool.num_idle_fibers());
+
+  auto task = []() { return StackAddress(); };
+  uintptr_t first = pool.run(task);
+  EXPECT_EQ(1u, pool.num_idle_fibers());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(first, pool.run(task));
+  }
+  EXPECT_EQ(1u, pool.num_idle_fibers());
+}
+
+TEST(FiberPoolTests, DestroysFibersBeyondTheIdleLimit) {
+  FiberPool pool(OptionsWithMaxIdleFibers(2));
+
+  // Each level of nesting needs a fiber of its own.
+  int depth = pool.run([&pool]() {
+    return pool.run([&pool]() {
+      return pool.run([]() { return 3; });
+    });
+  });
+  EXPECT_EQ(3, depth);
+  EXPECT_EQ(2u, pool.num_idle_fibers());
+
+  FiberPool unpooled(OptionsWithMaxIdleFibers(0));
+  EXPECT_EQ(1, unpooled.run([]() { return 1; }));
+  EXPECT_EQ(0u, unpooled.num_idle_fibers());
+}
+
+TEST(FiberPoolTests, TasksCanSwitchOutBeforeTheyAreDone) {
+  struct Task {
+    static Context* Main(Context* starter, void* arg) {
+      Task* task = static_cast<Task*>(arg);
+      for (int i = 0; i < 3; ++i) {
+        ++task->steps;
+        starter = SwitchToContext(starter, task);
+      }
+      task->done = true;
+      return starter;
+    }
+
+    int steps = 0;
+    bool done = false;
+  };
+
+  FiberPool pool;
+  Task task;
+  Context* fiber = pool.Start(&Task::Main, &task, nullptr);
+  while (!task.done) {
+    EXPECT_EQ(&task, platform::GetContextData(fiber));
+    fiber = SwitchToContext(fiber, nullptr);
+  }
+  EXPECT_EQ(3, task.steps);
+  pool.Park(fiber);
+  EXPECT_EQ(1u, pool.num_idle_fibers());
+
+  // A fiber may be parked in a different pool.
+  FiberPool other_pool;
+  Task other_task;
+  fiber = pool.Start(&Task::Main, &other_task, nullptr);
+  while (!other_task.done) {
+    fiber = SwitchToContext(fiber, nullptr);
+  }
+  other_pool.Park(fiber);
+  EXPECT_EQ(0u, pool.num_idle_fibers());
+  EXPECT_EQ(1u, other_pool.num_idle_fibers());
+}
@@ -0,0 +1,531 @@
+#include "platform/fiber_scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "platform/context_trace.h"
+#include "platform/futex.h"
+#include "stdext/work_stealing_deque.h"
+
+#if defined(_MSC_VER)
+#define PLATFORM_NOINLINE __declspec(noinline)
+#else
+#define PLATFORM_NOINLINE __attribute__((noinline))
+#endif
+
+namespace platform {
+
+namespace {
+
+// A fiber waiting in Join() for another fiber to complete.  These live on the
+// waiting fiber's stack.
+struct JoinWaiter {
+  FiberScheduler::Fiber* fiber;
+  FiberScheduler::Fiber* target;
+  JoinWaiter* next;
+};
+
+// Marks a fiber's list of join waiters as closed, because it has completed.
+JoinWaiter kFinishedJoinWaiters;
+
+// Values for Fiber::state.
+const uint32_t kFiberRunning = 0;
+const uint32_t kFiberRunningWithThreadWaiters = 1;
+const uint32_t kFiberDone = 2;
+
+// Every so many scheduling decisions a worker checks the shared queue before
+// its own deque, so that a busy worker does not starve yielded fibers.
+const uint32_t kInjectedQueueCheckInterval = 61;
+
+// The number of passes a worker makes over the other workers' deques looking
+// for work before it parks.
+const int kStealAttempts = 4;
+
+// Worker::next_timer_check when the worker has no timers.
+const uint64_t kNoTimers = UINT64_MAX;
+
+uint64_t ToNanoseconds(FiberScheduler::Clock::time_point time) {
+  auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      time.time_since_epoch());
+  return since_epoch.count() < 0 ? 0 : since_epoch.count();
+}
+
+FiberScheduler::Clock::time_point FromNanoseconds(uint64_t nanoseconds) {
+  return FiberScheduler::Clock::time_point(
+      std::chrono::duration_cast<FiberScheduler::Clock::duration>(
+          std::chrono::nanoseconds(nanoseconds)));
+}
+
+}  // namespace
+
+class FiberScheduler::Fiber {
+ public:
+  Fiber(FiberScheduler* scheduler, std::function<void()>&& function)
+      : scheduler(scheduler), function(std::move(function)),
+        state(kFiberRunning), join_waiters(nullptr) {}
+
+  FiberScheduler* const scheduler;
+  std::function<void()> function;
+
+  // The fiber's suspended context, or null if it has not started yet.
+  Context* context = nullptr;
+
+  // The context of the worker that most recently resumed this fiber, which
+  // is where the fiber switches back to when it suspends or completes.
+  Context* resumer = nullptr;
+
+  // The scheduler's reference to the fiber, released when it completes.
+  std::shared_ptr<Fiber> self;
+
+  // Set once |function| has returned, at which point the fiber's context is
+  // parked in a FiberPool.
+  bool completed = false;
+
+  std::atomic<uint32_t> state;
+  std::atomic<JoinWaiter*> join_waiters;
+};
+
+struct FiberScheduler::Worker {
+  Worker(FiberScheduler* scheduler, uint32_t seed,
+         const FiberPool::Options& fiber_pool_options,
+         std::chrono::nanoseconds timer_resolution)
+      : scheduler(scheduler), fiber_pool(fiber_pool_options),
+        random_state(seed),
+        timers(ToNanoseconds(Clock::now()), timer_resolution.count()),
+        next_timer_check(kNoTimers) {}
+
+  FiberScheduler* const scheduler;
+  stdext::work_stealing_deque<Fiber*> ready_fibers;
+
+  // Completed fibers are parked in the pool of the worker they completed on.
+  FiberPool fiber_pool;
+
+  // The fiber currently running on this worker, and what it asked for when
+  // it last suspended.
+  Fiber* current_fiber = nullptr;
+  SuspendCallback on_suspended = nullptr;
+  void* on_suspended_arg = nullptr;
+
+  uint32_t random_state;
+  uint32_t schedule_tick = 0;
+
+  // Timers are started only by this worker's thread, but may be cancelled
+  // from any thread.
+  std::mutex timers_mutex;
+  TimerWheel timers;
+  // When this worker next needs to advance |timers|.  Only accessed by the
+  // worker's own thread.
+  uint64_t next_timer_check;
+};
+
+namespace {
+
+thread_local FiberScheduler::Worker* tl_worker = nullptr;
+
+// A fiber may be resumed on a different thread each time it switches, but
+// the compiler assumes that the address of a thread local variable never
+// changes within a function.  Always go through this non-inlined function,
+// which contains a compiler barrier, so that the address is recomputed on
+// every access.
+PLATFORM_NOINLINE FiberScheduler::Worker* CurrentWorker() {
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  return tl_worker;
+}
+
+uint32_t NextRandom(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+Context* RunFiberMain(Context* resumer, void* arg) {
+  FiberScheduler::Fiber* fiber = static_cast<FiberScheduler::Fiber*>(arg);
+  fiber->resumer = resumer;
+  TraceContextTag(fiber);
+  fiber->function();
+  fiber->function = nullptr;
+  fiber->completed = true;
+  return fiber->resumer;
+}
+
+// A fiber in SleepUntil().  These live on the sleeping fiber's stack.
+struct Sleeper {
+  explicit Sleeper(FiberScheduler::Clock::time_point deadline)
+      : fiber(nullptr), deadline(deadline), timer(&Wake, this) {}
+
+  static void Start(FiberScheduler::Fiber* fiber, void* arg) {
+    Sleeper* sleeper = static_cast<Sleeper*>(arg);
+    sleeper->fiber = fiber;
+    FiberScheduler::StartTimer(&sleeper->timer, sleeper->deadline);
+  }
+
+  static void Wake(void* arg) {
+    FiberScheduler::Ready(static_cast<Sleeper*>(arg)->fiber);
+  }
+
+  FiberScheduler::Fiber* fiber;
+  const FiberScheduler::Clock::time_point deadline;
+  FiberScheduler::Timer timer;
+};
+
+void RegisterJoinWaiter(FiberScheduler::Fiber* fiber, void* arg) {
+  JoinWaiter* waiter = static_cast<JoinWaiter*>(arg);
+  std::atomic<JoinWaiter*>& join_waiters = waiter->target->join_waiters;
+
+  JoinWaiter* head = join_waiters.load(std::memory_order_acquire);
+  do {
+    if (head == &kFinishedJoinWaiters) {
+      FiberScheduler::Ready(fiber);
+      return;
+    }
+    waiter->next = head;
+  } while (!join_waiters.compare_exchange_weak(
+               head, waiter, std::memory_order_acq_rel,
+               std::memory_order_acquire));
+}
+
+}  // namespace
+
+FiberScheduler::Options::Options()
+    : num_workers(std::thread::hardware_concurrency()),
+      stack_size(64 * 1024),
+      stack_allocator(StackAllocator::GetDefault()),
+      max_idle_fibers_per_worker(64),
+      timer_resolution(std::chrono::milliseconds(1)) {
+  if (num_workers < 1) {
+    num_workers = 1;
+  }
+}
+
+FiberScheduler::FiberScheduler() : FiberScheduler(Options()) {}
+
+FiberScheduler::FiberScheduler(const Options& options)
+    : options_(options), num_injected_fibers_(0), wake_epoch_(0),
+      num_parked_workers_(0), shutting_down_(false), num_live_fibers_(0) {
+  assert(options_.num_workers > 0);
+  FiberPool::Options fiber_pool_options;
+  fiber_pool_options.stack_size = options_.stack_size;
+  fiber_pool_options.stack_allocator = options_.stack_allocator;
+  fiber_pool_options.max_idle_fibers = options_.max_idle_fibers_per_worker;
+  for (int i = 0; i < options_.num_workers; ++i) {
+    workers_.emplace_back(new Worker(
+        this, 0x9e3779b9u * (i + 1), fiber_pool_options,
+        options_.timer_resolution));
+  }
+  for (auto& worker : workers_) {
+    Worker* worker_ptr = worker.get();
+    threads_.emplace_back([this, worker_ptr]() { WorkerMain(worker_ptr); });
+  }
+}
+
+FiberScheduler::~FiberScheduler() {
+  {
+    std::unique_lock<std::mutex> lock(live_fibers_mutex_);
+    no_live_fibers_.wait(lock, [this]() {
+      return num_live_fibers_.load(std::memory_order_acquire) == 0;
+    });
+  }
+
+  shutting_down_.store(true);
+  wake_epoch_.fetch_add(1);
+  FutexWakeAll(&wake_epoch_);
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+std::shared_ptr<FiberScheduler::Fiber> FiberScheduler::Spawn(
+    std::function<void()> function) {
+  std::shared_ptr<Fiber> fiber =
+      std::make_shared<Fiber>(this, std::move(function));
+  fiber->self = fiber;
+  num_live_fibers_.fetch_add(1, std::memory_order_relaxed);
+  Schedule(fiber.get(), false);
+  return fiber;
+}
+
+void FiberScheduler::Join(const std::shared_ptr<Fiber>& fiber) {
+  if (IsDone(*fiber)) {
+    return;
+  }
+
+  Fiber* current_fiber = CurrentFiber();
+  if (current_fiber && current_fiber->scheduler == this) {
+    JoinWaiter waiter;
+    waiter.fiber = current_fiber;
+    waiter.target = fiber.get();
+    waiter.next = nullptr;
+    Suspend(&RegisterJoinWaiter, &waiter);
+    return;
+  }
+
+  // Block the thread.  Let the fiber know that it has a thread waiting on it
+  // so that it only issues a futex wake when necessary.
+  uint32_t state = fiber->state.load(std::memory_order_acquire);
+  while (state != kFiberDone) {
+    if (state == kFiberRunning &&
+        !fiber->state.compare_exchange_weak(
+            state, kFiberRunningWithThreadWaiters,
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+      continue;
+    }
+    FutexWait(&fiber->state, kFiberRunningWithThreadWaiters);
+    state = fiber->state.load(std::memory_order_acquire);
+  }
+}
+
+bool FiberScheduler::IsDone(const Fiber& fiber) {
+  return fiber.state.load(std::memory_order_acquire) == kFiberDone;
+}
+
+void FiberScheduler::YieldFiber() {
+  Suspend([](Fiber* fiber, void*) {
+    fiber->scheduler->Schedule(fiber, true);
+  }, nullptr);
+}
+
+void FiberScheduler::Suspend(SuspendCallback on_suspended, void* arg) {
+  Worker* worker = CurrentWorker();
+  assert(worker && worker->current_fiber);
+
+  Fiber* fiber = worker->current_fiber;
+  worker->on_suspended = on_suspended;
+  worker->on_suspended_arg = arg;
+
+  // When this returns we may be running on a different worker thread.
+  fiber->resumer = SwitchToContext(fiber->resumer, fiber);
+}
+
+void FiberScheduler::Ready(Fiber* fiber) {
+  fiber->scheduler->Schedule(fiber, false);
+}
+
+FiberScheduler::Fiber* FiberScheduler::CurrentFiber() {
+  Worker* worker = CurrentWorker();
+  return worker ? worker->current_fiber : nullptr;
+}
+
+void FiberScheduler::SleepUntil(Clock::time_point deadline) {
+  if (!CurrentFiber()) {
+    std::this_thread::sleep_until(deadline);
+    return;
+  }
+  if (deadline <= Clock::now()) {
+    return;
+  }
+
+  // The timer is only started once the fiber has switched out, so that it
+  // can not be made ready while it is still running.
+  Sleeper sleeper(deadline);
+  Suspend(&Sleeper::Start, &sleeper);
+}
+
+void FiberScheduler::StartTimer(Timer* timer, Clock::time_point deadline) {
+  Worker* worker = CurrentWorker();
+  assert(worker);
+  timer->worker_ = worker;
+
+  uint64_t deadline_ns = ToNanoseconds(deadline);
+  {
+    std::lock_guard<std::mutex> lock(worker->timers_mutex);
+    worker->timers.Add(&timer->entry_, deadline_ns);
+  }
+  worker->next_timer_check = std::min(worker->next_timer_check, deadline_ns);
+}
+
+bool FiberScheduler::CancelTimer(Timer* timer) {
+  Worker* worker = timer->worker_;
+  if (!worker) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(worker->timers_mutex);
+  return worker->timers.Cancel(&timer->entry_);
+}
+
+void FiberScheduler::WorkerMain(Worker* worker) {
+  tl_worker = worker;
+
+  while (true) {
+    RunTimers(worker);
+
+    Fiber* fiber = FindWork(worker);
+    if (fiber) {
+      RunFiber(worker, fiber);
+      continue;
+    }
+
+    if (shutting_down_.load()) {
+      break;
+    }
+
+    Park(worker);
+  }
+
+  tl_worker = nullptr;
+}
+
+void FiberScheduler::RunFiber(Worker* worker, Fiber* fiber) {
+  worker->current_fiber = fiber;
+
+  Context* suspended_context;
+  if (fiber->context) {
+    suspended_context = SwitchToContext(fiber->context, worker);
+  } else {
+    suspended_context =
+        worker->fiber_pool.Start(&RunFiberMain, fiber, worker);
+  }
+
+  worker->current_fiber = nullptr;
+
+  if (fiber->completed) {
+    worker->fiber_pool.Park(suspended_context);
+    FinishFiber(fiber);
+    return;
+  }
+  if (!suspended_context) {
+    // No stack could be allocated for the fiber.
+    FinishFiber(fiber);
+    return;
+  }
+
+  // Only now that the fiber is fully switched out is it safe to let another
+  // worker pick it up.
+  fiber->context = suspended_context;
+  SuspendCallback on_suspended = worker->on_suspended;
+  worker->on_suspended = nullptr;
+  on_suspended(fiber, worker->on_suspended_arg);
+}
+
+void FiberScheduler::FinishFiber(Fiber* fiber) {
+  std::shared_ptr<Fiber> self = std::move(fiber->self);
+
+  if (fiber->state.exchange(kFiberDone, std::memory_order_acq_rel) ==
+          kFiberRunningWithThreadWaiters) {
+    FutexWakeAll(&fiber->state);
+  }
+
+  JoinWaiter* waiter = fiber->join_waiters.exchange(
+      &kFinishedJoinWaiters, std::memory_order_acq_rel);
+  while (waiter) {
+    // The waiter lives on its fiber's stack, which may be gone as soon as
+    // that fiber is made ready.
+    JoinWaiter* next = waiter->next;
+    Ready(waiter->fiber);
+    waiter = next;
+  }
+
+  if (num_live_fibers_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    std::lock_guard<std::mutex> lock(live_fibers_mutex_);
+    no_live_fibers_.notify_all();
+  }
+}
+
+FiberScheduler::Fiber* FiberScheduler::FindWork(Worker* worker) {
+  Fiber* fiber;
+
+  bool check_injected_first =
+      ++worker->schedule_tick % kInjectedQueueCheckInterval == 0;
+  if (check_injected_first || worker->ready_fibers.empty()) {
+    if (num_injected_fibers_.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(injected_mutex_);
+      if (!injected_fibers_.empty()) {
+        fiber = injected_fibers_.front();
+        injected_fibers_.pop_front();
+        num_injected_fibers_.fetch_sub(1, std::memory_order_relaxed);
+        return fiber;
+      }
+    }
+  }
+
+  if (worker->ready_fibers.pop(&fiber)) {
+    return fiber;
+  }
+
+  const size_t num_workers = workers_.size();
+  for (int attempt = 0; attempt < kStealAttempts; ++attempt) {
+    size_t start = NextRandom(&worker->random_state) % num_workers;
+    for (size_t i = 0; i < num_workers; ++i) {
+      Worker* victim = workers_[(start + i) % num_workers].get();
+      if (victim != worker && victim->ready_fibers.steal(&fiber)) {
+        return fiber;
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+bool FiberScheduler::HasWork() {
+  if (num_injected_fibers_.load() > 0) {
+    return true;
+  }
+  for (auto& worker : workers_) {
+    if (!worker->ready_fibers.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void FiberScheduler::Park(Worker* worker) {
+  // Announce that we are about to park before the final check for work, so
+  // that anyone adding work after that check will see us and wake us.
+  uint32_t epoch = wake_epoch_.load();
+  num_parked_workers_.fetch_add(1);
+  // Pairs with the fence in WakeWorker(): either it sees the increment above,
+  // or the loads in HasWork() see the work it added.  The deques' empty()
+  // checks are relaxed, so the increment alone does not order them.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!HasWork() && !shutting_down_.load()) {
+    if (worker->next_timer_check == kNoTimers) {
+      FutexWait(&wake_epoch_, epoch);
+    } else {
+      FutexWaitUntil(&wake_epoch_, epoch,
+                     FromNanoseconds(worker->next_timer_check));
+    }
+  }
+  num_parked_workers_.fetch_sub(1);
+}
+
+void FiberScheduler::RunTimers(Worker* worker) {
+  if (worker->next_timer_check == kNoTimers) {
+    return;
+  }
+  uint64_t now = ToNanoseconds(Clock::now());
+  if (now < worker->next_timer_check) {
+    return;
+  }
+
+  // Callbacks run with the lock held, so that CancelTimer() can guarantee
+  // that they have finished.
+  std::lock_guard<std::mutex> lock(worker->timers_mutex);
+  worker->timers.Advance(now);
+  worker->next_timer_check = worker->timers.NextExpiry();
+}
+
+void FiberScheduler::Schedule(Fiber* fiber, bool from_yield) {
+  TraceContextReady(fiber);
+  Worker* worker = CurrentWorker();
+  if (!from_yield && worker && worker->scheduler == this) {
+    worker->ready_fibers.push(fiber);
+  } else {
+    std::lock_guard<std::mutex> lock(injected_mutex_);
+    injected_fibers_.push_back(fiber);
+    num_injected_fibers_.fetch_add(1);
+  }
+
+  WakeWorker();
+}
+
+void FiberScheduler::WakeWorker() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_parked_workers_.load(std::memory_order_relaxed) > 0) {
+    wake_epoch_.fetch_add(1);
+    FutexWake(&wake_epoch_, 1);
+  }
+}
+
+}  // namespace platform
@@ -0,0 +1,198 @@
+#ifndef __PLATFORM_FIBER_SCHEDULER_H__
+#define __PLATFORM_FIBER_SCHEDULER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "platform/context.h"
+#include "platform/fiber_pool.h"
+#include "platform/stack_allocator.h"
+#include "platform/timer_wheel.h"
+
+namespace platform {
+
+// Runs fibers on a fixed pool of worker threads (M:N threading).  Each worker
+// owns a work-stealing deque of fibers that are ready to run.  Fibers spawned
+// or woken from a worker go onto that worker's deque, and idle workers steal
+// from the others, so a fiber may resume on a different thread every time it
+// switches.  Workers with nothing to run or steal sleep on a futex until new
+// work arrives.
+//
+// Since fibers migrate between threads, code running in a fiber must not hold
+// on to thread local state across a call that may suspend it (YieldFiber(),
+// Join(), Suspend()).  Note that compilers will happily cache the address of
+// a thread local, or the result of pthread_self(), across such calls.
+//
+// Each worker also has a TimerWheel, which backs SleepUntil() and the
+// deadline variants of the waits in fiber_sync.h.  Expired timers are
+// processed in a batch each time the worker looks for a fiber to run, and
+// parked workers wake up in time for their next timer.
+//
+// Fibers run on stacks taken from a FiberPool on each worker, so spawning a
+// fiber usually reuses the stack of one that has completed.
+//
+// For context_trace.h, each fiber's context is tagged with its Fiber*, and
+// each worker's own context with its Worker*, and fibers are reported ready
+// whenever they are scheduled.
+class FiberScheduler {
+ public:
+  class Fiber;
+  struct Worker;
+
+  typedef std::chrono::steady_clock Clock;
+
+  struct Options {
+    Options();
+
+    // The number of worker threads.  Defaults to the number of hardware
+    // threads.
+    int num_workers;
+
+    // The stack size for each fiber.
+    size_t stack_size;
+
+    // Where fiber stacks come from.
+    StackAllocator* stack_allocator;
+
+    // Each worker keeps up to this many fibers parked once they complete,
+    // with their stacks, for reuse by newly spawned fibers.
+    size_t max_idle_fibers_per_worker;
+
+    // The granularity of the timer wheels.  Timers fire up to this much
+    // after their deadlines.
+    std::chrono::nanoseconds timer_resolution;
+  };
+
+  // Calls a function on a worker thread at, or shortly after, a deadline.
+  // Timers are the building block for waits with deadlines, as Suspend() is
+  // for waits, and live wherever their owner puts them.
+  class Timer {
+   public:
+    typedef TimerWheel::Callback Callback;
+
+    Timer(Callback callback, void* arg)
+        : entry_(callback, arg), worker_(nullptr) {}
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+   private:
+    friend class FiberScheduler;
+
+    TimerWheel::Timer entry_;
+    // The worker whose wheel the timer was started on.
+    Worker* worker_;
+  };
+
+  FiberScheduler();
+  explicit FiberScheduler(const Options& options);
+  FiberScheduler(const FiberScheduler&) = delete;
+  FiberScheduler& operator=(const FiberScheduler&) = delete;
+
+  // Waits for every spawned fiber to complete, then stops the workers.
+  ~FiberScheduler();
+
+  // Creates a new fiber which will run |function|.  May be called from any
+  // thread, including from within a fiber.
+  std::shared_ptr<Fiber> Spawn(std::function<void()> function);
+
+  // Waits for |fiber| to complete.  If called from a fiber running on this
+  // scheduler, only the calling fiber is suspended.  Otherwise the calling
+  // thread blocks.
+  void Join(const std::shared_ptr<Fiber>& fiber);
+
+  // Returns true if |fiber| has completed.
+  static bool IsDone(const Fiber& fiber);
+
+  // Puts the current fiber at the back of the line, allowing other ready
+  // fibers to run.  Must be called from a fiber.
+  static void YieldFiber();
+
+  // Suspends the current fiber, which must be running on a FiberScheduler.
+  // Once the fiber has been fully switched out, |on_suspended| is called on
+  // the worker thread with the fiber and |arg|.  The fiber will not run again
+  // until it is passed to Ready(), which may be done from |on_suspended|
+  // itself.  This is the building block for fiber blocking primitives.
+  typedef void (*SuspendCallback)(Fiber* fiber, void* arg);
+  static void Suspend(SuspendCallback on_suspended, void* arg);
+
+  // Makes a fiber that was passed to a SuspendCallback runnable again.  May
+  // be called from any thread.
+  static void Ready(Fiber* fiber);
+
+  // Returns the fiber that the calling code is running in, or null if it is
+  // not running in a FiberScheduler fiber.
+  static Fiber* CurrentFiber();
+
+  // Suspends the current fiber until |deadline|.  If not called from a
+  // fiber, the calling thread sleeps instead.
+  static void SleepUntil(Clock::time_point deadline);
+
+  template <typename Rep, typename Period>
+  static void SleepFor(const std::chrono::duration<Rep, Period>& duration) {
+    SleepUntil(DeadlineAfter(duration));
+  }
+
+  // Returns the deadline |duration| from now.
+  template <typename Rep, typename Period>
+  static Clock::time_point DeadlineAfter(
+      const std::chrono::duration<Rep, Period>& duration) {
+    return Clock::now() +
+           std::chrono::duration_cast<Clock::duration>(duration);
+  }
+
+  // Starts |timer|, which must not already be running, so that its callback
+  // is called at or after |deadline|.  Must be called on a worker thread,
+  // such as from a SuspendCallback.  The callback is called on the same
+  // worker thread, and must not start or cancel timers itself.
+  static void StartTimer(Timer* timer, Clock::time_point deadline);
+
+  // Stops |timer| from firing.  Returns false if it has already fired.
+  // Either way, its callback is not running once this returns.  May be
+  // called from any thread.
+  static bool CancelTimer(Timer* timer);
+
+  int num_workers() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  void WorkerMain(Worker* worker);
+  void RunFiber(Worker* worker, Fiber* fiber);
+  void FinishFiber(Fiber* fiber);
+  Fiber* FindWork(Worker* worker);
+  bool HasWork();
+  void Park(Worker* worker);
+  void RunTimers(Worker* worker);
+  void Schedule(Fiber* fiber, bool from_yield);
+  void WakeWorker();
+
+  const Options options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+
+  // Fibers made ready from outside of a worker thread, and yielded fibers.
+  std::mutex injected_mutex_;
+  std::deque<Fiber*> injected_fibers_;
+  std::atomic<size_t> num_injected_fibers_;
+
+  // Parked workers sleep on |wake_epoch_|, which is bumped whenever there may
+  // be new work for them.
+  std::atomic<uint32_t> wake_epoch_;
+  std::atomic<int> num_parked_workers_;
+  std::atomic<bool> shutting_down_;
+
+  std::atomic<size_t> num_live_fibers_;
+  std::mutex live_fibers_mutex_;
+  std::condition_variable no_live_fibers_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_FIBER_SCHEDULER_H__
@@ -0,0 +1,77 @@
+#include "platform/fiber_scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Measures FiberScheduler throughput on a fan-out/fan-in workload, for an
+// increasing number of worker threads.
+
+using platform::FiberScheduler;
+
+namespace {
+
+// Spawns |fan_out| children which each spawn |fan_out| trivial leaf fibers,
+// and joins them all.  Returns the total number of fibers run.
+int RunFanOutFanIn(FiberScheduler* scheduler, int fan_out) {
+  std::atomic<int> num_leaves(0);
+
+  auto root = scheduler->Spawn([scheduler, fan_out, &num_leaves]() {
+    std::vector<std::shared_ptr<FiberScheduler::Fiber>> children;
+    children.reserve(fan_out);
+    for (int i = 0; i < fan_out; ++i) {
+      children.push_back(scheduler->Spawn([scheduler, fan_out, &num_leaves]() {
+        std::vector<std::shared_ptr<FiberScheduler::Fiber>> leaves;
+        leaves.reserve(fan_out);
+        for (int j = 0; j < fan_out; ++j) {
+          leaves.push_back(scheduler->Spawn([&num_leaves]() {
+            num_leaves.fetch_add(1, std::memory_order_relaxed);
+          }));
+        }
+        for (auto& leaf : leaves) {
+          scheduler->Join(leaf);
+        }
+      }));
+    }
+    for (auto& child : children) {
+      scheduler->Join(child);
+    }
+  });
+  scheduler->Join(root);
+
+  return 1 + fan_out + num_leaves.load();
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int fan_out = 1000;
+  if (argc > 1) {
+    fan_out = atoi(argv[1]);
+  }
+
+  int max_workers = std::thread::hardware_concurrency();
+  if (max_workers < 1) {
+    max_workers = 1;
+  }
+
+  printf("Fan-out/fan-in of %d x %d fibers\n", fan_out, fan_out);
+  for (int num_workers = 1; num_workers <= max_workers; num_workers *= 2) {
+    FiberScheduler::Options options;
+    options.num_workers = num_workers;
+    FiberScheduler scheduler(options);
+
+    auto start = std::chrono::steady_clock::now();
+    int num_fibers = RunFanOutFanIn(&scheduler, fan_out);
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("  %3d workers: %12.0f fibers/s\n", num_workers,
+           num_fibers / seconds);
+  }
+
+  return 0;
+}
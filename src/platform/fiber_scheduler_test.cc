@@ -0,0 +1,284 @@
+#include "platform/fiber_scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::FiberScheduler;
+
+namespace {
+FiberScheduler::Options OptionsWithWorkers(int num_workers) {
+  FiberScheduler::Options options;
+  options.num_workers = num_workers;
+  return options;
+}
+}  // namespace
+
+TEST(FiberSchedulerTests, CanSpawnAndJoinFromThread) {
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+  int foo = 0;
+
+  auto fiber = scheduler.Spawn([&foo]() { foo = 1; });
+  scheduler.Join(fiber);
+
+  EXPECT_TRUE(FiberScheduler::IsDone(*fiber));
+  EXPECT_EQ(1, foo);
+}
+
+TEST(FiberSchedulerTests, CurrentFiberIsOnlySetInFibers) {
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  EXPECT_EQ(nullptr, FiberScheduler::CurrentFiber());
+
+  FiberScheduler::Fiber* current_fiber = nullptr;
+  auto fiber = scheduler.Spawn([&current_fiber]() {
+    current_fiber = FiberScheduler::CurrentFiber();
+  });
+  scheduler.Join(fiber);
+
+  EXPECT_EQ(fiber.get(), current_fiber);
+}
+
+TEST(FiberSchedulerTests, YieldLetsOtherFibersRun) {
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  std::vector<int> order;
+
+  auto outer = scheduler.Spawn([&]() {
+    auto first = scheduler.Spawn([&]() {
+      order.push_back(1);
+      FiberScheduler::YieldFiber();
+      order.push_back(3);
+    });
+    auto second = scheduler.Spawn([&]() {
+      order.push_back(2);
+    });
+    scheduler.Join(first);
+    scheduler.Join(second);
+  });
+  scheduler.Join(outer);
+
+  ASSERT_EQ(3u, order.size());
+  EXPECT_EQ(3, order.back());
+}
+
+TEST(FiberSchedulerTests, FiberCanJoinFiber) {
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+  std::atomic<int> foo(0);
+
+  auto outer = scheduler.Spawn([&]() {
+    auto inner = scheduler.Spawn([&]() {
+      for (int i = 0; i < 100; ++i) {
+        FiberScheduler::YieldFiber();
+      }
+      foo = 1;
+    });
+    scheduler.Join(inner);
+    EXPECT_EQ(1, foo.load());
+    foo = 2;
+  });
+  scheduler.Join(outer);
+
+  EXPECT_EQ(2, foo.load());
+}
+
+TEST(FiberSchedulerTests, SuspendAndReady) {
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+  std::atomic<FiberScheduler::Fiber*> parked(nullptr);
+  std::atomic<int> foo(0);
+
+  auto fiber = scheduler.Spawn([&]() {
+    foo = 1;
+    FiberScheduler::Suspend([](FiberScheduler::Fiber* fiber, void* arg) {
+      static_cast<std::atomic<FiberScheduler::Fiber*>*>(arg)->store(fiber);
+    }, &parked);
+    foo = 2;
+  });
+
+  while (!parked.load()) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(1, foo.load());
+  EXPECT_FALSE(FiberScheduler::IsDone(*fiber));
+
+  FiberScheduler::Ready(parked.load());
+  scheduler.Join(fiber);
+  EXPECT_EQ(2, foo.load());
+}
+
+namespace {
+// pthread_self() is declared as a const function, so the compiler may reuse
+// its result across a switch after which the fiber is running on a different
+// thread.  Query it through a function which the compiler cannot see into.
+__attribute__((noinline)) std::thread::id CurrentThreadId() {
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  return std::this_thread::get_id();
+}
+
+struct MigrationState {
+  std::atomic<bool> resumed;
+};
+
+// Makes the fiber ready again, which puts it on this worker's deque, then
+// holds this worker's thread hostage until the fiber has resumed.  The only
+// way for that to happen is for another worker to steal it.
+void ReadyAndBlockWorker(FiberScheduler::Fiber* fiber, void* arg) {
+  MigrationState* state = static_cast<MigrationState*>(arg);
+  FiberScheduler::Ready(fiber);
+  while (!state->resumed.load()) {
+    std::this_thread::yield();
+  }
+}
+}  // namespace
+
+TEST(FiberSchedulerTests, FibersMigrateBetweenWorkers) {
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+
+  // This must outlive the fiber, since the blocked worker polls it.
+  MigrationState state;
+  state.resumed = false;
+
+  std::thread::id before_suspend;
+  std::thread::id after_suspend;
+  auto fiber = scheduler.Spawn([&]() {
+    before_suspend = CurrentThreadId();
+    FiberScheduler::Suspend(&ReadyAndBlockWorker, &state);
+    after_suspend = CurrentThreadId();
+
+    state.resumed = true;
+  });
+  scheduler.Join(fiber);
+
+  EXPECT_NE(before_suspend, after_suspend);
+}
+
+TEST(FiberSchedulerTests, FanOutFanIn) {
+  const int kFanOut = 100;
+  FiberScheduler scheduler(OptionsWithWorkers(4));
+  std::atomic<int> num_leaves(0);
+
+  auto root = scheduler.Spawn([&]() {
+    std::vector<std::shared_ptr<FiberScheduler::Fiber>> children;
+    for (int i = 0; i < kFanOut; ++i) {
+      children.push_back(scheduler.Spawn([&]() {
+        std::vector<std::shared_ptr<FiberScheduler::Fiber>> grandchildren;
+        for (int j = 0; j < kFanOut; ++j) {
+          grandchildren.push_back(scheduler.Spawn([&]() { ++num_leaves; }));
+        }
+        for (auto& grandchild : grandchildren) {
+          scheduler.Join(grandchild);
+        }
+      }));
+    }
+    for (auto& child : children) {
+      scheduler.Join(child);
+    }
+  });
+  scheduler.Join(root);
+
+  EXPECT_EQ(kFanOut * kFanOut, num_leaves.load());
+}
+
+TEST(FiberSchedulerTests, DestructorWaitsForFibers) {
+  std::atomic<int> num_done(0);
+  {
+    FiberScheduler scheduler(OptionsWithWorkers(2));
+    for (int i = 0; i < 100; ++i) {
+      scheduler.Spawn([&num_done]() {
+        FiberScheduler::YieldFiber();
+        ++num_done;
+      });
+    }
+  }
+  EXPECT_EQ(100, num_done.load());
+}
+
+TEST(FiberSchedulerTests, StacksOfCompletedFibersAreReused) {
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  auto stack_address = []() {
+    volatile char local = 0;
+    return reinterpret_cast<uintptr_t>(&local);
+  };
+
+  uintptr_t addresses[10];
+  for (uintptr_t& address : addresses) {
+    scheduler.Join(scheduler.Spawn([&address, &stack_address]() {
+      address = stack_address();
+    }));
+  }
+  for (uintptr_t address : addresses) {
+    EXPECT_EQ(addresses[0], address);
+  }
+}
+
+TEST(FiberSchedulerTests, SleepingFibersDoNotBlockWorker) {
+  // Every fiber sleeps at the same time on the one worker, so together they
+  // take about as long as one of them.
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  const int kNumFibers = 100;
+  const auto kSleep = std::chrono::milliseconds(50);
+
+  auto start = FiberScheduler::Clock::now();
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  std::atomic<int> num_early(0);
+  for (int i = 0; i < kNumFibers; ++i) {
+    fibers.push_back(scheduler.Spawn([&num_early, kSleep]() {
+      auto deadline = FiberScheduler::DeadlineAfter(kSleep);
+      FiberScheduler::SleepUntil(deadline);
+      if (FiberScheduler::Clock::now() < deadline) {
+        ++num_early;
+      }
+    }));
+  }
+  for (auto& fiber : fibers) {
+    scheduler.Join(fiber);
+  }
+  auto elapsed = FiberScheduler::Clock::now() - start;
+
+  EXPECT_EQ(0, num_early.load());
+  EXPECT_LE(kSleep, elapsed);
+  EXPECT_GT(kSleep * 10, elapsed);
+}
+
+TEST(FiberSchedulerTests, SleepWakesInDeadlineOrder) {
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  std::vector<int> order;
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i : {3, 1, 2}) {
+    fibers.push_back(scheduler.Spawn([&order, i]() {
+      FiberScheduler::SleepFor(std::chrono::milliseconds(10 * i));
+      order.push_back(i);
+    }));
+  }
+  for (auto& fiber : fibers) {
+    scheduler.Join(fiber);
+  }
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), order);
+}
+
+TEST(FiberSchedulerTests, SleepOutsideOfFiberSleepsThread) {
+  auto start = FiberScheduler::Clock::now();
+  FiberScheduler::SleepFor(std::chrono::milliseconds(5));
+  EXPECT_LE(std::chrono::milliseconds(5),
+            FiberScheduler::Clock::now() - start);
+}
+
+TEST(FiberSchedulerTests, CancelledTimersDoNotFire) {
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  std::atomic<int> num_fired(0);
+  auto fiber = scheduler.Spawn([&num_fired]() {
+    FiberScheduler::Timer timer(
+        [](void* arg) { ++*static_cast<std::atomic<int>*>(arg); },
+        &num_fired);
+    FiberScheduler::StartTimer(
+        &timer, FiberScheduler::DeadlineAfter(std::chrono::milliseconds(5)));
+    EXPECT_TRUE(FiberScheduler::CancelTimer(&timer));
+    EXPECT_FALSE(FiberScheduler::CancelTimer(&timer));
+    FiberScheduler::SleepFor(std::chrono::milliseconds(20));
+  });
+  scheduler.Join(fiber);
+  EXPECT_EQ(0, num_fired.load());
+}
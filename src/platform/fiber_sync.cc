@@ -0,0 +1,372 @@
+#include "platform/fiber_sync.h"
+
+#include <climits>
+#include <thread>
+
+#include "platform/futex.h"
+
+namespace platform {
+
+// Waiters live on the stack of the fiber or thread that is waiting.
+struct FiberWaitQueue::Waiter {
+  Waiter(FiberWaitQueue* queue, const std::atomic<uint32_t>* word,
+         uint32_t expected)
+      : queue(queue), word(word), expected(expected),
+        fiber(FiberScheduler::CurrentFiber()), woken(0), timer(nullptr),
+        queued(false), timed_out(false), prev(nullptr), next(nullptr) {}
+
+  FiberWaitQueue* const queue;
+  const std::atomic<uint32_t>* const word;
+  const uint32_t expected;
+
+  // The waiting fiber, or null if a thread is waiting.
+  FiberScheduler::Fiber* const fiber;
+  // Set to 1 when a waiting thread is woken.
+  std::atomic<uint32_t> woken;
+
+  // For a fiber waiting with a deadline, the timer which takes it back out
+  // of the queue.
+  FiberScheduler::Timer* timer;
+  FiberScheduler::Clock::time_point deadline;
+
+  // Guarded by the queue lock.  |timed_out| is set if the waiter was taken
+  // out of the queue because its deadline passed.
+  bool queued;
+  bool timed_out;
+
+  Waiter* prev;
+  Waiter* next;
+};
+
+void FiberWaitQueue::Wait(const std::atomic<uint32_t>* word,
+                          uint32_t expected) {
+  Waiter waiter(this, word, expected);
+
+  if (waiter.fiber) {
+    // Only enqueue the fiber once it has switched out, since another thread
+    // may wake it as soon as it is visible in the queue.
+    FiberScheduler::Suspend(&EnqueueSuspendedFiber, &waiter);
+    return;
+  }
+
+  if (!EnqueueIfEqual(&waiter)) {
+    return;
+  }
+  while (waiter.woken.load(std::memory_order_acquire) == 0) {
+    FutexWait(&waiter.woken, 0);
+  }
+}
+
+bool FiberWaitQueue::WaitUntil(const std::atomic<uint32_t>* word,
+                               uint32_t expected,
+                               FiberScheduler::Clock::time_point deadline) {
+  Waiter waiter(this, word, expected);
+  waiter.deadline = deadline;
+
+  if (waiter.fiber) {
+    FiberScheduler::Timer timer(&TimeOut, &waiter);
+    waiter.timer = &timer;
+    FiberScheduler::Suspend(&EnqueueSuspendedFiberWithDeadline, &waiter);
+    return !waiter.timed_out;
+  }
+
+  if (!EnqueueIfEqual(&waiter)) {
+    return true;
+  }
+  while (waiter.woken.load(std::memory_order_acquire) == 0) {
+    if (FiberScheduler::Clock::now() >= deadline) {
+      LockQueue();
+      bool timed_out = waiter.queued;
+      if (timed_out) {
+        Unlink(&waiter);
+      }
+      UnlockQueue();
+      if (timed_out) {
+        return false;
+      }
+      // A waker has already taken us out of the queue, and will set
+      // |woken| shortly.  Wait for that, since it still refers to |waiter|.
+      while (waiter.woken.load(std::memory_order_acquire) == 0) {
+        FutexWait(&waiter.woken, 0);
+      }
+      return true;
+    }
+    FutexWaitUntil(&waiter.woken, 0, deadline);
+  }
+  return true;
+}
+
+void FiberWaitQueue::Wake(int count) {
+  // Pairs with the increment of |num_waiters_| in EnqueueIfEqual(): either
+  // the waiter sees the caller's change to its word, or we see the waiter.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_waiters_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  LockQueue();
+  Waiter* woken_head = head_;
+  Waiter* woken_tail = nullptr;
+  int num_woken = 0;
+  while (head_ && num_woken < count) {
+    head_->queued = false;
+    woken_tail = head_;
+    head_ = head_->next;
+    ++num_woken;
+  }
+  if (head_) {
+    head_->prev = nullptr;
+  } else {
+    tail_ = nullptr;
+  }
+  if (woken_tail) {
+    woken_tail->next = nullptr;
+  } else {
+    woken_head = nullptr;
+  }
+  num_waiters_.fetch_sub(num_woken, std::memory_order_relaxed);
+  UnlockQueue();
+
+  while (woken_head) {
+    // The waiter may be gone as soon as it is woken.
+    Waiter* next = woken_head->next;
+    if (woken_head->fiber) {
+      // Once this returns the timer will not touch the waiter.  If it has
+      // already fired, it found the waiter out of the queue and did nothing.
+      if (woken_head->timer) {
+        FiberScheduler::CancelTimer(woken_head->timer);
+      }
+      FiberScheduler::Ready(woken_head->fiber);
+    } else {
+      woken_head->woken.store(1, std::memory_order_release);
+      FutexWake(&woken_head->woken, 1);
+    }
+    woken_head = next;
+  }
+}
+
+void FiberWaitQueue::WakeAll() {
+  Wake(INT_MAX);
+}
+
+void FiberWaitQueue::EnqueueSuspendedFiber(
+    FiberScheduler::Fiber* fiber, void* arg) {
+  Waiter* waiter = static_cast<Waiter*>(arg);
+  if (!waiter->queue->EnqueueIfEqual(waiter)) {
+    FiberScheduler::Ready(fiber);
+  }
+}
+
+void FiberWaitQueue::EnqueueSuspendedFiberWithDeadline(
+    FiberScheduler::Fiber* fiber, void* arg) {
+  Waiter* waiter = static_cast<Waiter*>(arg);
+  // Start the timer first, so that it is already running if a waker finds
+  // the waiter in the queue.  It can not fire before this returns, since
+  // timers fire on the thread that started them.
+  FiberScheduler::StartTimer(waiter->timer, waiter->deadline);
+  if (!waiter->queue->EnqueueIfEqual(waiter)) {
+    FiberScheduler::CancelTimer(waiter->timer);
+    FiberScheduler::Ready(fiber);
+  }
+}
+
+void FiberWaitQueue::TimeOut(void* arg) {
+  Waiter* waiter = static_cast<Waiter*>(arg);
+  FiberWaitQueue* queue = waiter->queue;
+
+  queue->LockQueue();
+  bool timed_out = waiter->queued;
+  if (timed_out) {
+    queue->Unlink(waiter);
+    waiter->timed_out = true;
+  }
+  queue->UnlockQueue();
+
+  if (timed_out) {
+    FiberScheduler::Ready(waiter->fiber);
+  }
+}
+
+bool FiberWaitQueue::EnqueueIfEqual(Waiter* waiter) {
+  LockQueue();
+
+  num_waiters_.fetch_add(1, std::memory_order_seq_cst);
+  if (waiter->word->load(std::memory_order_seq_cst) != waiter->expected) {
+    num_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    UnlockQueue();
+    return false;
+  }
+
+  waiter->prev = tail_;
+  if (tail_) {
+    tail_->next = waiter;
+  } else {
+    head_ = waiter;
+  }
+  tail_ = waiter;
+  waiter->queued = true;
+
+  UnlockQueue();
+  return true;
+}
+
+void FiberWaitQueue::Unlink(Waiter* waiter) {
+  if (waiter->prev) {
+    waiter->prev->next = waiter->next;
+  } else {
+    head_ = waiter->next;
+  }
+  if (waiter->next) {
+    waiter->next->prev = waiter->prev;
+  } else {
+    tail_ = waiter->prev;
+  }
+  waiter->queued = false;
+  num_waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void FiberWaitQueue::LockQueue() {
+  while (queue_lock_.test_and_set(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+}
+
+void FiberWaitQueue::UnlockQueue() {
+  queue_lock_.clear(std::memory_order_release);
+}
+
+void FiberMutex::LockSlow(uint32_t state) {
+  // Mark the mutex as contended, so that the unlocker knows to wake us.
+  if (state != kLockedWithWaiters) {
+    state = state_.exchange(kLockedWithWaiters, std::memory_order_acquire);
+  }
+  while (state != kUnlocked) {
+    waiters_.Wait(&state_, kLockedWithWaiters);
+    state = state_.exchange(kLockedWithWaiters, std::memory_order_acquire);
+  }
+}
+
+bool FiberMutex::LockSlowUntil(uint32_t state,
+                               FiberScheduler::Clock::time_point deadline) {
+  if (state != kLockedWithWaiters) {
+    state = state_.exchange(kLockedWithWaiters, std::memory_order_acquire);
+  }
+  while (state != kUnlocked) {
+    if (!waiters_.WaitUntil(&state_, kLockedWithWaiters, deadline)) {
+      return false;
+    }
+    state = state_.exchange(kLockedWithWaiters, std::memory_order_acquire);
+  }
+  return true;
+}
+
+void FiberMutex::UnlockSlow() {
+  state_.store(kUnlocked, std::memory_order_release);
+  waiters_.Wake(1);
+}
+
+void FiberConditionVariable::wait(std::unique_lock<FiberMutex>& lock) {
+  uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+  lock.unlock();
+  waiters_.Wait(&sequence_, sequence);
+  lock.lock();
+}
+
+std::cv_status FiberConditionVariable::wait_until(
+    std::unique_lock<FiberMutex>& lock,
+    FiberScheduler::Clock::time_point deadline) {
+  uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+  lock.unlock();
+  bool woken = waiters_.WaitUntil(&sequence_, sequence, deadline);
+  lock.lock();
+  return woken ? std::cv_status::no_timeout : std::cv_status::timeout;
+}
+
+void FiberConditionVariable::notify_one() {
+  sequence_.fetch_add(1, std::memory_order_relaxed);
+  waiters_.Wake(1);
+}
+
+void FiberConditionVariable::notify_all() {
+  sequence_.fetch_add(1, std::memory_order_relaxed);
+  waiters_.WakeAll();
+}
+
+void FiberSemaphore::acquire() {
+  uint32_t count = count_.load(std::memory_order_relaxed);
+  while (true) {
+    if (count > 0) {
+      if (count_.compare_exchange_weak(
+              count, count - 1, std::memory_order_acquire,
+              std::memory_order_relaxed)) {
+        return;
+      }
+      continue;
+    }
+    waiters_.Wait(&count_, 0);
+    count = count_.load(std::memory_order_relaxed);
+  }
+}
+
+bool FiberSemaphore::try_acquire_until(
+    FiberScheduler::Clock::time_point deadline) {
+  uint32_t count = count_.load(std::memory_order_relaxed);
+  while (true) {
+    if (count > 0) {
+      if (count_.compare_exchange_weak(
+              count, count - 1, std::memory_order_acquire,
+              std::memory_order_relaxed)) {
+        return true;
+      }
+      continue;
+    }
+    if (!waiters_.WaitUntil(&count_, 0, deadline)) {
+      return try_acquire();
+    }
+    count = count_.load(std::memory_order_relaxed);
+  }
+}
+
+bool FiberSemaphore::try_acquire() {
+  uint32_t count = count_.load(std::memory_order_relaxed);
+  while (count > 0) {
+    if (count_.compare_exchange_weak(
+            count, count - 1, std::memory_order_acquire,
+            std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void FiberSemaphore::release(uint32_t update) {
+  count_.fetch_add(update, std::memory_order_release);
+  waiters_.Wake(update);
+}
+
+void FiberWaitGroup::done() {
+  if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    waiters_.WakeAll();
+  }
+}
+
+void FiberWaitGroup::wait() {
+  uint32_t count = count_.load(std::memory_order_acquire);
+  while (count != 0) {
+    waiters_.Wait(&count_, count);
+    count = count_.load(std::memory_order_acquire);
+  }
+}
+
+bool FiberWaitGroup::wait_until(FiberScheduler::Clock::time_point deadline) {
+  uint32_t count = count_.load(std::memory_order_acquire);
+  while (count != 0) {
+    if (!waiters_.WaitUntil(&count_, count, deadline)) {
+      return count_.load(std::memory_order_acquire) == 0;
+    }
+    count = count_.load(std::memory_order_acquire);
+  }
+  return true;
+}
+
+}  // namespace platform
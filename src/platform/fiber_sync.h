@@ -0,0 +1,378 @@
+#ifndef __PLATFORM_FIBER_SYNC_H__
+#define __PLATFORM_FIBER_SYNC_H__
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "platform/fiber_scheduler.h"
+#include "stdext/optional.h"
+
+namespace platform {
+
+// Synchronization primitives which, when they need to wait, suspend the
+// calling FiberScheduler fiber rather than blocking its worker thread, so
+// that the worker can run other fibers in the meantime.  They may also be
+// used from plain threads, which block as usual.
+//
+// Uncontended FiberMutex and FiberSemaphore operations are a single atomic
+// read-modify-write, and no operation touches a wait queue unless there is
+// someone waiting on it.
+//
+// Every wait has a variant which gives up at a deadline, or after a
+// duration, in the style of the standard library.  Fibers waiting with a
+// deadline are woken by their worker's timer wheel.
+
+// A queue of fibers and threads waiting for an atomic word to change, in the
+// style of a futex.  This is the common building block for the primitives
+// below.
+class FiberWaitQueue {
+ public:
+  FiberWaitQueue() : num_waiters_(0) {}
+  FiberWaitQueue(const FiberWaitQueue&) = delete;
+  FiberWaitQueue& operator=(const FiberWaitQueue&) = delete;
+
+  // Waits until woken by Wake(), if |*word| equals |expected|.  The check is
+  // atomic with respect to Wake(), so a Wake() issued after |*word| has been
+  // changed can not be missed.  May return spuriously.
+  void Wait(const std::atomic<uint32_t>* word, uint32_t expected);
+
+  // As Wait(), but gives up once |deadline| has passed.  Returns false if it
+  // gave up, and true if it was woken or returned spuriously.
+  bool WaitUntil(const std::atomic<uint32_t>* word, uint32_t expected,
+                 FiberScheduler::Clock::time_point deadline);
+
+  // Wakes up to |count| waiters, in the order that they started waiting.
+  void Wake(int count);
+  void WakeAll();
+
+ private:
+  struct Waiter;
+
+  static void EnqueueSuspendedFiber(FiberScheduler::Fiber* fiber, void* arg);
+  static void EnqueueSuspendedFiberWithDeadline(FiberScheduler::Fiber* fiber,
+                                                void* arg);
+  static void TimeOut(void* arg);
+  bool EnqueueIfEqual(Waiter* waiter);
+  void Unlink(Waiter* waiter);
+  void LockQueue();
+  void UnlockQueue();
+
+  std::atomic<int> num_waiters_;
+  std::atomic_flag queue_lock_ = ATOMIC_FLAG_INIT;
+  Waiter* head_ = nullptr;
+  Waiter* tail_ = nullptr;
+};
+
+// A mutex, usable with std::lock_guard and std::unique_lock.
+class FiberMutex {
+ public:
+  FiberMutex() : state_(kUnlocked) {}
+  FiberMutex(const FiberMutex&) = delete;
+  FiberMutex& operator=(const FiberMutex&) = delete;
+
+  void lock() {
+    uint32_t state = kUnlocked;
+    if (!state_.compare_exchange_strong(
+            state, kLocked, std::memory_order_acquire,
+            std::memory_order_relaxed)) {
+      LockSlow(state);
+    }
+  }
+
+  bool try_lock() {
+    uint32_t state = kUnlocked;
+    return state_.compare_exchange_strong(
+        state, kLocked, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  // Returns false if the mutex could not be locked before |deadline|.
+  bool try_lock_until(FiberScheduler::Clock::time_point deadline) {
+    uint32_t state = kUnlocked;
+    if (state_.compare_exchange_strong(
+            state, kLocked, std::memory_order_acquire,
+            std::memory_order_relaxed)) {
+      return true;
+    }
+    return LockSlowUntil(state, deadline);
+  }
+
+  template <typename Rep, typename Period>
+  bool try_lock_for(const std::chrono::duration<Rep, Period>& duration) {
+    return try_lock_until(FiberScheduler::DeadlineAfter(duration));
+  }
+
+  void unlock() {
+    if (state_.fetch_sub(1, std::memory_order_release) != kLocked) {
+      UnlockSlow();
+    }
+  }
+
+ private:
+  static const uint32_t kUnlocked = 0;
+  static const uint32_t kLocked = 1;
+  static const uint32_t kLockedWithWaiters = 2;
+
+  void LockSlow(uint32_t state);
+  bool LockSlowUntil(uint32_t state,
+                     FiberScheduler::Clock::time_point deadline);
+  void UnlockSlow();
+
+  std::atomic<uint32_t> state_;
+  FiberWaitQueue waiters_;
+};
+
+// A condition variable to be used with FiberMutex.
+class FiberConditionVariable {
+ public:
+  FiberConditionVariable() : sequence_(0) {}
+  FiberConditionVariable(const FiberConditionVariable&) = delete;
+  FiberConditionVariable& operator=(const FiberConditionVariable&) = delete;
+
+  // Atomically releases |lock| and waits for a notification, then
+  // re-acquires |lock|.  May return spuriously.
+  void wait(std::unique_lock<FiberMutex>& lock);
+
+  template <typename Predicate>
+  void wait(std::unique_lock<FiberMutex>& lock, Predicate predicate) {
+    while (!predicate()) {
+      wait(lock);
+    }
+  }
+
+  std::cv_status wait_until(std::unique_lock<FiberMutex>& lock,
+                            FiberScheduler::Clock::time_point deadline);
+
+  // Returns the value of |predicate| once it is true or the deadline has
+  // passed.
+  template <typename Predicate>
+  bool wait_until(std::unique_lock<FiberMutex>& lock,
+                  FiberScheduler::Clock::time_point deadline,
+                  Predicate predicate) {
+    while (!predicate()) {
+      if (wait_until(lock, deadline) == std::cv_status::timeout) {
+        return predicate();
+      }
+    }
+    return true;
+  }
+
+  template <typename Rep, typename Period>
+  std::cv_status wait_for(std::unique_lock<FiberMutex>& lock,
+                          const std::chrono::duration<Rep, Period>& duration) {
+    return wait_until(lock, FiberScheduler::DeadlineAfter(duration));
+  }
+
+  template <typename Rep, typename Period, typename Predicate>
+  bool wait_for(std::unique_lock<FiberMutex>& lock,
+                const std::chrono::duration<Rep, Period>& duration,
+                Predicate predicate) {
+    return wait_until(lock, FiberScheduler::DeadlineAfter(duration),
+                      std::move(predicate));
+  }
+
+  void notify_one();
+  void notify_all();
+
+ private:
+  std::atomic<uint32_t> sequence_;
+  FiberWaitQueue waiters_;
+};
+
+// A counting semaphore.
+class FiberSemaphore {
+ public:
+  explicit FiberSemaphore(uint32_t initial_count) : count_(initial_count) {}
+  FiberSemaphore(const FiberSemaphore&) = delete;
+  FiberSemaphore& operator=(const FiberSemaphore&) = delete;
+
+  // Decrements the count, waiting for it to become positive first.
+  void acquire();
+  bool try_acquire();
+
+  // Returns false if the count did not become positive before |deadline|.
+  bool try_acquire_until(FiberScheduler::Clock::time_point deadline);
+
+  template <typename Rep, typename Period>
+  bool try_acquire_for(const std::chrono::duration<Rep, Period>& duration) {
+    return try_acquire_until(FiberScheduler::DeadlineAfter(duration));
+  }
+
+  // Increments the count by |update|.
+  void release(uint32_t update = 1);
+
+ private:
+  std::atomic<uint32_t> count_;
+  FiberWaitQueue waiters_;
+};
+
+// Waits for a collection of tasks to complete, like Go's sync.WaitGroup.
+class FiberWaitGroup {
+ public:
+  FiberWaitGroup() : count_(0) {}
+  FiberWaitGroup(const FiberWaitGroup&) = delete;
+  FiberWaitGroup& operator=(const FiberWaitGroup&) = delete;
+
+  // Adds |count| outstanding tasks.
+  void add(uint32_t count = 1) {
+    count_.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  // Marks one outstanding task as complete.
+  void done();
+
+  // Waits for the number of outstanding tasks to reach zero.
+  void wait();
+
+  // Returns false if there were still outstanding tasks at |deadline|.
+  bool wait_until(FiberScheduler::Clock::time_point deadline);
+
+  template <typename Rep, typename Period>
+  bool wait_for(const std::chrono::duration<Rep, Period>& duration) {
+    return wait_until(FiberScheduler::DeadlineAfter(duration));
+  }
+
+ private:
+  std::atomic<uint32_t> count_;
+  FiberWaitQueue waiters_;
+};
+
+// A bounded, multiple producer, multiple consumer queue.  Senders wait while
+// the channel is full and receivers wait while it is empty.
+template <typename T>
+class FiberChannel {
+ public:
+  explicit FiberChannel(size_t capacity)
+      : buffer_(capacity), head_(0), size_(0), closed_(false) {
+    assert(capacity > 0);
+  }
+  FiberChannel(const FiberChannel&) = delete;
+  FiberChannel& operator=(const FiberChannel&) = delete;
+
+  // Waits for space in the channel and then adds |value| to it.  Returns
+  // false, without sending, if the channel has been closed.
+  bool send(T value) {
+    std::unique_lock<FiberMutex> lock(mutex_);
+    not_full_.wait(lock, [this]() {
+      return closed_ || size_ < buffer_.size();
+    });
+    if (closed_) {
+      return false;
+    }
+    Push(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // As send(), but also returns false if there was no space in the channel
+  // before |deadline|.
+  bool send_until(T value, FiberScheduler::Clock::time_point deadline) {
+    std::unique_lock<FiberMutex> lock(mutex_);
+    if (!not_full_.wait_until(lock, deadline, [this]() {
+          return closed_ || size_ < buffer_.size();
+        }) || closed_) {
+      return false;
+    }
+    Push(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool try_send(T value) {
+    std::unique_lock<FiberMutex> lock(mutex_);
+    if (closed_ || size_ == buffer_.size()) {
+      return false;
+    }
+    Push(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Waits for a value and moves it into |value|.  Returns false if the
+  // channel has been closed and all values sent before that have been
+  // received.
+  bool receive(T* value) {
+    std::unique_lock<FiberMutex> lock(mutex_);
+    not_empty_.wait(lock, [this]() { return closed_ || size_ > 0; });
+    if (size_ == 0) {
+      return false;
+    }
+    Pop(value);
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // As receive(), but also returns false if no value arrived before
+  // |deadline|.
+  bool receive_until(T* value, FiberScheduler::Clock::time_point deadline) {
+    std::unique_lock<FiberMutex> lock(mutex_);
+    if (!not_empty_.wait_until(lock, deadline, [this]() {
+          return closed_ || size_ > 0;
+        }) || size_ == 0) {
+      return false;
+    }
+    Pop(value);
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  bool try_receive(T* value) {
+    std::unique_lock<FiberMutex> lock(mutex_);
+    if (size_ == 0) {
+      return false;
+    }
+    Pop(value);
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Fails all pending and future sends, and wakes all receivers once the
+  // channel drains.
+  void close() {
+    {
+      std::lock_guard<FiberMutex> lock(mutex_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+ private:
+  void Push(T&& value) {
+    buffer_[(head_ + size_) % buffer_.size()].emplace(std::move(value));
+    ++size_;
+  }
+
+  void Pop(T* value) {
+    stdext::optional<T>& slot = buffer_[head_];
+    *value = std::move(*slot);
+    slot.reset();
+    head_ = (head_ + 1) % buffer_.size();
+    --size_;
+  }
+
+  FiberMutex mutex_;
+  FiberConditionVariable not_full_;
+  FiberConditionVariable not_empty_;
+
+  std::vector<stdext::optional<T>> buffer_;
+  size_t head_;
+  size_t size_;
+  bool closed_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_FIBER_SYNC_H__
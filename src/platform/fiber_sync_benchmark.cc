@@ -0,0 +1,94 @@
+#include "platform/fiber_sync.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Compares FiberMutex, contended by fibers on a FiberScheduler, against
+// std::mutex, contended by the same number of threads.
+
+using platform::FiberMutex;
+using platform::FiberScheduler;
+
+namespace {
+
+const int kIncrementsPerTask = 100000;
+
+double NanosecondsPerLock(std::chrono::steady_clock::duration duration,
+                          int num_tasks) {
+  return static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          duration).count()) / (static_cast<double>(num_tasks) *
+                                kIncrementsPerTask);
+}
+
+double MeasureStdMutex(int num_threads) {
+  std::mutex mutex;
+  int64_t counter = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < kIncrementsPerTask; ++j) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++counter;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  return NanosecondsPerLock(end - start, num_threads);
+}
+
+double MeasureFiberMutex(int num_workers, int num_fibers) {
+  FiberScheduler::Options options;
+  options.num_workers = num_workers;
+  FiberScheduler scheduler(options);
+  FiberMutex mutex;
+  int64_t counter = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < num_fibers; ++i) {
+    fibers.push_back(scheduler.Spawn([&]() {
+      for (int j = 0; j < kIncrementsPerTask; ++j) {
+        std::lock_guard<FiberMutex> lock(mutex);
+        ++counter;
+      }
+    }));
+  }
+  for (auto& fiber : fibers) {
+    scheduler.Join(fiber);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  return NanosecondsPerLock(end - start, num_fibers);
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int num_workers = std::thread::hardware_concurrency();
+  if (argc > 1) {
+    num_workers = atoi(argv[1]);
+  }
+  if (num_workers < 1) {
+    num_workers = 1;
+  }
+
+  printf("Contended lock/unlock cost, %d workers\n", num_workers);
+  for (int num_tasks = 1; num_tasks <= 64; num_tasks *= 4) {
+    printf("  %2d tasks: std::mutex %8.2f ns, FiberMutex %8.2f ns\n",
+           num_tasks, MeasureStdMutex(num_tasks),
+           MeasureFiberMutex(num_workers, num_tasks));
+  }
+
+  return 0;
+}
@@ -0,0 +1,331 @@
+#include "platform/fiber_sync.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::FiberChannel;
+using platform::FiberConditionVariable;
+using platform::FiberMutex;
+using platform::FiberScheduler;
+using platform::FiberSemaphore;
+using platform::FiberWaitGroup;
+
+namespace {
+FiberScheduler::Options OptionsWithWorkers(int num_workers) {
+  FiberScheduler::Options options;
+  options.num_workers = num_workers;
+  return options;
+}
+
+void JoinAll(FiberScheduler* scheduler,
+             const std::vector<std::shared_ptr<FiberScheduler::Fiber>>& fibers) {
+  for (auto& fiber : fibers) {
+    scheduler->Join(fiber);
+  }
+}
+}  // namespace
+
+TEST(FiberSyncTests, BlockedMutexDoesNotBlockWorker) {
+  // With a single worker, the second fiber can only block on the mutex
+  // without deadlocking if doing so lets the first fiber run again.
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  FiberMutex mutex;
+  std::vector<int> order;
+
+  auto first = scheduler.Spawn([&]() {
+    std::shared_ptr<FiberScheduler::Fiber> second;
+    {
+      std::lock_guard<FiberMutex> lock(mutex);
+      order.push_back(1);
+      second = scheduler.Spawn([&]() {
+        std::lock_guard<FiberMutex> lock(mutex);
+        order.push_back(3);
+      });
+      FiberScheduler::YieldFiber();
+      order.push_back(2);
+    }
+    scheduler.Join(second);
+  });
+  scheduler.Join(first);
+
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), order);
+}
+
+TEST(FiberSyncTests, MutexProvidesMutualExclusion) {
+  const int kNumFibers = 64;
+  const int kNumIncrements = 1000;
+  FiberScheduler scheduler(OptionsWithWorkers(4));
+  FiberMutex mutex;
+  int counter = 0;
+
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < kNumFibers; ++i) {
+    fibers.push_back(scheduler.Spawn([&]() {
+      for (int j = 0; j < kNumIncrements; ++j) {
+        std::lock_guard<FiberMutex> lock(mutex);
+        ++counter;
+        if (j % 100 == 0) {
+          FiberScheduler::YieldFiber();
+        }
+      }
+    }));
+  }
+  // Contend from a plain thread too.
+  for (int j = 0; j < kNumIncrements; ++j) {
+    std::lock_guard<FiberMutex> lock(mutex);
+    ++counter;
+  }
+  JoinAll(&scheduler, fibers);
+
+  EXPECT_EQ((kNumFibers + 1) * kNumIncrements, counter);
+}
+
+TEST(FiberSyncTests, TryLock) {
+  FiberMutex mutex;
+  EXPECT_TRUE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock());
+  mutex.unlock();
+  EXPECT_TRUE(mutex.try_lock());
+  mutex.unlock();
+}
+
+TEST(FiberSyncTests, ConditionVariableWakesWaiters) {
+  const int kNumWaiters = 16;
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+  FiberMutex mutex;
+  FiberConditionVariable condition;
+  bool ready = false;
+  std::atomic<int> num_woken(0);
+
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < kNumWaiters; ++i) {
+    fibers.push_back(scheduler.Spawn([&]() {
+      std::unique_lock<FiberMutex> lock(mutex);
+      condition.wait(lock, [&ready]() { return ready; });
+      ++num_woken;
+    }));
+  }
+
+  {
+    std::lock_guard<FiberMutex> lock(mutex);
+    ready = true;
+  }
+  condition.notify_all();
+  JoinAll(&scheduler, fibers);
+
+  EXPECT_EQ(kNumWaiters, num_woken.load());
+}
+
+TEST(FiberSyncTests, SemaphoreLimitsConcurrency) {
+  const int kLimit = 3;
+  FiberScheduler scheduler(OptionsWithWorkers(4));
+  FiberSemaphore semaphore(kLimit);
+  std::atomic<int> num_inside(0);
+  std::atomic<int> max_inside(0);
+
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < 50; ++i) {
+    fibers.push_back(scheduler.Spawn([&]() {
+      semaphore.acquire();
+      int inside = ++num_inside;
+      int max = max_inside.load();
+      while (inside > max && !max_inside.compare_exchange_weak(max, inside)) {
+      }
+      FiberScheduler::YieldFiber();
+      --num_inside;
+      semaphore.release();
+    }));
+  }
+  JoinAll(&scheduler, fibers);
+
+  EXPECT_LE(max_inside.load(), kLimit);
+  EXPECT_TRUE(semaphore.try_acquire());
+  EXPECT_TRUE(semaphore.try_acquire());
+  EXPECT_TRUE(semaphore.try_acquire());
+  EXPECT_FALSE(semaphore.try_acquire());
+}
+
+TEST(FiberSyncTests, WaitGroupWaitsForAllTasks) {
+  const int kNumTasks = 100;
+  FiberScheduler scheduler(OptionsWithWorkers(4));
+  FiberWaitGroup wait_group;
+  std::atomic<int> num_done(0);
+
+  auto waiter = scheduler.Spawn([&]() {
+    wait_group.add(kNumTasks);
+    for (int i = 0; i < kNumTasks; ++i) {
+      scheduler.Spawn([&]() {
+        FiberScheduler::YieldFiber();
+        ++num_done;
+        wait_group.done();
+      });
+    }
+    wait_group.wait();
+    EXPECT_EQ(kNumTasks, num_done.load());
+  });
+  scheduler.Join(waiter);
+}
+
+TEST(FiberSyncTests, ChannelDeliversEveryValueOnce) {
+  const int kNumProducers = 4;
+  const int kNumConsumers = 4;
+  const int kValuesPerProducer = 1000;
+  FiberScheduler scheduler(OptionsWithWorkers(4));
+  FiberChannel<int> channel(8);
+  std::atomic<int64_t> sum(0);
+  std::atomic<int> num_received(0);
+
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> producers;
+  for (int i = 0; i < kNumProducers; ++i) {
+    producers.push_back(scheduler.Spawn([&]() {
+      for (int j = 1; j <= kValuesPerProducer; ++j) {
+        EXPECT_TRUE(channel.send(j));
+      }
+    }));
+  }
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> consumers;
+  for (int i = 0; i < kNumConsumers; ++i) {
+    consumers.push_back(scheduler.Spawn([&]() {
+      int value;
+      while (channel.receive(&value)) {
+        sum += value;
+        ++num_received;
+      }
+    }));
+  }
+
+  JoinAll(&scheduler, producers);
+  channel.close();
+  JoinAll(&scheduler, consumers);
+
+  EXPECT_EQ(kNumProducers * kValuesPerProducer, num_received.load());
+  EXPECT_EQ(static_cast<int64_t>(kNumProducers) *
+                kValuesPerProducer * (kValuesPerProducer + 1) / 2,
+            sum.load());
+}
+
+TEST(FiberSyncTests, ClosedChannelRejectsSends) {
+  FiberChannel<std::unique_ptr<int>> channel(2);
+  EXPECT_TRUE(channel.try_send(std::unique_ptr<int>(new int(1))));
+  channel.close();
+  EXPECT_FALSE(channel.send(std::unique_ptr<int>(new int(2))));
+
+  std::unique_ptr<int> value;
+  ASSERT_TRUE(channel.receive(&value));
+  EXPECT_EQ(1, *value);
+  EXPECT_FALSE(channel.receive(&value));
+}
+
+TEST(FiberSyncTests, WaitsTimeOutInFibersAndThreads) {
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  FiberMutex mutex;
+  FiberConditionVariable condition;
+  FiberSemaphore semaphore(0);
+  FiberWaitGroup wait_group;
+  FiberChannel<int> channel(1);
+  wait_group.add();
+  const auto kTimeout = std::chrono::milliseconds(10);
+
+  auto check_timeouts = [&]() {
+    auto start = FiberScheduler::Clock::now();
+    EXPECT_FALSE(semaphore.try_acquire_for(kTimeout));
+    EXPECT_FALSE(wait_group.wait_for(kTimeout));
+    {
+      std::unique_lock<FiberMutex> lock(mutex);
+      EXPECT_EQ(std::cv_status::timeout, condition.wait_for(lock, kTimeout));
+      EXPECT_FALSE(condition.wait_for(lock, kTimeout, []() { return false; }));
+    }
+    int value;
+    EXPECT_FALSE(channel.receive_until(
+        &value, FiberScheduler::DeadlineAfter(kTimeout)));
+    EXPECT_TRUE(channel.try_send(1));
+    EXPECT_FALSE(
+        channel.send_until(2, FiberScheduler::DeadlineAfter(kTimeout)));
+    EXPECT_TRUE(channel.try_receive(&value));
+    EXPECT_LE(kTimeout * 6, FiberScheduler::Clock::now() - start);
+  };
+
+  // The fiber's timeouts must not block the worker, so a second fiber can
+  // hold the mutex the whole time.
+  std::atomic<bool> done(false);
+  auto holder = scheduler.Spawn([&]() {
+    std::lock_guard<FiberMutex> lock(mutex);
+    while (!done.load()) {
+      FiberScheduler::YieldFiber();
+    }
+  });
+  auto waiter = scheduler.Spawn([&]() {
+    EXPECT_FALSE(mutex.try_lock_for(kTimeout));
+    done.store(true);
+  });
+  scheduler.Join(waiter);
+  scheduler.Join(holder);
+
+  scheduler.Join(scheduler.Spawn(check_timeouts));
+  check_timeouts();
+}
+
+TEST(FiberSyncTests, WaitsWithDeadlinesCanBeWoken) {
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+  FiberSemaphore semaphore(0);
+  const int kNumWaiters = 50;
+  const auto kLongTimeout = std::chrono::seconds(30);
+
+  std::atomic<int> num_acquired(0);
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < kNumWaiters; ++i) {
+    fibers.push_back(scheduler.Spawn([&]() {
+      if (semaphore.try_acquire_for(kLongTimeout)) {
+        ++num_acquired;
+      }
+    }));
+  }
+  std::thread thread_waiter([&]() {
+    if (semaphore.try_acquire_for(kLongTimeout)) {
+      ++num_acquired;
+    }
+  });
+
+  auto start = FiberScheduler::Clock::now();
+  semaphore.release(kNumWaiters + 1);
+  JoinAll(&scheduler, fibers);
+  thread_waiter.join();
+
+  EXPECT_EQ(kNumWaiters + 1, num_acquired.load());
+  EXPECT_GT(kLongTimeout, FiberScheduler::Clock::now() - start);
+}
+
+TEST(FiberSyncTests, ManyFibersRaceWakesAgainstTimeouts) {
+  // Half of the waits are released around the time that they time out.
+  FiberScheduler scheduler(OptionsWithWorkers(2));
+  FiberSemaphore semaphore(0);
+  const int kNumWaiters = 200;
+
+  std::atomic<int> num_acquired(0);
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < kNumWaiters; ++i) {
+    fibers.push_back(scheduler.Spawn([&, i]() {
+      if (semaphore.try_acquire_for(std::chrono::milliseconds(i % 5))) {
+        ++num_acquired;
+      }
+    }));
+  }
+  for (int i = 0; i < kNumWaiters / 2; ++i) {
+    semaphore.release();
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+  }
+  JoinAll(&scheduler, fibers);
+
+  // Every release was either acquired, or is still available.
+  int num_left = 0;
+  while (semaphore.try_acquire()) {
+    ++num_left;
+  }
+  EXPECT_EQ(kNumWaiters / 2, num_acquired.load() + num_left);
+}
@@ -0,0 +1,52 @@
+#ifndef __PLATFORM_FILE_STATUS_H__
+#define __PLATFORM_FILE_STATUS_H__
+
+#include <cstdint>
+
+#include "stdext/span.h"
+
+namespace platform {
+
+// What StatFiles() found out about one path.
+struct FileStatus {
+  FileStatus()
+      : exists(false), error(0), modification_time_ns(0), size(0), inode(0),
+        device(0), is_directory(false) {}
+
+  // False if the path could not be stat()ed, in which case |error| is the
+  // errno value, such as ENOENT, and the other fields are zero.
+  bool exists;
+  int error;
+
+  // Nanoseconds since the Unix epoch.
+  int64_t modification_time_ns;
+  uint64_t size;
+  uint64_t inode;
+  // The device the file lives on, as returned in stat()'s st_dev.
+  uint64_t device;
+  bool is_directory;
+};
+
+struct StatFilesOptions {
+  StatFilesOptions() : max_threads(16), min_paths_per_thread(256) {}
+
+  // At most this many threads, including the calling one, stat the paths at
+  // once.  Many more than there are cores pays off on network file systems
+  // and cold caches, where each call mostly waits.
+  int max_threads;
+
+  // Small batches use fewer threads, so that starting them does not cost
+  // more than it saves.
+  int min_paths_per_thread;
+};
+
+// Fills |results[i]| with the status of |paths[i]|, following symbolic
+// links, as stat() would.  The paths are divided between a bounded number of
+// threads, each of which makes statx() calls.  Only available on Linux.
+void StatFiles(stdext::span<const char* const> paths,
+               stdext::span<FileStatus> results,
+               const StatFilesOptions& options = StatFilesOptions());
+
+}  // namespace platform
+
+#endif  // __PLATFORM_FILE_STATUS_H__
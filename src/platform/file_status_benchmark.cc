@@ -0,0 +1,92 @@
+#include "platform/file_status.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "platform/file_system.h"
+#include "stdext/file_system.h"
+
+// Compares checking the modification times of many files one at a time with
+// GetLastModificationTime() against checking them in one batch with
+// StatFiles().  Pass a directory on a network file system as the second
+// argument to see the effect of latency; by default the files are made in a
+// temporary directory.
+
+using platform::FileStatus;
+using platform::StatFiles;
+using platform::StatFilesOptions;
+
+namespace {
+
+template <typename Function>
+double MeasureSeconds(Function function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int num_files = 100000;
+  if (argc > 1) {
+    num_files = atoi(argv[1]);
+  }
+  stdext::file_system::TemporaryDirectory temporary_directory;
+  std::string directory = argc > 2 ? argv[2]
+                                   : temporary_directory.path().str();
+
+  std::vector<std::string> paths;
+  std::vector<const char*> c_paths;
+  paths.reserve(num_files);
+  for (int i = 0; i < num_files; ++i) {
+    paths.push_back(directory + "/file_status_benchmark_" +
+                    std::to_string(i));
+    int fd = open(paths.back().c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+      printf("Could not create %s\n", paths.back().c_str());
+      return 1;
+    }
+    close(fd);
+    c_paths.push_back(paths.back().c_str());
+  }
+  std::vector<FileStatus> results(num_files);
+
+  printf("Checking the modification times of %d files\n", num_files);
+  int num_found = 0;
+  double serial_seconds = MeasureSeconds([&]() {
+    for (const char* path : c_paths) {
+      if (platform::GetLastModificationTime(path)) {
+        ++num_found;
+      }
+    }
+  });
+  printf("  GetLastModificationTime() loop: %8.1f ms (%d found)\n",
+         serial_seconds * 1000, num_found);
+
+  for (int max_threads : {1, 4, 16, 64}) {
+    StatFilesOptions options;
+    options.max_threads = max_threads;
+    double seconds = MeasureSeconds([&]() {
+      StatFiles(stdext::make_span<const char* const>(c_paths.data(),
+                                                     c_paths.size()),
+                stdext::make_span(results.data(), results.size()), options);
+    });
+    printf("  StatFiles(), %2d threads:        %8.1f ms (%.1fx)\n",
+           max_threads, seconds * 1000, serial_seconds / seconds);
+  }
+
+  if (argc > 2) {
+    for (const std::string& path : paths) {
+      unlink(path.c_str());
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "platform/file_status.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::FileStatus;
+using platform::StatFiles;
+using platform::StatFilesOptions;
+
+namespace {
+void WriteFile(const std::string& path, size_t size) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(0, ftruncate(fd, size));
+  close(fd);
+}
+
+std::vector<FileStatus> Stat(const std::vector<std::string>& paths,
+                             const StatFilesOptions& options) {
+  std::vector<const char*> c_paths;
+  for (const std::string& path : paths) {
+    c_paths.push_back(path.c_str());
+  }
+  std::vector<FileStatus> results(paths.size());
+  StatFiles(stdext::make_span<const char* const>(c_paths.data(),
+                                                 c_paths.size()),
+            stdext::make_span(results.data(), results.size()), options);
+  return results;
+}
+
+void ExpectMatchesStat(const std::string& path, const FileStatus& result) {
+  struct stat status;
+  ASSERT_EQ(0, stat(path.c_str(), &status));
+  EXPECT_TRUE(result.exists);
+  EXPECT_EQ(0, result.error);
+  EXPECT_EQ(static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 +
+                status.st_mtim.tv_nsec,
+            result.modification_time_ns);
+  EXPECT_EQ(static_cast<uint64_t>(status.st_size), result.size);
+  EXPECT_EQ(status.st_ino, result.inode);
+  EXPECT_EQ(status.st_dev, result.device);
+  EXPECT_EQ(S_ISDIR(status.st_mode), result.is_directory);
+}
+}  // namespace
+
+TEST(FileStatusTests, ReportsWhatStatDoes) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string file = std::string(directory.path().c_str()) + "/file";
+  WriteFile(file, 1234);
+  std::string missing = std::string(directory.path().c_str()) + "/missing";
+
+  std::vector<FileStatus> results =
+      Stat({file, directory.path().str(), missing, file + "/not_a_directory"},
+           StatFilesOptions());
+  ExpectMatchesStat(file, results[0]);
+  EXPECT_EQ(1234u, results[0].size);
+  EXPECT_FALSE(results[0].is_directory);
+  ExpectMatchesStat(directory.path().str(), results[1]);
+  EXPECT_TRUE(results[1].is_directory);
+
+  EXPECT_FALSE(results[2].exists);
+  EXPECT_EQ(ENOENT, results[2].error);
+  EXPECT_EQ(0u, results[2].size);
+  EXPECT_FALSE(results[3].exists);
+  EXPECT_EQ(ENOTDIR, results[3].error);
+}
+
+TEST(FileStatusTests, ManyThreadsFillEveryResult) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::vector<std::string> paths;
+  for (int i = 0; i < 2000; ++i) {
+    paths.push_back(std::string(directory.path().c_str()) + "/" +
+                    std::to_string(i));
+    // Every other path is missing.
+    if (i % 2 == 0) {
+      WriteFile(paths.back(), i);
+    }
+  }
+
+  StatFilesOptions options;
+  options.max_threads = 8;
+  options.min_paths_per_thread = 1;
+  std::vector<FileStatus> results = Stat(paths, options);
+  for (int i = 0; i < 2000; ++i) {
+    if (i % 2 == 0) {
+      ExpectMatchesStat(paths[i], results[i]);
+      EXPECT_EQ(static_cast<uint64_t>(i), results[i].size);
+    } else {
+      EXPECT_FALSE(results[i].exists);
+    }
+  }
+}
+
+TEST(FileStatusTests, EmptyBatch) {
+  EXPECT_TRUE(Stat({}, StatFilesOptions()).empty());
+}
@@ -6,6 +6,7 @@
 #include <chrono>
 #include <functional>
 #include <string>
+#include <vector>
 
 namespace platform {
 
@@ -16,8 +17,105 @@ stdext::optional<::std::chrono::system_clock::time_point>
 
 stdext::optional<::std::string> MakeTemporaryDirectory();
 
+struct RemoveDirectoryTreeOptions {
+  RemoveDirectoryTreeOptions() : max_threads(8) {}
+
+  // The most threads, including the calling one, between which subtrees are
+  // shared out.  Extra threads are only started once there are subtrees
+  // waiting for them.  Ignored on Windows.
+  int max_threads;
+};
+
+struct RemoveDirectoryTreeError {
+  std::string path;
+  // The errno value, or on Windows the result of SHFileOperation().
+  int error;
+};
+
+// Removes |filepath| and everything below it, without following symbolic
+// links or crossing into other file systems.  Whatever can be removed is, and
+// if anything can not be, returns false and appends the reasons to |errors|
+// if it is given.
+bool RemoveDirectoryTree(const char* filepath,
+                         const RemoveDirectoryTreeOptions& options,
+                         std::vector<RemoveDirectoryTreeError>* errors);
 bool RemoveDirectoryTree(const char* filepath);
 
+// As above, but with |filepath|, and the paths of any errors, relative to the
+// directory |directory_fd|, as with unlinkat().  Only available on Linux.
+bool RemoveDirectoryTreeAt(int directory_fd, const char* filepath,
+                           const RemoveDirectoryTreeOptions& options,
+                           std::vector<RemoveDirectoryTreeError>* errors);
+
+// Removes |filepath| like RemoveDirectoryTree(), but on a background thread,
+// so that the caller need not wait however large the tree is.  It is first
+// renamed into a trash directory beside it, ".stdext_trash.<uid>", so that it
+// is gone from |filepath| on return.  The first time a process uses a trash
+// directory, whatever was left there by processes which have since exited is
+// removed too.  If |filepath| can not be renamed, or the trash directory is
+// not one which only the user could have made (it must be a directory owned
+// by them, with no permissions for anyone else), it is removed before
+// returning instead.  If that fails, false is returned, and the reasons are
+// appended to |errors| if it is given, or otherwise left for
+// FlushBackgroundRemovals() to report.  On Windows it is always removed
+// before returning.
+bool RemoveDirectoryTreeInBackground(
+    const char* filepath,
+    std::vector<RemoveDirectoryTreeError>* errors = nullptr);
+
+// Waits until everything passed to RemoveDirectoryTreeInBackground() so far
+// has been removed, for example before the process exits.  Returns false if
+// anything could not be, and appends the reasons to |errors| if it is given.
+// Each failure is only reported once.
+bool FlushBackgroundRemovals(
+    std::vector<RemoveDirectoryTreeError>* errors = nullptr);
+
+struct MapFileOptions {
+  enum Access {
+    kNormal,
+    // Read ahead aggressively, and drop pages soon after they are read.
+    kSequential,
+    // Do not read ahead.
+    kRandom,
+  };
+
+  MapFileOptions()
+      : access(kNormal), will_need(false), huge_pages(false),
+        populate(false) {}
+
+  // These are hints, given with madvise() on Linux, which are ignored where
+  // they are not supported.
+  Access access;
+  // Start reading the whole file in the background.
+  bool will_need;
+  // Back the mapping with transparent huge pages, for fewer TLB misses on
+  // large files.  Only some kernels and file systems support this.
+  bool huge_pages;
+
+  // Read the whole file in before returning, so that accessing it never
+  // waits for I/O, with MAP_POPULATE on Linux.
+  bool populate;
+};
+
+// The contents of a file in memory, as returned by MapFile().
+struct FileMapping {
+  const char* data;
+  size_t size;
+  // Whether the contents are mapped, rather than read into a buffer.
+  bool mapped;
+};
+
+// Maps the whole of |filepath| into memory read-only, so that its contents
+// can be read without being copied.  Files which can not be mapped, such as
+// pipes and those in /proc, are read into a buffer instead, and empty files
+// give an empty mapping.  Devices are neither, and fail with ENODEV.
+// Truncating a file while it is mapped makes reading the part which was cut
+// off crash.  Returns nothing, with errno set, if the file can not be opened
+// or read.
+stdext::optional<FileMapping> MapFile(const char* filepath,
+                                      const MapFileOptions& options);
+void UnmapFile(const FileMapping& mapping);
+
 // Returns the path of the executable file that spawned this process.
 std::string GetThisModulePath();
 
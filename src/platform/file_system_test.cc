@@ -0,0 +1,87 @@
+#include "platform/file_system.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::FileMapping;
+using platform::MapFile;
+using platform::MapFileOptions;
+using platform::UnmapFile;
+
+namespace {
+void WriteFile(const std::string& path, const std::string& contents) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+            write(fd, contents.data(), contents.size()));
+  close(fd);
+}
+}  // namespace
+
+TEST(FileSystemTests, MapFileWithHints) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string path = directory.path().str() + "/file";
+  std::string contents(3 * 1024 * 1024 + 17, 'x');
+  contents[12345] = 'y';
+  WriteFile(path, contents);
+
+  for (MapFileOptions::Access access :
+       {MapFileOptions::kNormal, MapFileOptions::kSequential,
+        MapFileOptions::kRandom}) {
+    MapFileOptions options;
+    options.access = access;
+    options.will_need = true;
+    options.huge_pages = true;
+    options.populate = true;
+    stdext::optional<FileMapping> mapping = MapFile(path.c_str(), options);
+    ASSERT_TRUE(mapping);
+    EXPECT_TRUE(mapping->mapped);
+    EXPECT_EQ(contents, std::string(mapping->data, mapping->size));
+    UnmapFile(*mapping);
+  }
+}
+
+TEST(FileSystemTests, MapFileReadsFilesWhichCanNotBeMapped) {
+  // Files in /proc claim to be empty.
+  stdext::optional<FileMapping> mapping =
+      MapFile("/proc/self/status", MapFileOptions());
+  ASSERT_TRUE(mapping);
+  EXPECT_FALSE(mapping->mapped);
+  EXPECT_NE(std::string::npos,
+            std::string(mapping->data, mapping->size).find("Pid:"));
+  UnmapFile(*mapping);
+
+  // Pipes can not be mapped at all.
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string fifo = directory.path().str() + "/fifo";
+  ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+  std::string contents(200 * 1024, 'z');
+  std::thread writer([&]() { WriteFile(fifo, contents); });
+  mapping = MapFile(fifo.c_str(), MapFileOptions());
+  writer.join();
+  ASSERT_TRUE(mapping);
+  EXPECT_FALSE(mapping->mapped);
+  EXPECT_EQ(contents, std::string(mapping->data, mapping->size));
+  UnmapFile(*mapping);
+}
+
+TEST(FileSystemTests, MapFileReportsErrors) {
+  errno = 0;
+  EXPECT_FALSE(MapFile("/does/not/exist", MapFileOptions()));
+  EXPECT_EQ(ENOENT, errno);
+
+  // Rather than reading forever.
+  errno = 0;
+  EXPECT_FALSE(MapFile("/dev/zero", MapFileOptions()));
+  EXPECT_EQ(ENODEV, errno);
+}
@@ -0,0 +1,29 @@
+#ifndef __PLATFORM_FUTEX_H__
+#define __PLATFORM_FUTEX_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace platform {
+
+// Blocks the calling thread for as long as |*address| is equal to
+// |expected|, until another thread calls FutexWake() on the same address.
+// The check and the sleep are atomic with respect to FutexWake().  Like all
+// futex waits this may return spuriously, so callers must re-check their
+// condition in a loop.
+void FutexWait(std::atomic<uint32_t>* address, uint32_t expected);
+
+// As FutexWait(), but also returns once |deadline| has passed.
+void FutexWaitUntil(std::atomic<uint32_t>* address, uint32_t expected,
+                    std::chrono::steady_clock::time_point deadline);
+
+// Wakes up to |count| threads blocked in FutexWait() on |address|.
+void FutexWake(std::atomic<uint32_t>* address, int count);
+
+// Wakes every thread blocked in FutexWait() on |address|.
+void FutexWakeAll(std::atomic<uint32_t>* address);
+
+}  // namespace platform
+
+#endif  // __PLATFORM_FUTEX_H__
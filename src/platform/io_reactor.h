@@ -0,0 +1,131 @@
+#ifndef __PLATFORM_IO_REACTOR_H__
+#define __PLATFORM_IO_REACTOR_H__
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "platform/fiber_sync.h"
+
+namespace platform {
+
+// Lets fibers use blocking-style reads and writes on sockets and pipes
+// without blocking their worker thread.  Registered file descriptors are put
+// into non-blocking mode and added to an edge-triggered epoll set, which a
+// single poller thread waits on.  An operation that would block suspends the
+// calling fiber until the poller sees the descriptor become ready again, so
+// one worker thread can serve as many connections as it has fibers.
+//
+// Operations may also be called from plain threads, which block as usual.
+// Since a fiber may come back from an operation on a different thread, read
+// errno through a function that the compiler can not see into, as with any
+// other thread local (see FiberScheduler).  Only available on Linux.
+class IoReactor {
+ public:
+  class Handle;
+
+  struct Options {
+    Options();
+
+    // The maximum number of readiness events collected by each call to
+    // epoll_wait().
+    int max_events_per_wait;
+  };
+
+  IoReactor();
+  explicit IoReactor(const Options& options);
+  IoReactor(const IoReactor&) = delete;
+  IoReactor& operator=(const IoReactor&) = delete;
+
+  // Every handle must have been unregistered by now.
+  ~IoReactor();
+
+  // Returns false if the reactor could not be set up.
+  bool IsValid() const { return epoll_fd_ >= 0; }
+
+  // Puts |fd| into non-blocking mode and starts watching it.  Returns null,
+  // with errno set, on failure.  The caller keeps ownership of |fd|.
+  Handle* Register(int fd);
+
+  // Stops watching the handle's descriptor and frees |handle|.  No operation
+  // on |handle| may be in progress.  The descriptor is not closed.
+  void Unregister(Handle* handle);
+
+  // If epoll_wait() failed with anything other than EINTR, the poller thread
+  // has stopped, and this is its errno value.  Operations which would wait
+  // fail with it instead, and so does Register().  Otherwise 0.  The failure
+  // is not logged, so it is up to callers to report it.
+  int poller_error() const { return poller_error_.load(); }
+
+ private:
+  void PollerMain();
+
+  // Stops the poller after epoll_wait() failed with |error|, and wakes every
+  // waiting operation so that it sees the failure.
+  void FailPoller(int error);
+
+  const Options options_;
+  int epoll_fd_;
+  // Written to in order to wake up the poller thread for shutdown.
+  int wake_fd_;
+  std::atomic<bool> shutting_down_;
+  std::atomic<int> poller_error_;
+  std::thread poller_thread_;
+
+  std::mutex handles_mutex_;
+  // Handles which are registered, for FailPoller() to wake.
+  std::unordered_set<Handle*> live_handles_;
+  // Handles which have been unregistered but which an event batch in flight
+  // may still refer to.  They are freed by the poller between batches.
+  Handle* retired_handles_;
+};
+
+// A descriptor registered with an IoReactor.  The operations behave like the
+// POSIX functions of the same name, returning -1 and setting errno on
+// failure, except that they wait for the descriptor to become ready instead
+// of failing with EAGAIN.
+class IoReactor::Handle {
+ public:
+  int fd() const { return fd_; }
+
+  ssize_t Read(void* buffer, size_t size);
+  ssize_t Write(const void* buffer, size_t size);
+
+  // The returned descriptor is non-blocking and close-on-exec, ready to be
+  // registered.
+  int Accept(sockaddr* address, socklen_t* address_length);
+
+  int Connect(const sockaddr* address, socklen_t address_length);
+
+ private:
+  friend class IoReactor;
+
+  Handle(IoReactor* reactor, int fd)
+      : reactor_(reactor), fd_(fd), read_sequence_(0), write_sequence_(0),
+        next_retired_(nullptr) {}
+  Handle(const Handle&) = delete;
+  Handle& operator=(const Handle&) = delete;
+
+  IoReactor* const reactor_;
+  const int fd_;
+
+  // Bumped by the poller each time the descriptor becomes readable or
+  // writable.  An operation that fails with EAGAIN waits for the sequence
+  // number that it read before trying to change.
+  std::atomic<uint32_t> read_sequence_;
+  std::atomic<uint32_t> write_sequence_;
+  FiberWaitQueue read_waiters_;
+  FiberWaitQueue write_waiters_;
+
+  Handle* next_retired_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_IO_REACTOR_H__
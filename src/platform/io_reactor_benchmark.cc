@@ -0,0 +1,175 @@
+#include "platform/io_reactor.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "platform/fiber_scheduler.h"
+
+// Measures IoReactor throughput with fibers on a single worker thread: the
+// round trip rate of many concurrent ping-pong connections, and the bulk
+// transfer rate of a single connection.
+
+using platform::FiberScheduler;
+using platform::IoReactor;
+
+namespace {
+
+struct Connection {
+  int fds[2];
+  IoReactor::Handle* handles[2];
+};
+
+void DestroyConnections(IoReactor* reactor,
+                        std::vector<Connection>* connections) {
+  for (auto& connection : *connections) {
+    for (int i = 0; i < 2; ++i) {
+      reactor->Unregister(connection.handles[i]);
+      close(connection.fds[i]);
+    }
+  }
+  connections->clear();
+}
+
+bool MakeConnections(IoReactor* reactor, int count,
+                     std::vector<Connection>* connections) {
+  for (int i = 0; i < count; ++i) {
+    Connection connection;
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0,
+                   connection.fds) != 0) {
+      DestroyConnections(reactor, connections);
+      return false;
+    }
+    connection.handles[0] = reactor->Register(connection.fds[0]);
+    connection.handles[1] = reactor->Register(connection.fds[1]);
+    connections->push_back(connection);
+  }
+  return true;
+}
+
+bool TransferExactly(IoReactor::Handle* handle, char* buffer, size_t size,
+                     bool write) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t result = write ? handle->Write(buffer + done, size - done)
+                           : handle->Read(buffer + done, size - done);
+    if (result <= 0) {
+      return false;
+    }
+    done += result;
+  }
+  return true;
+}
+
+// Returns -1 if the sockets could not be created, which is usually due to
+// the open file limit.
+double MeasureRoundTrips(int num_connections, int round_trips) {
+  IoReactor reactor;
+  FiberScheduler::Options options;
+  options.num_workers = 1;
+  FiberScheduler scheduler(options);
+  std::vector<Connection> connections;
+  if (!MakeConnections(&reactor, num_connections, &connections)) {
+    return -1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (auto& connection : connections) {
+    IoReactor::Handle* client = connection.handles[0];
+    IoReactor::Handle* server = connection.handles[1];
+    fibers.push_back(scheduler.Spawn([client, round_trips]() {
+      char message[64] = {0};
+      for (int i = 0; i < round_trips; ++i) {
+        TransferExactly(client, message, sizeof(message), true);
+        TransferExactly(client, message, sizeof(message), false);
+      }
+    }));
+    fibers.push_back(scheduler.Spawn([server, round_trips]() {
+      char message[64];
+      for (int i = 0; i < round_trips; ++i) {
+        TransferExactly(server, message, sizeof(message), false);
+        TransferExactly(server, message, sizeof(message), true);
+      }
+    }));
+  }
+  for (auto& fiber : fibers) {
+    scheduler.Join(fiber);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  DestroyConnections(&reactor, &connections);
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return static_cast<double>(num_connections) * round_trips / seconds;
+}
+
+double MeasureBulkTransfer(size_t total_bytes) {
+  const size_t kChunkSize = 64 * 1024;
+  IoReactor reactor;
+  FiberScheduler::Options options;
+  options.num_workers = 1;
+  FiberScheduler scheduler(options);
+  std::vector<Connection> connections;
+  if (!MakeConnections(&reactor, 1, &connections)) {
+    return -1;
+  }
+  IoReactor::Handle* writer_handle = connections[0].handles[0];
+  IoReactor::Handle* reader_handle = connections[0].handles[1];
+
+  auto start = std::chrono::steady_clock::now();
+  auto writer = scheduler.Spawn([writer_handle, total_bytes, kChunkSize]() {
+    std::vector<char> chunk(kChunkSize, 'x');
+    for (size_t sent = 0; sent < total_bytes; sent += kChunkSize) {
+      TransferExactly(writer_handle, chunk.data(), kChunkSize, true);
+    }
+  });
+  auto reader = scheduler.Spawn([reader_handle, total_bytes, kChunkSize]() {
+    std::vector<char> chunk(kChunkSize);
+    for (size_t received = 0; received < total_bytes;
+         received += kChunkSize) {
+      TransferExactly(reader_handle, chunk.data(), kChunkSize, false);
+    }
+  });
+  scheduler.Join(writer);
+  scheduler.Join(reader);
+  auto end = std::chrono::steady_clock::now();
+
+  DestroyConnections(&reactor, &connections);
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return total_bytes / seconds / (1024 * 1024);
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int max_connections = 10000;
+  if (argc > 1) {
+    max_connections = atoi(argv[1]);
+  }
+
+  printf("64 byte ping-pong on one worker\n");
+  for (int num_connections = 1; num_connections <= max_connections;
+       num_connections *= 10) {
+    int round_trips = 100000 / num_connections;
+    if (round_trips < 10) {
+      round_trips = 10;
+    }
+    double rate = MeasureRoundTrips(num_connections, round_trips);
+    if (rate < 0) {
+      printf("  %6d connections: could not create sockets\n",
+             num_connections);
+      break;
+    }
+    printf("  %6d connections: %12.0f round trips/s\n", num_connections,
+           rate);
+  }
+
+  printf("Bulk transfer on one worker: %.0f MiB/s\n",
+         MeasureBulkTransfer(1024 * 1024 * 1024));
+
+  return 0;
+}
@@ -0,0 +1,352 @@
+#include "platform/io_reactor.h"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "platform/fiber_scheduler.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::FiberScheduler;
+using platform::IoReactor;
+
+namespace {
+FiberScheduler::Options OptionsWithWorkers(int num_workers) {
+  FiberScheduler::Options options;
+  options.num_workers = num_workers;
+  return options;
+}
+
+bool WriteAll(IoReactor::Handle* handle, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t result =
+        handle->Write(data.data() + written, data.size() - written);
+    if (result <= 0) {
+      return false;
+    }
+    written += result;
+  }
+  return true;
+}
+
+std::string ReadExactly(IoReactor::Handle* handle, size_t size) {
+  std::string data(size, '\0');
+  size_t read = 0;
+  while (read < size) {
+    ssize_t result = handle->Read(&data[read], size - read);
+    if (result <= 0) {
+      break;
+    }
+    read += result;
+  }
+  data.resize(read);
+  return data;
+}
+
+// Returns the descriptors of this process's epoll sets.
+std::set<int> EpollDescriptors() {
+  std::set<int> fds;
+  DIR* dir = opendir("/proc/self/fd");
+  while (struct dirent* dirent = dir ? readdir(dir) : nullptr) {
+    std::string link = std::string("/proc/self/fd/") + dirent->d_name;
+    char target[64];
+    ssize_t size = readlink(link.c_str(), target, sizeof(target) - 1);
+    if (size > 0 &&
+        std::string(target, size) == "anon_inode:[eventpoll]") {
+      fds.insert(atoi(dirent->d_name));
+    }
+  }
+  if (dir) {
+    closedir(dir);
+  }
+  return fds;
+}
+
+// A connected pair of sockets, each registered with |reactor|.
+struct SocketPair {
+  explicit SocketPair(IoReactor* reactor) : reactor(reactor) {
+    int fds[2];
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds));
+    first = reactor->Register(fds[0]);
+    second = reactor->Register(fds[1]);
+  }
+  ~SocketPair() {
+    CloseFirst();
+    int second_fd = second->fd();
+    reactor->Unregister(second);
+    close(second_fd);
+  }
+  void CloseFirst() {
+    if (first) {
+      int first_fd = first->fd();
+      reactor->Unregister(first);
+      close(first_fd);
+      first = nullptr;
+    }
+  }
+
+  IoReactor* reactor;
+  IoReactor::Handle* first;
+  IoReactor::Handle* second;
+};
+}  // namespace
+
+TEST(IoReactorTests, RegisterFailsForBadDescriptor) {
+  IoReactor reactor;
+  ASSERT_TRUE(reactor.IsValid());
+  EXPECT_EQ(nullptr, reactor.Register(-1));
+}
+
+TEST(IoReactorTests, PollerFailureFailsWaitingOperations) {
+  std::set<int> other_epoll_fds = EpollDescriptors();
+  IoReactor reactor;
+  ASSERT_TRUE(reactor.IsValid());
+  SocketPair wake(&reactor);
+  SocketPair blocked(&reactor);
+
+  std::atomic<ssize_t> result(0);
+  std::atomic<int> error(0);
+  std::thread reader([&]() {
+    char c;
+    ssize_t read = blocked.second->Read(&c, 1);
+    error = errno;
+    result = read;
+  });
+
+  // Replace the reactor's epoll set with something else, so that the next
+  // epoll_wait() fails with EINVAL, and wake the poller so that it calls it.
+  int epoll_fd = -1;
+  for (int fd : EpollDescriptors()) {
+    if (!other_epoll_fds.count(fd)) {
+      epoll_fd = fd;
+    }
+  }
+  ASSERT_LE(0, epoll_fd);
+  int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  ASSERT_EQ(epoll_fd, dup3(null_fd, epoll_fd, O_CLOEXEC));
+  close(null_fd);
+  EXPECT_TRUE(WriteAll(wake.first, "x"));
+
+  reader.join();
+  EXPECT_EQ(-1, result.load());
+  EXPECT_EQ(EINVAL, error.load());
+  EXPECT_EQ(EINVAL, reactor.poller_error());
+  EXPECT_EQ(nullptr, reactor.Register(wake.first->fd()));
+}
+
+TEST(IoReactorTests, BlockedReadDoesNotBlockWorker) {
+  IoReactor reactor;
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  SocketPair sockets(&reactor);
+
+  // The reader runs first and has to wait for the writer, which can only run
+  // if the reader gave up the only worker.
+  std::string received;
+  auto reader = scheduler.Spawn([&]() {
+    received = ReadExactly(sockets.second, 5);
+  });
+  auto writer = scheduler.Spawn([&]() {
+    EXPECT_TRUE(WriteAll(sockets.first, "hello"));
+  });
+  scheduler.Join(reader);
+  scheduler.Join(writer);
+
+  EXPECT_EQ("hello", received);
+}
+
+TEST(IoReactorTests, ThreadsCanUseHandles) {
+  IoReactor reactor;
+  SocketPair sockets(&reactor);
+
+  std::string received;
+  std::thread reader([&]() { received = ReadExactly(sockets.second, 5); });
+  EXPECT_TRUE(WriteAll(sockets.first, "hello"));
+  reader.join();
+
+  EXPECT_EQ("hello", received);
+}
+
+TEST(IoReactorTests, ReadReturnsZeroAtEndOfStream) {
+  IoReactor reactor;
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  SocketPair sockets(&reactor);
+
+  ssize_t result = -1;
+  auto reader = scheduler.Spawn([&]() {
+    char byte;
+    result = sockets.second->Read(&byte, 1);
+  });
+  auto closer = scheduler.Spawn([&]() { sockets.CloseFirst(); });
+  scheduler.Join(reader);
+  scheduler.Join(closer);
+
+  EXPECT_EQ(0, result);
+}
+
+TEST(IoReactorTests, WriteWaitsForReaderToDrainBuffer) {
+  const size_t kSize = 4 * 1024 * 1024;
+  IoReactor reactor;
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+  SocketPair sockets(&reactor);
+
+  // Much more than fits in the socket buffers.
+  std::string sent(kSize, 'x');
+  for (size_t i = 0; i < kSize; ++i) {
+    sent[i] = static_cast<char>(i * 7);
+  }
+  std::string received;
+  auto writer = scheduler.Spawn([&]() {
+    EXPECT_TRUE(WriteAll(sockets.first, sent));
+  });
+  auto reader = scheduler.Spawn([&]() {
+    received = ReadExactly(sockets.second, kSize);
+  });
+  scheduler.Join(writer);
+  scheduler.Join(reader);
+
+  EXPECT_TRUE(sent == received);
+}
+
+TEST(IoReactorTests, LoopbackTcpEcho) {
+  IoReactor reactor;
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ASSERT_LE(0, listen_fd);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+  ASSERT_EQ(0, bind(listen_fd, reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)));
+  ASSERT_EQ(0, listen(listen_fd, 16));
+  socklen_t address_length = sizeof(address);
+  ASSERT_EQ(0, getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address),
+                           &address_length));
+  IoReactor::Handle* listener = reactor.Register(listen_fd);
+  ASSERT_NE(nullptr, listener);
+
+  const int kNumClients = 8;
+  auto server = scheduler.Spawn([&]() {
+    std::vector<std::shared_ptr<FiberScheduler::Fiber>> connections;
+    for (int i = 0; i < kNumClients; ++i) {
+      int connection_fd = listener->Accept(nullptr, nullptr);
+      ASSERT_LE(0, connection_fd);
+      connections.push_back(scheduler.Spawn([&reactor, connection_fd]() {
+        IoReactor::Handle* connection = reactor.Register(connection_fd);
+        char buffer[256];
+        ssize_t size;
+        while ((size = connection->Read(buffer, sizeof(buffer))) > 0) {
+          WriteAll(connection, std::string(buffer, size));
+        }
+        reactor.Unregister(connection);
+        close(connection_fd);
+      }));
+    }
+    for (auto& connection : connections) {
+      scheduler.Join(connection);
+    }
+  });
+
+  std::atomic<int> num_echoed(0);
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> clients;
+  for (int i = 0; i < kNumClients; ++i) {
+    clients.push_back(scheduler.Spawn([&, i]() {
+      int client_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      IoReactor::Handle* client = reactor.Register(client_fd);
+      ASSERT_NE(nullptr, client);
+      ASSERT_EQ(0, client->Connect(reinterpret_cast<sockaddr*>(&address),
+                                   sizeof(address)));
+      std::string message = "message " + std::to_string(i);
+      EXPECT_TRUE(WriteAll(client, message));
+      if (ReadExactly(client, message.size()) == message) {
+        ++num_echoed;
+      }
+      reactor.Unregister(client);
+      close(client_fd);
+    }));
+  }
+  for (auto& client : clients) {
+    scheduler.Join(client);
+  }
+  scheduler.Join(server);
+  reactor.Unregister(listener);
+  close(listen_fd);
+
+  EXPECT_EQ(kNumClients, num_echoed.load());
+}
+
+TEST(IoReactorTests, ConnectReportsRefusedConnection) {
+  IoReactor reactor;
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+
+  // Find a port with nothing listening on it.
+  int unused_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(0, bind(unused_fd, reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)));
+  socklen_t address_length = sizeof(address);
+  ASSERT_EQ(0, getsockname(unused_fd, reinterpret_cast<sockaddr*>(&address),
+                           &address_length));
+
+  int result = 0;
+  auto client = scheduler.Spawn([&]() {
+    int client_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    IoReactor::Handle* handle = reactor.Register(client_fd);
+    result = handle->Connect(reinterpret_cast<sockaddr*>(&address),
+                             sizeof(address));
+    reactor.Unregister(handle);
+    close(client_fd);
+  });
+  scheduler.Join(client);
+  close(unused_fd);
+
+  EXPECT_EQ(-1, result);
+}
+
+TEST(IoReactorTests, ManyBlockedReadersOnOneWorker) {
+  const int kNumPairs = 500;
+  IoReactor reactor;
+  FiberScheduler scheduler(OptionsWithWorkers(1));
+
+  std::vector<std::unique_ptr<SocketPair>> pairs;
+  for (int i = 0; i < kNumPairs; ++i) {
+    pairs.emplace_back(new SocketPair(&reactor));
+  }
+
+  std::atomic<int> num_received(0);
+  std::vector<std::shared_ptr<FiberScheduler::Fiber>> fibers;
+  for (int i = 0; i < kNumPairs; ++i) {
+    fibers.push_back(scheduler.Spawn([&, i]() {
+      if (ReadExactly(pairs[i]->second, 4) == "ping") {
+        ++num_received;
+      }
+    }));
+  }
+  for (int i = 0; i < kNumPairs; ++i) {
+    fibers.push_back(scheduler.Spawn([&, i]() {
+      WriteAll(pairs[i]->first, "ping");
+    }));
+  }
+  for (auto& fiber : fibers) {
+    scheduler.Join(fiber);
+  }
+
+  EXPECT_EQ(kNumPairs, num_received.load());
+}
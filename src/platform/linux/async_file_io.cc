@@ -0,0 +1,725 @@
+#include "platform/async_file_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "platform/fiber_scheduler.h"
+#include "platform/futex.h"
+
+namespace platform {
+
+struct AsyncFileIo::Request {
+  enum Operation {
+    kRead,
+    kWrite,
+    kOpenAt,
+    kStatx,
+    kFsync,
+  };
+
+  Operation operation;
+  int fd;
+  const char* path;
+  void* buffer;
+  size_t size;
+  uint64_t offset;
+  int flags;
+  // The mode for kOpenAt, or the mask for kStatx.
+  unsigned mode_or_mask;
+  struct statx* statx_result;
+
+  Backend* backend;
+  int64_t result;
+  // The waiting fiber, or null if a thread is waiting.
+  FiberScheduler::Fiber* fiber;
+  // Set to 1 when a waiting thread's request completes.
+  std::atomic<uint32_t> done;
+
+  Request* next;
+};
+
+class AsyncFileIo::Backend {
+ public:
+  virtual ~Backend() {}
+  virtual BackendType type() const = 0;
+
+  // Starts executing |request|, and calls Complete() on it once it is done.
+  virtual void Submit(Request* request) = 0;
+};
+
+namespace {
+
+typedef AsyncFileIo::Request Request;
+
+// A single read or write never transfers more than this, as with read(2).
+const size_t kMaxTransferSize = 0x7ffff000;
+
+void Complete(Request* request, int64_t result) {
+  request->result = result;
+  if (request->fiber) {
+    // The request lives on the fiber's stack, so it may be gone as soon as
+    // the fiber is ready.
+    FiberScheduler::Ready(request->fiber);
+  } else {
+    request->done.store(1, std::memory_order_release);
+    FutexWake(&request->done, 1);
+  }
+}
+
+int64_t ExecuteSynchronously(const Request& request) {
+  int64_t result = -1;
+  switch (request.operation) {
+    case Request::kRead:
+      result = pread(request.fd, request.buffer,
+                     std::min(request.size, kMaxTransferSize),
+                     request.offset);
+      break;
+    case Request::kWrite:
+      result = pwrite(request.fd, request.buffer,
+                      std::min(request.size, kMaxTransferSize),
+                      request.offset);
+      break;
+    case Request::kOpenAt:
+      result = openat(request.fd, request.path, request.flags,
+                      static_cast<mode_t>(request.mode_or_mask));
+      break;
+    case Request::kStatx:
+      result = statx(request.fd, request.path, request.flags,
+                     request.mode_or_mask, request.statx_result);
+      break;
+    case Request::kFsync:
+      result = request.flags ? fdatasync(request.fd) : fsync(request.fd);
+      break;
+  }
+  return result < 0 ? -errno : result;
+}
+
+// Runs requests synchronously on a fixed set of threads.
+class ThreadPoolBackend : public AsyncFileIo::Backend {
+ public:
+  explicit ThreadPoolBackend(int num_threads)
+      : stopping_(false), head_(nullptr), tail_(nullptr) {
+    for (int i = 0; i < std::max(num_threads, 1); ++i) {
+      threads_.emplace_back(&ThreadPoolBackend::ThreadMain, this);
+    }
+  }
+
+  ~ThreadPoolBackend() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    has_requests_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  AsyncFileIo::BackendType type() const override {
+    return AsyncFileIo::kThreadPool;
+  }
+
+  void Submit(Request* request) override {
+    request->next = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (tail_) {
+        tail_->next = request;
+      } else {
+        head_ = request;
+      }
+      tail_ = request;
+    }
+    has_requests_.notify_one();
+  }
+
+ private:
+  void ThreadMain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      has_requests_.wait(lock, [this]() { return stopping_ || head_; });
+      if (!head_) {
+        return;
+      }
+      Request* request = head_;
+      head_ = head_->next;
+      if (!head_) {
+        tail_ = nullptr;
+      }
+
+      lock.unlock();
+      Complete(request, ExecuteSynchronously(*request));
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable has_requests_;
+  bool stopping_;
+  Request* head_;
+  Request* tail_;
+  std::vector<std::thread> threads_;
+};
+
+int IoUringSetup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int IoUringRegister(int ring_fd, unsigned opcode, void* arg,
+                    unsigned num_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, ring_fd, opcode, arg, num_args));
+}
+
+// The ring indices are shared with the kernel.
+unsigned LoadAcquire(const unsigned* index) {
+  return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* index, unsigned value) {
+  __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+// Submits requests to an io_uring from a dedicated thread, which also reaps
+// their completions.  Requests are collected in a pending list while the ring
+// thread is busy, and then all submitted together.  The ring thread always
+// keeps a read of |doorbell_fd_| in flight, so that it can sleep in
+// io_uring_enter() and still be woken when new requests arrive.  If
+// io_uring_enter() fails for any reason other than a transient one, the ring
+// is stopped, and every request which the kernel does not have yet fails
+// with the error.
+class IoUringBackend : public AsyncFileIo::Backend {
+ public:
+  // Returns null if io_uring is unavailable or does not support all of the
+  // operations that we need.
+  static std::unique_ptr<IoUringBackend> Create(unsigned queue_depth);
+
+  ~IoUringBackend() override;
+
+  AsyncFileIo::BackendType type() const override {
+    return AsyncFileIo::kIoUring;
+  }
+
+  void Submit(Request* request) override;
+
+ private:
+  IoUringBackend()
+      : ring_fd_(-1), doorbell_fd_(-1), sq_ring_(MAP_FAILED), sq_ring_size_(0),
+        cq_ring_(MAP_FAILED), cq_ring_size_(0), sqes_(nullptr),
+        sqes_size_(0), shutting_down_(false), pending_head_(nullptr),
+        pending_tail_(nullptr), ring_error_(0), doorbell_value_(0) {}
+
+  bool Initialize(unsigned queue_depth);
+  bool SupportsRequiredOperations();
+  void RingThreadMain();
+  // Moves as many pending requests into the submission queue as there is
+  // room for.  Returns the number of entries queued.
+  unsigned QueuePendingRequests(unsigned* in_flight);
+  io_uring_sqe* NextSqe();
+  void ReapCompletions(unsigned* in_flight, bool* doorbell_armed);
+  // Stops the ring after io_uring_enter() failed with |error|.  Fails the
+  // requests which were not submitted, and waits for the kernel to finish
+  // those which were, since it still has their buffers.
+  void FailRing(int error, unsigned* in_flight, bool* doorbell_armed);
+
+  int ring_fd_;
+  int doorbell_fd_;
+
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  unsigned cq_entries_;
+  io_uring_cqe* cqes_;
+
+  std::thread ring_thread_;
+  std::atomic<bool> shutting_down_;
+
+  std::mutex pending_mutex_;
+  Request* pending_head_;
+  Request* pending_tail_;
+  // Set once the ring has been stopped, after which requests fail with it
+  // straight away.
+  int ring_error_;
+
+  // Only touched by the kernel, while the doorbell read is in flight.
+  uint64_t doorbell_value_;
+};
+
+// Identifies the doorbell read's completion.
+const uint64_t kDoorbellUserData = 0;
+
+std::unique_ptr<IoUringBackend> IoUringBackend::Create(
+    unsigned queue_depth) {
+  std::unique_ptr<IoUringBackend> backend(new IoUringBackend());
+  if (!backend->Initialize(queue_depth)) {
+    return nullptr;
+  }
+  backend->ring_thread_ =
+      std::thread(&IoUringBackend::RingThreadMain, backend.get());
+  return backend;
+}
+
+bool IoUringBackend::Initialize(unsigned queue_depth) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = IoUringSetup(queue_depth, &params);
+  if (ring_fd_ < 0) {
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  char* sq_ring = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+  sq_entries_ =
+      *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_entries);
+  // Submission queue entries are always used in order, so the indirection
+  // array can be set up once.
+  unsigned* sq_array =
+      reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+  for (unsigned i = 0; i < sq_entries_; ++i) {
+    sq_array[i] = i;
+  }
+
+  char* cq_ring = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+  cq_entries_ =
+      *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_entries);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+
+  if (!SupportsRequiredOperations()) {
+    return false;
+  }
+
+  doorbell_fd_ = eventfd(0, EFD_CLOEXEC);
+  return doorbell_fd_ >= 0;
+}
+
+bool IoUringBackend::SupportsRequiredOperations() {
+  const int kMaxOperations = 256;
+  std::vector<char> probe_storage(
+      sizeof(io_uring_probe) + kMaxOperations * sizeof(io_uring_probe_op));
+  io_uring_probe* probe =
+      reinterpret_cast<io_uring_probe*>(probe_storage.data());
+  if (IoUringRegister(ring_fd_, IORING_REGISTER_PROBE, probe,
+                      kMaxOperations) != 0) {
+    return false;
+  }
+
+  const int kRequiredOperations[] = {
+    IORING_OP_READ,
+    IORING_OP_WRITE,
+    IORING_OP_OPENAT,
+    IORING_OP_STATX,
+    IORING_OP_FSYNC,
+  };
+  for (int operation : kRequiredOperations) {
+    if (operation > probe->last_op ||
+        !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+IoUringBackend::~IoUringBackend() {
+  if (ring_thread_.joinable()) {
+    shutting_down_.store(true);
+    uint64_t one = 1;
+    ssize_t written = write(doorbell_fd_, &one, sizeof(one));
+    (void)written;
+    ring_thread_.join();
+  }
+
+  if (sqes_) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (doorbell_fd_ >= 0) {
+    close(doorbell_fd_);
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+  }
+}
+
+void IoUringBackend::Submit(Request* request) {
+  request->next = nullptr;
+  bool was_empty;
+  int ring_error;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    ring_error = ring_error_;
+    if (!ring_error) {
+      was_empty = !pending_head_;
+      if (pending_tail_) {
+        pending_tail_->next = request;
+      } else {
+        pending_head_ = request;
+      }
+      pending_tail_ = request;
+    }
+  }
+  if (ring_error) {
+    Complete(request, -ring_error);
+    return;
+  }
+
+  // If the list was not empty then someone has already rung the doorbell,
+  // and the ring thread will pick this request up along with theirs.
+  if (was_empty) {
+    uint64_t one = 1;
+    ssize_t written = write(doorbell_fd_, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+void IoUringBackend::RingThreadMain() {
+  unsigned in_flight = 0;
+  bool doorbell_armed = false;
+
+  while (true) {
+    bool shutting_down = shutting_down_.load();
+    unsigned to_submit = QueuePendingRequests(&in_flight);
+
+    if (!doorbell_armed && !shutting_down) {
+      io_uring_sqe* sqe = NextSqe();
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = doorbell_fd_;
+      sqe->addr = reinterpret_cast<uint64_t>(&doorbell_value_);
+      sqe->len = sizeof(doorbell_value_);
+      sqe->user_data = kDoorbellUserData;
+      ++to_submit;
+      doorbell_armed = true;
+    }
+
+    if (shutting_down && !doorbell_armed && in_flight == 0 && to_submit == 0) {
+      std::lock_guard<std::mutex> lock(pending_mutex_);
+      if (!pending_head_) {
+        return;
+      }
+      continue;
+    }
+
+    int result = IoUringEnter(ring_fd_, to_submit, 1,
+                              IORING_ENTER_GETEVENTS);
+    if (result < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+      FailRing(errno, &in_flight, &doorbell_armed);
+      return;
+    }
+    // Otherwise, even if it failed, we should just reap what we have and try
+    // again.
+    ReapCompletions(&in_flight, &doorbell_armed);
+  }
+}
+
+void IoUringBackend::FailRing(int error, unsigned* in_flight,
+                              bool* doorbell_armed) {
+  // Take back the entries which the kernel did not consume.
+  unsigned head = LoadAcquire(sq_head_);
+  unsigned tail = *sq_tail_;
+  for (; head != tail; ++head) {
+    uint64_t user_data = sqes_[head & sq_mask_].user_data;
+    if (user_data == kDoorbellUserData) {
+      *doorbell_armed = false;
+      continue;
+    }
+    --*in_flight;
+    Complete(reinterpret_cast<Request*>(user_data), -error);
+  }
+  StoreRelease(sq_tail_, head);
+
+  Request* pending;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    ring_error_ = error;
+    pending = pending_head_;
+    pending_head_ = pending_tail_ = nullptr;
+  }
+  while (pending) {
+    Request* request = pending;
+    pending = pending->next;
+    Complete(request, -error);
+  }
+
+  // Completions are still posted without io_uring_enter(), so wait for them
+  // with poll(), including that of the doorbell read, which writes to
+  // |doorbell_value_|.
+  if (*doorbell_armed) {
+    uint64_t one = 1;
+    ssize_t written = write(doorbell_fd_, &one, sizeof(one));
+    (void)written;
+  }
+  while (*in_flight > 0 || *doorbell_armed) {
+    pollfd ring = {ring_fd_, POLLIN, 0};
+    // With a timeout, in case the ring itself can no longer be polled.
+    poll(&ring, 1, 10);
+    ReapCompletions(in_flight, doorbell_armed);
+  }
+}
+
+unsigned IoUringBackend::QueuePendingRequests(unsigned* in_flight) {
+  // Leave room for the doorbell read, in both queues.
+  unsigned sq_used = *sq_tail_ - LoadAcquire(sq_head_) + 1;
+  unsigned cq_used = *in_flight + 1;
+  unsigned sq_free = sq_used < sq_entries_ ? sq_entries_ - sq_used : 0;
+  unsigned cq_free = cq_used < cq_entries_ ? cq_entries_ - cq_used : 0;
+  unsigned capacity = std::min(sq_free, cq_free);
+
+  Request* requests;
+  unsigned count = 0;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    requests = pending_head_;
+    Request* last = nullptr;
+    Request* request = pending_head_;
+    while (request && count < capacity) {
+      last = request;
+      request = request->next;
+      ++count;
+    }
+    pending_head_ = request;
+    if (!pending_head_) {
+      pending_tail_ = nullptr;
+    }
+    if (last) {
+      last->next = nullptr;
+    }
+  }
+
+  while (requests) {
+    // The request may complete, and be freed, as soon as it is submitted.
+    Request* request = requests;
+    requests = requests->next;
+
+    io_uring_sqe* sqe = NextSqe();
+    sqe->fd = request->fd;
+    sqe->user_data = reinterpret_cast<uint64_t>(request);
+    switch (request->operation) {
+      case Request::kRead:
+      case Request::kWrite:
+        sqe->opcode = request->operation == Request::kRead ? IORING_OP_READ
+                                                           : IORING_OP_WRITE;
+        sqe->addr = reinterpret_cast<uint64_t>(request->buffer);
+        sqe->len =
+            static_cast<uint32_t>(std::min(request->size, kMaxTransferSize));
+        sqe->off = request->offset;
+        break;
+      case Request::kOpenAt:
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->addr = reinterpret_cast<uint64_t>(request->path);
+        sqe->len = request->mode_or_mask;
+        sqe->open_flags = request->flags;
+        break;
+      case Request::kStatx:
+        sqe->opcode = IORING_OP_STATX;
+        sqe->addr = reinterpret_cast<uint64_t>(request->path);
+        sqe->len = request->mode_or_mask;
+        sqe->off = reinterpret_cast<uint64_t>(request->statx_result);
+        sqe->statx_flags = request->flags;
+        break;
+      case Request::kFsync:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fsync_flags = request->flags ? IORING_FSYNC_DATASYNC : 0;
+        break;
+    }
+  }
+
+  *in_flight += count;
+  return count;
+}
+
+// The kernel only reads the submission queue from io_uring_enter() on the
+// ring thread, since we do not use SQPOLL, so the entry may be filled in after
+// the tail has been advanced.
+io_uring_sqe* IoUringBackend::NextSqe() {
+  unsigned tail = *sq_tail_;
+  io_uring_sqe* sqe = &sqes_[tail & sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+  StoreRelease(sq_tail_, tail + 1);
+  return sqe;
+}
+
+void IoUringBackend::ReapCompletions(unsigned* in_flight,
+                                     bool* doorbell_armed) {
+  unsigned head = *cq_head_;
+  unsigned tail = LoadAcquire(cq_tail_);
+  for (; head != tail; ++head) {
+    const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+    if (cqe.user_data == kDoorbellUserData) {
+      *doorbell_armed = false;
+      continue;
+    }
+    --*in_flight;
+    Complete(reinterpret_cast<Request*>(cqe.user_data), cqe.res);
+  }
+  StoreRelease(cq_head_, head);
+}
+
+void SubmitSuspendedFiber(FiberScheduler::Fiber*, void* arg) {
+  Request* request = static_cast<Request*>(arg);
+  request->backend->Submit(request);
+}
+
+}  // namespace
+
+AsyncFileIo::Options::Options()
+    : queue_depth(256), num_fallback_threads(16), force_thread_pool(false) {}
+
+AsyncFileIo::AsyncFileIo() : AsyncFileIo(Options()) {}
+
+AsyncFileIo::AsyncFileIo(const Options& options) {
+  if (!options.force_thread_pool) {
+    backend_ = IoUringBackend::Create(options.queue_depth);
+  }
+  if (!backend_) {
+    backend_.reset(new ThreadPoolBackend(options.num_fallback_threads));
+  }
+}
+
+AsyncFileIo::~AsyncFileIo() {}
+
+AsyncFileIo::BackendType AsyncFileIo::backend_type() const {
+  return backend_->type();
+}
+
+ssize_t AsyncFileIo::Read(int fd, void* buffer, size_t size, off_t offset) {
+  Request request;
+  request.operation = Request::kRead;
+  request.fd = fd;
+  request.buffer = buffer;
+  request.size = size;
+  request.offset = offset;
+  return Execute(&request);
+}
+
+ssize_t AsyncFileIo::Write(int fd, const void* buffer, size_t size,
+                           off_t offset) {
+  Request request;
+  request.operation = Request::kWrite;
+  request.fd = fd;
+  request.buffer = const_cast<void*>(buffer);
+  request.size = size;
+  request.offset = offset;
+  return Execute(&request);
+}
+
+int AsyncFileIo::OpenAt(int directory_fd, const char* path, int flags,
+                        mode_t mode) {
+  Request request;
+  request.operation = Request::kOpenAt;
+  request.fd = directory_fd;
+  request.path = path;
+  request.flags = flags;
+  request.mode_or_mask = mode;
+  return static_cast<int>(Execute(&request));
+}
+
+int AsyncFileIo::Statx(int directory_fd, const char* path, int flags,
+                       unsigned mask, struct statx* result) {
+  Request request;
+  request.operation = Request::kStatx;
+  request.fd = directory_fd;
+  request.path = path;
+  request.flags = flags;
+  request.mode_or_mask = mask;
+  request.statx_result = result;
+  return static_cast<int>(Execute(&request));
+}
+
+int AsyncFileIo::Fsync(int fd, bool data_only) {
+  Request request;
+  request.operation = Request::kFsync;
+  request.fd = fd;
+  request.flags = data_only ? 1 : 0;
+  return static_cast<int>(Execute(&request));
+}
+
+int64_t AsyncFileIo::Execute(Request* request) {
+  request->backend = backend_.get();
+  request->fiber = FiberScheduler::CurrentFiber();
+  request->done.store(0, std::memory_order_relaxed);
+
+  if (request->fiber) {
+    // Only submit once the fiber has switched out, since the request may
+    // complete, and make the fiber ready, straight away.
+    FiberScheduler::Suspend(&SubmitSuspendedFiber, request);
+    return request->result;
+  }
+
+  backend_->Submit(request);
+  while (request->done.load(std::memory_order_acquire) == 0) {
+    FutexWait(&request->done, 0);
+  }
+  return request->result;
+}
+
+}  // namespace platform
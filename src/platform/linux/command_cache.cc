@@ -0,0 +1,385 @@
+#include "platform/command_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "platform/process.h"
+#include "stdext/murmurhash/MurmurHash3.h"
+
+namespace platform {
+
+namespace {
+
+// Identifies the format of the entries, and of the keys they are stored
+// under.
+const uint32_t kEntryMagic = 0x434d4301;
+const char kKeyVersion[] = "command_cache 2";
+
+// Temporary files older than this were left by a process which died while
+// storing an entry.
+const time_t kStaleTemporaryFileSeconds = 60 * 60;
+
+// Input files are hashed this much at a time.
+const size_t kHashChunkSize = 1024 * 1024;
+
+struct EntryHeader {
+  uint32_t magic;
+  int32_t status;
+  uint64_t key_size;
+  uint64_t stdout_size;
+  uint64_t stderr_size;
+};
+
+void AppendField(std::string* key, const std::string& field) {
+  uint64_t size = field.size();
+  key->append(reinterpret_cast<const char*>(&size), sizeof(size));
+  key->append(field);
+}
+
+std::string ToHex(const uint64_t* digest) {
+  char hex[33];
+  snprintf(hex, sizeof(hex), "%016llx%016llx",
+           static_cast<unsigned long long>(digest[0]),
+           static_cast<unsigned long long>(digest[1]));
+  return hex;
+}
+
+// Returns false if the current directory is unknown, for example because it
+// was removed.
+bool GetCurrentDirectory(std::string* directory) {
+  std::vector<char> buffer(256);
+  while (!getcwd(buffer.data(), buffer.size())) {
+    if (errno != ERANGE) {
+      return false;
+    }
+    buffer.resize(buffer.size() * 2);
+  }
+  directory->assign(buffer.data());
+  return true;
+}
+
+std::string Digest(const std::string& data) {
+  uint64_t digest[2];
+  MurmurHash3_x64_128(data.data(), static_cast<int>(data.size()), 0, digest);
+  return ToHex(digest);
+}
+
+// Returns the digest of the contents of the file |fd|, as the digest of the
+// digests of each chunk, so that files larger than MurmurHash3 accepts can
+// be hashed without reading them into memory at once.
+stdext::optional<std::string> DigestContents(int fd) {
+  std::string chunk(kHashChunkSize, '\0');
+  std::string chunk_digests;
+  while (true) {
+    size_t size = 0;
+    while (size < chunk.size()) {
+      ssize_t result = read(fd, &chunk[size], chunk.size() - size);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result < 0) {
+        return stdext::nullopt;
+      }
+      if (result == 0) {
+        break;
+      }
+      size += result;
+    }
+    if (size == 0) {
+      break;
+    }
+    uint64_t digest[2];
+    MurmurHash3_x64_128(chunk.data(), static_cast<int>(size), 0, digest);
+    chunk_digests.append(reinterpret_cast<const char*>(digest),
+                         sizeof(digest));
+    if (size < chunk.size()) {
+      break;
+    }
+  }
+  return Digest(chunk_digests);
+}
+
+std::string Fingerprint(const CommandCache::Input& input) {
+  int fd = open(input.path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return "missing";
+  }
+
+  std::string fingerprint;
+  if (input.fingerprint == CommandCache::Input::kContents) {
+    stdext::optional<std::string> digest = DigestContents(fd);
+    fingerprint = digest ? "contents " + *digest : "unreadable";
+  } else {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "size %lld mtime %lld.%09ld",
+             static_cast<long long>(status.st_size),
+             static_cast<long long>(status.st_mtim.tv_sec),
+             static_cast<long>(status.st_mtim.tv_nsec));
+    fingerprint = buffer;
+  }
+  close(fd);
+  return fingerprint;
+}
+
+bool ReadExactly(int fd, char* data, size_t size) {
+  while (size > 0) {
+    ssize_t result = read(fd, data, size);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    data += result;
+    size -= result;
+  }
+  return true;
+}
+
+bool WriteExactly(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t result = write(fd, data, size);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result < 0) {
+      return false;
+    }
+    data += result;
+    size -= result;
+  }
+  return true;
+}
+
+// Records that the entry |fd| has just been used in its modification time.
+// The time is set explicitly because file systems which take it from a
+// coarse clock would otherwise give entries used in quick succession the
+// same time.
+void MarkUsed(int fd) {
+  struct timespec times[2];
+  times[0].tv_nsec = UTIME_OMIT;
+  clock_gettime(CLOCK_REALTIME, &times[1]);
+  futimens(fd, times);
+}
+
+bool EndsWith(const char* str, const char* suffix) {
+  size_t length = strlen(str);
+  size_t suffix_length = strlen(suffix);
+  return length >= suffix_length &&
+         strcmp(str + length - suffix_length, suffix) == 0;
+}
+
+struct EntryFile {
+  std::string path;
+  uint64_t size;
+  struct timespec last_used;
+};
+
+}  // namespace
+
+CommandCache::CommandCache(const stdext::file_system::Path& directory,
+                           const Options& options)
+    : directory_(directory), options_(options) {
+  mkdir(directory_.c_str(), 0755);
+}
+
+stdext::optional<CommandCache::Result> CommandCache::Run(
+    const Command& command) {
+  std::string key;
+  std::string digest = ComputeKey(command, &key);
+  std::string entry = directory_.str() + "/" + digest + ".entry";
+
+  Result result;
+  if (!digest.empty() && Load(entry, key, &result)) {
+    return result;
+  }
+
+  stdext::optional<CaptureResult> captured =
+      CaptureSystemCommand(command.command.c_str(), CaptureOptions());
+  if (!captured) {
+    return stdext::nullopt;
+  }
+  result.status = captured->status;
+  result.stdout_data = std::move(captured->stdout_data);
+  result.stderr_data = std::move(captured->stderr_data);
+  result.cached = false;
+
+  if (!digest.empty() && WIFEXITED(result.status) &&
+      (WEXITSTATUS(result.status) == 0 || options_.cache_failures)) {
+    Store(entry, key, result);
+  }
+  return result;
+}
+
+std::string CommandCache::ComputeKey(const Command& command,
+                                     std::string* key) const {
+  key->assign(kKeyVersion);
+  AppendField(key, command.command);
+  // Relative paths, in the command and in the inputs, depend on it.
+  std::string current_directory;
+  if (!GetCurrentDirectory(&current_directory)) {
+    return std::string();
+  }
+  AppendField(key, current_directory);
+  for (const std::string& name : command.environment_variables) {
+    AppendField(key, name);
+    // An empty field for an unset variable, which is distinct from one set
+    // to the empty string.
+    const char* value = getenv(name.c_str());
+    AppendField(key, value ? std::string("=") + value : std::string());
+  }
+  for (const Input& input : command.inputs) {
+    AppendField(key, input.path.str());
+    AppendField(key, Fingerprint(input));
+  }
+  return Digest(*key);
+}
+
+bool CommandCache::Load(const std::string& entry, const std::string& key,
+                        Result* result) {
+  int fd = open(entry.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  EntryHeader header;
+  struct stat status;
+  std::string stored_key;
+  bool ok = fstat(fd, &status) == 0 &&
+            ReadExactly(fd, reinterpret_cast<char*>(&header),
+                        sizeof(header)) &&
+            header.magic == kEntryMagic &&
+            header.key_size == key.size() &&
+            static_cast<uint64_t>(status.st_size) ==
+                sizeof(header) + header.key_size + header.stdout_size +
+                    header.stderr_size;
+  if (ok) {
+    // The key is stored in full in case of a digest collision.
+    stored_key.resize(header.key_size);
+    result->stdout_data.resize(header.stdout_size);
+    result->stderr_data.resize(header.stderr_size);
+    ok = ReadExactly(fd, &stored_key[0], stored_key.size()) &&
+         stored_key == key &&
+         ReadExactly(fd, &result->stdout_data[0], header.stdout_size) &&
+         ReadExactly(fd, &result->stderr_data[0], header.stderr_size);
+  }
+  if (ok) {
+    result->status = header.status;
+    result->cached = true;
+    MarkUsed(fd);
+  }
+  close(fd);
+  return ok;
+}
+
+void CommandCache::Store(const std::string& entry, const std::string& key,
+                         const Result& result) {
+  std::string temporary = directory_.str() + "/tmp.XXXXXX";
+  int fd = mkostemp(&temporary[0], O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+
+  EntryHeader header;
+  header.magic = kEntryMagic;
+  header.status = result.status;
+  header.key_size = key.size();
+  header.stdout_size = result.stdout_data.size();
+  header.stderr_size = result.stderr_data.size();
+  bool ok = fchmod(fd, 0644) == 0 &&
+            WriteExactly(fd, reinterpret_cast<const char*>(&header),
+                         sizeof(header)) &&
+            WriteExactly(fd, key.data(), key.size()) &&
+            WriteExactly(fd, result.stdout_data.data(),
+                         result.stdout_data.size()) &&
+            WriteExactly(fd, result.stderr_data.data(),
+                         result.stderr_data.size());
+  if (ok) {
+    MarkUsed(fd);
+  }
+  ok = close(fd) == 0 && ok;
+  // Readers see either the previous entry or this one, never a partial one.
+  if (!ok || rename(temporary.c_str(), entry.c_str()) != 0) {
+    unlink(temporary.c_str());
+    return;
+  }
+
+  Evict();
+}
+
+void CommandCache::Evict() {
+  // Only one process evicts at a time, and the others leave it to that one.
+  std::string lock_path = directory_.str() + "/lock";
+  int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock_fd < 0) {
+    return;
+  }
+  if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    close(lock_fd);
+    return;
+  }
+
+  DIR* dir = opendir(directory_.c_str());
+  std::vector<EntryFile> entries;
+  uint64_t total_size = 0;
+  time_t now = time(nullptr);
+  while (dir) {
+    struct dirent* dirent = readdir(dir);
+    if (!dirent) {
+      break;
+    }
+    std::string path = directory_.str() + "/" + dirent->d_name;
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+      continue;
+    }
+    if (EndsWith(dirent->d_name, ".entry")) {
+      entries.push_back(EntryFile{path, static_cast<uint64_t>(status.st_size),
+                                  status.st_mtim});
+      total_size += status.st_size;
+    } else if (strncmp(dirent->d_name, "tmp.", 4) == 0 &&
+               now - status.st_mtim.tv_sec > kStaleTemporaryFileSeconds) {
+      unlink(path.c_str());
+    }
+  }
+  if (dir) {
+    closedir(dir);
+  }
+
+  if (total_size > options_.max_size_bytes) {
+    std::sort(entries.begin(), entries.end(),
+              [](const EntryFile& a, const EntryFile& b) {
+                return a.last_used.tv_sec != b.last_used.tv_sec
+                           ? a.last_used.tv_sec < b.last_used.tv_sec
+                           : a.last_used.tv_nsec < b.last_used.tv_nsec;
+              });
+    for (const EntryFile& entry : entries) {
+      if (total_size <= options_.max_size_bytes) {
+        break;
+      }
+      // Processes which already have the entry open can still read it.
+      unlink(entry.path.c_str());
+      total_size -= entry.size;
+    }
+  }
+
+  close(lock_fd);
+}
+
+}  // namespace platform
@@ -0,0 +1,374 @@
+#include "platform/directory_iterator.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace platform {
+
+namespace {
+
+// The record which getdents64() fills its buffer with.
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+// No more than this many directory descriptors are held at once, however
+// high the descriptor limit is.
+const int kMaxHeldDirectories = 256;
+
+const size_t kMinBufferSize = 4096;
+
+DirectoryEntry::Type ToType(unsigned char d_type) {
+  switch (d_type) {
+    case DT_REG:
+      return DirectoryEntry::kRegular;
+    case DT_DIR:
+      return DirectoryEntry::kDirectory;
+    case DT_LNK:
+      return DirectoryEntry::kSymlink;
+    case DT_UNKNOWN:
+      return DirectoryEntry::kUnknown;
+    default:
+      return DirectoryEntry::kOther;
+  }
+}
+
+DirectoryEntry::Type StatType(int directory_fd, const char* name) {
+  struct stat status;
+  if (fstatat(directory_fd, name, &status, AT_SYMLINK_NOFOLLOW) != 0) {
+    return DirectoryEntry::kUnknown;
+  }
+  if (S_ISREG(status.st_mode)) {
+    return DirectoryEntry::kRegular;
+  } else if (S_ISDIR(status.st_mode)) {
+    return DirectoryEntry::kDirectory;
+  } else if (S_ISLNK(status.st_mode)) {
+    return DirectoryEntry::kSymlink;
+  }
+  return DirectoryEntry::kOther;
+}
+
+// A directory's descriptor, shared by the directories below it while they
+// wait to be opened relative to it.
+class HeldDirectory {
+ public:
+  HeldDirectory(int fd, std::atomic<int>* num_held)
+      : fd_(fd), num_held_(num_held) {}
+  HeldDirectory(const HeldDirectory&) = delete;
+  HeldDirectory& operator=(const HeldDirectory&) = delete;
+  ~HeldDirectory() {
+    close(fd_);
+    --*num_held_;
+  }
+
+  int fd() const { return fd_; }
+
+ private:
+  const int fd_;
+  std::atomic<int>* const num_held_;
+};
+
+struct PendingDirectory {
+  // The nearest ancestor whose descriptor is held, or null for the root, and
+  // the path of the directory relative to it, which is opened with
+  // OpenDirectoryBeneath().
+  std::shared_ptr<HeldDirectory> anchor;
+  std::string path_from_anchor;
+  // Relative to the root.
+  std::string path;
+  int depth;
+};
+
+class TreeWalk {
+ public:
+  TreeWalk(int root_fd, const WalkCallback& callback,
+           const WalkOptions& options)
+      : root_fd_(root_fd), callback_(callback), options_(options),
+        max_held_(MaxHeldDirectoryDescriptors()), num_held_(0), num_busy_(0),
+        error_(0) {
+    PendingDirectory root;
+    root.depth = 0;
+    pending_.push_back(std::move(root));
+  }
+
+  void RunWorker();
+  int error() const { return error_.load(); }
+
+ private:
+  // Reads |directory|, and adds the subdirectories to walk to |children|.
+  void Walk(DirectoryReader* reader, const PendingDirectory& directory,
+            std::vector<PendingDirectory>* children);
+
+  const int root_fd_;
+  const WalkCallback& callback_;
+  const WalkOptions& options_;
+
+  const int max_held_;
+  std::atomic<int> num_held_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  // Used as a stack, so that the walk is depth first, which keeps the
+  // number of held descriptors down.
+  std::vector<PendingDirectory> pending_;
+  // The number of directories being walked, whose subdirectories may yet be
+  // added to |pending_|.
+  int num_busy_;
+
+  std::atomic<int> error_;
+};
+
+void TreeWalk::RunWorker() {
+  DirectoryReader reader(options_.buffer_size);
+  std::vector<PendingDirectory> children;
+  while (true) {
+    PendingDirectory directory;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this]() {
+        return !pending_.empty() || num_busy_ == 0;
+      });
+      if (pending_.empty()) {
+        return;
+      }
+      directory = std::move(pending_.back());
+      pending_.pop_back();
+      ++num_busy_;
+    }
+
+    Walk(&reader, directory, &children);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (PendingDirectory& child : children) {
+        pending_.push_back(std::move(child));
+      }
+      --num_busy_;
+    }
+    changed_.notify_all();
+    children.clear();
+  }
+}
+
+void TreeWalk::Walk(DirectoryReader* reader, const PendingDirectory& directory,
+                    std::vector<PendingDirectory>* children) {
+  int fd = OpenDirectoryBeneath(
+      directory.anchor ? directory.anchor->fd() : root_fd_,
+      directory.path_from_anchor);
+  if (fd < 0) {
+    int expected = 0;
+    error_.compare_exchange_strong(expected, errno);
+    return;
+  }
+  reader->Reset(fd);
+
+  bool tried_holding = false;
+  std::shared_ptr<HeldDirectory> held;
+  while (const DirectoryEntry* entry = reader->Next()) {
+    DirectoryEntry resolved = *entry;
+    if (resolved.type == DirectoryEntry::kUnknown) {
+      resolved.type = StatType(reader->fd(), resolved.name);
+    }
+    WalkEntry walk_entry = {reader->fd(), directory.path, resolved,
+                            directory.depth + 1};
+    if (!callback_(walk_entry) ||
+        resolved.type != DirectoryEntry::kDirectory) {
+      continue;
+    }
+
+    PendingDirectory child;
+    child.depth = directory.depth + 1;
+    child.path = directory.path.empty()
+                     ? std::string(resolved.name)
+                     : directory.path + "/" + resolved.name;
+    if (!tried_holding) {
+      // Directories with subdirectories to walk stay open for them, while
+      // there are descriptors to spare, through a duplicate so that the
+      // reader can go on to the next directory.
+      tried_holding = true;
+      if (++num_held_ <= max_held_) {
+        int fd = fcntl(reader->fd(), F_DUPFD_CLOEXEC, 0);
+        if (fd >= 0) {
+          held = std::make_shared<HeldDirectory>(fd, &num_held_);
+        } else {
+          --num_held_;
+        }
+      } else {
+        --num_held_;
+      }
+    }
+    if (held) {
+      child.anchor = held;
+      child.path_from_anchor = resolved.name;
+    } else {
+      // Otherwise they are opened from the nearest held ancestor, one
+      // component at a time.
+      child.anchor = directory.anchor;
+      child.path_from_anchor =
+          directory.path_from_anchor.empty()
+              ? std::string(resolved.name)
+              : directory.path_from_anchor + "/" + resolved.name;
+    }
+    children->push_back(std::move(child));
+  }
+  if (reader->error()) {
+    int expected = 0;
+    error_.compare_exchange_strong(expected, reader->error());
+  }
+  reader->Close();
+}
+
+}  // namespace
+
+DirectoryReader::DirectoryReader(size_t buffer_size)
+    : fd_(-1), error_(0),
+      buffer_(new char[std::max(buffer_size, kMinBufferSize)]),
+      buffer_size_(std::max(buffer_size, kMinBufferSize)), position_(0),
+      end_(0) {}
+
+DirectoryReader::~DirectoryReader() {
+  Close();
+}
+
+bool DirectoryReader::Open(int directory_fd, const char* path) {
+  Close();
+  fd_ = openat(directory_fd, path,
+               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd_ < 0) {
+    error_ = errno;
+    return false;
+  }
+  return true;
+}
+
+void DirectoryReader::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = -1;
+  error_ = 0;
+  position_ = 0;
+  end_ = 0;
+}
+
+void DirectoryReader::Reset(int fd) {
+  Close();
+  fd_ = fd;
+}
+
+int DirectoryReader::Release() {
+  int fd = fd_;
+  fd_ = -1;
+  Close();
+  return fd;
+}
+
+const DirectoryEntry* DirectoryReader::Next() {
+  while (fd_ >= 0) {
+    if (position_ >= end_) {
+      long size = syscall(SYS_getdents64, fd_, buffer_.get(), buffer_size_);
+      if (size < 0 && errno == EINTR) {
+        continue;
+      }
+      if (size <= 0) {
+        if (size < 0) {
+          error_ = errno;
+        }
+        return nullptr;
+      }
+      position_ = 0;
+      end_ = static_cast<size_t>(size);
+    }
+
+    const LinuxDirent64* dirent =
+        reinterpret_cast<const LinuxDirent64*>(buffer_.get() + position_);
+    position_ += dirent->d_reclen;
+    const char* name = dirent->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    entry_.name = name;
+    entry_.inode = dirent->d_ino;
+    entry_.type = ToType(dirent->d_type);
+    return &entry_;
+  }
+  return nullptr;
+}
+
+int OpenDirectoryBeneath(int directory_fd, const std::string& path) {
+  const int kFlags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+  if (path.empty()) {
+    return openat(directory_fd, ".", kFlags);
+  }
+
+  int fd = directory_fd;
+  size_t begin = 0;
+  while (begin <= path.size()) {
+    size_t end = std::min(path.find('/', begin), path.size());
+    int next = openat(fd, path.substr(begin, end - begin).c_str(), kFlags);
+    int error = errno;
+    if (fd != directory_fd) {
+      close(fd);
+    }
+    if (next < 0) {
+      errno = error;
+      return -1;
+    }
+    fd = next;
+    begin = end + 1;
+  }
+  return fd;
+}
+
+int MaxHeldDirectoryDescriptors() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 ||
+      limit.rlim_cur == RLIM_INFINITY) {
+    return kMaxHeldDirectories;
+  }
+  // Leave most of them for the rest of the process.
+  rlim_t max_held = std::min<rlim_t>(limit.rlim_cur / 4, kMaxHeldDirectories);
+  return static_cast<int>(std::max<rlim_t>(max_held, 1));
+}
+
+int WalkDirectoryTree(const char* root, const WalkCallback& callback,
+                      const WalkOptions& options) {
+  int root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd < 0) {
+    return errno;
+  }
+
+  TreeWalk walk(root_fd, callback, options);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < options.num_threads; ++i) {
+    threads.emplace_back(&TreeWalk::RunWorker, &walk);
+  }
+  walk.RunWorker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  close(root_fd);
+  return walk.error();
+}
+
+}  // namespace platform
@@ -0,0 +1,109 @@
+#include "platform/file_status.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+namespace platform {
+
+namespace {
+
+// Threads claim this many paths at a time, so that they do not contend on
+// the shared counter, while still sharing out slow paths evenly.
+const size_t kPathsPerClaim = 64;
+
+const unsigned kStatxMask = STATX_TYPE | STATX_MTIME | STATX_SIZE | STATX_INO;
+
+// Set once statx() has been found to be missing, as on kernels before 4.11.
+std::atomic<bool> g_statx_unavailable(false);
+
+void StatWithStat(const char* path, FileStatus* result) {
+  struct stat status;
+  if (stat(path, &status) != 0) {
+    *result = FileStatus();
+    result->error = errno;
+    return;
+  }
+  result->exists = true;
+  result->error = 0;
+  result->modification_time_ns =
+      static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 +
+      status.st_mtim.tv_nsec;
+  result->size = status.st_size;
+  result->inode = status.st_ino;
+  result->device = status.st_dev;
+  result->is_directory = S_ISDIR(status.st_mode);
+}
+
+void StatPath(const char* path, FileStatus* result) {
+  if (g_statx_unavailable.load(std::memory_order_relaxed)) {
+    StatWithStat(path, result);
+    return;
+  }
+
+  struct statx status;
+  if (statx(AT_FDCWD, path, AT_STATX_SYNC_AS_STAT, kStatxMask, &status) != 0) {
+    if (errno == ENOSYS) {
+      g_statx_unavailable.store(true, std::memory_order_relaxed);
+      StatWithStat(path, result);
+      return;
+    }
+    *result = FileStatus();
+    result->error = errno;
+    return;
+  }
+  result->exists = true;
+  result->error = 0;
+  result->modification_time_ns =
+      static_cast<int64_t>(status.stx_mtime.tv_sec) * 1000000000 +
+      status.stx_mtime.tv_nsec;
+  result->size = status.stx_size;
+  result->inode = status.stx_ino;
+  result->device = makedev(status.stx_dev_major, status.stx_dev_minor);
+  result->is_directory = S_ISDIR(status.stx_mode);
+}
+
+void StatClaimedPaths(stdext::span<const char* const> paths,
+                      stdext::span<FileStatus> results,
+                      std::atomic<size_t>* next) {
+  while (true) {
+    size_t begin = next->fetch_add(kPathsPerClaim, std::memory_order_relaxed);
+    if (begin >= paths.size()) {
+      return;
+    }
+    size_t end = std::min(begin + kPathsPerClaim, paths.size());
+    for (size_t i = begin; i < end; ++i) {
+      StatPath(paths[i], &results[i]);
+    }
+  }
+}
+
+}  // namespace
+
+void StatFiles(stdext::span<const char* const> paths,
+               stdext::span<FileStatus> results,
+               const StatFilesOptions& options) {
+  assert(paths.size() == results.size());
+  size_t num_threads = std::min<size_t>(
+      std::max(options.max_threads, 1),
+      paths.size() / std::max(options.min_paths_per_thread, 1) + 1);
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(&StatClaimedPaths, paths, results, &next);
+  }
+  StatClaimedPaths(paths, results, &next);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace platform
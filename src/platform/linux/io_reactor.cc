@@ -0,0 +1,278 @@
+#include "platform/io_reactor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <vector>
+
+namespace platform {
+
+namespace {
+// errno is thread local and __errno_location() is declared const, so the
+// compiler may reuse its address after a wait has moved the calling fiber to
+// another worker thread.  Always go through these instead.
+__attribute__((noinline)) int LastError() {
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  return errno;
+}
+
+__attribute__((noinline)) void SetLastError(int error) {
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  errno = error;
+}
+
+// Runs |operation| until it succeeds or fails with something other than
+// EAGAIN, waiting for |sequence| to change after each EAGAIN.  Fails with the
+// poller's error if the poller has stopped, since nothing would end the wait.
+template <typename Result, typename Operation>
+Result RetryUntilReady(const IoReactor* reactor,
+                       std::atomic<uint32_t>* sequence,
+                       FiberWaitQueue* waiters, Operation operation) {
+  while (true) {
+    uint32_t observed = sequence->load();
+    Result result = operation();
+    if (result >= 0) {
+      return result;
+    }
+    int error = LastError();
+    if (error == EINTR) {
+      continue;
+    }
+    if (error != EAGAIN && error != EWOULDBLOCK) {
+      return result;
+    }
+    // FailPoller() sets the error before bumping the sequence, so either it
+    // is seen here or the wait ends at once.
+    int poller_error = reactor->poller_error();
+    if (poller_error != 0) {
+      SetLastError(poller_error);
+      return -1;
+    }
+    waiters->Wait(sequence, observed);
+  }
+}
+
+void BumpAndWake(std::atomic<uint32_t>* sequence, FiberWaitQueue* waiters) {
+  sequence->fetch_add(1, std::memory_order_release);
+  waiters->WakeAll();
+}
+}  // namespace
+
+IoReactor::Options::Options() : max_events_per_wait(256) {}
+
+IoReactor::IoReactor() : IoReactor(Options()) {}
+
+IoReactor::IoReactor(const Options& options)
+    : options_(options), epoll_fd_(-1), wake_fd_(-1), shutting_down_(false),
+      poller_error_(0), retired_handles_(nullptr) {
+  assert(options_.max_events_per_wait > 0);
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    return;
+  }
+  wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wake_fd_ < 0) {
+    close(epoll_fd_);
+    epoll_fd_ = -1;
+    return;
+  }
+
+  // The wake descriptor is the only one registered without a handle.
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) != 0) {
+    close(wake_fd_);
+    close(epoll_fd_);
+    wake_fd_ = -1;
+    epoll_fd_ = -1;
+    return;
+  }
+
+  poller_thread_ = std::thread(&IoReactor::PollerMain, this);
+}
+
+IoReactor::~IoReactor() {
+  if (!IsValid()) {
+    return;
+  }
+
+  shutting_down_.store(true);
+  uint64_t one = 1;
+  ssize_t written = write(wake_fd_, &one, sizeof(one));
+  (void)written;
+  poller_thread_.join();
+
+  while (retired_handles_) {
+    Handle* next = retired_handles_->next_retired_;
+    delete retired_handles_;
+    retired_handles_ = next;
+  }
+
+  close(wake_fd_);
+  close(epoll_fd_);
+}
+
+IoReactor::Handle* IoReactor::Register(int fd) {
+  int poller_error = poller_error_.load();
+  if (poller_error != 0) {
+    errno = poller_error;
+    return nullptr;
+  }
+
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0) {
+    return nullptr;
+  }
+  if (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+    return nullptr;
+  }
+
+  Handle* handle = new Handle(this, fd);
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.ptr = handle;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    delete handle;
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  live_handles_.insert(handle);
+  return handle;
+}
+
+void IoReactor::Unregister(Handle* handle) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, handle->fd_, nullptr);
+
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  live_handles_.erase(handle);
+  handle->next_retired_ = retired_handles_;
+  retired_handles_ = handle;
+}
+
+void IoReactor::PollerMain() {
+  std::vector<epoll_event> events(options_.max_events_per_wait);
+
+  while (!shutting_down_.load(std::memory_order_relaxed)) {
+    int num_events = epoll_wait(
+        epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FailPoller(errno);
+      return;
+    }
+
+    for (int i = 0; i < num_events; ++i) {
+      Handle* handle = static_cast<Handle*>(events[i].data.ptr);
+      if (!handle) {
+        continue;
+      }
+      uint32_t ready = events[i].events;
+      // Errors and hang-ups wake everyone, so that they can see the failure.
+      if (ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        BumpAndWake(&handle->read_sequence_, &handle->read_waiters_);
+      }
+      if (ready & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        BumpAndWake(&handle->write_sequence_, &handle->write_waiters_);
+      }
+    }
+
+    // Anything retired by now was removed from the epoll set before the next
+    // epoll_wait() call, and so can no longer appear in a batch.
+    Handle* retired;
+    {
+      std::lock_guard<std::mutex> lock(handles_mutex_);
+      retired = retired_handles_;
+      retired_handles_ = nullptr;
+    }
+    while (retired) {
+      Handle* next = retired->next_retired_;
+      delete retired;
+      retired = next;
+    }
+  }
+}
+
+void IoReactor::FailPoller(int error) {
+  poller_error_.store(error);
+
+  // Retired handles are left for the destructor, since no more batches can
+  // refer to them.
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  for (Handle* handle : live_handles_) {
+    BumpAndWake(&handle->read_sequence_, &handle->read_waiters_);
+    BumpAndWake(&handle->write_sequence_, &handle->write_waiters_);
+  }
+}
+
+ssize_t IoReactor::Handle::Read(void* buffer, size_t size) {
+  return RetryUntilReady<ssize_t>(
+      reactor_, &read_sequence_, &read_waiters_,
+      [this, buffer, size]() { return read(fd_, buffer, size); });
+}
+
+ssize_t IoReactor::Handle::Write(const void* buffer, size_t size) {
+  return RetryUntilReady<ssize_t>(
+      reactor_, &write_sequence_, &write_waiters_,
+      [this, buffer, size]() { return write(fd_, buffer, size); });
+}
+
+int IoReactor::Handle::Accept(sockaddr* address, socklen_t* address_length) {
+  return RetryUntilReady<int>(
+      reactor_, &read_sequence_, &read_waiters_,
+      [this, address, address_length]() {
+        return accept4(fd_, address, address_length,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+      });
+}
+
+int IoReactor::Handle::Connect(const sockaddr* address,
+                               socklen_t address_length) {
+  if (connect(fd_, address, address_length) == 0) {
+    return 0;
+  }
+  // An interrupted connect carries on asynchronously, like EINPROGRESS.
+  int error = LastError();
+  if (error != EINPROGRESS && error != EINTR) {
+    return -1;
+  }
+
+  // A writability event may have been queued before the connection was
+  // started, so check that it has really completed before trusting it.
+  while (true) {
+    uint32_t observed = write_sequence_.load();
+    pollfd poll_fd;
+    poll_fd.fd = fd_;
+    poll_fd.events = POLLOUT;
+    if (poll(&poll_fd, 1, 0) > 0) {
+      break;
+    }
+    int poller_error = reactor_->poller_error();
+    if (poller_error != 0) {
+      SetLastError(poller_error);
+      return -1;
+    }
+    write_waiters_.Wait(&write_sequence_, observed);
+  }
+
+  error = 0;
+  socklen_t error_length = sizeof(error);
+  if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &error_length) != 0) {
+    return -1;
+  }
+  if (error != 0) {
+    SetLastError(error);
+    return -1;
+  }
+  return 0;
+}
+
+}  // namespace platform
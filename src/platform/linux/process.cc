@@ -0,0 +1,910 @@
+#include "platform/process.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+extern char** environ;
+
+namespace platform {
+
+namespace {
+
+// Processes without a pidfd are polled at this interval.
+const auto kPollInterval = std::chrono::milliseconds(1);
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// posix_spawn_file_actions_addchdir_np() was added in glibc 2.29.
+#if defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 29)
+#define HAVE_SPAWN_ADDCHDIR
+#endif
+#endif
+
+struct timespec ToTimespec(Process::Clock::duration duration) {
+  auto nanoseconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+  struct timespec result;
+  result.tv_sec = static_cast<time_t>(nanoseconds / 1000000000);
+  result.tv_nsec = static_cast<long>(nanoseconds % 1000000000);
+  return result;
+}
+
+int AddRedirect(posix_spawn_file_actions_t* child_fd_actions, int fd,
+                const stdext::optional<stdext::file_system::Path>& file_path,
+                int flags, mode_t file_mode) {
+  if (file_path) {
+    return posix_spawn_file_actions_addopen(
+        child_fd_actions, fd, file_path->c_str(), flags, file_mode);
+  } else {
+    return posix_spawn_file_actions_addopen(
+        child_fd_actions, fd, "/dev/null", O_RDWR, 0);
+  }
+}
+
+std::chrono::nanoseconds ToDuration(const struct timeval& time) {
+  return std::chrono::seconds(time.tv_sec) +
+         std::chrono::microseconds(time.tv_usec);
+}
+
+void AddRusage(const struct rusage& rusage, ResourceUsage* usage) {
+  usage->user_time = ToDuration(rusage.ru_utime);
+  usage->system_time = ToDuration(rusage.ru_stime);
+  // Linux reports this in kilobytes.
+  usage->max_rss_bytes = static_cast<uint64_t>(rusage.ru_maxrss) * 1024;
+  usage->voluntary_context_switches = rusage.ru_nvcsw;
+  usage->involuntary_context_switches = rusage.ru_nivcsw;
+}
+
+// Reads the I/O counters of the exited but not yet reaped process |pid|.
+void ReadIoAccounting(pid_t pid, ResourceUsage* usage) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/io", static_cast<int>(pid));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  char buffer[512];
+  ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+  if (size <= 0) {
+    return;
+  }
+  buffer[size] = '\0';
+
+  const struct {
+    const char* name;
+    uint64_t* value;
+  } fields[] = {
+    {"rchar: ", &usage->read_chars},
+    {"wchar: ", &usage->write_chars},
+    {"read_bytes: ", &usage->read_bytes},
+    {"write_bytes: ", &usage->write_bytes},
+  };
+  for (const auto& field : fields) {
+    const char* line = strstr(buffer, field.name);
+    if (line) {
+      *field.value = strtoull(line + strlen(field.name), nullptr, 10);
+    }
+  }
+}
+
+// Closes a file descriptor when it goes out of scope.
+class ScopedFd {
+ public:
+  ScopedFd() : fd_(-1) {}
+  explicit ScopedFd(int fd) : fd_(fd) {}
+  ScopedFd(const ScopedFd&) = delete;
+  ScopedFd& operator=(const ScopedFd&) = delete;
+  ~ScopedFd() { reset(); }
+
+  int get() const { return fd_; }
+  void reset(int fd = -1) {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    fd_ = fd;
+  }
+
+ private:
+  int fd_;
+};
+
+// Creates a pipe whose ends are both closed on exec.  The end which stays in
+// this process is made non-blocking.
+bool MakePipe(ScopedFd* read_end, ScopedFd* write_end, bool nonblocking_read) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    return false;
+  }
+  read_end->reset(fds[0]);
+  write_end->reset(fds[1]);
+  int nonblocking_fd = nonblocking_read ? fds[0] : fds[1];
+  return fcntl(nonblocking_fd, F_SETFL,
+               fcntl(nonblocking_fd, F_GETFL) | O_NONBLOCK) == 0;
+}
+
+// Frees posix_spawn()'s arguments when they go out of scope.
+class SpawnArguments {
+ public:
+  SpawnArguments() {
+    file_actions_ok_ = posix_spawn_file_actions_init(&file_actions) == 0;
+    attributes_ok_ = posix_spawnattr_init(&attributes) == 0;
+  }
+  ~SpawnArguments() {
+    if (file_actions_ok_) {
+      posix_spawn_file_actions_destroy(&file_actions);
+    }
+    if (attributes_ok_) {
+      posix_spawnattr_destroy(&attributes);
+    }
+  }
+
+  bool ok() const { return file_actions_ok_ && attributes_ok_; }
+
+  posix_spawn_file_actions_t file_actions;
+  posix_spawnattr_t attributes;
+
+ private:
+  bool file_actions_ok_;
+  bool attributes_ok_;
+};
+
+int AddRedirects(
+    posix_spawn_file_actions_t* child_fd_actions,
+    const stdext::optional<stdext::file_system::Path>& stdout_file,
+    const stdext::optional<stdext::file_system::Path>& stderr_file,
+    const stdext::optional<stdext::file_system::Path>& stdin_file) {
+  int error = AddRedirect(child_fd_actions, 1, stdout_file,
+                          O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (!error) {
+    error = AddRedirect(child_fd_actions, 2, stderr_file,
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (!error) {
+    error = AddRedirect(child_fd_actions, 0, stdin_file, O_RDONLY, 0);
+  }
+  return error;
+}
+
+// Starts the program at |path| with |arguments|, in a new process group.
+Process Spawn(const char* path, char* const* argv, char* const* envp,
+              SpawnArguments* arguments) {
+  short flags = POSIX_SPAWN_SETPGROUP;
+#ifdef POSIX_SPAWN_USEVFORK
+  // Current glibc always spawns with clone(CLONE_VM | CLONE_VFORK) and
+  // ignores this, but older versions only do so when asked.
+  flags |= POSIX_SPAWN_USEVFORK;
+#endif
+  int error = posix_spawnattr_setflags(&arguments->attributes, flags);
+  if (!error) {
+    error = posix_spawnattr_setpgroup(&arguments->attributes, 0);
+  }
+
+  pid_t pid;
+  auto start_time = Process::Clock::now();
+  if (!error) {
+    error = posix_spawn(&pid, path, &arguments->file_actions,
+                        &arguments->attributes, argv, envp);
+  }
+  if (error) {
+    errno = error;
+    return Process();
+  }
+
+  return Process(pid, OpenPidfd(pid), start_time);
+}
+
+// Starts "/bin/sh -c |command|" with |arguments|, in a new process group.
+Process SpawnShell(const char* command, SpawnArguments* arguments) {
+  const char* spawned_args[] = {"/bin/sh", "-c", command, NULL};
+  return Spawn("/bin/sh", const_cast<char**>(spawned_args), environ,
+               arguments);
+}
+
+// FindProgram()'s results, keyed by the program's name and the value of PATH
+// that it was found with.
+struct ProgramCache {
+  std::mutex mutex;
+  std::unordered_map<std::string, std::string> paths;
+};
+
+ProgramCache* GetProgramCache() {
+  // Never destroyed, so that it can be used during static destruction.
+  static ProgramCache* cache = new ProgramCache();
+  return cache;
+}
+
+std::string ProgramCacheKey(const std::string& program) {
+  const char* search_path = getenv("PATH");
+  std::string key = program;
+  key.push_back('\0');
+  if (search_path) {
+    key += search_path;
+  }
+  return key;
+}
+
+// Searches PATH for |program| as execvp() does.
+stdext::optional<std::string> SearchPath(const std::string& program) {
+  const char* search_path = getenv("PATH");
+  std::string directories = search_path ? search_path : "/bin:/usr/bin";
+  int error = ENOENT;
+  size_t begin = 0;
+  while (true) {
+    size_t end = directories.find(':', begin);
+    if (end == std::string::npos) {
+      end = directories.size();
+    }
+    // As with execvp(), an empty entry means the current directory.
+    std::string candidate =
+        end == begin ? program
+                     : directories.substr(begin, end - begin) + "/" + program;
+    struct stat status;
+    if (access(candidate.c_str(), X_OK) == 0) {
+      if (stat(candidate.c_str(), &status) == 0 && S_ISREG(status.st_mode)) {
+        return candidate;
+      }
+    } else if (errno == EACCES) {
+      // Reported if nothing executable is found later in the search.
+      error = EACCES;
+    }
+    if (end == directories.size()) {
+      break;
+    }
+    begin = end + 1;
+  }
+  errno = error;
+  return stdext::nullopt;
+}
+
+// As write(), but if the child has closed its end of the pipe this fails
+// with EPIPE instead of raising SIGPIPE, which would kill this process.
+ssize_t WriteWithoutSigpipe(int fd, const char* data, size_t size) {
+  sigset_t sigpipe;
+  sigset_t old_mask;
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+
+  ssize_t result = write(fd, data, size);
+  int saved_errno = errno;
+  if (result == -1 && errno == EPIPE && !sigismember(&old_mask, SIGPIPE)) {
+    // Discard the SIGPIPE now pending on this thread before unblocking it.
+    struct timespec no_wait = {0, 0};
+    while (sigtimedwait(&sigpipe, nullptr, &no_wait) == -1 &&
+           errno == EINTR) {
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  errno = saved_errno;
+  return result;
+}
+
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// Moves a child's output from the read end of a pipe to wherever it should
+// go: a string, a callback and a file.
+class OutputPump {
+ public:
+  OutputPump(bool capture, const CaptureOptions::ChunkCallback* callback,
+             std::string* captured)
+      : capture_(capture), callback_(callback), captured_(captured),
+        mode_(kCopy) {}
+
+  // Sets up the pipe and the file, and returns the end of the pipe to
+  // give to the child.
+  bool Open(const stdext::optional<stdext::file_system::Path>& file,
+            ScopedFd* child_end) {
+    if (!MakePipe(&pipe_, child_end, true)) {
+      return false;
+    }
+    if (!file) {
+      return true;
+    }
+    file_.reset(open(file->c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644));
+    if (file_.get() < 0) {
+      return false;
+    }
+    if (!capture_ && !*callback_) {
+      mode_ = kSplice;
+      return true;
+    }
+    // tee() needs a second pipe to duplicate the output into.
+    mode_ = MakePipe(&tee_read_, &tee_write_, false) ? kTee : kCopy;
+    return true;
+  }
+
+  bool done() const { return pipe_.get() < 0; }
+  int fd() const { return pipe_.get(); }
+
+  // Moves whatever output is available.  Returns false on errors other than
+  // those of the pipe itself, which are treated as the end of the output.
+  bool Pump() {
+    while (!done()) {
+      ssize_t size = 0;
+      switch (mode_) {
+        case kSplice:
+          size = splice(pipe_.get(), nullptr, file_.get(), nullptr,
+                        kChunkSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+          break;
+        case kTee:
+          size = tee(pipe_.get(), tee_write_.get(), kChunkSize,
+                     SPLICE_F_NONBLOCK);
+          break;
+        case kCopy:
+          size = read(pipe_.get(), buffer_, sizeof(buffer_));
+          break;
+      }
+
+      if (size == 0) {
+        pipe_.reset();
+        return true;
+      }
+      if (size < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN) {
+          return true;
+        }
+        if (errno == EINVAL && mode_ != kCopy) {
+          // The file does not support splicing, e.g. because it was opened
+          // for appending.
+          mode_ = kCopy;
+          continue;
+        }
+        if (mode_ == kSplice) {
+          return false;
+        }
+        pipe_.reset();
+        return true;
+      }
+
+      if (mode_ == kTee && !FinishTee(size)) {
+        return false;
+      }
+      if (mode_ == kCopy) {
+        Deliver(buffer_, size);
+        if (file_.get() >= 0 && !WriteAll(file_.get(), buffer_, size)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  enum Mode {
+    // Output only goes to the file, and is spliced there.
+    kSplice,
+    // Output is duplicated into |tee_write_| and spliced into the file, and
+    // the duplicate is read from |tee_read_|.
+    kTee,
+    // Output is read, and then written to the file, if any.
+    kCopy,
+  };
+
+  static const size_t kChunkSize = 64 * 1024;
+
+  // Moves the |size| bytes which have just been teed from the pipe into the
+  // file, and reads their duplicate.
+  bool FinishTee(size_t size) {
+    size_t spliced = 0;
+    while (spliced < size) {
+      ssize_t result = splice(pipe_.get(), nullptr, file_.get(), nullptr,
+                              size - spliced, SPLICE_F_MOVE);
+      if (result <= 0) {
+        if (result < 0 && errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      spliced += result;
+    }
+
+    size_t received = 0;
+    while (received < size) {
+      ssize_t result = read(tee_read_.get(), buffer_,
+                            std::min(size - received, sizeof(buffer_)));
+      if (result <= 0) {
+        if (result < 0 && errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      Deliver(buffer_, result);
+      received += result;
+    }
+    return true;
+  }
+
+  void Deliver(const char* data, size_t size) {
+    if (capture_) {
+      captured_->append(data, size);
+    }
+    if (*callback_) {
+      (*callback_)(data, size);
+    }
+  }
+
+  const bool capture_;
+  const CaptureOptions::ChunkCallback* callback_;
+  std::string* captured_;
+  Mode mode_;
+  ScopedFd pipe_;
+  ScopedFd file_;
+  ScopedFd tee_read_;
+  ScopedFd tee_write_;
+  char buffer_[kChunkSize];
+};
+
+}  // namespace
+
+void ResourceUsageSummary::Add(const ResourceUsage& usage) {
+  ++num_processes;
+  total.wall_time += usage.wall_time;
+  total.user_time += usage.user_time;
+  total.system_time += usage.system_time;
+  total.max_rss_bytes = std::max(total.max_rss_bytes, usage.max_rss_bytes);
+  total.voluntary_context_switches += usage.voluntary_context_switches;
+  total.involuntary_context_switches += usage.involuntary_context_switches;
+  total.read_bytes += usage.read_bytes;
+  total.write_bytes += usage.write_bytes;
+  total.read_chars += usage.read_chars;
+  total.write_chars += usage.write_chars;
+
+  max.wall_time = std::max(max.wall_time, usage.wall_time);
+  max.user_time = std::max(max.user_time, usage.user_time);
+  max.system_time = std::max(max.system_time, usage.system_time);
+  max.max_rss_bytes = std::max(max.max_rss_bytes, usage.max_rss_bytes);
+  max.voluntary_context_switches = std::max(
+      max.voluntary_context_switches, usage.voluntary_context_switches);
+  max.involuntary_context_switches = std::max(
+      max.involuntary_context_switches, usage.involuntary_context_switches);
+  max.read_bytes = std::max(max.read_bytes, usage.read_bytes);
+  max.write_bytes = std::max(max.write_bytes, usage.write_bytes);
+  max.read_chars = std::max(max.read_chars, usage.read_chars);
+  max.write_chars = std::max(max.write_chars, usage.write_chars);
+}
+
+Process::Process() : pid_(-1), pidfd_(-1), exited_(false), status_(0) {}
+
+Process::Process(pid_t pid, int pidfd, Clock::time_point start_time)
+    : pid_(pid), pidfd_(pidfd), exited_(false), status_(0),
+      start_time_(start_time) {}
+
+Process::Process(Process&& other)
+    : pid_(other.pid_), pidfd_(other.pidfd_), exited_(other.exited_),
+      status_(other.status_), start_time_(other.start_time_),
+      resource_usage_(other.resource_usage_) {
+  other.pid_ = -1;
+  other.pidfd_ = -1;
+}
+
+Process& Process::operator=(Process&& other) {
+  if (this != &other) {
+    Reset();
+    pid_ = other.pid_;
+    pidfd_ = other.pidfd_;
+    exited_ = other.exited_;
+    status_ = other.status_;
+    start_time_ = other.start_time_;
+    resource_usage_ = other.resource_usage_;
+    other.pid_ = -1;
+    other.pidfd_ = -1;
+  }
+  return *this;
+}
+
+Process::~Process() {
+  Reset();
+}
+
+void Process::Reset() {
+  if (IsValid() && !exited_) {
+    killpg(pid_, SIGKILL);
+    Reap(true);
+  }
+  if (pidfd_ >= 0) {
+    close(pidfd_);
+  }
+  pid_ = -1;
+  pidfd_ = -1;
+  exited_ = false;
+  status_ = 0;
+  resource_usage_ = ResourceUsage();
+}
+
+bool Process::Reap(bool block) {
+  assert(IsValid());
+  if (exited_) {
+    return true;
+  }
+
+  // Wait for the process without reaping it, so that its /proc entry can
+  // still be read.
+  siginfo_t info;
+  info.si_pid = 0;
+  int result;
+  do {
+    result = waitid(P_PID, pid_, &info,
+                    WEXITED | WNOWAIT | (block ? 0 : WNOHANG));
+  } while (result == -1 && errno == EINTR);
+  if (result == 0 && info.si_pid == 0) {
+    return false;
+  }
+  auto end_time = Clock::now();
+  if (result == 0) {
+    ReadIoAccounting(pid_, &resource_usage_);
+  }
+
+  int status;
+  struct rusage rusage;
+  pid_t reaped;
+  do {
+    reaped = wait4(pid_, &status, 0, &rusage);
+  } while (reaped == -1 && errno == EINTR);
+
+  exited_ = true;
+  resource_usage_.wall_time = end_time - start_time_;
+  if (reaped == pid_) {
+    AddRusage(rusage, &resource_usage_);
+  }
+  // As with SystemCommand(), a child which can not be waited for, say
+  // because SIGCHLD is ignored, is reported with status 1.
+  status_ = reaped == pid_ ? status : 1;
+  return true;
+}
+
+stdext::optional<int> Process::Poll() {
+  if (Reap(false)) {
+    return status_;
+  }
+  return stdext::nullopt;
+}
+
+int Process::Wait() {
+  Reap(true);
+  return status_;
+}
+
+stdext::optional<int> Process::WaitUntil(Clock::time_point deadline) {
+  if (exited_ || WaitForAny({this}, deadline)) {
+    return status_;
+  }
+  return stdext::nullopt;
+}
+
+bool Process::Signal(int signal) {
+  if (!IsValid() || exited_) {
+    errno = ESRCH;
+    return false;
+  }
+  // The process group can not be reused while its leader has not been
+  // waited for, so this can not signal an unrelated group.
+  return killpg(pid_, signal) == 0;
+}
+
+int OpenPidfd(pid_t pid) {
+  long fd = syscall(SYS_pidfd_open, pid, 0);
+  return fd < 0 ? -1 : static_cast<int>(fd);
+}
+
+Process StartSystemCommand(
+    const char* command,
+    const stdext::optional<stdext::file_system::Path>& stdout_file,
+    const stdext::optional<stdext::file_system::Path>& stderr_file,
+    const stdext::optional<stdext::file_system::Path>& stdin_file) {
+  SpawnArguments arguments;
+  if (!arguments.ok()) {
+    return Process();
+  }
+
+  int error = AddRedirects(&arguments.file_actions, stdout_file, stderr_file,
+                           stdin_file);
+  if (error) {
+    errno = error;
+    return Process();
+  }
+
+  return SpawnShell(command, &arguments);
+}
+
+stdext::optional<SystemCommandResult> SystemCommandWithUsage(
+    const char* command,
+    const stdext::optional<stdext::file_system::Path>& stdout_file,
+    const stdext::optional<stdext::file_system::Path>& stderr_file,
+    const stdext::optional<stdext::file_system::Path>& stdin_file) {
+  Process process =
+      StartSystemCommand(command, stdout_file, stderr_file, stdin_file);
+  if (!process.IsValid()) {
+    return stdext::nullopt;
+  }
+  SystemCommandResult result;
+  result.status = process.Wait();
+  result.resource_usage = process.resource_usage();
+  return result;
+}
+
+Process StartProgram(const std::vector<std::string>& argv,
+                     const ProgramOptions& options) {
+  if (argv.empty()) {
+    errno = EINVAL;
+    return Process();
+  }
+
+  SpawnArguments arguments;
+  if (!arguments.ok()) {
+    return Process();
+  }
+  int error = AddRedirects(&arguments.file_actions, options.stdout_file,
+                           options.stderr_file, options.stdin_file);
+  if (!error && options.working_directory) {
+#ifdef HAVE_SPAWN_ADDCHDIR
+    error = posix_spawn_file_actions_addchdir_np(
+        &arguments.file_actions, options.working_directory->c_str());
+#else
+    error = ENOSYS;
+#endif
+  }
+  if (error) {
+    errno = error;
+    return Process();
+  }
+
+  std::vector<char*> spawned_args;
+  for (const std::string& arg : argv) {
+    spawned_args.push_back(const_cast<char*>(arg.c_str()));
+  }
+  spawned_args.push_back(nullptr);
+
+  std::vector<char*> environment;
+  if (options.environment) {
+    for (const std::string& variable : *options.environment) {
+      environment.push_back(const_cast<char*>(variable.c_str()));
+    }
+    environment.push_back(nullptr);
+  }
+  char* const* envp = options.environment ? environment.data() : environ;
+
+  bool searched = argv[0].find('/') == std::string::npos;
+  for (int attempt = 0; ; ++attempt) {
+    stdext::optional<std::string> path = FindProgram(argv[0]);
+    if (!path) {
+      return Process();
+    }
+    Process process = Spawn(path->c_str(), spawned_args.data(), envp,
+                            &arguments);
+    if (process.IsValid() || !searched || attempt > 0 ||
+        (errno != ENOENT && errno != EACCES)) {
+      return process;
+    }
+
+    // The program may have been moved since it was cached, so search for it
+    // again.
+    ProgramCache* cache = GetProgramCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->paths.erase(ProgramCacheKey(argv[0]));
+  }
+}
+
+stdext::optional<std::string> FindProgram(const std::string& program) {
+  if (program.empty()) {
+    errno = ENOENT;
+    return stdext::nullopt;
+  }
+  if (program.find('/') != std::string::npos) {
+    return program;
+  }
+
+  ProgramCache* cache = GetProgramCache();
+  std::string key = ProgramCacheKey(program);
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    auto found = cache->paths.find(key);
+    if (found != cache->paths.end()) {
+      return found->second;
+    }
+  }
+
+  stdext::optional<std::string> path = SearchPath(program);
+  if (path) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->paths[key] = *path;
+  }
+  return path;
+}
+
+stdext::optional<CaptureResult> CaptureSystemCommand(
+    const char* command, const CaptureOptions& options) {
+  CaptureResult result;
+  result.status = 0;
+  // The pumps hold 64KB buffers each, so keep them off the stack.
+  std::unique_ptr<OutputPump> stdout_pump(new OutputPump(
+      options.capture_stdout, &options.on_stdout, &result.stdout_data));
+  std::unique_ptr<OutputPump> stderr_pump(new OutputPump(
+      options.capture_stderr, &options.on_stderr, &result.stderr_data));
+
+  ScopedFd child_stdout;
+  ScopedFd child_stderr;
+  ScopedFd child_stdin;
+  ScopedFd stdin_pipe;
+  if (!stdout_pump->Open(options.stdout_file, &child_stdout) ||
+      !stderr_pump->Open(options.stderr_file, &child_stderr)) {
+    return stdext::nullopt;
+  }
+  if (!options.stdin_data.empty() &&
+      !MakePipe(&child_stdin, &stdin_pipe, false)) {
+    return stdext::nullopt;
+  }
+
+  SpawnArguments arguments;
+  if (!arguments.ok()) {
+    return stdext::nullopt;
+  }
+  int error = posix_spawn_file_actions_adddup2(
+      &arguments.file_actions, child_stdout.get(), 1);
+  if (!error) {
+    error = posix_spawn_file_actions_adddup2(
+        &arguments.file_actions, child_stderr.get(), 2);
+  }
+  if (!error) {
+    error = child_stdin.get() >= 0
+        ? posix_spawn_file_actions_adddup2(
+              &arguments.file_actions, child_stdin.get(), 0)
+        : posix_spawn_file_actions_addopen(
+              &arguments.file_actions, 0, "/dev/null", O_RDONLY, 0);
+  }
+  if (error) {
+    errno = error;
+    return stdext::nullopt;
+  }
+
+  Process process = SpawnShell(command, &arguments);
+  if (!process.IsValid()) {
+    return stdext::nullopt;
+  }
+  // Only the child may hold these, or the pipes would never see the end.
+  child_stdout.reset();
+  child_stderr.reset();
+  child_stdin.reset();
+
+  size_t stdin_written = 0;
+  bool ok = true;
+  while (ok && !(stdout_pump->done() && stderr_pump->done() &&
+                 stdin_pipe.get() < 0)) {
+    struct pollfd fds[3];
+    int num_fds = 0;
+    OutputPump* pumps[2] = {stdout_pump.get(), stderr_pump.get()};
+    for (OutputPump* pump : pumps) {
+      if (!pump->done()) {
+        fds[num_fds++] = {pump->fd(), POLLIN, 0};
+      }
+    }
+    if (stdin_pipe.get() >= 0) {
+      fds[num_fds++] = {stdin_pipe.get(), POLLOUT, 0};
+    }
+    if (poll(fds, num_fds, -1) < 0 && errno != EINTR) {
+      ok = false;
+      break;
+    }
+
+    for (OutputPump* pump : pumps) {
+      if (ok && !pump->done()) {
+        ok = pump->Pump();
+      }
+    }
+
+    if (stdin_pipe.get() >= 0) {
+      ssize_t written = WriteWithoutSigpipe(
+          stdin_pipe.get(), options.stdin_data.data() + stdin_written,
+          options.stdin_data.size() - stdin_written);
+      if (written > 0) {
+        stdin_written += written;
+      }
+      // A child which stops reading early is not an error.
+      if (stdin_written == options.stdin_data.size() ||
+          (written < 0 && errno != EAGAIN && errno != EINTR)) {
+        stdin_pipe.reset();
+      }
+    }
+  }
+
+  if (!ok) {
+    int saved_errno = errno;
+    process.Signal(SIGKILL);
+    process.Wait();
+    errno = saved_errno;
+    return stdext::nullopt;
+  }
+  result.status = process.Wait();
+  result.resource_usage = process.resource_usage();
+  return result;
+}
+
+stdext::optional<size_t> WaitForAny(const std::vector<Process*>& processes,
+                                    Process::Clock::time_point deadline) {
+  std::vector<struct pollfd> pidfds;
+  while (true) {
+    pidfds.clear();
+    bool any_running = false;
+    bool any_without_pidfd = false;
+    for (size_t i = 0; i < processes.size(); ++i) {
+      Process* process = processes[i];
+      if (process->exited()) {
+        continue;
+      }
+      if (process->Poll()) {
+        return i;
+      }
+      any_running = true;
+      if (process->pidfd() >= 0) {
+        struct pollfd pidfd;
+        pidfd.fd = process->pidfd();
+        pidfd.events = POLLIN;
+        pidfd.revents = 0;
+        pidfds.push_back(pidfd);
+      } else {
+        any_without_pidfd = true;
+      }
+    }
+
+    Process::Clock::time_point now = Process::Clock::now();
+    if (!any_running || now >= deadline) {
+      return stdext::nullopt;
+    }
+    Process::Clock::duration timeout = deadline - now;
+    if (any_without_pidfd) {
+      timeout = std::min<Process::Clock::duration>(timeout, kPollInterval);
+    }
+    struct timespec poll_timeout = ToTimespec(timeout);
+    ppoll(pidfds.data(), pidfds.size(), &poll_timeout, nullptr);
+  }
+}
+
+std::vector<size_t> WaitForAll(const std::vector<Process*>& processes) {
+  std::vector<size_t> order;
+  while (stdext::optional<size_t> index = WaitForAny(processes)) {
+    order.push_back(*index);
+  }
+  return order;
+}
+
+}  // namespace platform
@@ -0,0 +1,93 @@
+#include "platform/process_pool.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace platform {
+
+namespace {
+
+// While commands are held back by the load average, it is checked this
+// often.  The kernel only updates it every five seconds.
+const auto kLoadCheckInterval = std::chrono::seconds(1);
+
+int DefaultMaxProcesses() {
+  long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return num_cpus > 0 ? static_cast<int>(num_cpus) : 1;
+}
+
+}  // namespace
+
+ProcessPool::ProcessPool(const Options& options)
+    : max_processes_(options.max_processes > 0 ? options.max_processes
+                                               : DefaultMaxProcesses()),
+      max_load_average_(options.max_load_average) {}
+
+void ProcessPool::Add(const Command& command, Callback on_exit) {
+  queue_.push_back(Job{command, std::move(on_exit)});
+}
+
+bool ProcessPool::MayStart(size_t num_running) const {
+  if (num_running >= static_cast<size_t>(max_processes_)) {
+    return false;
+  }
+  if (num_running == 0 || max_load_average_ <= 0) {
+    return true;
+  }
+  double load_average;
+  return getloadavg(&load_average, 1) != 1 ||
+         load_average < max_load_average_;
+}
+
+void ProcessPool::Run() {
+  std::vector<RunningJob> running;
+  std::vector<Process*> processes;
+  while (!queue_.empty() || !running.empty()) {
+    while (!queue_.empty() && MayStart(running.size())) {
+      Job job = std::move(queue_.front());
+      queue_.pop_front();
+      Process process = StartSystemCommand(
+          job.command.command.c_str(), job.command.stdout_file,
+          job.command.stderr_file, job.command.stdin_file);
+      if (!process.IsValid()) {
+        if (job.on_exit) {
+          job.on_exit(1);
+        }
+        continue;
+      }
+      running.push_back(RunningJob{std::move(process), std::move(job.on_exit)});
+    }
+    if (running.empty()) {
+      continue;
+    }
+
+    processes.clear();
+    for (RunningJob& job : running) {
+      processes.push_back(&job.process);
+    }
+    // If commands are being held back by the load average, look at it again
+    // now and then even if nothing exits.
+    bool throttled = !queue_.empty() &&
+                     running.size() < static_cast<size_t>(max_processes_);
+    stdext::optional<size_t> exited = WaitForAny(
+        processes, throttled ? Process::Clock::now() + kLoadCheckInterval
+                             : Process::Clock::time_point::max());
+    if (!exited) {
+      continue;
+    }
+
+    RunningJob job = std::move(running[*exited]);
+    running.erase(running.begin() + *exited);
+    int status = job.process.Wait();
+    resource_usage_.Add(job.process.resource_usage());
+    if (job.on_exit) {
+      job.on_exit(status);
+    }
+  }
+}
+
+}  // namespace platform
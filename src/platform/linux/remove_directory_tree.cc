@@ -0,0 +1,369 @@
+#include "platform/file_system.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "platform/directory_iterator.h"
+
+namespace platform {
+
+namespace {
+
+// A directory being removed.  Its entries are removed first, and it is
+// removed itself once the last of its subdirectories is.
+struct RemovalDirectory {
+  RemovalDirectory() : fd(-1), num_remaining(0), failed(false) {}
+
+  // Null for the root.
+  std::shared_ptr<RemovalDirectory> parent;
+  std::string name;
+
+  // The nearest ancestor whose descriptor is held, and the path of this
+  // directory relative to it.  Null for the root.
+  std::shared_ptr<RemovalDirectory> anchor;
+  std::string path_from_anchor;
+
+  // Held while the subdirectories are removed, or -1.
+  int fd;
+
+  // The number of subdirectories not removed yet.
+  std::atomic<int> num_remaining;
+
+  // Set if anything below the directory could not be removed, in which case
+  // neither can it, and the error is not reported again.
+  std::atomic<bool> failed;
+};
+
+class TreeRemoval {
+ public:
+  TreeRemoval(int parent_fd, const char* root, int root_fd, dev_t device,
+              const RemoveDirectoryTreeOptions& options,
+              std::vector<RemoveDirectoryTreeError>* errors)
+      : parent_fd_(parent_fd), root_(root), device_(device), options_(options),
+        errors_(errors),
+        max_held_(MaxHeldDirectoryDescriptors()), num_held_(0), num_busy_(0),
+        failed_(false) {
+    std::shared_ptr<RemovalDirectory> directory =
+        std::make_shared<RemovalDirectory>();
+    directory->fd = root_fd;
+    pending_.push_back(std::move(directory));
+  }
+
+  // Removes directories until there are none left, starting more threads to
+  // help while there are directories waiting for them.
+  void RunWorker();
+
+  // Waits for the threads started by RunWorker().
+  void JoinThreads();
+
+  bool failed() const { return failed_.load(); }
+
+ private:
+  // Removes the entries of |directory|, and adds its subdirectories to
+  // |children|.
+  void Empty(DirectoryReader* reader,
+             const std::shared_ptr<RemovalDirectory>& directory,
+             std::vector<std::shared_ptr<RemovalDirectory>>* children);
+
+  // Called once nothing remains to be removed below |directory|.  Removes
+  // it, and then any ancestors for which it was the last subdirectory.
+  void Finish(RemovalDirectory* directory);
+
+  // Returns a descriptor for |directory|, and sets |owned| if it is a new one
+  // for the caller to close.
+  int OpenDirectory(const RemovalDirectory& directory, bool* owned) const;
+
+  void AddError(const RemovalDirectory& directory, const char* name,
+                int error);
+
+  // |root_| is relative to |parent_fd_|.
+  const int parent_fd_;
+  const char* const root_;
+  const dev_t device_;
+  const RemoveDirectoryTreeOptions& options_;
+  std::vector<RemoveDirectoryTreeError>* const errors_;
+
+  // Directories with subdirectories keep their descriptors open, so that the
+  // subdirectories can be opened and removed relative to them, while fewer
+  // than |max_held_| are open.  Beyond that, directories are opened one
+  // component at a time from their nearest held ancestor, however far up
+  // that is.
+  const int max_held_;
+  std::atomic<int> num_held_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  // Used as a stack, so that the removal is depth first, which keeps the
+  // number of held descriptors down.
+  std::vector<std::shared_ptr<RemovalDirectory>> pending_;
+  // The number of directories being emptied, whose subdirectories may yet be
+  // added to |pending_|.
+  int num_busy_;
+  std::vector<std::thread> threads_;
+
+  std::atomic<bool> failed_;
+  std::mutex errors_mutex_;
+};
+
+void TreeRemoval::RunWorker() {
+  DirectoryReader reader;
+  std::vector<std::shared_ptr<RemovalDirectory>> children;
+  while (true) {
+    std::shared_ptr<RemovalDirectory> directory;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this]() {
+        return !pending_.empty() || num_busy_ == 0;
+      });
+      if (pending_.empty()) {
+        return;
+      }
+      directory = std::move(pending_.back());
+      pending_.pop_back();
+      ++num_busy_;
+    }
+
+    Empty(&reader, directory, &children);
+    if (children.empty()) {
+      Finish(directory.get());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::shared_ptr<RemovalDirectory>& child : children) {
+        pending_.push_back(std::move(child));
+      }
+      --num_busy_;
+      if (pending_.size() > 1 &&
+          static_cast<int>(threads_.size()) + 1 < options_.max_threads) {
+        threads_.emplace_back(&TreeRemoval::RunWorker, this);
+      }
+    }
+    changed_.notify_all();
+    children.clear();
+  }
+}
+
+void TreeRemoval::JoinThreads() {
+  // No more are started once RunWorker() has returned.
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void TreeRemoval::Empty(
+    DirectoryReader* reader,
+    const std::shared_ptr<RemovalDirectory>& directory,
+    std::vector<std::shared_ptr<RemovalDirectory>>* children) {
+  if (directory->fd >= 0) {
+    // The root, which is opened up front.
+    reader->Reset(directory->fd);
+    directory->fd = -1;
+  } else {
+    bool owned;
+    int anchor_fd = OpenDirectory(*directory->anchor, &owned);
+    int fd = anchor_fd < 0 ? -1
+                           : OpenDirectoryBeneath(anchor_fd,
+                                                  directory->path_from_anchor);
+    int error = errno;
+    if (owned && anchor_fd >= 0) {
+      close(anchor_fd);
+    }
+    if (fd < 0) {
+      AddError(*directory->parent, directory->name.c_str(), error);
+      directory->failed = true;
+      return;
+    }
+    reader->Reset(fd);
+
+    // Mount points are left alone, along with whatever is mounted there.
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_dev != device_) {
+      AddError(*directory->parent, directory->name.c_str(), EXDEV);
+      directory->failed = true;
+      reader->Close();
+      return;
+    }
+  }
+
+  while (const DirectoryEntry* entry = reader->Next()) {
+    bool is_directory = entry->type == DirectoryEntry::kDirectory;
+    if (entry->type == DirectoryEntry::kUnknown) {
+      struct stat status;
+      is_directory = fstatat(reader->fd(), entry->name, &status,
+                             AT_SYMLINK_NOFOLLOW) == 0 &&
+                     S_ISDIR(status.st_mode);
+    }
+    if (is_directory) {
+      std::shared_ptr<RemovalDirectory> child =
+          std::make_shared<RemovalDirectory>();
+      child->parent = directory;
+      child->name = entry->name;
+      children->push_back(std::move(child));
+    } else if (unlinkat(reader->fd(), entry->name, 0) != 0 &&
+               errno != ENOENT) {
+      AddError(*directory, entry->name, errno);
+      directory->failed = true;
+    }
+  }
+  if (reader->error()) {
+    AddError(*directory, nullptr, reader->error());
+    directory->failed = true;
+  }
+  if (children->empty()) {
+    reader->Close();
+    return;
+  }
+
+  directory->num_remaining = static_cast<int>(children->size());
+  // The root is always held, since it has no anchor.
+  bool hold = ++num_held_ <= max_held_ || !directory->anchor;
+  if (hold) {
+    directory->fd = reader->Release();
+  } else {
+    --num_held_;
+    reader->Close();
+  }
+  for (std::shared_ptr<RemovalDirectory>& child : *children) {
+    if (hold) {
+      child->anchor = directory;
+      child->path_from_anchor = child->name;
+    } else {
+      child->anchor = directory->anchor;
+      child->path_from_anchor =
+          directory->path_from_anchor + "/" + child->name;
+    }
+  }
+}
+
+void TreeRemoval::Finish(RemovalDirectory* directory) {
+  while (true) {
+    if (directory->fd >= 0) {
+      close(directory->fd);
+      directory->fd = -1;
+      --num_held_;
+    }
+
+    RemovalDirectory* parent = directory->parent.get();
+    bool failed = directory->failed;
+    if (!failed) {
+      int result;
+      if (!parent) {
+        result = unlinkat(parent_fd_, root_, AT_REMOVEDIR);
+      } else {
+        bool owned;
+        int parent_fd = OpenDirectory(*parent, &owned);
+        result = parent_fd < 0 ? -1
+                               : unlinkat(parent_fd, directory->name.c_str(),
+                                          AT_REMOVEDIR);
+        int error = errno;
+        if (owned && parent_fd >= 0) {
+          close(parent_fd);
+        }
+        errno = error;
+      }
+      if (result != 0 && errno != ENOENT) {
+        AddError(parent ? *parent : *directory,
+                 parent ? directory->name.c_str() : nullptr, errno);
+        failed = true;
+      }
+    }
+
+    if (!parent) {
+      return;
+    }
+    if (failed) {
+      parent->failed = true;
+    }
+    if (--parent->num_remaining != 0) {
+      return;
+    }
+    directory = parent;
+  }
+}
+
+int TreeRemoval::OpenDirectory(const RemovalDirectory& directory,
+                               bool* owned) const {
+  if (directory.fd >= 0) {
+    *owned = false;
+    return directory.fd;
+  }
+  // Directories which are not held have held anchors.
+  *owned = true;
+  return OpenDirectoryBeneath(directory.anchor->fd,
+                              directory.path_from_anchor);
+}
+
+void TreeRemoval::AddError(const RemovalDirectory& directory,
+                           const char* name, int error) {
+  failed_ = true;
+  if (!errors_) {
+    return;
+  }
+
+  std::string path;
+  if (name) {
+    path = name;
+  }
+  for (const RemovalDirectory* ancestor = &directory; ancestor->parent;
+       ancestor = ancestor->parent.get()) {
+    path = path.empty() ? ancestor->name : ancestor->name + "/" + path;
+  }
+  path = path.empty() ? std::string(root_) : std::string(root_) + "/" + path;
+
+  std::lock_guard<std::mutex> lock(errors_mutex_);
+  errors_->push_back(RemoveDirectoryTreeError{std::move(path), error});
+}
+
+}  // namespace
+
+bool RemoveDirectoryTreeAt(int directory_fd, const char* filepath,
+                           const RemoveDirectoryTreeOptions& options,
+                           std::vector<RemoveDirectoryTreeError>* errors) {
+  int root_fd = openat(directory_fd, filepath,
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  struct stat status;
+  if (root_fd >= 0 && fstat(root_fd, &status) != 0) {
+    close(root_fd);
+    root_fd = -1;
+  }
+  if (root_fd < 0) {
+    // Anything other than a directory is removed on its own.
+    if ((errno != ENOTDIR && errno != ELOOP) ||
+        unlinkat(directory_fd, filepath, 0) != 0) {
+      if (errors) {
+        errors->push_back(RemoveDirectoryTreeError{filepath, errno});
+      }
+      return false;
+    }
+    return true;
+  }
+
+  TreeRemoval removal(directory_fd, filepath, root_fd, status.st_dev, options,
+                      errors);
+  removal.RunWorker();
+  removal.JoinThreads();
+  return !removal.failed();
+}
+
+bool RemoveDirectoryTree(const char* filepath,
+                         const RemoveDirectoryTreeOptions& options,
+                         std::vector<RemoveDirectoryTreeError>* errors) {
+  return RemoveDirectoryTreeAt(AT_FDCWD, filepath, options, errors);
+}
+
+bool RemoveDirectoryTree(const char* filepath) {
+  return RemoveDirectoryTree(filepath, RemoveDirectoryTreeOptions(), nullptr);
+}
+
+}  // namespace platform
@@ -0,0 +1,326 @@
+#include "platform/zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace platform {
+
+namespace {
+
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+
+// Requests larger than this are refused with E2BIG.
+const size_t kMaxRequestSize = 64 * 1024;
+
+// Standard input, output and error, in that order.
+const int kNumStreams = 3;
+
+struct Reply {
+  pid_t pid;
+  int error;
+};
+
+void AppendString(std::string* message, const std::string& str) {
+  uint32_t size = static_cast<uint32_t>(str.size());
+  message->append(reinterpret_cast<const char*>(&size), sizeof(size));
+  message->append(str);
+}
+
+bool ReadStrings(const char* data, const char* end,
+                 std::vector<std::string>* strings) {
+  while (data < end) {
+    uint32_t size;
+    if (static_cast<size_t>(end - data) < sizeof(size)) {
+      return false;
+    }
+    memcpy(&size, data, sizeof(size));
+    data += sizeof(size);
+    if (static_cast<size_t>(end - data) < size) {
+      return false;
+    }
+    strings->emplace_back(data, size);
+    data += size;
+  }
+  return !strings->empty();
+}
+
+// Closes every descriptor other than the standard streams and |keep|, which
+// must be greater than 2.
+void CloseDescriptorsExcept(int keep) {
+  if (syscall(SYS_close_range, 3, keep - 1, 0) == 0 &&
+      syscall(SYS_close_range, keep + 1, ~0u, 0) == 0) {
+    return;
+  }
+  // Kernels before 5.9 do not have close_range().
+  long max_fd = sysconf(_SC_OPEN_MAX);
+  for (int fd = 3; fd < max_fd; ++fd) {
+    if (fd != keep) {
+      close(fd);
+    }
+  }
+}
+
+void CloseStreams(int* fds, size_t num_fds) {
+  for (size_t i = 0; i < num_fds; ++i) {
+    if (fds[i] >= 0) {
+      close(fds[i]);
+    }
+  }
+}
+
+// Runs in a child forked by the zygote.
+__attribute__((noreturn)) void RunChild(
+    int socket, const int* fds, Zygote::EntryPoint entry_point,
+    const std::vector<std::string>& args) {
+  close(socket);
+  setpgid(0, 0);
+  for (int i = 0; i < kNumStreams; ++i) {
+    dup2(fds[i], i);
+    close(fds[i]);
+  }
+  sigset_t no_signals;
+  sigemptyset(&no_signals);
+  sigprocmask(SIG_SETMASK, &no_signals, nullptr);
+
+  int result = entry_point(args);
+  // Exit without running this process's static destructors and atexit()
+  // handlers, which belong to the process that the zygote was forked from.
+  fflush(nullptr);
+  _exit(result);
+}
+
+// Handles one request from |socket|.  Returns false once the socket has been
+// closed.
+bool HandleRequest(int socket, const Zygote::EntryPoints& entry_points,
+                   std::vector<char>* buffer) {
+  struct iovec data = {buffer->data(), buffer->size()};
+  union {
+    char buffer[CMSG_SPACE(sizeof(int) * kNumStreams)];
+    struct cmsghdr align;
+  } control;
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  ssize_t size = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+  if (size < 0 && errno == EINTR) {
+    return true;
+  }
+  if (size <= 0) {
+    return false;
+  }
+
+  int fds[kNumStreams] = {-1, -1, -1};
+  size_t num_fds = 0;
+  for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header;
+       header = CMSG_NXTHDR(&message, header)) {
+    if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+      num_fds = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(fds, CMSG_DATA(header),
+             std::min<size_t>(num_fds, kNumStreams) * sizeof(int));
+    }
+  }
+
+  Reply reply = {-1, 0};
+  std::vector<std::string> strings;
+  if (num_fds != kNumStreams || (message.msg_flags & MSG_TRUNC) ||
+      !ReadStrings(buffer->data(), buffer->data() + size, &strings)) {
+    reply.error = EINVAL;
+  } else {
+    auto found = entry_points.find(strings[0]);
+    if (found == entry_points.end()) {
+      reply.error = ENOENT;
+    } else {
+      // CLONE_PARENT makes the child a sibling of the zygote, so that the
+      // process which asked for it can wait for it.
+      long pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, nullptr, nullptr,
+                         nullptr, nullptr);
+      if (pid == 0) {
+        strings.erase(strings.begin());
+        RunChild(socket, fds, found->second, strings);
+      }
+      if (pid < 0) {
+        reply.error = errno;
+      } else {
+        reply.pid = static_cast<pid_t>(pid);
+      }
+    }
+  }
+  CloseStreams(fds, std::min<size_t>(num_fds, kNumStreams));
+
+  return send(socket, &reply, sizeof(reply), MSG_NOSIGNAL) == sizeof(reply);
+}
+
+__attribute__((noreturn)) void RunZygote(
+    int socket, const Zygote::EntryPoints& entry_points) {
+  // Hold on to nothing of the parent's but the socket, so that, for example,
+  // pipes which the parent is reading from still see their end.
+  socket = fcntl(socket, F_DUPFD_CLOEXEC, kNumStreams);
+  int null_fd = open("/dev/null", O_RDWR);
+  for (int i = 0; i < kNumStreams; ++i) {
+    dup2(null_fd, i);
+  }
+  CloseDescriptorsExcept(socket);
+
+  std::vector<char> buffer(kMaxRequestSize);
+  while (socket >= 0 && HandleRequest(socket, entry_points, &buffer)) {
+  }
+  _exit(0);
+}
+
+int OpenStream(const stdext::optional<stdext::file_system::Path>& file,
+               int flags) {
+  if (file) {
+    return open(file->c_str(), flags | O_CLOEXEC, 0644);
+  }
+  return open("/dev/null", O_RDWR | O_CLOEXEC);
+}
+
+}  // namespace
+
+Zygote::Zygote(const EntryPoints& entry_points) : socket_(-1), pid_(-1) {
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+    return;
+  }
+  // Otherwise output buffered in this process would be written again by
+  // every child.
+  fflush(nullptr);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(sockets[0]);
+    RunZygote(sockets[1], entry_points);
+  }
+
+  close(sockets[1]);
+  if (pid < 0) {
+    close(sockets[0]);
+    return;
+  }
+  socket_ = sockets[0];
+  pid_ = pid;
+}
+
+Zygote::~Zygote() {
+  if (!IsValid()) {
+    return;
+  }
+  // The zygote exits once it sees the socket close.
+  close(socket_);
+  while (waitpid(pid_, nullptr, 0) == -1 && errno == EINTR) {
+  }
+}
+
+Process Zygote::Start(
+    const std::string& name, const std::vector<std::string>& args,
+    const stdext::optional<stdext::file_system::Path>& stdout_file,
+    const stdext::optional<stdext::file_system::Path>& stderr_file,
+    const stdext::optional<stdext::file_system::Path>& stdin_file) {
+  if (!IsValid()) {
+    errno = EBADF;
+    return Process();
+  }
+
+  std::string request;
+  AppendString(&request, name);
+  for (const std::string& arg : args) {
+    AppendString(&request, arg);
+  }
+  if (request.size() > kMaxRequestSize) {
+    errno = E2BIG;
+    return Process();
+  }
+
+  int fds[kNumStreams] = {
+    OpenStream(stdin_file, O_RDONLY),
+    OpenStream(stdout_file, O_WRONLY | O_CREAT | O_TRUNC),
+    OpenStream(stderr_file, O_WRONLY | O_CREAT | O_TRUNC),
+  };
+  for (int fd : fds) {
+    if (fd < 0) {
+      int error = errno;
+      CloseStreams(fds, kNumStreams);
+      errno = error;
+      return Process();
+    }
+  }
+
+  struct iovec data = {const_cast<char*>(request.data()), request.size()};
+  union {
+    char buffer[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+  Reply reply;
+  ssize_t received = -1;
+  auto start_time = Process::Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ssize_t sent;
+    while ((sent = sendmsg(socket_, &message, MSG_NOSIGNAL)) == -1 &&
+           errno == EINTR) {
+    }
+    if (sent == static_cast<ssize_t>(request.size())) {
+      while ((received = recv(socket_, &reply, sizeof(reply), 0)) == -1 &&
+             errno == EINTR) {
+      }
+    }
+  }
+  int error = errno;
+  CloseStreams(fds, kNumStreams);
+  if (received != sizeof(reply)) {
+    // The zygote has died.
+    errno = received < 0 ? error : EPIPE;
+    return Process();
+  }
+  if (reply.pid < 0) {
+    errno = reply.error;
+    return Process();
+  }
+
+  // The child also does this itself, but may not have yet, and signals sent
+  // through the Process must reach its group.
+  setpgid(reply.pid, reply.pid);
+  return Process(reply.pid, OpenPidfd(reply.pid), start_time);
+}
+
+int Zygote::Run(const std::string& name, const std::vector<std::string>& args,
+                const stdext::optional<stdext::file_system::Path>& stdout_file,
+                const stdext::optional<stdext::file_system::Path>& stderr_file,
+                const stdext::optional<stdext::file_system::Path>& stdin_file) {
+  Process process = Start(name, args, stdout_file, stderr_file, stdin_file);
+  if (!process.IsValid()) {
+    return 1;
+  }
+  return process.Wait();
+}
+
+}  // namespace platform
@@ -0,0 +1,120 @@
+#include "platform/file_system.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include "stdext/file_system.h"
+
+// Compares reading a file into a std::string and then scanning it against
+// scanning a mapping of it, with and without the hints MapFileOptions can
+// give.  Pass a file as the second argument to read that instead of a
+// generated one.
+
+using platform::MapFileOptions;
+
+namespace {
+
+template <typename Function>
+double MeasureSeconds(Function function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+size_t CountLines(const char* data, size_t size) {
+  return std::count(data, data + size, '\n');
+}
+
+bool ReadFile(const char* path, std::string* contents) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  char buffer[64 * 1024];
+  ssize_t size;
+  while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+    contents->append(buffer, size);
+  }
+  close(fd);
+  return size == 0;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  size_t megabytes = 256;
+  if (argc > 1) {
+    megabytes = atoi(argv[1]);
+  }
+  stdext::file_system::TemporaryDirectory temporary_directory;
+  std::string path;
+  if (argc > 2) {
+    path = argv[2];
+  } else {
+    path = temporary_directory.path().str() + "/map_file_benchmark";
+    std::string line(99, 'x');
+    line += '\n';
+    std::string chunk;
+    for (int i = 0; i < 10000; ++i) {
+      chunk += line;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    for (size_t written = 0; fd >= 0 && written < megabytes * 1024 * 1024;
+         written += chunk.size()) {
+      if (write(fd, chunk.data(), chunk.size()) !=
+          static_cast<ssize_t>(chunk.size())) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    if (fd < 0) {
+      printf("Could not write %s\n", path.c_str());
+      return 1;
+    }
+    close(fd);
+  }
+
+  printf("Counting the lines of %s\n", path.c_str());
+  size_t lines = 0;
+  double read_seconds = MeasureSeconds([&]() {
+    std::string contents;
+    if (ReadFile(path.c_str(), &contents)) {
+      lines = CountLines(contents.data(), contents.size());
+    }
+  });
+  printf("  Read into a std::string:   %8.1f ms (%zu lines)\n",
+         read_seconds * 1000, lines);
+
+  struct Variant {
+    const char* name;
+    MapFileOptions options;
+  };
+  Variant variants[4];
+  variants[0].name = "MappedFile:                ";
+  variants[1].name = "MappedFile, sequential:    ";
+  variants[1].options.access = MapFileOptions::kSequential;
+  variants[1].options.will_need = true;
+  variants[2].name = "MappedFile, huge pages:    ";
+  variants[2].options.huge_pages = true;
+  variants[3].name = "MappedFile, populated:     ";
+  variants[3].options.populate = true;
+  for (const Variant& variant : variants) {
+    lines = 0;
+    double seconds = MeasureSeconds([&]() {
+      stdext::file_system::MappedFile file(path.c_str(), variant.options);
+      if (!file.error()) {
+        lines = CountLines(file.str().data(), file.size());
+      }
+    });
+    printf("  %s%8.1f ms (%.1fx, %zu lines)\n", variant.name,
+           seconds * 1000, read_seconds / seconds, lines);
+  }
+  return 0;
+}
@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "platform/context.h"
+#include "platform/context_trace.h"
+#include "platform/fiber_pool.h"
+#include "platform/timer_wheel.h"
+#include "stdext/generator.h"
+
+// Microbenchmarks for the fiber layer, intended to be run on every commit so
+// that regressions can be caught by comparing results.  Each benchmark is
+// measured as a number of samples, and the distribution of the samples is
+// written to stdout as JSON.
+//
+// Usage: platform_benchmarks [--samples=N] [--filter=SUBSTRING]
+
+using platform::Context;
+using platform::StackAllocator;
+using platform::SwitchToContext;
+using platform::SwitchToNewContext;
+using platform::TimerWheel;
+
+namespace {
+
+const size_t kDefaultStackSize = 64 * 1024;
+
+typedef std::chrono::steady_clock Clock;
+
+double Nanoseconds(Clock::duration duration) {
+  return static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+struct Result {
+  std::string name;
+  // How many operations each sample timed.
+  int operations_per_sample;
+  // Nanoseconds per operation, one entry per sample.
+  std::vector<double> samples;
+};
+
+// Runs |sample| |num_samples| times, after one untimed warm up run.  Each run
+// of |sample| performs |operations_per_sample| operations and returns how
+// long they took.
+Result Measure(const std::string& name, int num_samples,
+               int operations_per_sample,
+               const std::function<Clock::duration()>& sample) {
+  Result result;
+  result.name = name;
+  result.operations_per_sample = operations_per_sample;
+  sample();
+  for (int i = 0; i < num_samples; ++i) {
+    result.samples.push_back(Nanoseconds(sample()) / operations_per_sample);
+  }
+  return result;
+}
+
+// Switching back and forth between two contexts, optionally with context
+// tracing enabled.  One operation is a single switch.
+Result MeasurePingPong(const std::string& name, int num_samples,
+                       bool traced) {
+  const int kSwitchesPerSample = 2000;
+
+  struct PingPongState {
+    int iterations;
+  } state;
+
+  if (traced) {
+    platform::StartContextTracing();
+  }
+  Result result = Measure(
+      name, num_samples, kSwitchesPerSample,
+      [&state]() {
+        state.iterations = kSwitchesPerSample / 2;
+        // The helper is created, and later finishes, outside of the timed
+        // region, so that only the switches are timed.
+        Context* helper = SwitchToNewContext(
+            kDefaultStackSize, nullptr, [&state](Context* context) {
+              context = SwitchToContext(context, nullptr);
+              for (int i = 0; i < state.iterations; ++i) {
+                context = SwitchToContext(context, nullptr);
+              }
+              return context;
+            });
+        auto start = Clock::now();
+        for (int i = 0; i < state.iterations; ++i) {
+          helper = SwitchToContext(helper, nullptr);
+        }
+        auto end = Clock::now();
+        helper = SwitchToContext(helper, nullptr);
+        assert(helper == nullptr);
+        return end - start;
+      });
+  if (traced) {
+    platform::StopContextTracing();
+    platform::ClearContextTrace();
+  }
+  return result;
+}
+
+// Creating a context, switching to it and having it immediately finish.  One
+// operation is one context.
+Result MeasureNewContext(const std::string& name, int num_samples,
+                         size_t stack_size) {
+  const int kContextsPerSample = 200;
+  return Measure(
+      name, num_samples, kContextsPerSample, [stack_size]() {
+        auto start = Clock::now();
+        for (int i = 0; i < kContextsPerSample; ++i) {
+          SwitchToNewContext(stack_size, nullptr, [](Context* context) {
+            return context;
+          });
+        }
+        return Clock::now() - start;
+      });
+}
+
+// Running short tasks on fibers from a FiberPool, which after the first task
+// reuses the same parked fiber.  One operation is one task, which is a switch
+// into the pooled fiber and a switch back out.
+Result MeasureFiberPool(const std::string& name, int num_samples) {
+  const int kTasksPerSample = 1000;
+  platform::FiberPool pool;
+  return Measure(name, num_samples, kTasksPerSample, [&pool]() {
+    int total = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < kTasksPerSample; ++i) {
+      total += pool.run([i]() { return i; });
+    }
+    auto end = Clock::now();
+    assert(total == kTasksPerSample * (kTasksPerSample - 1) / 2);
+    (void)total;
+    return end - start;
+  });
+}
+
+// Pulling values out of a stdext::generator.  One operation is one value,
+// which is a switch into the generator and a switch back out.
+Result MeasureGenerator(const std::string& name, int num_samples) {
+  const int kValuesPerSample = 1000;
+  stdext::generator<int> values([](stdext::generator<int>::yielder& yield) {
+    for (int i = 0; yield(i); ++i) {
+    }
+  });
+  stdext::generator<int>::iterator it = values.begin();
+  return Measure(name, num_samples, kValuesPerSample, [&it]() {
+    auto start = Clock::now();
+    for (int i = 0; i < kValuesPerSample; ++i) {
+      ++it;
+    }
+    return Clock::now() - start;
+  });
+}
+
+// Adding timeouts to a wheel which already holds |num_pending| long ones,
+// and then either cancelling them or letting them expire.  One operation is
+// one timer.
+Result MeasureTimerWheel(const std::string& name, int num_samples,
+                         int num_pending, bool expire) {
+  const int kTimersPerSample = 1000;
+  const uint64_t kDay = 24ull * 60 * 60 * 1000 * 1000 * 1000;
+
+  TimerWheel wheel(0);
+  std::vector<std::unique_ptr<TimerWheel::Timer>> pending;
+  for (int i = 0; i < num_pending; ++i) {
+    pending.emplace_back(new TimerWheel::Timer([](void*) {}, nullptr));
+    wheel.Add(pending.back().get(), kDay + i);
+  }
+  std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+  for (int i = 0; i < kTimersPerSample; ++i) {
+    timers.emplace_back(new TimerWheel::Timer([](void*) {}, nullptr));
+  }
+
+  uint64_t now = 0;
+  return Measure(
+      name, num_samples, kTimersPerSample, [&wheel, &timers, &now, expire]() {
+        auto start = Clock::now();
+        for (int i = 0; i < kTimersPerSample; ++i) {
+          wheel.Add(timers[i].get(), now + 1000 * 1000 * (i % 1000 + 1));
+        }
+        if (expire) {
+          now += 1000 * 1000 * 1000;
+          wheel.Advance(now);
+        } else {
+          for (int i = 0; i < kTimersPerSample; ++i) {
+            wheel.Cancel(timers[i].get());
+          }
+        }
+        return Clock::now() - start;
+      });
+}
+
+// A ring of fibers, each of which switches to the next, as in the
+// SmallSwitchRing test but with the fibers kept alive between laps.  Each
+// fiber writes to |touch_bytes| of its stack whenever it runs, to show the
+// cost of cache and TLB misses once the ring's working set no longer fits.
+class FiberRing {
+ public:
+  FiberRing(int size, size_t touch_bytes)
+      : contexts_(size), touch_bytes_(touch_bytes), exiting_(false),
+        laps_remaining_(0), resumed_by_main_(false), main_(nullptr) {
+    for (int i = 0; i < size; ++i) {
+      contexts_[i] = SwitchToNewContext(
+          kDefaultStackSize, nullptr,
+          [this, i](Context* creator) { return FiberMain(i, creator); });
+    }
+  }
+
+  ~FiberRing() {
+    exiting_ = true;
+    for (Context* context : contexts_) {
+      Context* finished = SwitchToContext(context, nullptr);
+      assert(finished == nullptr);
+      (void)finished;
+    }
+  }
+
+  // Runs |laps| laps of the ring, which is |laps| * size() switches.
+  void Run(int laps) {
+    laps_remaining_ = laps;
+    resumed_by_main_ = true;
+    contexts_.back() = SwitchToContext(contexts_.front(), nullptr);
+  }
+
+  int size() const { return static_cast<int>(contexts_.size()); }
+
+ private:
+  static const size_t kMaxTouchBytes = 16 * 1024;
+
+  Context* FiberMain(int id, Context* creator) {
+    // Park until the first lap.
+    Context* from = SwitchToContext(creator, nullptr);
+
+    volatile char stack_data[kMaxTouchBytes];
+    (void)stack_data;
+    while (!exiting_) {
+      // Whoever switched to us is now suspended, so remember where it is.
+      if (id == 0 && resumed_by_main_) {
+        main_ = from;
+        resumed_by_main_ = false;
+      } else if (id == 0) {
+        contexts_.back() = from;
+      } else {
+        contexts_[id - 1] = from;
+      }
+
+      for (size_t i = 0; i < touch_bytes_; i += 64) {
+        stack_data[i] = static_cast<char>(i);
+      }
+
+      Context* next;
+      if (id == size() - 1) {
+        --laps_remaining_;
+        next = laps_remaining_ > 0 ? contexts_[0] : main_;
+      } else {
+        next = contexts_[id + 1];
+      }
+      from = SwitchToContext(next, nullptr);
+    }
+    return from;
+  }
+
+  std::vector<Context*> contexts_;
+  const size_t touch_bytes_;
+  bool exiting_;
+  int laps_remaining_;
+  // True if the first fiber is about to be resumed by Run() rather than by
+  // the last fiber.
+  bool resumed_by_main_;
+  Context* main_;
+};
+
+Result MeasureRing(const std::string& name, int num_samples, int ring_size,
+                   size_t touch_bytes) {
+  FiberRing ring(ring_size, touch_bytes);
+  int laps = std::max(1, 2000 / ring_size);
+  return Measure(
+      name, num_samples, laps * ring_size, [&ring, laps]() {
+        auto start = Clock::now();
+        ring.Run(laps);
+        return Clock::now() - start;
+      });
+}
+
+// Returns the nearest-rank percentile of the sorted |samples|.
+double Percentile(const std::vector<double>& samples, double percentile) {
+  size_t rank = static_cast<size_t>(percentile / 100.0 * samples.size());
+  return samples[std::min(rank, samples.size() - 1)];
+}
+
+// Returns |str| as a quoted JSON string.
+std::string JsonString(const std::string& str) {
+  std::string json = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      json += '\\';
+      json += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escape[7];
+      snprintf(escape, sizeof(escape), "\\u%04x",
+               static_cast<unsigned>(c));
+      json += escape;
+    } else {
+      json += c;
+    }
+  }
+  return json + "\"";
+}
+
+void PrintResultJson(const Result& result, bool last) {
+  std::vector<double> sorted = result.samples;
+  std::sort(sorted.begin(), sorted.end());
+  double sum = 0;
+  for (double sample : sorted) {
+    sum += sample;
+  }
+
+  printf("    {\n");
+  printf("      \"name\": %s,\n", JsonString(result.name).c_str());
+  printf("      \"unit\": \"ns/op\",\n");
+  printf("      \"samples\": %zu,\n", sorted.size());
+  printf("      \"operations_per_sample\": %d,\n",
+         result.operations_per_sample);
+  printf("      \"min\": %.3f,\n", sorted.front());
+  printf("      \"mean\": %.3f,\n", sum / sorted.size());
+  printf("      \"p50\": %.3f,\n", Percentile(sorted, 50));
+  printf("      \"p90\": %.3f,\n", Percentile(sorted, 90));
+  printf("      \"p99\": %.3f,\n", Percentile(sorted, 99));
+  printf("      \"max\": %.3f\n", sorted.back());
+  printf("    }%s\n", last ? "" : ",");
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int num_samples = 100;
+  std::string filter;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--samples=", 10) == 0) {
+      num_samples = std::max(1, atoi(argv[i] + 10));
+    } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else {
+      fprintf(stderr, "Usage: %s [--samples=N] [--filter=SUBSTRING]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  typedef std::function<Result(const std::string& name)> Benchmark;
+  std::vector<std::pair<std::string, Benchmark>> benchmarks;
+  for (bool traced : {false, true}) {
+    benchmarks.emplace_back(
+        std::string("switch_to_context/ping_pong") +
+            (traced ? "/traced" : ""),
+        [=](const std::string& name) {
+          return MeasurePingPong(name, num_samples, traced);
+        });
+  }
+  for (size_t stack_size : {16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024}) {
+    benchmarks.emplace_back(
+        "switch_to_new_context/stack_size:" + std::to_string(stack_size),
+        [=](const std::string& name) {
+          return MeasureNewContext(name, num_samples, stack_size);
+        });
+  }
+  benchmarks.emplace_back(
+      "fiber_pool/run", [=](const std::string& name) {
+        return MeasureFiberPool(name, num_samples);
+      });
+  benchmarks.emplace_back(
+      "generator/next", [=](const std::string& name) {
+        return MeasureGenerator(name, num_samples);
+      });
+  for (int num_pending : {0, 1000 * 1000}) {
+    for (bool expire : {false, true}) {
+      benchmarks.emplace_back(
+          std::string("timer_wheel/") +
+              (expire ? "add_expire" : "add_cancel") +
+              "/pending:" + std::to_string(num_pending),
+          [=](const std::string& name) {
+            return MeasureTimerWheel(name, num_samples, num_pending, expire);
+          });
+    }
+  }
+  for (size_t touch_bytes : {0, 4 * 1024}) {
+    for (int ring_size : {2, 16, 128, 1024, 4096}) {
+      benchmarks.emplace_back(
+          "ring/fibers:" + std::to_string(ring_size) +
+              "/touch_bytes:" + std::to_string(touch_bytes),
+          [=](const std::string& name) {
+            return MeasureRing(name, num_samples, ring_size, touch_bytes);
+          });
+    }
+  }
+
+  std::vector<Result> results;
+  for (auto& benchmark : benchmarks) {
+    if (benchmark.first.find(filter) != std::string::npos) {
+      results.push_back(benchmark.second(benchmark.first));
+    }
+  }
+
+  printf("{\n");
+  printf("  \"executable\": %s,\n", JsonString(argv[0]).c_str());
+  printf("  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    PrintResultJson(results[i], i + 1 == results.size());
+  }
+  printf("  ]\n");
+  printf("}\n");
+
+  return 0;
+}
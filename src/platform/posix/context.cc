@@ -2,6 +2,8 @@
 
 #include <ucontext.h>
 
+#include "platform/context_trace.h"
+
 namespace platform {
 
 struct Context {
@@ -10,29 +12,37 @@ struct Context {
   void* data;
 
   // Parameters passed when returning from a context.
-  void* stack_to_free;
+  Stack stack_to_free;
+  StackAllocator* stack_allocator;
   Context* previous_context;
 };
 
 namespace {
 void OnReturnFromSwap(Context* context) {
-  if (context->stack_to_free) {
-    free(context->stack_to_free);
-    context->stack_to_free = nullptr;
+  if (context->stack_to_free.base) {
+    context->stack_allocator->Free(context->stack_to_free);
+    context->stack_to_free = Stack();
   }
 }
 
 struct NewContextParams {
-  const FiberMain* fiber_main;
+  RawFiberMain entry_point;
+  void* arg;
   Context* previous_context;
-  void* stack_pointer;
+  StackAllocator* stack_allocator;
+  Stack stack;
 };
 thread_local NewContextParams tl_new_context_params;
 
 void RunNewContext() {
-  FiberMain fiber_main = std::move(*tl_new_context_params.fiber_main);
-  void* stack_pointer = tl_new_context_params.stack_pointer;
-  Context* next_context = fiber_main(tl_new_context_params.previous_context);
+  // The new context always starts on the thread that created it, but it may
+  // later be resumed on another thread.  Copy everything out of the thread
+  // local up front so that it is never touched after the first switch.
+  NewContextParams params = tl_new_context_params;
+  StackAllocator* stack_allocator = params.stack_allocator;
+  Stack stack = params.stack;
+  Context* next_context = params.entry_point(params.previous_context,
+                                             params.arg);
 
   // We cannot end a fiber naturally, a new context to switch to must be
   // specified.  Only the main original thread can terminate naturally.
@@ -40,8 +50,14 @@ void RunNewContext() {
 
   // We're done, so tell the next fiber to free our stack after we perform
   // our final switch.
-  next_context->stack_to_free = stack_pointer;
+  next_context->stack_to_free = stack;
+  next_context->stack_allocator = stack_allocator;
   next_context->previous_context = nullptr;
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(ContextTraceEvent::kExit, nullptr,
+                                      next_context, nullptr,
+                                      next_context->data);
+  }
   if (setcontext(&next_context->ucontext) == -1) {
     assert(false);
   }
@@ -53,8 +69,13 @@ Context* SwitchToContext(Context* destination_context,
   Context existing_context;
   existing_context.data = context_data;
 
-  destination_context->stack_to_free = nullptr;
+  destination_context->stack_to_free = Stack();
   destination_context->previous_context = &existing_context;
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(
+        ContextTraceEvent::kSwitch, &existing_context, destination_context,
+        context_data, destination_context->data);
+  }
   if (swapcontext(
           &existing_context.ucontext, &destination_context->ucontext) == -1) {
     return nullptr;
@@ -65,7 +86,8 @@ Context* SwitchToContext(Context* destination_context,
 }
 
 Context* SwitchToNewContext(
-    size_t stack_size, void* context_data, const FiberMain& entry_point) {
+    StackAllocator* stack_allocator, size_t stack_size, void* context_data,
+    RawFiberMain entry_point, void* arg) {
   Context existing_context;
   existing_context.data = context_data;
 
@@ -74,22 +96,30 @@ Context* SwitchToNewContext(
     return nullptr;
   }
 
-  new_ucontext.uc_stack.ss_size = stack_size;
-  new_ucontext.uc_stack.ss_sp = malloc(stack_size);
-  if (new_ucontext.uc_stack.ss_sp == nullptr) {
+  Stack stack = stack_allocator->Allocate(stack_size);
+  if (stack.base == nullptr) {
     return nullptr;
   }
+  new_ucontext.uc_stack.ss_size = stack.size;
+  new_ucontext.uc_stack.ss_sp = stack.base;
 
   // We pass parameters to the new context through a thread local variable.
-  tl_new_context_params.fiber_main = &entry_point;
+  tl_new_context_params.entry_point = entry_point;
+  tl_new_context_params.arg = arg;
   tl_new_context_params.previous_context = &existing_context;
-  tl_new_context_params.stack_pointer = new_ucontext.uc_stack.ss_sp;
+  tl_new_context_params.stack_allocator = stack_allocator;
+  tl_new_context_params.stack = stack;
   new_ucontext.uc_link = nullptr;
 
   makecontext(
       &new_ucontext, &RunNewContext, 0);
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(ContextTraceEvent::kNewContext,
+                                      &existing_context, nullptr,
+                                      context_data, nullptr);
+  }
   if (swapcontext(&existing_context.ucontext, &new_ucontext) == -1) {
-    free(new_ucontext.uc_stack.ss_sp);
+    stack_allocator->Free(stack);
     return nullptr;
   }
   OnReturnFromSwap(&existing_context);
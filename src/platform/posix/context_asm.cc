@@ -0,0 +1,300 @@
+#include "platform/context.h"
+
+#include <cstdint>
+
+#include "platform/context_trace.h"
+
+// A context switch backend which saves only the registers that the calling
+// convention requires to be preserved across a function call, plus the
+// floating point control state.  Unlike swapcontext(), this never touches the
+// signal mask and so never enters the kernel.
+
+#if defined(__x86_64__)
+
+// System V AMD64.  The saved frame, from the lowest address up, is:
+//   [0] MXCSR (low 32 bits) and x87 control word (bits 32-47)
+//   [1] r15  [2] r14  [3] r13  [4] r12  [5] rbx  [6] rbp
+//   [7] return address
+asm(R"(
+  .text
+  .globl platform_posix_swap_stacks
+  .hidden platform_posix_swap_stacks
+  .type platform_posix_swap_stacks, @function
+  .align 16
+platform_posix_swap_stacks:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  subq $8, %rsp
+  stmxcsr (%rsp)
+  fnstcw 4(%rsp)
+
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+
+  ldmxcsr (%rsp)
+  fldcw 4(%rsp)
+  addq $8, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  ret
+  .size platform_posix_swap_stacks, .-platform_posix_swap_stacks
+
+  .globl platform_posix_context_entry
+  .hidden platform_posix_context_entry
+  .type platform_posix_context_entry, @function
+  .align 16
+platform_posix_context_entry:
+  movq %rbx, %rdi
+  andq $-16, %rsp
+  callq *%r12
+  ud2
+  .size platform_posix_context_entry, .-platform_posix_context_entry
+)");
+
+namespace {
+const int kFrameWords = 8;
+const int kFrameFPControlIndex = 0;
+const int kFrameArgumentIndex = 5;
+const int kFrameFunctionIndex = 4;
+const int kFrameReturnAddressIndex = 7;
+
+uint64_t GetFPControl() {
+  uint32_t mxcsr;
+  uint16_t x87_control_word;
+  asm volatile("stmxcsr %0" : "=m"(mxcsr));
+  asm volatile("fnstcw %0" : "=m"(x87_control_word));
+  return static_cast<uint64_t>(mxcsr) |
+         (static_cast<uint64_t>(x87_control_word) << 32);
+}
+}  // namespace
+
+#elif defined(__aarch64__)
+
+// AAPCS64.  The saved frame, from the lowest address up, is:
+//   [0-9] x19-x28  [10] x29 (fp)  [11] x30 (lr)
+//   [12-19] d8-d15
+//   [20] FPCR  [21] padding to keep sp 16 byte aligned
+asm(R"(
+  .text
+  .globl platform_posix_swap_stacks
+  .hidden platform_posix_swap_stacks
+  .type platform_posix_swap_stacks, %function
+  .align 4
+platform_posix_swap_stacks:
+  sub sp, sp, #176
+  stp x19, x20, [sp, #0]
+  stp x21, x22, [sp, #16]
+  stp x23, x24, [sp, #32]
+  stp x25, x26, [sp, #48]
+  stp x27, x28, [sp, #64]
+  stp x29, x30, [sp, #80]
+  stp d8, d9, [sp, #96]
+  stp d10, d11, [sp, #112]
+  stp d12, d13, [sp, #128]
+  stp d14, d15, [sp, #144]
+  mrs x9, fpcr
+  str x9, [sp, #160]
+
+  mov x9, sp
+  str x9, [x0]
+  mov sp, x1
+
+  ldr x9, [sp, #160]
+  msr fpcr, x9
+  ldp d14, d15, [sp, #144]
+  ldp d12, d13, [sp, #128]
+  ldp d10, d11, [sp, #112]
+  ldp d8, d9, [sp, #96]
+  ldp x29, x30, [sp, #80]
+  ldp x27, x28, [sp, #64]
+  ldp x25, x26, [sp, #48]
+  ldp x23, x24, [sp, #32]
+  ldp x21, x22, [sp, #16]
+  ldp x19, x20, [sp, #0]
+  add sp, sp, #176
+  ret
+  .size platform_posix_swap_stacks, .-platform_posix_swap_stacks
+
+  .globl platform_posix_context_entry
+  .hidden platform_posix_context_entry
+  .type platform_posix_context_entry, %function
+  .align 4
+platform_posix_context_entry:
+  mov x0, x19
+  mov x29, xzr
+  blr x20
+  brk #0
+  .size platform_posix_context_entry, .-platform_posix_context_entry
+)");
+
+namespace {
+const int kFrameWords = 22;
+const int kFrameFPControlIndex = 20;
+const int kFrameArgumentIndex = 0;
+const int kFrameFunctionIndex = 1;
+const int kFrameReturnAddressIndex = 11;
+
+uint64_t GetFPControl() {
+  uint64_t fpcr;
+  asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+  return fpcr;
+}
+}  // namespace
+
+#else
+#error "The assembly context backend does not support this architecture."
+#endif
+
+extern "C" {
+// Saves the callee-saved registers onto the current stack, stores the
+// resulting stack pointer into |from_stack_pointer|, and then restores the
+// registers saved at |to_stack_pointer| and returns into that context.
+void platform_posix_swap_stacks(void** from_stack_pointer,
+                                void* to_stack_pointer);
+
+// The return address planted in the initial frame of a new context.  It
+// calls the function stored in the frame's function slot, passing the value
+// stored in the argument slot.
+void platform_posix_context_entry();
+}
+
+namespace platform {
+
+struct Context {
+  // Parameters passed when proceeding to the next context.
+  void* stack_pointer;
+  void* data;
+
+  // Parameters passed when returning from a context.
+  Stack stack_to_free;
+  StackAllocator* stack_allocator;
+  Context* previous_context;
+};
+
+namespace {
+void OnReturnFromSwap(Context* context) {
+  if (context->stack_to_free.base) {
+    context->stack_allocator->Free(context->stack_to_free);
+    context->stack_to_free = Stack();
+  }
+}
+
+struct NewContextParams {
+  RawFiberMain entry_point;
+  void* arg;
+  Context* previous_context;
+  StackAllocator* stack_allocator;
+  Stack stack;
+};
+
+// Unlike the ucontext backend, parameters are handed to the new context
+// through a register in its initial frame rather than through a thread local
+// variable.
+void RunNewContext(NewContextParams* params) {
+  StackAllocator* stack_allocator = params->stack_allocator;
+  Stack stack = params->stack;
+  Context* next_context =
+      params->entry_point(params->previous_context, params->arg);
+
+  // We cannot end a fiber naturally, a new context to switch to must be
+  // specified.  Only the main original thread can terminate naturally.
+  assert(next_context);
+
+  // We're done, so tell the next fiber to free our stack after we perform
+  // our final switch.  The stack pointer we save here is never resumed.
+  next_context->stack_to_free = stack;
+  next_context->stack_allocator = stack_allocator;
+  next_context->previous_context = nullptr;
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(ContextTraceEvent::kExit, nullptr,
+                                      next_context, nullptr,
+                                      next_context->data);
+  }
+  void* unused_stack_pointer;
+  platform_posix_swap_stacks(&unused_stack_pointer,
+                             next_context->stack_pointer);
+  assert(false);
+}
+
+// Lays out an initial frame at the top of the given stack so that switching
+// to the returned stack pointer will enter RunNewContext(params).
+void* MakeInitialFrame(const Stack& stack, NewContextParams* params) {
+  uintptr_t stack_top = reinterpret_cast<uintptr_t>(stack.base) + stack.size;
+  stack_top &= ~static_cast<uintptr_t>(15);
+
+  uint64_t* frame = reinterpret_cast<uint64_t*>(stack_top) - kFrameWords;
+  for (int i = 0; i < kFrameWords; ++i) {
+    frame[i] = 0;
+  }
+  frame[kFrameFPControlIndex] = GetFPControl();
+  frame[kFrameArgumentIndex] = reinterpret_cast<uintptr_t>(params);
+  frame[kFrameFunctionIndex] = reinterpret_cast<uintptr_t>(&RunNewContext);
+  frame[kFrameReturnAddressIndex] =
+      reinterpret_cast<uintptr_t>(&platform_posix_context_entry);
+
+  return frame;
+}
+}  // namespace
+
+Context* SwitchToContext(Context* destination_context,
+                         void* context_data) {
+  Context existing_context;
+  existing_context.data = context_data;
+
+  destination_context->stack_to_free = Stack();
+  destination_context->previous_context = &existing_context;
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(
+        ContextTraceEvent::kSwitch, &existing_context, destination_context,
+        context_data, destination_context->data);
+  }
+  platform_posix_swap_stacks(&existing_context.stack_pointer,
+                             destination_context->stack_pointer);
+
+  OnReturnFromSwap(&existing_context);
+  return existing_context.previous_context;
+}
+
+Context* SwitchToNewContext(
+    StackAllocator* stack_allocator, size_t stack_size, void* context_data,
+    RawFiberMain entry_point, void* arg) {
+  Context existing_context;
+  existing_context.data = context_data;
+
+  Stack stack = stack_allocator->Allocate(stack_size);
+  if (stack.base == nullptr) {
+    return nullptr;
+  }
+
+  NewContextParams params;
+  params.entry_point = entry_point;
+  params.arg = arg;
+  params.previous_context = &existing_context;
+  params.stack_allocator = stack_allocator;
+  params.stack = stack;
+
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(ContextTraceEvent::kNewContext,
+                                      &existing_context, nullptr,
+                                      context_data, nullptr);
+  }
+  platform_posix_swap_stacks(&existing_context.stack_pointer,
+                             MakeInitialFrame(stack, &params));
+
+  OnReturnFromSwap(&existing_context);
+  return existing_context.previous_context;
+}
+
+void* GetContextData(const Context* context) {
+  return context->data;
+}
+
+}  // namespace platform
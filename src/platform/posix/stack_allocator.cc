@@ -0,0 +1,228 @@
+#include "platform/stack_allocator.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdint>
+
+#include "platform/stack_profiler.h"
+
+namespace platform {
+
+namespace {
+
+// Size classes are powers of two, starting at 16KiB.  Requests larger than
+// the largest size class are mapped directly and never cached.
+const int kMinSizeClassLog2 = 14;
+const int kNumSizeClasses = 12;
+
+// When a thread's cache runs dry, enough stacks of the requested size class
+// to fill roughly this many bytes are mapped at once.
+const size_t kSlabTargetSize = 1024 * 1024;
+
+size_t PageSize() {
+  static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return page_size;
+}
+
+size_t RoundUpToPageSize(size_t size) {
+  return (size + PageSize() - 1) & ~(PageSize() - 1);
+}
+
+size_t SizeClassStackSize(int size_class) {
+  return RoundUpToPageSize(
+      static_cast<size_t>(1) << (kMinSizeClassLog2 + size_class));
+}
+
+// Returns the smallest size class that can hold |size| bytes, or -1 if there
+// is none.
+int SizeClassForSize(size_t size) {
+  for (int i = 0; i < kNumSizeClasses; ++i) {
+    if (SizeClassStackSize(i) >= size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Maps |count| contiguous stacks of |size| bytes each, with a guard page
+// below each one.  Returns false if the memory could not be mapped.
+bool MapStacks(size_t size, size_t count, Stack* stacks) {
+  const size_t page_size = PageSize();
+  const size_t stride = size + page_size;
+
+  void* slab = mmap(
+      nullptr, stride * count, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (slab == MAP_FAILED) {
+    return false;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t* guard_page = static_cast<uint8_t*>(slab) + i * stride;
+    if (mprotect(guard_page, page_size, PROT_NONE) != 0) {
+      munmap(slab, stride * count);
+      return false;
+    }
+    stacks[i].base = guard_page + page_size;
+    stacks[i].size = size;
+  }
+
+  return true;
+}
+
+void UnmapStack(const Stack& stack) {
+  const size_t page_size = PageSize();
+  munmap(static_cast<uint8_t*>(stack.base) - page_size,
+         stack.size + page_size);
+}
+
+// Cached stacks are kept in an intrusive list, with each node stored at the
+// top of the stack it describes.  The top of the stack is the memory that a
+// new fiber touches first, so this costs nothing in resident memory.
+struct FreeStackNode {
+  FreeStackNode* next;
+};
+
+FreeStackNode* NodeForStack(const Stack& stack) {
+  return reinterpret_cast<FreeStackNode*>(
+      static_cast<uint8_t*>(stack.base) + stack.size) - 1;
+}
+
+class ThreadStackCache {
+ public:
+  ~ThreadStackCache() {
+    for (int i = 0; i < kNumSizeClasses; ++i) {
+      Stack stack;
+      while (Pop(i, &stack)) {
+        UnmapStack(stack);
+      }
+    }
+  }
+
+  bool Pop(int size_class, Stack* stack) {
+    SizeClassList& list = lists_[size_class];
+    if (!list.head) {
+      return false;
+    }
+
+    FreeStackNode* node = list.head;
+    list.head = node->next;
+    --list.count;
+
+    stack->size = SizeClassStackSize(size_class);
+    stack->base = reinterpret_cast<uint8_t*>(node + 1) - stack->size;
+    return true;
+  }
+
+  bool Push(int size_class, const Stack& stack, size_t max_count) {
+    SizeClassList& list = lists_[size_class];
+    if (list.count >= max_count) {
+      return false;
+    }
+
+    FreeStackNode* node = NodeForStack(stack);
+    node->next = list.head;
+    list.head = node;
+    ++list.count;
+    return true;
+  }
+
+ private:
+  struct SizeClassList {
+    FreeStackNode* head = nullptr;
+    size_t count = 0;
+  };
+  SizeClassList lists_[kNumSizeClasses];
+};
+
+thread_local ThreadStackCache tl_stack_cache;
+
+Stack AllocateStack(size_t size, size_t max_cached_per_size_class) {
+  Stack stack;
+
+  int size_class = SizeClassForSize(size);
+  if (size_class < 0) {
+    MapStacks(RoundUpToPageSize(size), 1, &stack);
+    return stack;
+  }
+
+  if (tl_stack_cache.Pop(size_class, &stack)) {
+    return stack;
+  }
+
+  // Map a slab of stacks, return the first one and cache the rest.
+  const size_t stack_size = SizeClassStackSize(size_class);
+  size_t slab_count = kSlabTargetSize / (stack_size + PageSize());
+  if (slab_count > max_cached_per_size_class + 1) {
+    slab_count = max_cached_per_size_class + 1;
+  }
+  if (slab_count < 1) {
+    slab_count = 1;
+  }
+
+  Stack slab_stacks[kSlabTargetSize / (1 << kMinSizeClassLog2)];
+  assert(slab_count <= sizeof(slab_stacks) / sizeof(slab_stacks[0]));
+  if (!MapStacks(stack_size, slab_count, slab_stacks)) {
+    return stack;
+  }
+
+  for (size_t i = 1; i < slab_count; ++i) {
+    if (!tl_stack_cache.Push(
+            size_class, slab_stacks[i], max_cached_per_size_class)) {
+      UnmapStack(slab_stacks[i]);
+    }
+  }
+
+  return slab_stacks[0];
+}
+
+}  // namespace
+
+size_t StackAllocator::AllocatedSize(size_t size) {
+  int size_class = SizeClassForSize(size);
+  return size_class < 0 ? RoundUpToPageSize(size)
+                        : SizeClassStackSize(size_class);
+}
+
+Stack StackAllocator::Allocate(size_t size) {
+  Stack stack = AllocateStack(size, options_.max_cached_per_size_class);
+  if (stack.base && options_.profile) {
+    options_.profile->OnAllocate(&stack);
+  }
+  return stack;
+}
+
+void StackAllocator::Free(const Stack& stack) {
+  if (!stack.base) {
+    return;
+  }
+
+  if (options_.profile) {
+    options_.profile->OnFree(stack);
+  }
+
+  int size_class = SizeClassForSize(stack.size);
+  if (size_class < 0 || SizeClassStackSize(size_class) != stack.size) {
+    UnmapStack(stack);
+    return;
+  }
+
+  if (options_.release_on_free && stack.size > PageSize()) {
+    // Keep the top page, where the cache's list node lives, resident.
+    madvise(stack.base, stack.size - PageSize(), MADV_DONTNEED);
+  }
+
+  if (!tl_stack_cache.Push(
+          size_class, stack, options_.max_cached_per_size_class)) {
+    UnmapStack(stack);
+  }
+}
+
+StackAllocator* StackAllocator::GetDefault() {
+  static StackAllocator default_allocator;
+  return &default_allocator;
+}
+
+}  // namespace platform
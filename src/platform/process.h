@@ -0,0 +1,258 @@
+#ifndef __PLATFORM_PROCESS_H__
+#define __PLATFORM_PROCESS_H__
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "stdext/file_system.h"
+#include "stdext/optional.h"
+
+namespace platform {
+
+// What a process, and the descendants which it waited for, used while it
+// ran, as reported by wait4() and /proc/<pid>/io.
+struct ResourceUsage {
+  ResourceUsage()
+      : wall_time(0), user_time(0), system_time(0), max_rss_bytes(0),
+        voluntary_context_switches(0), involuntary_context_switches(0),
+        read_bytes(0), write_bytes(0), read_chars(0), write_chars(0) {}
+
+  // From just before the process was started until it was seen to exit.
+  std::chrono::nanoseconds wall_time;
+  std::chrono::nanoseconds user_time;
+  std::chrono::nanoseconds system_time;
+
+  // The largest resident set of the process, or of any one descendant.
+  uint64_t max_rss_bytes;
+
+  uint64_t voluntary_context_switches;
+  uint64_t involuntary_context_switches;
+
+  // Bytes read from and written to storage, and bytes passed through read()
+  // and write() and similar calls whether or not they reached storage.  Zero
+  // if /proc/<pid>/io could not be read.
+  uint64_t read_bytes;
+  uint64_t write_bytes;
+  uint64_t read_chars;
+  uint64_t write_chars;
+};
+
+// Totals ResourceUsages over a batch of processes.
+struct ResourceUsageSummary {
+  ResourceUsageSummary() : num_processes(0) {}
+
+  void Add(const ResourceUsage& usage);
+
+  size_t num_processes;
+  // Every field summed, except max_rss_bytes, which is the largest.
+  ResourceUsage total;
+  // The largest value of each field.
+  ResourceUsage max;
+};
+
+// A child process which runs without the parent waiting for it, so that one
+// thread can look after many of them.  Only available on Linux.
+//
+// Each child is the leader of a new process group, so that signals sent
+// through Signal() also reach the processes it starts in turn.  Where the
+// kernel supports it, the process also has a pidfd, which becomes readable
+// when the process exits and so can be waited on with poll() or epoll
+// alongside other descriptors.
+//
+// Statuses are as returned by waitpid(), to be examined with WIFEXITED() and
+// friends, as with SystemCommand().
+class Process {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // A Process which does not refer to any process.
+  Process();
+  Process(Process&& other);
+  Process& operator=(Process&& other);
+  Process(const Process&) = delete;
+  Process& operator=(const Process&) = delete;
+
+  // Takes ownership of the child process |pid|, which must lead its own
+  // process group and which the caller must not wait for itself, and of
+  // |pidfd| unless it is -1.  |start_time| is when the process was started,
+  // for its ResourceUsage.
+  Process(pid_t pid, int pidfd, Clock::time_point start_time = Clock::now());
+
+  // If the process is still running, kills its process group and waits for
+  // it to exit.
+  ~Process();
+
+  bool IsValid() const { return pid_ > 0; }
+  pid_t pid() const { return pid_; }
+
+  // Returns a descriptor which becomes readable once the process has exited,
+  // or -1 if pidfds are not supported.  It is owned by the Process, and
+  // stays open until the Process is destroyed.
+  int pidfd() const { return pidfd_; }
+
+  // Returns true once the process has exited and been waited for.
+  bool exited() const { return exited_; }
+
+  // What the process used, once it has exited.
+  const ResourceUsage& resource_usage() const { return resource_usage_; }
+
+  // Returns the process's status if it has exited, without blocking.
+  stdext::optional<int> Poll();
+
+  // Waits for the process to exit, and returns its status.
+  int Wait();
+
+  // As Wait(), but gives up and returns nothing once |deadline| has passed.
+  stdext::optional<int> WaitUntil(Clock::time_point deadline);
+
+  template <typename Rep, typename Period>
+  stdext::optional<int> WaitFor(
+      const std::chrono::duration<Rep, Period>& duration) {
+    return WaitUntil(
+        Clock::now() + std::chrono::duration_cast<Clock::duration>(duration));
+  }
+
+  // Sends |signal| to the process's group.  Returns false, with errno set, if
+  // the signal could not be sent, including when the process has already
+  // been waited for.
+  bool Signal(int signal);
+
+ private:
+  // Reaps the process if it has exited, or waits for it to if |block|.
+  bool Reap(bool block);
+  void Reset();
+
+  pid_t pid_;
+  int pidfd_;
+  bool exited_;
+  int status_;
+  Clock::time_point start_time_;
+  ResourceUsage resource_usage_;
+};
+
+// Opens a pidfd for the process |pid|, which may be polled for its exit.
+// Returns -1 on kernels older than 5.3, which do not have pidfds.
+int OpenPidfd(pid_t pid);
+
+// Starts the given system command as SystemCommand() does, but returns
+// without waiting for it to exit.  On failure, returns an invalid Process
+// and sets errno.
+Process StartSystemCommand(
+    const char* command,
+    const stdext::optional<stdext::file_system::Path>& stdout_file,
+    const stdext::optional<stdext::file_system::Path>& stderr_file,
+    const stdext::optional<stdext::file_system::Path>& stdin_file);
+
+struct SystemCommandResult {
+  // As returned by SystemCommand().
+  int status;
+  ResourceUsage resource_usage;
+};
+
+// Runs the given system command and waits for it, as SystemCommand() does,
+// but also returns what it used.  Returns nothing, with errno set, if the
+// command could not be started.
+stdext::optional<SystemCommandResult> SystemCommandWithUsage(
+    const char* command,
+    const stdext::optional<stdext::file_system::Path>& stdout_file,
+    const stdext::optional<stdext::file_system::Path>& stderr_file,
+    const stdext::optional<stdext::file_system::Path>& stdin_file);
+
+// Options for StartProgram().
+struct ProgramOptions {
+  // If set, the program's entire environment, as "NAME=value" strings.
+  // Otherwise it inherits this process's environment.
+  stdext::optional<std::vector<std::string>> environment;
+
+  // If set, the directory the program starts in.  Needs glibc 2.29 or later,
+  // without which StartProgram() fails with ENOSYS.
+  stdext::optional<stdext::file_system::Path> working_directory;
+
+  // As for StartSystemCommand().
+  stdext::optional<stdext::file_system::Path> stdout_file;
+  stdext::optional<stdext::file_system::Path> stderr_file;
+  stdext::optional<stdext::file_system::Path> stdin_file;
+};
+
+// Starts the program |argv[0]| with the arguments |argv| directly, rather
+// than through "/bin/sh -c", which saves starting a shell for every process.
+// If |argv[0]| contains no slash, it is looked for with FindProgram().  The
+// child is started with posix_spawn(), which on glibc shares this process's
+// memory until the exec rather than copying its page tables.  On failure,
+// including when the program can not be executed, returns an invalid Process
+// and sets errno.
+Process StartProgram(const std::vector<std::string>& argv,
+                     const ProgramOptions& options);
+
+// Returns the file which execvp() would run for |program|, searching this
+// process's PATH if |program| contains no slash.  Results are cached for each
+// value of PATH, and are forgotten by StartProgram() if they turn out to be
+// stale.  Returns nothing, with errno set, if there is no such program.
+stdext::optional<std::string> FindProgram(const std::string& program);
+
+// Options for CaptureSystemCommand().
+struct CaptureOptions {
+  typedef std::function<void(const char* data, size_t size)> ChunkCallback;
+
+  CaptureOptions() : capture_stdout(true), capture_stderr(true) {}
+
+  // Written to the child's standard input, which is closed afterwards.  If
+  // empty, the child reads from /dev/null instead.
+  std::string stdin_data;
+
+  // Whether standard output and error are collected into the CaptureResult.
+  bool capture_stdout;
+  bool capture_stderr;
+
+  // If set, called with each chunk of standard output or error as it
+  // arrives.
+  ChunkCallback on_stdout;
+  ChunkCallback on_stderr;
+
+  // If set, standard output or error is also written to these files.
+  // Output which is only going to a file is moved there with splice(), and
+  // output which is also collected is duplicated with tee(), so that it is
+  // never copied through this process on its way to the file.
+  stdext::optional<stdext::file_system::Path> stdout_file;
+  stdext::optional<stdext::file_system::Path> stderr_file;
+};
+
+struct CaptureResult {
+  // As returned by waitpid().
+  int status;
+  ResourceUsage resource_usage;
+  std::string stdout_data;
+  std::string stderr_data;
+};
+
+// Runs |command| as SystemCommand() does, with its standard streams
+// connected to pipes rather than files, and waits for it to exit.  Both
+// output pipes are drained together with poll(), so a child which fills one
+// while the other is being read never deadlocks.  Output is read until every
+// process holding the pipes, including any the child left running in the
+// background, has closed them.  Returns nothing, with errno set, if the
+// command could not be started or its output could not be written to a
+// file.
+stdext::optional<CaptureResult> CaptureSystemCommand(
+    const char* command, const CaptureOptions& options);
+
+// Waits for any of |processes| which have not exited yet to exit, and
+// returns its index.  Returns nothing once |deadline| has passed, or if all
+// of them have already exited.
+stdext::optional<size_t> WaitForAny(
+    const std::vector<Process*>& processes,
+    Process::Clock::time_point deadline = Process::Clock::time_point::max());
+
+// Waits for all of |processes| to exit, and returns the indices of those
+// which had not exited yet, in the order in which they exited.
+std::vector<size_t> WaitForAll(const std::vector<Process*>& processes);
+
+}  // namespace platform
+
+#endif  // __PLATFORM_PROCESS_H__
@@ -0,0 +1,96 @@
+#include "platform/process.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "platform/subprocess.h"
+#include "platform/zygote.h"
+
+// Measures how many short-lived processes can be started and waited for per
+// second, through the shell with SystemCommand(), without it with
+// StartProgram(), both one at a time and with many running at once, and by
+// forking them from a Zygote.
+
+using platform::Process;
+using platform::ProgramOptions;
+using platform::StartProgram;
+using platform::SystemCommand;
+using platform::WaitForAll;
+using platform::Zygote;
+
+namespace {
+
+template <typename Function>
+double MeasureRate(int count, Function function) {
+  auto start = std::chrono::steady_clock::now();
+  function(count);
+  auto end = std::chrono::steady_clock::now();
+  return count / std::chrono::duration<double>(end - start).count();
+}
+
+void RunSystemCommands(int count) {
+  for (int i = 0; i < count; ++i) {
+    SystemCommand("true", stdext::nullopt, stdext::nullopt, stdext::nullopt);
+  }
+}
+
+void RunPrograms(int count) {
+  for (int i = 0; i < count; ++i) {
+    StartProgram({"true"}, ProgramOptions()).Wait();
+  }
+}
+
+void RunConcurrentPrograms(int count, int concurrency) {
+  for (int started = 0; started < count; started += concurrency) {
+    std::vector<Process> processes;
+    std::vector<Process*> pointers;
+    processes.reserve(concurrency);
+    for (int i = 0; i < concurrency && started + i < count; ++i) {
+      processes.push_back(StartProgram({"true"}, ProgramOptions()));
+      pointers.push_back(&processes.back());
+    }
+    WaitForAll(pointers);
+  }
+}
+
+int ReturnZero(const std::vector<std::string>&) { return 0; }
+
+void RunZygoteChildren(Zygote* zygote, int count) {
+  for (int i = 0; i < count; ++i) {
+    zygote->Run("zero", {}, stdext::nullopt, stdext::nullopt,
+                stdext::nullopt);
+  }
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int count = 2000;
+  if (argc > 1) {
+    count = atoi(argv[1]);
+  }
+
+  // Started first, while this process has no other threads.
+  Zygote zygote(Zygote::EntryPoints{{"zero", &ReturnZero}});
+
+  printf("Running \"true\" %d times\n", count);
+  printf("  SystemCommand(), one at a time: %8.0f processes/s\n",
+         MeasureRate(count, &RunSystemCommands));
+  printf("  StartProgram(), one at a time:  %8.0f processes/s\n",
+         MeasureRate(count, &RunPrograms));
+  for (int concurrency : {8, 64}) {
+    printf("  StartProgram(), %2d at a time:   %8.0f processes/s\n",
+           concurrency, MeasureRate(count, [concurrency](int count) {
+             RunConcurrentPrograms(count, concurrency);
+           }));
+  }
+  printf("  Zygote::Run(), one at a time:   %8.0f processes/s\n",
+         MeasureRate(count, [&zygote](int count) {
+           RunZygoteChildren(&zygote, count);
+         }));
+
+  return 0;
+}
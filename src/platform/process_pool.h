@@ -0,0 +1,93 @@
+#ifndef __PLATFORM_PROCESS_POOL_H__
+#define __PLATFORM_PROCESS_POOL_H__
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "platform/process.h"
+#include "stdext/file_system.h"
+#include "stdext/optional.h"
+
+namespace platform {
+
+// Runs a queue of system commands with at most a fixed number of them running
+// at once, as "make -j" does.  Only available on Linux.
+//
+// The commands are started and waited for by the thread which calls Run(),
+// which waits for all of the running children at once with WaitForAny(), and
+// calls each command's callback on that thread as soon as it exits.  The
+// callbacks therefore fire in the order in which the commands finish, and may
+// add further commands to the pool.
+class ProcessPool {
+ public:
+  struct Options {
+    Options() : max_processes(0), max_load_average(0) {}
+
+    // The most commands which run at once.  If 0, the number of online CPUs.
+    int max_processes;
+
+    // If positive, no command is started while the system's one minute load
+    // average is at least this high, unless none are running, as with
+    // "make -l".
+    double max_load_average;
+  };
+
+  struct Command {
+    Command(const char* command) : command(command) {}
+    Command(const std::string& command) : command(command) {}
+
+    // Run with "/bin/sh -c", as by SystemCommand().
+    std::string command;
+    stdext::optional<stdext::file_system::Path> stdout_file;
+    stdext::optional<stdext::file_system::Path> stderr_file;
+    stdext::optional<stdext::file_system::Path> stdin_file;
+  };
+
+  // Called with a command's status as SystemCommand() would return it,
+  // including 1 if the command could not be started.
+  typedef std::function<void(int status)> Callback;
+
+  ProcessPool() : ProcessPool(Options()) {}
+  explicit ProcessPool(const Options& options);
+  ProcessPool(const ProcessPool&) = delete;
+  ProcessPool& operator=(const ProcessPool&) = delete;
+
+  // Queues |command| to be run by Run().  |on_exit| may be empty.
+  void Add(const Command& command, Callback on_exit);
+
+  // Runs queued commands until there are none left, and all have exited.
+  void Run();
+
+  int max_processes() const { return max_processes_; }
+
+  // What the commands which have exited so far used, in total.
+  const ResourceUsageSummary& resource_usage() const {
+    return resource_usage_;
+  }
+
+ private:
+  struct Job {
+    Command command;
+    Callback on_exit;
+  };
+
+  struct RunningJob {
+    Process process;
+    Callback on_exit;
+  };
+
+  // Returns true if another command may start while |num_running| are
+  // running.
+  bool MayStart(size_t num_running) const;
+
+  const int max_processes_;
+  const double max_load_average_;
+  std::deque<Job> queue_;
+  ResourceUsageSummary resource_usage_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_PROCESS_POOL_H__
@@ -0,0 +1,115 @@
+#include "platform/process_pool.h"
+
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::ProcessPool;
+
+namespace {
+ProcessPool::Options OptionsWithMaxProcesses(int max_processes) {
+  ProcessPool::Options options;
+  options.max_processes = max_processes;
+  return options;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start).count();
+}
+}  // namespace
+
+TEST(ProcessPoolTests, DefaultsToOneProcessPerCpu) {
+  ProcessPool pool;
+  EXPECT_LE(1, pool.max_processes());
+}
+
+TEST(ProcessPoolTests, RunsEveryCommand) {
+  ProcessPool pool(OptionsWithMaxProcesses(4));
+  std::vector<int> statuses(20, -1);
+  for (int i = 0; i < 20; ++i) {
+    pool.Add("exit " + std::to_string(i),
+             [&statuses, i](int status) { statuses[i] = status; });
+  }
+  pool.Run();
+
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(WIFEXITED(statuses[i]));
+    EXPECT_EQ(i, WEXITSTATUS(statuses[i]));
+  }
+  EXPECT_EQ(20u, pool.resource_usage().num_processes);
+  EXPECT_LT(0u, pool.resource_usage().max.max_rss_bytes);
+}
+
+TEST(ProcessPoolTests, CallbacksFireInCompletionOrder) {
+  ProcessPool pool(OptionsWithMaxProcesses(3));
+  std::vector<int> order;
+  for (int i : {3, 1, 2}) {
+    pool.Add("sleep 0." + std::to_string(i),
+             [&order, i](int) { order.push_back(i); });
+  }
+  pool.Run();
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), order);
+}
+
+TEST(ProcessPoolTests, LimitsTheNumberOfRunningCommands) {
+  ProcessPool pool(OptionsWithMaxProcesses(2));
+  for (int i = 0; i < 6; ++i) {
+    pool.Add("sleep 0.1", ProcessPool::Callback());
+  }
+  auto start = std::chrono::steady_clock::now();
+  pool.Run();
+  double seconds = SecondsSince(start);
+
+  // Three rounds of two commands each.
+  EXPECT_LE(0.3, seconds);
+  EXPECT_GT(0.6, seconds);
+}
+
+TEST(ProcessPoolTests, CallbacksMayAddCommands) {
+  ProcessPool pool(OptionsWithMaxProcesses(2));
+  int num_done = 0;
+  std::function<void(int)> add_more = [&](int status) {
+    EXPECT_EQ(0, status);
+    if (++num_done < 10) {
+      pool.Add("true", add_more);
+    }
+  };
+  pool.Add("true", add_more);
+  pool.Run();
+  EXPECT_EQ(10, num_done);
+}
+
+TEST(ProcessPoolTests, ReportsCommandsWhichCanNotStart) {
+  ProcessPool pool;
+  ProcessPool::Command command("true");
+  command.stdin_file = stdext::file_system::Path("/this/file/does/not/exist");
+  int status = -1;
+  pool.Add(command, [&status](int exit_status) { status = exit_status; });
+  pool.Run();
+  EXPECT_EQ(1, status);
+}
+
+TEST(ProcessPoolTests, HighLoadRunsOneCommandAtATime) {
+  double load_average;
+  ASSERT_EQ(1, getloadavg(&load_average, 1));
+  if (load_average <= 0) {
+    // The load can not be higher than any limit.
+    return;
+  }
+
+  ProcessPool::Options options = OptionsWithMaxProcesses(4);
+  options.max_load_average = load_average / 1000;
+  ProcessPool pool(options);
+  for (int i = 0; i < 3; ++i) {
+    pool.Add("sleep 0.1", ProcessPool::Callback());
+  }
+  auto start = std::chrono::steady_clock::now();
+  pool.Run();
+  EXPECT_LE(0.3, SecondsSince(start));
+}
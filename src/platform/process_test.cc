@@ -0,0 +1,449 @@
+#include "platform/process.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::CaptureOptions;
+using platform::CaptureResult;
+using platform::CaptureSystemCommand;
+using platform::FindProgram;
+using platform::Process;
+using platform::ProgramOptions;
+using platform::ResourceUsage;
+using platform::ResourceUsageSummary;
+using platform::StartProgram;
+using platform::StartSystemCommand;
+using platform::WaitForAll;
+using platform::WaitForAny;
+using stdext::file_system::Path;
+
+namespace {
+Process Start(const char* command) {
+  return StartSystemCommand(command, stdext::nullopt, stdext::nullopt,
+                            stdext::nullopt);
+}
+
+std::string ReadFile(const std::string& path) {
+  std::string contents;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return contents;
+  }
+  char buffer[4096];
+  ssize_t size;
+  while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, size);
+  }
+  close(fd);
+  return contents;
+}
+
+double SecondsSince(Process::Clock::time_point start) {
+  return std::chrono::duration<double>(Process::Clock::now() - start).count();
+}
+}  // namespace
+
+TEST(ProcessTests, WaitReturnsExitStatus) {
+  Process process = Start("exit 3");
+  ASSERT_TRUE(process.IsValid());
+  int status = process.Wait();
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(3, WEXITSTATUS(status));
+  EXPECT_TRUE(process.exited());
+
+  // Once waited for, the status is remembered.
+  EXPECT_EQ(status, process.Wait());
+  ASSERT_TRUE(process.Poll());
+  EXPECT_EQ(status, *process.Poll());
+}
+
+TEST(ProcessTests, RedirectsToFiles) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string output = std::string(directory.path().c_str()) + "/out";
+
+  Process process = StartSystemCommand(
+      "echo hello", Path(output), stdext::nullopt, stdext::nullopt);
+  EXPECT_EQ(0, process.Wait());
+
+  char buffer[16] = {};
+  int fd = open(output.c_str(), O_RDONLY);
+  ASSERT_LE(0, fd);
+  EXPECT_EQ(6, read(fd, buffer, sizeof(buffer)));
+  close(fd);
+  EXPECT_EQ(std::string("hello\n"), buffer);
+}
+
+TEST(ProcessTests, FailsToStartWithMissingStdin) {
+  Process process = StartSystemCommand(
+      "true", stdext::nullopt, stdext::nullopt,
+      Path("/this/file/does/not/exist"));
+  EXPECT_FALSE(process.IsValid());
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST(ProcessTests, PollAndTimedWaitDoNotBlock) {
+  Process process = Start("sleep 10");
+  EXPECT_FALSE(process.Poll());
+
+  auto start = Process::Clock::now();
+  EXPECT_FALSE(process.WaitFor(std::chrono::milliseconds(50)));
+  EXPECT_LE(0.05, SecondsSince(start));
+  EXPECT_FALSE(process.exited());
+
+  EXPECT_TRUE(process.Signal(SIGTERM));
+  int status = process.Wait();
+  ASSERT_TRUE(WIFSIGNALED(status));
+  EXPECT_EQ(SIGTERM, WTERMSIG(status));
+
+  EXPECT_FALSE(process.Signal(SIGTERM));
+  EXPECT_EQ(ESRCH, errno);
+}
+
+TEST(ProcessTests, SignalReachesTheWholeProcessGroup) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string fifo = std::string(directory.path().c_str()) + "/fifo";
+  ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+
+  // The shell's background child holds the write end of the fifo, so the
+  // read end only sees end of file once that child has died as well.
+  std::string command = "sleep 30 > " + fifo + " & wait";
+  Process process = Start(command.c_str());
+  int fd = open(fifo.c_str(), O_RDONLY);
+  ASSERT_LE(0, fd);
+
+  auto start = Process::Clock::now();
+  EXPECT_TRUE(process.Signal(SIGKILL));
+  char byte;
+  EXPECT_EQ(0, read(fd, &byte, 1));
+  close(fd);
+  EXPECT_GT(10.0, SecondsSince(start));
+  process.Wait();
+}
+
+TEST(ProcessTests, PidfdBecomesReadableOnExit) {
+  Process process = Start("sleep 0.05");
+  if (process.pidfd() < 0) {
+    // Kernels before 5.3 have no pidfds.
+    return;
+  }
+
+  struct pollfd pidfd = {process.pidfd(), POLLIN, 0};
+  EXPECT_EQ(0, poll(&pidfd, 1, 0));
+  EXPECT_EQ(1, poll(&pidfd, 1, 10000));
+  ASSERT_TRUE(process.Poll());
+  EXPECT_EQ(0, *process.Poll());
+}
+
+TEST(ProcessTests, DestructorKillsRunningProcesses) {
+  auto start = Process::Clock::now();
+  {
+    Process process = Start("sleep 30");
+    ASSERT_TRUE(process.IsValid());
+  }
+  EXPECT_GT(10.0, SecondsSince(start));
+}
+
+TEST(ProcessTests, WaitForAllReportsCompletionOrder) {
+  std::vector<Process> processes;
+  processes.push_back(Start("sleep 0.6"));
+  processes.push_back(Start("sleep 0.2"));
+  processes.push_back(Start("sleep 0.4"));
+  processes.push_back(Start("exit 1"));
+  std::vector<Process*> pointers;
+  for (Process& process : processes) {
+    pointers.push_back(&process);
+  }
+
+  std::vector<size_t> order = WaitForAll(pointers);
+  EXPECT_EQ((std::vector<size_t>{3, 1, 2, 0}), order);
+  for (Process& process : processes) {
+    EXPECT_TRUE(process.exited());
+  }
+  EXPECT_FALSE(WaitForAny(pointers));
+}
+
+TEST(ProcessTests, WaitForAnyTimesOut) {
+  Process process = Start("sleep 10");
+  auto start = Process::Clock::now();
+  EXPECT_FALSE(WaitForAny({&process},
+                          start + std::chrono::milliseconds(50)));
+  EXPECT_LE(0.05, SecondsSince(start));
+}
+
+TEST(ProcessTests, ManyConcurrentProcesses) {
+  const int kNumProcesses = 200;
+  std::vector<Process> processes;
+  std::vector<Process*> pointers;
+  processes.reserve(kNumProcesses);
+  for (int i = 0; i < kNumProcesses; ++i) {
+    processes.push_back(Start("exit 0"));
+    ASSERT_TRUE(processes.back().IsValid());
+    pointers.push_back(&processes.back());
+  }
+  EXPECT_EQ(static_cast<size_t>(kNumProcesses), WaitForAll(pointers).size());
+}
+
+TEST(ProcessTests, CapturesStdoutAndStderrSeparately) {
+  stdext::optional<CaptureResult> result = CaptureSystemCommand(
+      "echo out; echo err >&2; exit 4", CaptureOptions());
+  ASSERT_TRUE(result);
+  ASSERT_TRUE(WIFEXITED(result->status));
+  EXPECT_EQ(4, WEXITSTATUS(result->status));
+  EXPECT_EQ("out\n", result->stdout_data);
+  EXPECT_EQ("err\n", result->stderr_data);
+}
+
+TEST(ProcessTests, CapturesLargeOutputOnBothStreams) {
+  // Each stream is much larger than a pipe's buffer, so this only finishes
+  // if both are drained at once.
+  stdext::optional<CaptureResult> result = CaptureSystemCommand(
+      "head -c 1000000 /dev/zero & head -c 1000000 /dev/zero >&2; wait",
+      CaptureOptions());
+  ASSERT_TRUE(result);
+  EXPECT_EQ(0, result->status);
+  EXPECT_EQ(std::string(1000000, '\0'), result->stdout_data);
+  EXPECT_EQ(std::string(1000000, '\0'), result->stderr_data);
+}
+
+TEST(ProcessTests, FeedsStdinToCapturedCommand) {
+  CaptureOptions options;
+  for (int i = 0; options.stdin_data.size() < 1000000; ++i) {
+    options.stdin_data += std::to_string(i) + "\n";
+  }
+  stdext::optional<CaptureResult> result = CaptureSystemCommand("cat", options);
+  ASSERT_TRUE(result);
+  EXPECT_EQ(0, result->status);
+  EXPECT_EQ(options.stdin_data, result->stdout_data);
+
+  // Without stdin data, the command reads from /dev/null.
+  result = CaptureSystemCommand("cat", CaptureOptions());
+  ASSERT_TRUE(result);
+  EXPECT_EQ("", result->stdout_data);
+}
+
+TEST(ProcessTests, CommandsMayIgnoreTheirStdin) {
+  CaptureOptions options;
+  options.stdin_data = std::string(1000000, 'x');
+  stdext::optional<CaptureResult> result = CaptureSystemCommand(
+      "echo done", options);
+  ASSERT_TRUE(result);
+  EXPECT_EQ(0, result->status);
+  EXPECT_EQ("done\n", result->stdout_data);
+}
+
+TEST(ProcessTests, CallsChunkCallbacks) {
+  std::string streamed;
+  CaptureOptions options;
+  options.capture_stdout = false;
+  options.on_stdout = [&streamed](const char* data, size_t size) {
+    streamed.append(data, size);
+  };
+  stdext::optional<CaptureResult> result = CaptureSystemCommand(
+      "head -c 300000 /dev/zero", options);
+  ASSERT_TRUE(result);
+  EXPECT_EQ("", result->stdout_data);
+  EXPECT_EQ(std::string(300000, '\0'), streamed);
+}
+
+TEST(ProcessTests, CapturesIntoFiles) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string stdout_file = std::string(directory.path().c_str()) + "/out";
+  std::string stderr_file = std::string(directory.path().c_str()) + "/err";
+
+  CaptureOptions options;
+  options.stdout_file = Path(stdout_file);
+  options.stderr_file = Path(stderr_file);
+  options.capture_stderr = false;
+  stdext::optional<CaptureResult> result = CaptureSystemCommand(
+      "seq 100000; seq 50000 >&2", options);
+  ASSERT_TRUE(result);
+  EXPECT_EQ(0, result->status);
+
+  // Standard output went both to the file and into the result, and standard
+  // error only to its file.
+  std::string expected_stdout = ReadFile(stdout_file);
+  EXPECT_EQ(588895u, expected_stdout.size());
+  EXPECT_EQ(expected_stdout, result->stdout_data);
+  EXPECT_EQ(288894u, ReadFile(stderr_file).size());
+  EXPECT_EQ("", result->stderr_data);
+}
+
+TEST(ProcessTests, CaptureFailsWithUnwritableFile) {
+  CaptureOptions options;
+  options.stdout_file = Path("/this/directory/does/not/exist/out");
+  EXPECT_FALSE(CaptureSystemCommand("true", options));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST(ProcessTests, StartProgramPassesArgumentsUnchanged) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string output = std::string(directory.path().c_str()) + "/out";
+
+  ProgramOptions options;
+  options.stdout_file = Path(output);
+  Process process = StartProgram(
+      {"printf", "%s|%s\\n", "two words", "$HOME; exit 1"}, options);
+  ASSERT_TRUE(process.IsValid());
+  EXPECT_EQ(0, process.Wait());
+  EXPECT_EQ("two words|$HOME; exit 1\n", ReadFile(output));
+}
+
+TEST(ProcessTests, StartProgramUsesEnvironmentAndWorkingDirectory) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string output = std::string(directory.path().c_str()) + "/out";
+
+  ProgramOptions options;
+  options.stdout_file = Path(output);
+  options.environment = std::vector<std::string>{"GREETING=hello"};
+  options.working_directory = Path(directory.path().c_str());
+  Process process = StartProgram(
+      {"/bin/sh", "-c", "echo $GREETING ${HOME-unset}; pwd -P"}, options);
+  ASSERT_TRUE(process.IsValid());
+  EXPECT_EQ(0, process.Wait());
+
+  char resolved[PATH_MAX];
+  ASSERT_NE(nullptr, realpath(directory.path().c_str(), resolved));
+  EXPECT_EQ("hello unset\n" + std::string(resolved) + "\n", ReadFile(output));
+}
+
+TEST(ProcessTests, StartProgramReportsMissingPrograms) {
+  Process process = StartProgram({"this-program-does-not-exist"},
+                                 ProgramOptions());
+  EXPECT_FALSE(process.IsValid());
+  EXPECT_EQ(ENOENT, errno);
+
+  process = StartProgram({"/this/program/does/not/exist"}, ProgramOptions());
+  EXPECT_FALSE(process.IsValid());
+  EXPECT_EQ(ENOENT, errno);
+
+  EXPECT_FALSE(StartProgram({}, ProgramOptions()).IsValid());
+  EXPECT_EQ(EINVAL, errno);
+}
+
+TEST(ProcessTests, StartProgramReturnsExitStatus) {
+  Process process = StartProgram({"sh", "-c", "exit 5"}, ProgramOptions());
+  int status = process.Wait();
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(5, WEXITSTATUS(status));
+}
+
+TEST(ProcessTests, FindProgramSearchesPath) {
+  stdext::optional<std::string> path = FindProgram("sh");
+  ASSERT_TRUE(path);
+  EXPECT_EQ('/', (*path)[0]);
+  EXPECT_EQ(0, access(path->c_str(), X_OK));
+  EXPECT_EQ(*path, *FindProgram("sh"));
+
+  EXPECT_EQ("./relative", *FindProgram("./relative"));
+  EXPECT_FALSE(FindProgram("this-program-does-not-exist"));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST(ProcessTests, StartProgramForgetsStalePaths) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string bin = directory.path().c_str();
+  std::string old_path = getenv("PATH");
+  std::string program = bin + "/process-test-program";
+  std::string moved = bin + "/moved/process-test-program";
+  ASSERT_EQ(0, mkdir((bin + "/moved").c_str(), 0700));
+  ASSERT_EQ(0, symlink("/bin/true", program.c_str()));
+  setenv("PATH", (bin + ":" + bin + "/moved:" + old_path).c_str(), 1);
+
+  EXPECT_EQ(program, *FindProgram("process-test-program"));
+  ASSERT_EQ(0, rename(program.c_str(), moved.c_str()));
+  Process process = StartProgram({"process-test-program"}, ProgramOptions());
+  EXPECT_TRUE(process.IsValid());
+  EXPECT_EQ(0, process.Wait());
+  EXPECT_EQ(moved, *FindProgram("process-test-program"));
+
+  setenv("PATH", old_path.c_str(), 1);
+}
+
+TEST(ProcessTests, ReportsResourceUsage) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string output = std::string(directory.path().c_str()) + "/out";
+
+  // The shell's children count towards its usage once it has waited for
+  // them.
+  std::string command =
+      "head -c 1000000 /dev/zero > " + output + "; sleep 0.05; "
+      "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done";
+  Process process = Start(command.c_str());
+  EXPECT_EQ(0, process.Wait());
+
+  const ResourceUsage& usage = process.resource_usage();
+  EXPECT_LE(std::chrono::milliseconds(50), usage.wall_time);
+  EXPECT_LT(std::chrono::nanoseconds(0), usage.user_time + usage.system_time);
+  EXPECT_GE(usage.wall_time, usage.user_time);
+  EXPECT_LT(0u, usage.max_rss_bytes);
+  EXPECT_LT(0u, usage.voluntary_context_switches);
+  EXPECT_LE(1000000u, usage.write_chars);
+}
+
+TEST(ProcessTests, SystemCommandReportsResourceUsage) {
+  stdext::optional<platform::SystemCommandResult> result =
+      platform::SystemCommandWithUsage("head -c 100000 /dev/zero > /dev/null; "
+                                       "exit 2",
+                                       stdext::nullopt, stdext::nullopt,
+                                       stdext::nullopt);
+  ASSERT_TRUE(result);
+  ASSERT_TRUE(WIFEXITED(result->status));
+  EXPECT_EQ(2, WEXITSTATUS(result->status));
+  EXPECT_LE(100000u, result->resource_usage.write_chars);
+  EXPECT_LT(0u, result->resource_usage.max_rss_bytes);
+}
+
+TEST(ProcessTests, CaptureReportsResourceUsage) {
+  stdext::optional<CaptureResult> result = CaptureSystemCommand(
+      "head -c 100000 /dev/zero", CaptureOptions());
+  ASSERT_TRUE(result);
+  EXPECT_LE(100000u, result->resource_usage.write_chars);
+  EXPECT_LT(0u, result->resource_usage.max_rss_bytes);
+}
+
+TEST(ProcessTests, SummarizesResourceUsage) {
+  ResourceUsage first;
+  first.wall_time = std::chrono::milliseconds(10);
+  first.user_time = std::chrono::milliseconds(4);
+  first.max_rss_bytes = 1000;
+  first.write_bytes = 5;
+  ResourceUsage second;
+  second.wall_time = std::chrono::milliseconds(30);
+  second.user_time = std::chrono::milliseconds(2);
+  second.max_rss_bytes = 3000;
+  second.write_bytes = 7;
+
+  ResourceUsageSummary summary;
+  summary.Add(first);
+  summary.Add(second);
+  EXPECT_EQ(2u, summary.num_processes);
+  EXPECT_EQ(std::chrono::milliseconds(40), summary.total.wall_time);
+  EXPECT_EQ(std::chrono::milliseconds(6), summary.total.user_time);
+  EXPECT_EQ(3000u, summary.total.max_rss_bytes);
+  EXPECT_EQ(12u, summary.total.write_bytes);
+  EXPECT_EQ(std::chrono::milliseconds(30), summary.max.wall_time);
+  EXPECT_EQ(std::chrono::milliseconds(4), summary.max.user_time);
+  EXPECT_EQ(7u, summary.max.write_bytes);
+}
@@ -0,0 +1,75 @@
+#include "platform/file_system.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include "platform/test_directory_tree.h"
+#include "stdext/file_system.h"
+
+// Compares removing a directory tree with nftw() and remove(), as
+// RemoveDirectoryTree() used to, against RemoveDirectoryTree() on varying
+// numbers of threads.
+
+using platform::MakeTestDirectoryTree;
+using platform::RemoveDirectoryTree;
+using platform::RemoveDirectoryTreeOptions;
+
+namespace {
+
+template <typename Function>
+double MeasureSeconds(Function function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+int RemoveEntry(const char* path, const struct stat*, int, struct FTW*) {
+  return remove(path) < 0 ? -1 : 0;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  int fanout = 10;
+  if (argc > 1) {
+    fanout = atoi(argv[1]);
+  }
+  stdext::file_system::TemporaryDirectory temporary_directory;
+  std::string root = temporary_directory.path().str() + "/tree";
+
+  printf("Removing a tree %d wide and 3 deep\n", fanout);
+  if (mkdir(root.c_str(), 0755) != 0 ||
+      !MakeTestDirectoryTree(root, fanout, 3)) {
+    printf("Could not make a tree in %s\n", root.c_str());
+    return 1;
+  }
+  double nftw_seconds = MeasureSeconds([&]() {
+    nftw(root.c_str(), RemoveEntry, 20, FTW_DEPTH | FTW_MOUNT | FTW_PHYS);
+  });
+  printf("  nftw() and remove():              %8.1f ms\n",
+         nftw_seconds * 1000);
+
+  for (int max_threads : {1, 2, 4, 8}) {
+    if (mkdir(root.c_str(), 0755) != 0 ||
+        !MakeTestDirectoryTree(root, fanout, 3)) {
+      printf("Could not make a tree in %s\n", root.c_str());
+      return 1;
+    }
+    RemoveDirectoryTreeOptions options;
+    options.max_threads = max_threads;
+    bool removed = false;
+    double seconds = MeasureSeconds([&]() {
+      removed = RemoveDirectoryTree(root.c_str(), options, nullptr);
+    });
+    printf("  RemoveDirectoryTree(), %d threads: %8.1f ms (%.1fx)%s\n",
+           max_threads, seconds * 1000, nftw_seconds / seconds,
+           removed ? "" : " failed");
+  }
+  return 0;
+}
@@ -0,0 +1,238 @@
+#include "platform/file_system.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "platform/test_directory_tree.h"
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::MakeTestDirectoryTree;
+using platform::RemoveDirectoryTree;
+using platform::RemoveDirectoryTreeError;
+using platform::RemoveDirectoryTreeOptions;
+
+namespace {
+void WriteFile(const std::string& path) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_LE(0, fd);
+  close(fd);
+}
+
+bool Exists(const std::string& path) {
+  struct stat status;
+  return lstat(path.c_str(), &status) == 0;
+}
+
+std::set<std::string> ListDirectory(const std::string& path) {
+  std::set<std::string> names;
+  DIR* dir = opendir(path.c_str());
+  while (struct dirent* dirent = dir ? readdir(dir) : nullptr) {
+    if (std::string(dirent->d_name) != "." &&
+        std::string(dirent->d_name) != "..") {
+      names.insert(dirent->d_name);
+    }
+  }
+  if (dir) {
+    closedir(dir);
+  }
+  return names;
+}
+}  // namespace
+
+TEST(RemoveDirectoryTreeTests, RemovesTreeWithoutFollowingLinks) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string outside = directory.path().str() + "/outside";
+  ASSERT_EQ(0, mkdir(outside.c_str(), 0755));
+  WriteFile(outside + "/file");
+
+  for (int max_threads : {1, 4}) {
+    std::string root = directory.path().str() + "/tree";
+    ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+    ASSERT_TRUE(MakeTestDirectoryTree(root, 4, 3));
+    ASSERT_EQ(0, symlink(outside.c_str(), (root + "/dir1/link").c_str()));
+
+    RemoveDirectoryTreeOptions options;
+    options.max_threads = max_threads;
+    std::vector<RemoveDirectoryTreeError> errors;
+    EXPECT_TRUE(RemoveDirectoryTree(root.c_str(), options, &errors));
+    EXPECT_TRUE(errors.empty());
+    EXPECT_FALSE(Exists(root));
+    EXPECT_TRUE(Exists(outside + "/file"));
+  }
+}
+
+TEST(RemoveDirectoryTreeTests, RemovesDeepTrees) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string root = directory.path().str() + "/tree";
+  ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+  // Far deeper than nftw() could go, with paths far longer than PATH_MAX.
+  const int kDepth = 1000;
+  int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_LE(0, fd);
+  for (int i = 0; i < kDepth; ++i) {
+    ASSERT_EQ(0, mkdirat(fd, "directory", 0755));
+    ASSERT_EQ(0, mkdirat(fd, "sibling", 0755));
+    int next = openat(fd, "directory", O_RDONLY | O_DIRECTORY);
+    close(fd);
+    ASSERT_LE(0, next);
+    fd = next;
+  }
+  close(fd);
+
+  std::vector<RemoveDirectoryTreeError> errors;
+  EXPECT_TRUE(RemoveDirectoryTree(root.c_str(), RemoveDirectoryTreeOptions(),
+                                  &errors));
+  EXPECT_TRUE(errors.empty());
+  EXPECT_FALSE(Exists(root));
+}
+
+TEST(RemoveDirectoryTreeTests, RemovesDeepTreesWithFewDescriptors) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string root = directory.path().str() + "/tree";
+  ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+  // Every level waits for both of its subdirectories to be removed.
+  const int kDepth = 300;
+  int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_LE(0, fd);
+  for (int i = 0; i < kDepth; ++i) {
+    ASSERT_EQ(0, mkdirat(fd, "directory", 0755));
+    ASSERT_EQ(0, mkdirat(fd, "sibling", 0755));
+    int next = openat(fd, "directory", O_RDONLY | O_DIRECTORY);
+    close(fd);
+    ASSERT_LE(0, next);
+    fd = next;
+  }
+  close(fd);
+
+  struct rlimit old_limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &old_limit));
+  struct rlimit limit = old_limit;
+  limit.rlim_cur = 64;
+  ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+  std::vector<RemoveDirectoryTreeError> errors;
+  EXPECT_TRUE(RemoveDirectoryTree(root.c_str(), RemoveDirectoryTreeOptions(),
+                                  &errors));
+  EXPECT_EQ(0, setrlimit(RLIMIT_NOFILE, &old_limit));
+  EXPECT_TRUE(errors.empty());
+  EXPECT_FALSE(Exists(root));
+}
+
+TEST(RemoveDirectoryTreeTests, RemovesOtherFiles) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string file = directory.path().str() + "/file";
+  WriteFile(file);
+  std::string link = directory.path().str() + "/link";
+  ASSERT_EQ(0, symlink(directory.path().c_str(), link.c_str()));
+
+  EXPECT_TRUE(RemoveDirectoryTree(file.c_str()));
+  EXPECT_FALSE(Exists(file));
+  EXPECT_TRUE(RemoveDirectoryTree(link.c_str()));
+  EXPECT_FALSE(Exists(link));
+  EXPECT_TRUE(Exists(directory.path().str()));
+}
+
+TEST(RemoveDirectoryTreeTests, ReportsErrors) {
+  std::vector<RemoveDirectoryTreeError> errors;
+  EXPECT_FALSE(RemoveDirectoryTree("/does/not/exist",
+                                   RemoveDirectoryTreeOptions(), &errors));
+  ASSERT_EQ(1u, errors.size());
+  EXPECT_EQ("/does/not/exist", errors[0].path);
+  EXPECT_EQ(ENOENT, errors[0].error);
+}
+
+TEST(RemoveDirectoryTreeTests, RemovesInBackground) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string trash =
+      directory.path().str() + "/.stdext_trash." + std::to_string(getuid());
+  ASSERT_EQ(0, mkdir(trash.c_str(), 0700));
+
+  // Something left behind by a process which has exited, and something
+  // which a running one is still removing.
+  pid_t pid = fork();
+  ASSERT_LE(0, pid);
+  if (pid == 0) {
+    _exit(0);
+  }
+  ASSERT_EQ(pid, waitpid(pid, nullptr, 0));
+  std::string stale = trash + "/" + std::to_string(pid) + ".0";
+  ASSERT_EQ(0, mkdir(stale.c_str(), 0755));
+  WriteFile(stale + "/file");
+  std::string live = trash + "/" + std::to_string(getppid()) + ".0";
+  ASSERT_EQ(0, mkdir(live.c_str(), 0755));
+
+  std::string root = directory.path().str() + "/tree";
+  ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+  ASSERT_TRUE(MakeTestDirectoryTree(root, 3, 2));
+  EXPECT_TRUE(platform::RemoveDirectoryTreeInBackground(root.c_str()));
+  EXPECT_FALSE(Exists(root));
+
+  std::vector<RemoveDirectoryTreeError> errors;
+  EXPECT_TRUE(platform::FlushBackgroundRemovals(&errors));
+  EXPECT_TRUE(errors.empty());
+  EXPECT_EQ(std::set<std::string>{std::to_string(getppid()) + ".0"},
+            ListDirectory(trash));
+
+  // What can not be moved to the trash is removed at once instead.
+  std::string missing = directory.path().str() + "/missing";
+  EXPECT_FALSE(platform::RemoveDirectoryTreeInBackground(missing.c_str()));
+  EXPECT_FALSE(platform::FlushBackgroundRemovals(&errors));
+  ASSERT_EQ(1u, errors.size());
+  EXPECT_EQ(missing, errors[0].path);
+  EXPECT_EQ(ENOENT, errors[0].error);
+
+  // Or returned straight away, if asked for.
+  errors.clear();
+  EXPECT_FALSE(
+      platform::RemoveDirectoryTreeInBackground(missing.c_str(), &errors));
+  ASSERT_EQ(1u, errors.size());
+  EXPECT_EQ(missing, errors[0].path);
+  EXPECT_TRUE(platform::FlushBackgroundRemovals());
+}
+
+TEST(RemoveDirectoryTreeTests, BackgroundRemovalChecksTheTrash) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string trash =
+      directory.path().str() + "/.stdext_trash." + std::to_string(getuid());
+
+  // Someone else could plant a link to an unrelated directory, holding what
+  // looks like a stale entry.
+  std::string unrelated = directory.path().str() + "/unrelated";
+  ASSERT_EQ(0, mkdir(unrelated.c_str(), 0700));
+  ASSERT_EQ(0, mkdir((unrelated + "/99999.keep").c_str(), 0755));
+  ASSERT_EQ(0, symlink(unrelated.c_str(), trash.c_str()));
+
+  std::string root = directory.path().str() + "/tree";
+  ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+  ASSERT_TRUE(MakeTestDirectoryTree(root, 2, 2));
+  EXPECT_TRUE(platform::RemoveDirectoryTreeInBackground(root.c_str()));
+  EXPECT_FALSE(Exists(root));
+  EXPECT_TRUE(platform::FlushBackgroundRemovals());
+  EXPECT_EQ(std::set<std::string>{"99999.keep"}, ListDirectory(unrelated));
+
+  // Nor is a trash directory which others could write to used.
+  ASSERT_EQ(0, unlink(trash.c_str()));
+  ASSERT_EQ(0, mkdir(trash.c_str(), 0700));
+  ASSERT_EQ(0, chmod(trash.c_str(), 0777));
+  ASSERT_EQ(0, mkdir((trash + "/99999.keep").c_str(), 0755));
+  ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+  EXPECT_TRUE(platform::RemoveDirectoryTreeInBackground(root.c_str()));
+  EXPECT_FALSE(Exists(root));
+  EXPECT_TRUE(platform::FlushBackgroundRemovals());
+  EXPECT_EQ(std::set<std::string>{"99999.keep"}, ListDirectory(trash));
+}
@@ -0,0 +1,78 @@
+#ifndef __PLATFORM_STACK_ALLOCATOR_H__
+#define __PLATFORM_STACK_ALLOCATOR_H__
+
+#include <cstddef>
+
+namespace platform {
+
+class StackProfile;
+
+// A region of memory reserved for use as a fiber stack.  The usable memory
+// spans [base, base + size), and the stack grows down from base + size.
+struct Stack {
+  void* base = nullptr;
+  size_t size = 0;
+  // True if the stack was painted by a StackProfile.
+  bool profiled = false;
+};
+
+// Hands out memory for fiber stacks.  Stacks are reserved from the OS in
+// slabs and only committed as their pages are touched.  Each stack has an
+// inaccessible guard page directly below it, so that an overflow faults
+// rather than silently corrupting neighbouring memory.
+//
+// Freed stacks are placed in a per-thread cache, bucketed by power of two
+// size class, from which subsequent allocations of the same class are served
+// without a system call.  Stacks are not tied to the allocator or thread that
+// created them, and may be freed from any thread.
+class StackAllocator {
+ public:
+  struct Options {
+    Options()
+        : release_on_free(false), max_cached_per_size_class(32),
+          profile(nullptr) {}
+
+    // If true, the pages of a freed stack are handed back to the OS with
+    // madvise(MADV_DONTNEED) before the stack is placed in the cache.  This
+    // reduces resident memory at the cost of faulting the pages back in on
+    // reuse.
+    bool release_on_free;
+
+    // The maximum number of stacks of each size class that a thread will
+    // cache.  Stacks freed past this limit are returned to the OS.
+    size_t max_cached_per_size_class;
+
+    // If set, stacks from this allocator are measured by |profile|.  See
+    // stack_profiler.h.
+    StackProfile* profile;
+  };
+
+  StackAllocator() {}
+  explicit StackAllocator(const Options& options) : options_(options) {}
+
+  // Returns a stack with at least |size| usable bytes.  The returned stack's
+  // base will be null if the allocation failed.
+  Stack Allocate(size_t size);
+
+  // Returns a stack previously returned by Allocate() on any StackAllocator.
+  // Stacks from an allocator with a profile must be freed by an allocator
+  // with the same profile to be measured.
+  void Free(const Stack& stack);
+
+  const Options& options() const { return options_; }
+
+  // Returns the usable size of the stacks that Allocate(|size|) returns,
+  // which is |size| rounded up to its size class, or just to whole pages if
+  // it is larger than the largest one or on Windows.
+  static size_t AllocatedSize(size_t size);
+
+  // The allocator used by SwitchToNewContext() when none is specified.
+  static StackAllocator* GetDefault();
+
+ private:
+  Options options_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_STACK_ALLOCATOR_H__
@@ -0,0 +1,106 @@
+#include "platform/context.h"
+#include "platform/stack_allocator.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::Context;
+using platform::Stack;
+using platform::StackAllocator;
+using platform::SwitchToNewContext;
+
+const size_t kDefaultStackSize = 16 * 1024;
+
+TEST(StackAllocatorTests, AllocatedStacksAreUsable) {
+  StackAllocator allocator;
+  Stack stack = allocator.Allocate(kDefaultStackSize);
+  ASSERT_NE(nullptr, stack.base);
+  EXPECT_GE(stack.size, kDefaultStackSize);
+
+  memset(stack.base, 0xab, stack.size);
+  EXPECT_EQ(0xab, static_cast<uint8_t*>(stack.base)[stack.size - 1]);
+
+  allocator.Free(stack);
+}
+
+TEST(StackAllocatorTests, FreedStacksAreReused) {
+  StackAllocator allocator;
+  Stack first = allocator.Allocate(kDefaultStackSize);
+  ASSERT_NE(nullptr, first.base);
+  allocator.Free(first);
+
+  Stack second = allocator.Allocate(kDefaultStackSize);
+  EXPECT_EQ(first.base, second.base);
+  EXPECT_EQ(first.size, second.size);
+  allocator.Free(second);
+}
+
+TEST(StackAllocatorTests, DistinctLiveStacks) {
+  StackAllocator allocator;
+  const int kNumStacks = 100;
+  Stack stacks[kNumStacks];
+  for (int i = 0; i < kNumStacks; ++i) {
+    stacks[i] = allocator.Allocate(kDefaultStackSize);
+    ASSERT_NE(nullptr, stacks[i].base);
+    memset(stacks[i].base, i, stacks[i].size);
+  }
+  for (int i = 0; i < kNumStacks; ++i) {
+    EXPECT_EQ(i, static_cast<uint8_t*>(stacks[i].base)[0]);
+    allocator.Free(stacks[i]);
+  }
+}
+
+TEST(StackAllocatorTests, LargeStacksAreNotCached) {
+  StackAllocator allocator;
+  const size_t kLargeStackSize = 256 * 1024 * 1024;
+  Stack stack = allocator.Allocate(kLargeStackSize);
+  ASSERT_NE(nullptr, stack.base);
+  EXPECT_GE(stack.size, kLargeStackSize);
+  allocator.Free(stack);
+}
+
+TEST(StackAllocatorTests, ReleaseOnFreeKeepsStacksUsable) {
+  StackAllocator::Options options;
+  options.release_on_free = true;
+  StackAllocator allocator(options);
+
+  Stack stack = allocator.Allocate(kDefaultStackSize);
+  ASSERT_NE(nullptr, stack.base);
+  memset(stack.base, 0xab, stack.size);
+  allocator.Free(stack);
+
+  stack = allocator.Allocate(kDefaultStackSize);
+  ASSERT_NE(nullptr, stack.base);
+  // Released pages come back zero filled.
+  EXPECT_EQ(0, static_cast<uint8_t*>(stack.base)[0]);
+  allocator.Free(stack);
+}
+
+#if !defined(_WIN32)
+TEST(StackAllocatorDeathTest, OverflowHitsGuardPage) {
+  StackAllocator allocator;
+  Stack stack = allocator.Allocate(kDefaultStackSize);
+  ASSERT_NE(nullptr, stack.base);
+
+  volatile uint8_t* below_stack = static_cast<uint8_t*>(stack.base) - 1;
+  EXPECT_DEATH(*below_stack = 0, "");
+
+  allocator.Free(stack);
+}
+#endif
+
+TEST(StackAllocatorTests, CanSwitchToNewContextWithAllocator) {
+  StackAllocator allocator;
+  int foo = 0;
+
+  Context* prev_context = SwitchToNewContext(
+      &allocator, kDefaultStackSize, nullptr, [&foo](Context* context) {
+        foo = 1;
+        return context;
+      });
+
+  EXPECT_EQ(nullptr, prev_context);
+  EXPECT_EQ(1, foo);
+}
@@ -0,0 +1,130 @@
+#include "platform/stack_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "platform/stack_allocator.h"
+
+namespace platform {
+
+namespace {
+
+const uint64_t kCanary = 0xa5c3f00dcafe5a3cull;
+
+}  // namespace
+
+const size_t StackProfile::kBucketSize;
+const size_t StackProfile::kNumBuckets;
+
+StackProfile::StackProfile(const char* name, const Options& options)
+    : name_(name), options_(options), allocation_count_(0), num_samples_(0),
+      num_saturated_(0), max_usage_(0) {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t StackProfile::num_samples() const {
+  return num_samples_.load(std::memory_order_relaxed);
+}
+
+uint64_t StackProfile::num_saturated() const {
+  return num_saturated_.load(std::memory_order_relaxed);
+}
+
+size_t StackProfile::max_usage() const {
+  return max_usage_.load(std::memory_order_relaxed);
+}
+
+size_t StackProfile::Percentile(double percentile) const {
+  std::vector<uint64_t> histogram = Histogram();
+  uint64_t total = 0;
+  for (uint64_t count : histogram) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = static_cast<uint64_t>(
+      std::ceil(std::min(percentile, 100.0) / 100.0 * total));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < histogram.size(); ++i) {
+    seen += histogram[i];
+    if (seen >= rank) {
+      return std::min((i + 1) * kBucketSize, max_usage());
+    }
+  }
+  return max_usage();
+}
+
+std::vector<uint64_t> StackProfile::Histogram() const {
+  std::vector<uint64_t> histogram(kNumBuckets);
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    histogram[i] = buckets_[i].load(std::memory_order_relaxed);
+  }
+  return histogram;
+}
+
+size_t StackProfile::StackSizeFor(size_t requested_size) const {
+  if (!options_.adaptive || num_samples() < options_.min_samples ||
+      num_saturated() > 0) {
+    return requested_size;
+  }
+
+  size_t size = static_cast<size_t>(
+      Percentile(options_.percentile) * options_.headroom);
+  size = std::max(size, options_.min_stack_size);
+  // Rounded up as the allocator would, since any size up to that costs the
+  // same.
+  size = StackAllocator::AllocatedSize(size);
+  return std::min(size, requested_size);
+}
+
+void StackProfile::OnAllocate(Stack* stack) {
+  uint32_t count = allocation_count_.fetch_add(1, std::memory_order_relaxed);
+  if (options_.sample_interval > 1 && count % options_.sample_interval != 0) {
+    stack->profiled = false;
+    return;
+  }
+
+  uint64_t* words = static_cast<uint64_t*>(stack->base);
+  std::fill(words, words + stack->size / sizeof(uint64_t), kCanary);
+  stack->profiled = true;
+}
+
+void StackProfile::OnFree(const Stack& stack) {
+  if (!stack.profiled) {
+    return;
+  }
+
+  // The stack grows down, so the lowest overwritten word marks the peak.
+  const uint64_t* words = static_cast<const uint64_t*>(stack.base);
+  const size_t num_words = stack.size / sizeof(uint64_t);
+  size_t first_used = 0;
+  while (first_used < num_words && words[first_used] == kCanary) {
+    ++first_used;
+  }
+
+  Record((num_words - first_used) * sizeof(uint64_t), first_used == 0);
+}
+
+void StackProfile::Record(size_t usage, bool saturated) {
+  size_t bucket = usage == 0 ? 0 : (usage - 1) / kBucketSize;
+  buckets_[std::min(bucket, kNumBuckets - 1)].fetch_add(
+      1, std::memory_order_relaxed);
+  if (saturated) {
+    num_saturated_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  size_t max_usage = max_usage_.load(std::memory_order_relaxed);
+  while (usage > max_usage &&
+         !max_usage_.compare_exchange_weak(max_usage, usage,
+                                           std::memory_order_relaxed)) {
+  }
+
+  num_samples_.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace platform
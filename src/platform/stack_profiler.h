@@ -0,0 +1,116 @@
+#ifndef __PLATFORM_STACK_PROFILER_H__
+#define __PLATFORM_STACK_PROFILER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace platform {
+
+struct Stack;
+
+// Measures how much of their stacks the fibers created from one call site
+// actually use, and optionally sizes new stacks for that call site from the
+// measurements.
+//
+// A StackProfile is attached to a StackAllocator through its options, and
+// the call site creates its contexts from that allocator, e.g.:
+//
+//   StackProfile profile("http_connection");
+//   StackAllocator::Options options;
+//   options.profile = &profile;
+//   StackAllocator allocator(options);
+//   SwitchToNewContext(&allocator, profile.StackSizeFor(256 * 1024), ...);
+//
+// Sampled stacks are painted with a canary pattern when they are allocated,
+// and when they are freed, the lowest overwritten word gives the peak usage
+// of the fiber that ran on them.  Painting commits every page of the stack,
+// so in production only a fraction of stacks should be sampled.
+class StackProfile {
+ public:
+  struct Options {
+    Options()
+        : sample_interval(1), adaptive(false), percentile(99.0),
+          headroom(1.5), min_samples(64), min_stack_size(16 * 1024) {}
+
+    // One in every |sample_interval| stacks is painted and measured.
+    uint32_t sample_interval;
+
+    // If true, StackSizeFor() returns a size derived from the measurements
+    // rather than the requested size.
+    bool adaptive;
+
+    // The percentile of observed usage that adaptive sizes are based on, and
+    // the factor it is multiplied by to give the stack size.
+    double percentile;
+    double headroom;
+
+    // Adaptive sizing only kicks in once this many stacks were measured.
+    uint64_t min_samples;
+
+    // Adaptive sizes are never smaller than this.
+    size_t min_stack_size;
+  };
+
+  // Usage is recorded in buckets of this many bytes.  Usage beyond the last
+  // bucket is recorded in the last bucket.
+  static const size_t kBucketSize = 1024;
+  static const size_t kNumBuckets = 1024;
+
+  explicit StackProfile(const char* name, const Options& options = Options());
+  StackProfile(const StackProfile&) = delete;
+  StackProfile& operator=(const StackProfile&) = delete;
+
+  const char* name() const { return name_; }
+  const Options& options() const { return options_; }
+
+  // The number of stacks measured so far.
+  uint64_t num_samples() const;
+
+  // The number of measured stacks whose fiber reached the very bottom of the
+  // stack, and so may have needed more than it had.  While this is non-zero,
+  // StackSizeFor() does not shrink stacks.
+  uint64_t num_saturated() const;
+
+  // The largest usage seen, in bytes.
+  size_t max_usage() const;
+
+  // Returns an upper bound on the usage, in bytes, that |percentile| percent
+  // of measured stacks stayed within, or 0 if none were measured yet.
+  size_t Percentile(double percentile) const;
+
+  // Returns the number of measured stacks in each bucket.
+  std::vector<uint64_t> Histogram() const;
+
+  // Returns the stack size to use for a new fiber from this call site, which
+  // would otherwise have been given |requested_size|.  Adaptive sizes are
+  // never larger than |requested_size|, and are otherwise rounded up to the
+  // size of the stacks that StackAllocator::Allocate() hands out for them,
+  // which is the next power of two size class on POSIX systems.  Stacks keep
+  // their guard page, so a fiber which outgrows an adaptive size faults
+  // rather than corrupting memory.
+  size_t StackSizeFor(size_t requested_size) const;
+
+ private:
+  friend class StackAllocator;
+
+  // Called by StackAllocator on every stack it allocates and frees.
+  void OnAllocate(Stack* stack);
+  void OnFree(const Stack& stack);
+
+  void Record(size_t usage, bool saturated);
+
+  const char* const name_;
+  const Options options_;
+
+  std::atomic<uint32_t> allocation_count_;
+  std::atomic<uint64_t> num_samples_;
+  std::atomic<uint64_t> num_saturated_;
+  std::atomic<size_t> max_usage_;
+  std::atomic<uint64_t> buckets_[kNumBuckets];
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_STACK_PROFILER_H__
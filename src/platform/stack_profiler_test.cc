@@ -0,0 +1,189 @@
+#include "platform/stack_profiler.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "platform/context.h"
+#include "platform/fiber_scheduler.h"
+#include "platform/stack_allocator.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::Context;
+using platform::FiberScheduler;
+using platform::Stack;
+using platform::StackAllocator;
+using platform::StackProfile;
+using platform::SwitchToNewContext;
+
+namespace {
+const size_t kStackSize = 64 * 1024;
+
+StackAllocator::Options OptionsWithProfile(StackProfile* profile) {
+  StackAllocator::Options options;
+  options.profile = profile;
+  return options;
+}
+
+// Allocates a stack, writes a byte |usage| bytes below its top, and frees it.
+void UseStack(StackAllocator* allocator, size_t usage) {
+  Stack stack = allocator->Allocate(kStackSize);
+  ASSERT_NE(nullptr, stack.base);
+  static_cast<uint8_t*>(stack.base)[stack.size - usage] = 1;
+  allocator->Free(stack);
+}
+
+// Touches roughly |bytes| of stack below the caller's frame.
+void __attribute__((noinline)) UseStackFrame(size_t bytes) {
+  volatile char frame[32 * 1024];
+  for (size_t i = 0; i < bytes && i < sizeof(frame); i += 64) {
+    frame[sizeof(frame) - 1 - i] = static_cast<char>(i);
+  }
+}
+}  // namespace
+
+TEST(StackProfilerTests, RecordsPeakUsage) {
+  StackProfile profile("test");
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  UseStack(&allocator, 5000);
+  EXPECT_EQ(1u, profile.num_samples());
+  EXPECT_EQ(0u, profile.num_saturated());
+  EXPECT_EQ(5000u, profile.max_usage());
+  EXPECT_EQ(5000u, profile.Percentile(50));
+
+  std::vector<uint64_t> histogram = profile.Histogram();
+  ASSERT_EQ(StackProfile::kNumBuckets, histogram.size());
+  EXPECT_EQ(1u, histogram[5000 / StackProfile::kBucketSize]);
+}
+
+TEST(StackProfilerTests, MeasuresFibers) {
+  StackProfile profile("test");
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  for (size_t bytes : {1024, 24 * 1024}) {
+    Context* finished = SwitchToNewContext(
+        &allocator, kStackSize, nullptr, [bytes](Context* creator) {
+          UseStackFrame(bytes);
+          return creator;
+        });
+    EXPECT_EQ(nullptr, finished);
+  }
+
+  EXPECT_EQ(2u, profile.num_samples());
+  EXPECT_LE(1024u, profile.Percentile(50));
+  EXPECT_GT(16 * 1024u, profile.Percentile(50));
+  EXPECT_LE(24 * 1024u, profile.max_usage());
+  EXPECT_GT(kStackSize, profile.max_usage());
+}
+
+TEST(StackProfilerTests, MeasuresFiberSchedulerFibers) {
+  StackProfile profile("test");
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  FiberScheduler::Options options;
+  options.num_workers = 2;
+  options.stack_allocator = &allocator;
+  // Stacks are measured when they are freed, so give every fiber its own.
+  options.max_idle_fibers_per_worker = 0;
+  {
+    FiberScheduler scheduler(options);
+    for (int i = 0; i < 20; ++i) {
+      scheduler.Spawn([]() { UseStackFrame(8 * 1024); });
+    }
+  }
+
+  EXPECT_EQ(20u, profile.num_samples());
+  EXPECT_LE(8 * 1024u, profile.Percentile(1));
+}
+
+TEST(StackProfilerTests, OnlySampledStacksAreMeasured) {
+  StackProfile::Options profile_options;
+  profile_options.sample_interval = 4;
+  StackProfile profile("test", profile_options);
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  for (int i = 0; i < 8; ++i) {
+    UseStack(&allocator, 1000);
+  }
+  EXPECT_EQ(2u, profile.num_samples());
+}
+
+TEST(StackProfilerTests, AdaptiveSizeFollowsPercentile) {
+  StackProfile::Options profile_options;
+  profile_options.adaptive = true;
+  profile_options.min_samples = 10;
+  profile_options.percentile = 90;
+  profile_options.headroom = 1.5;
+  StackProfile profile("test", profile_options);
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  const size_t kRequestedSize = 256 * 1024;
+  for (int i = 0; i < 9; ++i) {
+    UseStack(&allocator, 20000);
+  }
+  EXPECT_EQ(kRequestedSize, profile.StackSizeFor(kRequestedSize));
+
+  UseStack(&allocator, 20000);
+  // 20000 bytes with 50% headroom, rounded up to a size class.
+  EXPECT_EQ(32u * 1024, profile.StackSizeFor(kRequestedSize));
+  // Never larger than requested.
+  EXPECT_EQ(16u * 1024, profile.StackSizeFor(16 * 1024));
+
+  // A rare deep fiber above the percentile does not change the size.
+  UseStack(&allocator, 60000);
+  EXPECT_EQ(32u * 1024, profile.StackSizeFor(kRequestedSize));
+}
+
+TEST(StackProfilerTests, AdaptiveSizeIsWhatTheAllocatorHandsOut) {
+  StackProfile::Options profile_options;
+  profile_options.adaptive = true;
+  profile_options.min_samples = 1;
+  profile_options.percentile = 100;
+  profile_options.headroom = 1;
+  StackProfile profile("test", profile_options);
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  // Anything over 16KiB is served from the 32KiB size class, so there is no
+  // point in asking for, say, 20KiB.
+  UseStack(&allocator, 20000);
+  size_t size = profile.StackSizeFor(256 * 1024);
+  EXPECT_EQ(32u * 1024, size);
+  Stack stack = allocator.Allocate(size);
+  ASSERT_NE(nullptr, stack.base);
+  EXPECT_EQ(size, stack.size);
+  allocator.Free(stack);
+}
+
+TEST(StackProfilerTests, AdaptiveSizeHasAMinimum) {
+  StackProfile::Options profile_options;
+  profile_options.adaptive = true;
+  profile_options.min_samples = 1;
+  StackProfile profile("test", profile_options);
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  UseStack(&allocator, 100);
+  EXPECT_EQ(profile_options.min_stack_size,
+            profile.StackSizeFor(256 * 1024));
+}
+
+TEST(StackProfilerTests, SaturatedStacksDisableShrinking) {
+  StackProfile::Options profile_options;
+  profile_options.adaptive = true;
+  profile_options.min_samples = 1;
+  StackProfile profile("test", profile_options);
+  StackAllocator allocator(OptionsWithProfile(&profile));
+
+  UseStack(&allocator, 100);
+  EXPECT_GT(kStackSize, profile.StackSizeFor(kStackSize));
+
+  Stack stack = allocator.Allocate(kStackSize);
+  ASSERT_NE(nullptr, stack.base);
+  memset(stack.base, 0, 8);
+  allocator.Free(stack);
+
+  EXPECT_EQ(1u, profile.num_saturated());
+  EXPECT_EQ(kStackSize, profile.max_usage());
+  EXPECT_EQ(kStackSize, profile.StackSizeFor(kStackSize));
+}
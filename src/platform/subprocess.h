@@ -7,7 +7,8 @@
 namespace platform {
 
 // Executes the given system command, with stdout/stderr/stdin redirected to
-// or from the given files, or null if files are not provided.
+// or from the given files, or null if files are not provided.  On Linux,
+// SystemCommandWithUsage() in process.h also returns what the command used.
 int SystemCommand(
     const char* command,
     const stdext::optional<stdext::file_system::Path>& stdout_file,
@@ -0,0 +1,39 @@
+#ifndef __PLATFORM_TEST_DIRECTORY_TREE_H__
+#define __PLATFORM_TEST_DIRECTORY_TREE_H__
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace platform {
+
+// Fills the existing directory |path| with a tree for tests and benchmarks to
+// walk: |fanout| empty files named "file<i>" and, if |depth| is positive,
+// |fanout| directories named "dir<i>" each holding a tree |depth| - 1 levels
+// deep.  Returns false, with errno set, if any entry can not be created.
+inline bool MakeTestDirectoryTree(const std::string& path, int fanout,
+                                  int depth) {
+  for (int i = 0; i < fanout; ++i) {
+    std::string file = path + "/file" + std::to_string(i);
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd < 0) {
+      return false;
+    }
+    close(fd);
+    if (depth > 0) {
+      std::string directory = path + "/dir" + std::to_string(i);
+      if (mkdir(directory.c_str(), 0755) != 0 ||
+          !MakeTestDirectoryTree(directory, fanout, depth - 1)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace platform
+
+#endif  // __PLATFORM_TEST_DIRECTORY_TREE_H__
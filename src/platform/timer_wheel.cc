@@ -0,0 +1,211 @@
+#include "platform/timer_wheel.h"
+
+#include <cassert>
+
+namespace platform {
+
+namespace {
+
+int HighestSetBit(uint64_t value) {
+  assert(value != 0);
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return static_cast<int>(index);
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+int LowestSetBit(uint64_t value) {
+  assert(value != 0);
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+// Returns |value| with its lowest |bits| bits cleared.
+uint64_t RoundDown(uint64_t value, int bits) {
+  return bits >= 64 ? 0 : value >> bits << bits;
+}
+
+}  // namespace
+
+TimerWheel::TimerWheel(uint64_t now, uint64_t tick_ns)
+    : tick_ns_(tick_ns), now_tick_(now / tick_ns), size_(0) {
+  assert(tick_ns > 0);
+  for (uint64_t& bits : occupied_) {
+    bits = 0;
+  }
+}
+
+void TimerWheel::Add(Timer* timer, uint64_t deadline) {
+  assert(!timer->pending());
+  // Round up, so that timers never fire early.
+  timer->deadline_tick_ =
+      deadline / tick_ns_ + (deadline % tick_ns_ != 0 ? 1 : 0);
+  Insert(timer);
+  ++size_;
+}
+
+bool TimerWheel::Cancel(Timer* timer) {
+  if (!timer->pending()) {
+    return false;
+  }
+
+  uint32_t slot = timer->slot_;
+  Unlink(timer);
+  if (slot < kNumSlots && slots_[slot].empty()) {
+    occupied_[slot / kSlotsPerLevel] &=
+        ~(static_cast<uint64_t>(1) << (slot % kSlotsPerLevel));
+  }
+  --size_;
+  return true;
+}
+
+size_t TimerWheel::Advance(uint64_t now) {
+  const uint64_t target_tick = now / tick_ns_;
+
+  List firing;
+  SpliceBack(&firing, &expired_, kFiringSlot);
+
+  // Jump from one tick with something to do to the next, rather than
+  // visiting every tick in between.
+  while (true) {
+    uint64_t tick = NextEventTick();
+    if (tick > target_tick) {
+      if (target_tick > now_tick_) {
+        now_tick_ = target_tick;
+      }
+      break;
+    }
+    now_tick_ = tick;
+
+    // Move timers down from every level whose slot starts at this tick,
+    // highest first, so that they can cascade through several levels.
+    for (int level = kNumLevels - 1; level > 0; --level) {
+      int shift = level * kSlotBits;
+      if (now_tick_ == RoundDown(now_tick_, shift)) {
+        Cascade(level, static_cast<int>(
+            (now_tick_ >> shift) & (kSlotsPerLevel - 1)));
+      }
+    }
+
+    int index = static_cast<int>(now_tick_ & (kSlotsPerLevel - 1));
+    SpliceBack(&firing, &slots_[index], kFiringSlot);
+    occupied_[0] &= ~(static_cast<uint64_t>(1) << index);
+    SpliceBack(&firing, &expired_, kFiringSlot);
+  }
+
+  size_t num_fired = 0;
+  while (!firing.empty()) {
+    // Callbacks may cancel timers that are still waiting to fire in this
+    // batch, so take them off the list one at a time.
+    Timer* timer = firing.head.next_;
+    Unlink(timer);
+    --size_;
+    ++num_fired;
+    timer->callback_(timer->arg_);
+  }
+  return num_fired;
+}
+
+uint64_t TimerWheel::NextExpiry() const {
+  if (!expired_.empty()) {
+    return 0;
+  }
+  uint64_t tick = NextEventTick();
+  if (tick == UINT64_MAX || tick > UINT64_MAX / tick_ns_) {
+    return UINT64_MAX;
+  }
+  return tick * tick_ns_;
+}
+
+void TimerWheel::Insert(Timer* timer) {
+  uint64_t tick = timer->deadline_tick_;
+  if (tick <= now_tick_) {
+    PushBack(&expired_, timer, kExpiredSlot);
+    return;
+  }
+
+  int level = HighestSetBit(tick ^ now_tick_) / kSlotBits;
+  int index = static_cast<int>(
+      (tick >> (level * kSlotBits)) & (kSlotsPerLevel - 1));
+  uint32_t slot = level * kSlotsPerLevel + index;
+  PushBack(&slots_[slot], timer, slot);
+  occupied_[level] |= static_cast<uint64_t>(1) << index;
+}
+
+void TimerWheel::PushBack(List* list, Timer* timer, uint32_t slot) {
+  timer->prev_ = list->head.prev_;
+  timer->next_ = &list->head;
+  list->head.prev_->next_ = timer;
+  list->head.prev_ = timer;
+  timer->slot_ = slot;
+}
+
+void TimerWheel::Unlink(Timer* timer) {
+  timer->prev_->next_ = timer->next_;
+  timer->next_->prev_ = timer->prev_;
+  timer->prev_ = nullptr;
+  timer->next_ = nullptr;
+  timer->slot_ = kNoSlot;
+}
+
+void TimerWheel::SpliceBack(List* destination, List* source, uint32_t slot) {
+  if (source->empty()) {
+    return;
+  }
+  for (Timer* timer = source->head.next_; timer != &source->head;
+       timer = timer->next_) {
+    timer->slot_ = slot;
+  }
+
+  Timer* first = source->head.next_;
+  Timer* last = source->head.prev_;
+  first->prev_ = destination->head.prev_;
+  destination->head.prev_->next_ = first;
+  last->next_ = &destination->head;
+  destination->head.prev_ = last;
+  source->head.prev_ = source->head.next_ = &source->head;
+}
+
+void TimerWheel::Cascade(int level, int index) {
+  List& list = slots_[level * kSlotsPerLevel + index];
+  occupied_[level] &= ~(static_cast<uint64_t>(1) << index);
+  while (!list.empty()) {
+    Timer* timer = list.head.next_;
+    Unlink(timer);
+    Insert(timer);
+  }
+}
+
+uint64_t TimerWheel::NextEventTick() const {
+  for (int level = 0; level < kNumLevels; ++level) {
+    if (!occupied_[level]) {
+      continue;
+    }
+
+    // Every occupied slot is after the current one, since a timer's level
+    // is that of the highest digit in which it is ahead of the current tick.
+    int shift = level * kSlotBits;
+    int current = static_cast<int>(
+        (now_tick_ >> shift) & (kSlotsPerLevel - 1));
+    assert(current == kSlotsPerLevel - 1 ||
+           (occupied_[level] &
+            ~(~static_cast<uint64_t>(0) << (current + 1))) == 0);
+    (void)current;
+
+    // Each level's next slot comes before the end of the current slot on
+    // the level above it, so the lowest occupied level has the earliest.
+    uint64_t index = LowestSetBit(occupied_[level]);
+    return RoundDown(now_tick_, shift + kSlotBits) + (index << shift);
+  }
+  return UINT64_MAX;
+}
+
+}  // namespace platform
@@ -0,0 +1,118 @@
+#ifndef __PLATFORM_TIMER_WHEEL_H__
+#define __PLATFORM_TIMER_WHEEL_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace platform {
+
+// A hierarchical timing wheel, for keeping track of large numbers of
+// timeouts.  Adding and cancelling a timer is O(1), and timers are intrusive,
+// so the wheel never allocates memory.
+//
+// Time is measured in nanoseconds on any monotonic clock, and is rounded to
+// ticks of a configurable resolution.  Timers never fire before their
+// deadline, but may fire up to a tick after it, or later if Advance() is not
+// called often enough.
+//
+// The wheel has 11 levels of 64 slots, which together cover every 64 bit
+// tick count.  A timer is kept at the level of the highest digit (in base 64)
+// in which its deadline differs from the current tick, and it moves down a
+// level each time the current tick reaches the start of its slot, so each
+// timer is moved at most 10 times.
+//
+// This class is not thread safe.
+class TimerWheel {
+ public:
+  typedef void (*Callback)(void* arg);
+
+  class Timer {
+   public:
+    Timer(Callback callback, void* arg)
+        : callback_(callback), arg_(arg), prev_(nullptr), next_(nullptr),
+          deadline_tick_(0), slot_(kNoSlot) {}
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    // Returns true if the timer has been added and has neither fired nor been
+    // cancelled.
+    bool pending() const { return slot_ != kNoSlot; }
+
+   private:
+    friend class TimerWheel;
+
+    Callback callback_;
+    void* arg_;
+    Timer* prev_;
+    Timer* next_;
+    uint64_t deadline_tick_;
+    uint32_t slot_;
+  };
+
+  // Creates a wheel whose current time is |now|, and which rounds deadlines
+  // up to multiples of |tick_ns| nanoseconds.
+  explicit TimerWheel(uint64_t now, uint64_t tick_ns = 1000 * 1000);
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Arranges for |timer|'s callback to be called from the first call to
+  // Advance() at or after |deadline|.  |timer| must not be pending, and must
+  // stay alive until it fires or is cancelled.
+  void Add(Timer* timer, uint64_t deadline);
+
+  // Stops |timer| from firing.  Returns false if it was not pending.
+  bool Cancel(Timer* timer);
+
+  // Moves the current time forward to |now| and calls the callbacks of the
+  // timers which have expired, in batch.  Callbacks may add and cancel
+  // timers, but timers added with a deadline which has already passed only
+  // fire on the next call.  Returns the number of timers that fired.
+  size_t Advance(uint64_t now);
+
+  // Returns a time at or before which Advance() must be called for the
+  // timers to fire on time, or UINT64_MAX if there are no timers.  This is
+  // exact if the earliest timer is on the lowest level of the wheel, and
+  // earlier otherwise.
+  uint64_t NextExpiry() const;
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  static const int kSlotBits = 6;
+  static const int kSlotsPerLevel = 1 << kSlotBits;
+  static const int kNumLevels = 11;
+  static const uint32_t kNumSlots = kNumLevels * kSlotsPerLevel;
+  // Slot numbers for timers which are not in the wheel proper.
+  static const uint32_t kExpiredSlot = kNumSlots;
+  static const uint32_t kFiringSlot = kNumSlots + 1;
+  static const uint32_t kNoSlot = kNumSlots + 2;
+
+  // The list heads are Timers without callbacks, linked in a circle.
+  struct List {
+    List() : head(nullptr, nullptr) { head.prev_ = head.next_ = &head; }
+    bool empty() const { return head.next_ == &head; }
+    Timer head;
+  };
+
+  void Insert(Timer* timer);
+  static void PushBack(List* list, Timer* timer, uint32_t slot);
+  static void Unlink(Timer* timer);
+  static void SpliceBack(List* destination, List* source, uint32_t slot);
+  void Cascade(int level, int index);
+  uint64_t NextEventTick() const;
+
+  const uint64_t tick_ns_;
+  uint64_t now_tick_;
+  size_t size_;
+
+  // One bit per slot on each level, set if the slot has timers in it.
+  uint64_t occupied_[kNumLevels];
+  List slots_[kNumSlots];
+  // Timers added with deadlines that have already passed.
+  List expired_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_TIMER_WHEEL_H__
@@ -0,0 +1,225 @@
+#include "platform/timer_wheel.h"
+
+#include <cstdint>
+#include <deque>
+#include <random>
+
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::TimerWheel;
+
+namespace {
+const uint64_t kMillisecond = 1000 * 1000;
+
+void CountFired(void* arg) {
+  ++*static_cast<int*>(arg);
+}
+
+// A timer which remembers the time passed to the Advance() call that fired
+// it, and to the call before that.
+struct RecordingTimer {
+  RecordingTimer(const uint64_t* now, const uint64_t* previous)
+      : timer(&Fire, this), deadline(0), fired_at(0), previous_advance(0),
+        num_fired(0), now(now), previous(previous) {}
+
+  static void Fire(void* arg) {
+    RecordingTimer* self = static_cast<RecordingTimer*>(arg);
+    self->fired_at = *self->now;
+    self->previous_advance = *self->previous;
+    ++self->num_fired;
+  }
+
+  TimerWheel::Timer timer;
+  uint64_t deadline;
+  uint64_t fired_at;
+  uint64_t previous_advance;
+  int num_fired;
+  const uint64_t* now;
+  const uint64_t* previous;
+};
+}  // namespace
+
+TEST(TimerWheelTests, FiresAtDeadlineAndNotBefore) {
+  TimerWheel wheel(0);
+  int num_fired = 0;
+  TimerWheel::Timer timer(&CountFired, &num_fired);
+
+  wheel.Add(&timer, 5 * kMillisecond + 1);
+  EXPECT_TRUE(timer.pending());
+  EXPECT_EQ(1u, wheel.size());
+
+  EXPECT_EQ(0u, wheel.Advance(5 * kMillisecond));
+  EXPECT_EQ(0, num_fired);
+  EXPECT_EQ(1u, wheel.Advance(6 * kMillisecond));
+  EXPECT_EQ(1, num_fired);
+  EXPECT_FALSE(timer.pending());
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTests, PastDeadlinesFireOnNextAdvance) {
+  TimerWheel wheel(100 * kMillisecond);
+  int num_fired = 0;
+  TimerWheel::Timer timer(&CountFired, &num_fired);
+
+  wheel.Add(&timer, 0);
+  EXPECT_EQ(0u, wheel.NextExpiry());
+  EXPECT_EQ(1u, wheel.Advance(100 * kMillisecond));
+  EXPECT_EQ(1, num_fired);
+}
+
+TEST(TimerWheelTests, CancelledTimersDoNotFire) {
+  TimerWheel wheel(0);
+  int num_fired = 0;
+  TimerWheel::Timer near(&CountFired, &num_fired);
+  TimerWheel::Timer far(&CountFired, &num_fired);
+  TimerWheel::Timer expired(&CountFired, &num_fired);
+
+  wheel.Add(&near, 10 * kMillisecond);
+  wheel.Add(&far, 10000 * kMillisecond);
+  wheel.Add(&expired, 0);
+  EXPECT_TRUE(wheel.Cancel(&near));
+  EXPECT_TRUE(wheel.Cancel(&far));
+  EXPECT_TRUE(wheel.Cancel(&expired));
+  EXPECT_FALSE(wheel.Cancel(&far));
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_EQ(UINT64_MAX, wheel.NextExpiry());
+
+  EXPECT_EQ(0u, wheel.Advance(20000 * kMillisecond));
+  EXPECT_EQ(0, num_fired);
+
+  // Cancelled timers can be added again.
+  wheel.Add(&near, 20001 * kMillisecond);
+  EXPECT_EQ(1u, wheel.Advance(20001 * kMillisecond));
+  EXPECT_EQ(1, num_fired);
+}
+
+TEST(TimerWheelTests, NextExpiry) {
+  TimerWheel wheel(0);
+  int num_fired = 0;
+  TimerWheel::Timer near(&CountFired, &num_fired);
+  TimerWheel::Timer far(&CountFired, &num_fired);
+
+  wheel.Add(&far, 100000 * kMillisecond);
+  uint64_t far_expiry = wheel.NextExpiry();
+  EXPECT_LT(0u, far_expiry);
+  EXPECT_GE(100000 * kMillisecond, far_expiry);
+
+  wheel.Add(&near, 10 * kMillisecond);
+  EXPECT_EQ(10 * kMillisecond, wheel.NextExpiry());
+
+  // Advancing to a far expiry which is not exact moves the timer closer.
+  wheel.Advance(10 * kMillisecond);
+  while (far.pending()) {
+    uint64_t expiry = wheel.NextExpiry();
+    EXPECT_GE(100000 * kMillisecond, expiry);
+    wheel.Advance(expiry);
+  }
+  EXPECT_EQ(2, num_fired);
+}
+
+TEST(TimerWheelTests, CallbacksCanAddAndCancelTimers) {
+  struct State {
+    TimerWheel* wheel;
+    TimerWheel::Timer* to_add;
+    TimerWheel::Timer* to_cancel;
+  };
+  TimerWheel wheel(0);
+  int num_fired = 0;
+  TimerWheel::Timer added(&CountFired, &num_fired);
+  TimerWheel::Timer cancelled(&CountFired, &num_fired);
+  State state = {&wheel, &added, &cancelled};
+  TimerWheel::Timer first([](void* arg) {
+    State* state = static_cast<State*>(arg);
+    state->wheel->Add(state->to_add, 20 * kMillisecond);
+    state->wheel->Cancel(state->to_cancel);
+  }, &state);
+
+  // |cancelled| is due at the same time as |first|, and is cancelled while
+  // it is waiting to fire in the same batch.
+  wheel.Add(&first, 10 * kMillisecond);
+  wheel.Add(&cancelled, 10 * kMillisecond);
+  EXPECT_EQ(1u, wheel.Advance(15 * kMillisecond));
+  EXPECT_EQ(0, num_fired);
+  EXPECT_TRUE(added.pending());
+  EXPECT_EQ(1u, wheel.Advance(20 * kMillisecond));
+  EXPECT_EQ(1, num_fired);
+}
+
+TEST(TimerWheelTests, ExtremeDeadlines) {
+  TimerWheel wheel(0, 1);
+  int num_fired = 0;
+  TimerWheel::Timer timer(&CountFired, &num_fired);
+
+  wheel.Add(&timer, UINT64_MAX - 1);
+  EXPECT_EQ(0u, wheel.Advance(UINT64_MAX - 2));
+  EXPECT_EQ(1u, wheel.Advance(UINT64_MAX - 1));
+  EXPECT_EQ(1, num_fired);
+}
+
+// Adds timers with deadlines spread over every level of the wheel, and
+// advances in irregular steps, checking that each timer fires exactly once,
+// at the first Advance() that reaches its deadline's tick.
+TEST(TimerWheelTests, RandomDeadlinesFireOnTime) {
+  const int kNumTimers = 20000;
+  const uint64_t kTick = 1000;
+  std::mt19937_64 random(1234);
+  uint64_t now = 5 * kTick + 17;
+  uint64_t previous = now;
+  TimerWheel wheel(now, kTick);
+
+  std::deque<RecordingTimer> timers;
+  for (int i = 0; i < kNumTimers; ++i) {
+    timers.emplace_back(&now, &previous);
+    RecordingTimer& timer = timers.back();
+    int magnitude = random() % 40;
+    timer.deadline = now + random() % (kTick << magnitude);
+    wheel.Add(&timer.timer, timer.deadline);
+  }
+
+  while (!wheel.empty()) {
+    uint64_t expiry = wheel.NextExpiry();
+    ASSERT_NE(UINT64_MAX, expiry);
+    // Sometimes stop short of, and sometimes overshoot, the next expiry.
+    uint64_t step = expiry > now ? expiry - now : 0;
+    step = step / 2 + random() % (step + 2 * kTick);
+    previous = now;
+    now += step;
+    wheel.Advance(now);
+  }
+
+  for (const RecordingTimer& timer : timers) {
+    EXPECT_EQ(1, timer.num_fired);
+    uint64_t deadline_tick = (timer.deadline + kTick - 1) / kTick;
+    EXPECT_LE(deadline_tick * kTick, timer.fired_at);
+    EXPECT_LT(timer.previous_advance / kTick, deadline_tick);
+  }
+}
+
+TEST(TimerWheelTests, MillionsOfTimers) {
+  const int kNumTimers = 2000 * 1000;
+  std::minstd_rand random(42);
+  TimerWheel wheel(0);
+  int num_fired = 0;
+  std::deque<TimerWheel::Timer> timers;
+  for (int i = 0; i < kNumTimers; ++i) {
+    timers.emplace_back(&CountFired, &num_fired);
+  }
+
+  // One timeout per connection, of up to a minute.
+  for (auto& timer : timers) {
+    wheel.Add(&timer, (random() % 60000) * kMillisecond);
+  }
+  for (int i = 0; i < kNumTimers; i += 2) {
+    wheel.Cancel(&timers[i]);
+  }
+  EXPECT_EQ(static_cast<size_t>(kNumTimers / 2), wheel.size());
+
+  size_t total_fired = 0;
+  for (uint64_t now = 0; now <= 60000 * kMillisecond;
+       now += 100 * kMillisecond) {
+    total_fired += wheel.Advance(now);
+  }
+  EXPECT_EQ(static_cast<size_t>(kNumTimers / 2), total_fired);
+  EXPECT_EQ(kNumTimers / 2, num_fired);
+  EXPECT_TRUE(wheel.empty());
+}
@@ -1,12 +1,24 @@
 #include "platform/file_system.h"
 
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdlib.h>
-#include <ftw.h>
 #include <unistd.h>
 
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
 
 namespace platform {
 
@@ -36,31 +48,348 @@ stdext::optional<std::string> MakeTemporaryDirectory() {
 }
 
 namespace {
-int RemoveFile(
-    const char *pathname, const struct stat *sbuf, int type, struct FTW *ftwb) {
-  if (remove(pathname) < 0) {
-    std::cerr << "Error removing path: " << pathname << std::endl;
-    return -1;
+// A trash directory, held open so that entries are only ever renamed into and
+// removed from the directory that was checked, whatever happens to its path.
+class TrashDirectory {
+ public:
+  TrashDirectory(int fd, std::string path) : fd_(fd), path_(std::move(path)) {}
+  TrashDirectory(const TrashDirectory&) = delete;
+  TrashDirectory& operator=(const TrashDirectory&) = delete;
+  ~TrashDirectory() { close(fd_); }
+
+  int fd() const { return fd_; }
+  const std::string& path() const { return path_; }
+
+ private:
+  const int fd_;
+  const std::string path_;
+};
+
+// Removes the directories passed to RemoveDirectoryTreeInBackground() one at
+// a time, on a thread of its own.
+class BackgroundRemover {
+ public:
+  // Never destroyed, since its thread may still be running when the process
+  // exits.  Anything it had not removed by then is left in the trash for the
+  // next process to remove.
+  static BackgroundRemover* Get() {
+    static BackgroundRemover* remover = new BackgroundRemover();
+    return remover;
+  }
+
+  bool Remove(const char* filepath,
+              std::vector<RemoveDirectoryTreeError>* errors);
+  bool Flush(std::vector<RemoveDirectoryTreeError>* errors);
+
+ private:
+  struct TrashEntry {
+    std::shared_ptr<TrashDirectory> trash;
+    std::string name;
+  };
+
+  BackgroundRemover() : busy_(false), started_(false), counter_(0) {}
+
+  // Opens the trash directory |path|, making it if need be, or returns null
+  // if it is not one which only we could have put there.
+  static std::shared_ptr<TrashDirectory> OpenTrash(const std::string& path);
+
+  // Claims whatever processes which have exited left in |trash|.
+  void ClaimStaleTrash(const std::shared_ptr<TrashDirectory>& trash);
+
+  // Returns a name for an entry in a trash directory which no other process
+  // will use.
+  std::string NewTrashName();
+
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<TrashEntry> pending_;
+  bool busy_;
+  bool started_;
+  uint64_t counter_;
+  // The device and inode of each trash directory used so far.
+  std::set<std::pair<dev_t, ino_t>> claimed_trash_;
+  std::vector<RemoveDirectoryTreeError> errors_;
+};
+
+bool BackgroundRemover::Remove(
+    const char* filepath, std::vector<RemoveDirectoryTreeError>* errors) {
+  std::string path(filepath);
+  while (path.size() > 1 && path.back() == '/') {
+    path.pop_back();
+  }
+  size_t separator = path.rfind('/');
+  std::string parent = separator == std::string::npos
+                           ? std::string(".")
+                           : path.substr(0, std::max<size_t>(separator, 1));
+  std::shared_ptr<TrashDirectory> trash =
+      OpenTrash(parent + "/.stdext_trash." + std::to_string(getuid()));
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::string name;
+  if (trash) {
+    struct stat status;
+    if (fstat(trash->fd(), &status) == 0 &&
+        claimed_trash_.emplace(status.st_dev, status.st_ino).second) {
+      ClaimStaleTrash(trash);
+    }
+    name = NewTrashName();
+  }
+  if (!trash ||
+      renameat(AT_FDCWD, path.c_str(), trash->fd(), name.c_str()) != 0) {
+    lock.unlock();
+    if (errors) {
+      return RemoveDirectoryTree(path.c_str(), RemoveDirectoryTreeOptions(),
+                                 errors);
+    }
+    std::vector<RemoveDirectoryTreeError> unreported;
+    if (RemoveDirectoryTree(path.c_str(), RemoveDirectoryTreeOptions(),
+                            &unreported)) {
+      return true;
+    }
+    lock.lock();
+    errors_.insert(errors_.end(), unreported.begin(), unreported.end());
+    return false;
+  }
+
+  pending_.push_back(TrashEntry{std::move(trash), std::move(name)});
+  if (!started_) {
+    std::thread(&BackgroundRemover::Run, this).detach();
+    started_ = true;
+  }
+  changed_.notify_all();
+  return true;
+}
+
+bool BackgroundRemover::Flush(std::vector<RemoveDirectoryTreeError>* errors) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this]() { return pending_.empty() && !busy_; });
+  bool ok = errors_.empty();
+  if (errors) {
+    errors->insert(errors->end(), errors_.begin(), errors_.end());
+  }
+  errors_.clear();
+  return ok;
+}
+
+std::shared_ptr<TrashDirectory> BackgroundRemover::OpenTrash(
+    const std::string& path) {
+  mkdir(path.c_str(), 0700);
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  // Anyone who can write to the parent, such as /tmp, could have made it
+  // first, or put a link to somewhere else there.
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_uid != getuid() ||
+      (status.st_mode & 077) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  return std::make_shared<TrashDirectory>(fd, path);
+}
+
+void BackgroundRemover::ClaimStaleTrash(
+    const std::shared_ptr<TrashDirectory>& trash) {
+  int fd = fcntl(trash->fd(), F_DUPFD_CLOEXEC, 0);
+  DIR* dir = fd < 0 ? nullptr : fdopendir(fd);
+  if (!dir) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  while (struct dirent* dirent = readdir(dir)) {
+    // Names start with the pid of the process which made them.
+    char* end;
+    long pid = strtol(dirent->d_name, &end, 10);
+    if (end == dirent->d_name || *end != '.' || pid == getpid() ||
+        kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH) {
+      continue;
+    }
+    // Renaming it first means that only one process claims it.
+    std::string name = NewTrashName();
+    if (renameat(trash->fd(), dirent->d_name, trash->fd(), name.c_str()) ==
+        0) {
+      pending_.push_back(TrashEntry{trash, std::move(name)});
+    }
   }
+  closedir(dir);
+}
+
+std::string BackgroundRemover::NewTrashName() {
+  return std::to_string(getpid()) + "." + std::to_string(counter_++);
+}
+
+void BackgroundRemover::Run() {
+  // Removal is left to one thread, so as not to compete with the work which
+  // deferred it.
+  RemoveDirectoryTreeOptions options;
+  options.max_threads = 1;
+  std::vector<RemoveDirectoryTreeError> errors;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    changed_.wait(lock, [this]() { return !pending_.empty(); });
+    TrashEntry entry = std::move(pending_.front());
+    pending_.pop_front();
+    busy_ = true;
+    lock.unlock();
 
-  return 0;
+    RemoveDirectoryTreeAt(entry.trash->fd(), entry.name.c_str(), options,
+                          &errors);
+    for (RemoveDirectoryTreeError& error : errors) {
+      error.path = entry.trash->path() + "/" + error.path;
+    }
+    entry.trash.reset();
+
+    lock.lock();
+    errors_.insert(errors_.end(), errors.begin(), errors.end());
+    errors.clear();
+    busy_ = false;
+    changed_.notify_all();
+  }
 }
 }  // namespace
 
-bool RemoveDirectoryTree(const char* filepath) {
-  // At least one file descriptor will be used for each directory level, so
-  // this value effectively limits the directory depth we can traverse to.
-  int kFDLimit = 20;
+bool RemoveDirectoryTreeInBackground(
+    const char* filepath, std::vector<RemoveDirectoryTreeError>* errors) {
+  return BackgroundRemover::Get()->Remove(filepath, errors);
+}
 
-  if (nftw(filepath, RemoveFile, kFDLimit,
-           FTW_DEPTH | FTW_MOUNT | FTW_PHYS) < 0) {
-    std::cerr << "Error removing directory tree: " << filepath << std::endl;
-    return false;
+bool FlushBackgroundRemovals(std::vector<RemoveDirectoryTreeError>* errors) {
+  return BackgroundRemover::Get()->Flush(errors);
+}
+
+namespace {
+// Reads the rest of |fd| into a buffer allocated with malloc(), for files
+// which can not be mapped.
+bool ReadIntoBuffer(int fd, FileMapping* mapping) {
+  char* buffer = nullptr;
+  size_t capacity = 0;
+  size_t size = 0;
+  while (true) {
+    if (size == capacity) {
+      capacity = std::max<size_t>(capacity * 2, 64 * 1024);
+      char* grown = static_cast<char*>(realloc(buffer, capacity));
+      if (!grown) {
+        free(buffer);
+        errno = ENOMEM;
+        return false;
+      }
+      buffer = grown;
+    }
+    ssize_t result = read(fd, buffer + size, capacity - size);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result < 0) {
+      int error = errno;
+      free(buffer);
+      errno = error;
+      return false;
+    }
+    if (result == 0) {
+      break;
+    }
+    size += result;
   }
 
+  if (size == 0) {
+    free(buffer);
+    buffer = nullptr;
+  }
+  mapping->data = buffer;
+  mapping->size = size;
+  mapping->mapped = false;
   return true;
 }
 
+void Advise(void* address, size_t size, const MapFileOptions& options) {
+  if (options.access == MapFileOptions::kSequential) {
+    madvise(address, size, MADV_SEQUENTIAL);
+  } else if (options.access == MapFileOptions::kRandom) {
+    madvise(address, size, MADV_RANDOM);
+  }
+  if (options.will_need) {
+    madvise(address, size, MADV_WILLNEED);
+  }
+#if defined(MADV_HUGEPAGE)
+  if (options.huge_pages) {
+    madvise(address, size, MADV_HUGEPAGE);
+  }
+#endif
+}
+}  // namespace
+
+stdext::optional<FileMapping> MapFile(const char* filepath,
+                                      const MapFileOptions& options) {
+  int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return stdext::nullopt;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return stdext::nullopt;
+  }
+  if (static_cast<uint64_t>(status.st_size) > SIZE_MAX) {
+    close(fd);
+    errno = EFBIG;
+    return stdext::nullopt;
+  }
+  // Devices such as /dev/zero may never reach the end, so only files and
+  // streams which will are read into a buffer.
+  if (!S_ISREG(status.st_mode) && !S_ISFIFO(status.st_mode) &&
+      !S_ISSOCK(status.st_mode)) {
+    close(fd);
+    errno = S_ISDIR(status.st_mode) ? EISDIR : ENODEV;
+    return stdext::nullopt;
+  }
+
+  FileMapping mapping;
+  // Files in /proc and the like claim to be empty, so only files which say
+  // they have contents are mapped.
+  if (S_ISREG(status.st_mode) && status.st_size > 0) {
+    int flags = MAP_SHARED;
+#if defined(MAP_POPULATE)
+    if (options.populate) {
+      flags |= MAP_POPULATE;
+    }
+#endif
+    size_t size = static_cast<size_t>(status.st_size);
+    void* address = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+    if (address != MAP_FAILED) {
+      close(fd);
+      Advise(address, size, options);
+      mapping.data = static_cast<const char*>(address);
+      mapping.size = size;
+      mapping.mapped = true;
+      return mapping;
+    }
+  }
+
+  bool ok = ReadIntoBuffer(fd, &mapping);
+  int error = errno;
+  close(fd);
+  if (!ok) {
+    errno = error;
+    return stdext::nullopt;
+  }
+  return mapping;
+}
+
+void UnmapFile(const FileMapping& mapping) {
+  if (mapping.mapped) {
+    munmap(const_cast<char*>(mapping.data), mapping.size);
+  } else {
+    free(const_cast<char*>(mapping.data));
+  }
+}
+
 std::string GetThisModulePath() {
   const size_t kBufferSize = 512;
   char path_buffer[kBufferSize];
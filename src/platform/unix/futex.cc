@@ -0,0 +1,52 @@
+#include "platform/futex.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <climits>
+#include <ctime>
+
+namespace platform {
+
+namespace {
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "Futexes operate on plain 32-bit words.");
+
+long Futex(std::atomic<uint32_t>* address, int op, uint32_t value,
+           const struct timespec* timeout = nullptr,
+           uint32_t bitset = 0) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(address),
+                 op | FUTEX_PRIVATE_FLAG, value, timeout, nullptr, bitset);
+}
+}  // namespace
+
+void FutexWait(std::atomic<uint32_t>* address, uint32_t expected) {
+  Futex(address, FUTEX_WAIT, expected);
+}
+
+void FutexWaitUntil(std::atomic<uint32_t>* address, uint32_t expected,
+                    std::chrono::steady_clock::time_point deadline) {
+  // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC time, which is the
+  // clock behind std::chrono::steady_clock.
+  auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      deadline.time_since_epoch());
+  if (since_epoch.count() < 0) {
+    return;
+  }
+  struct timespec timeout;
+  timeout.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+  timeout.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+  Futex(address, FUTEX_WAIT_BITSET, expected, &timeout,
+        FUTEX_BITSET_MATCH_ANY);
+}
+
+void FutexWake(std::atomic<uint32_t>* address, int count) {
+  Futex(address, FUTEX_WAKE, count);
+}
+
+void FutexWakeAll(std::atomic<uint32_t>* address) {
+  Futex(address, FUTEX_WAKE, INT_MAX);
+}
+
+}  // namespace platform
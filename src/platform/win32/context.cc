@@ -2,6 +2,8 @@
 
 #include <windows.h>
 
+#include "platform/context_trace.h"
+
 namespace platform {
 
 struct Context {
@@ -25,19 +27,26 @@ void EnsureThreadIsFiber() {
 }
 
 struct NewContextParams {
-  const FiberMain* fiber_main;
+  RawFiberMain entry_point;
+  void* arg;
   Context* previous_context;
 };
 
 void __stdcall FiberEntryPoint(void* param) {
   NewContextParams* params = reinterpret_cast<NewContextParams*>(param);
 
-  Context* next_context = (*params->fiber_main)(params->previous_context);
+  Context* next_context =
+      params->entry_point(params->previous_context, params->arg);
 
   assert(next_context);
 
   next_context->previous_context = nullptr;
   next_context->fiber_to_delete = tl_current_fiber;
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(ContextTraceEvent::kExit, nullptr,
+                                      next_context, nullptr,
+                                      next_context->data);
+  }
 
   tl_current_fiber = next_context->fiber;
   SwitchToFiber(next_context->fiber);
@@ -62,6 +71,11 @@ Context* SwitchToContext(Context* destination_context,
 
   destination_context->fiber_to_delete = NULL;
   destination_context->previous_context = &existing_context;
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(
+        ContextTraceEvent::kSwitch, &existing_context, destination_context,
+        context_data, destination_context->data);
+  }
   tl_current_fiber = destination_context->fiber;
   SwitchToFiber(destination_context->fiber);
 
@@ -69,8 +83,11 @@ Context* SwitchToContext(Context* destination_context,
   return existing_context.previous_context;
 }
 
-Context* SwitchToNewContext(size_t stack_size, void* context_data,
-                            const FiberMain& entry_point) {
+// Windows fibers always allocate and own their stacks, so there is nothing for
+// |stack_allocator| to do here.
+Context* SwitchToNewContext(StackAllocator* stack_allocator,
+                            size_t stack_size, void* context_data,
+                            RawFiberMain entry_point, void* arg) {
   EnsureThreadIsFiber();
 
   Context existing_context;
@@ -78,11 +95,17 @@ Context* SwitchToNewContext(size_t stack_size, void* context_data,
   existing_context.data = context_data;
 
   NewContextParams new_context_params;
-  new_context_params.fiber_main = &entry_point;
+  new_context_params.entry_point = entry_point;
+  new_context_params.arg = arg;
   new_context_params.previous_context = &existing_context;
 
   void* next_fiber = CreateFiber(stack_size, &FiberEntryPoint,
                                  &new_context_params);
+  if (IsContextTracingEnabled()) {
+    internal::RecordContextTraceEvent(ContextTraceEvent::kNewContext,
+                                      &existing_context, nullptr,
+                                      context_data, nullptr);
+  }
   tl_current_fiber = next_fiber;
   SwitchToFiber(next_fiber);
 
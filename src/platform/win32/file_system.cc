@@ -2,6 +2,8 @@
 
 #include <windows.h>
 
+#include <cerrno>
+#include <cstdint>
 #include <ctime>
 #include <iostream>
 #include <memory>
@@ -75,7 +77,9 @@ stdext::optional<std::string> MakeTemporaryDirectory() {
   return random_path;
 }
 
-bool RemoveDirectoryTree(const char* filepath) {
+bool RemoveDirectoryTree(const char* filepath,
+                         const RemoveDirectoryTreeOptions& options,
+                         std::vector<RemoveDirectoryTreeError>* errors) {
   // Turns out that the string we need to pass in here has to be *double*
   // null terminated.  So, set that up.
   std::string str(filepath);
@@ -96,9 +100,80 @@ bool RemoveDirectoryTree(const char* filepath) {
       0,
       "" };
   int result = SHFileOperation(&file_op);
+  if (result != 0 && errors) {
+    errors->push_back(RemoveDirectoryTreeError{filepath, result});
+  }
   return result == 0;
 }
 
+bool RemoveDirectoryTree(const char* filepath) {
+  return RemoveDirectoryTree(filepath, RemoveDirectoryTreeOptions(), nullptr);
+}
+
+bool RemoveDirectoryTreeInBackground(
+    const char* filepath, std::vector<RemoveDirectoryTreeError>* errors) {
+  return RemoveDirectoryTree(filepath, RemoveDirectoryTreeOptions(), errors);
+}
+
+// Nothing is ever left to be removed, or reported, later.
+bool FlushBackgroundRemovals(
+    std::vector<RemoveDirectoryTreeError>* /*errors*/) {
+  return true;
+}
+
+stdext::optional<FileMapping> MapFile(const char* filepath,
+                                      const MapFileOptions& options) {
+  // The hints have no equivalent here.
+  HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    errno = GetLastError() == ERROR_FILE_NOT_FOUND ? ENOENT : EIO;
+    return stdext::optional<FileMapping>();
+  }
+
+  FileMapping mapping = {nullptr, 0, false};
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    errno = EIO;
+    return stdext::optional<FileMapping>();
+  }
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    return mapping;
+  }
+  if (static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) {
+    CloseHandle(file);
+    errno = EFBIG;
+    return stdext::optional<FileMapping>();
+  }
+
+  HANDLE file_mapping =
+      CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  void* view = file_mapping
+                   ? MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0)
+                   : NULL;
+  if (file_mapping) {
+    // The view keeps the mapping alive.
+    CloseHandle(file_mapping);
+  }
+  CloseHandle(file);
+  if (!view) {
+    errno = EIO;
+    return stdext::optional<FileMapping>();
+  }
+  mapping.data = static_cast<const char*>(view);
+  mapping.size = static_cast<size_t>(size.QuadPart);
+  mapping.mapped = true;
+  return mapping;
+}
+
+void UnmapFile(const FileMapping& mapping) {
+  if (mapping.mapped) {
+    UnmapViewOfFile(mapping.data);
+  }
+}
+
 std::string GetThisModulePath() {
   HMODULE module = GetModuleHandleW(NULL);
   char path_str[MAX_PATH];
@@ -0,0 +1,37 @@
+#include "platform/futex.h"
+
+#include <windows.h>
+
+namespace platform {
+
+void FutexWait(std::atomic<uint32_t>* address, uint32_t expected) {
+  WaitOnAddress(address, &expected, sizeof(expected), INFINITE);
+}
+
+void FutexWaitUntil(std::atomic<uint32_t>* address, uint32_t expected,
+                    std::chrono::steady_clock::time_point deadline) {
+  auto now = std::chrono::steady_clock::now();
+  if (deadline <= now) {
+    return;
+  }
+  // Round up, so that the caller does not wake before the deadline and spin.
+  auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - now + std::chrono::milliseconds(1) -
+      std::chrono::nanoseconds(1));
+  DWORD timeout_ms = timeout.count() >= INFINITE
+                         ? INFINITE - 1
+                         : static_cast<DWORD>(timeout.count());
+  WaitOnAddress(address, &expected, sizeof(expected), timeout_ms);
+}
+
+void FutexWake(std::atomic<uint32_t>* address, int count) {
+  for (int i = 0; i < count; ++i) {
+    WakeByAddressSingle(address);
+  }
+}
+
+void FutexWakeAll(std::atomic<uint32_t>* address) {
+  WakeByAddressAll(address);
+}
+
+}  // namespace platform
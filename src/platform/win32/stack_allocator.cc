@@ -0,0 +1,68 @@
+#include "platform/stack_allocator.h"
+
+#include <windows.h>
+
+#include <cstdint>
+
+#include "platform/stack_profiler.h"
+
+namespace platform {
+
+namespace {
+size_t PageSize() {
+  SYSTEM_INFO system_info;
+  GetSystemInfo(&system_info);
+  return system_info.dwPageSize;
+}
+}  // namespace
+
+size_t StackAllocator::AllocatedSize(size_t size) {
+  const size_t page_size = PageSize();
+  return (size + page_size - 1) & ~(page_size - 1);
+}
+
+// Stacks are not cached on Windows, where fibers created through
+// SwitchToNewContext() manage their own stacks.  Each stack is reserved with
+// a no-access guard page below it and committed on demand by the OS.
+Stack StackAllocator::Allocate(size_t size) {
+  const size_t page_size = PageSize();
+  size = AllocatedSize(size);
+
+  Stack stack;
+  uint8_t* reservation = static_cast<uint8_t*>(
+      VirtualAlloc(NULL, size + page_size, MEM_RESERVE | MEM_COMMIT,
+                   PAGE_READWRITE));
+  if (reservation == NULL) {
+    return stack;
+  }
+
+  DWORD old_protect;
+  if (!VirtualProtect(reservation, page_size, PAGE_NOACCESS, &old_protect)) {
+    VirtualFree(reservation, 0, MEM_RELEASE);
+    return stack;
+  }
+
+  stack.base = reservation + page_size;
+  stack.size = size;
+  if (options_.profile) {
+    options_.profile->OnAllocate(&stack);
+  }
+  return stack;
+}
+
+void StackAllocator::Free(const Stack& stack) {
+  if (!stack.base) {
+    return;
+  }
+  if (options_.profile) {
+    options_.profile->OnFree(stack);
+  }
+  VirtualFree(static_cast<uint8_t*>(stack.base) - PageSize(), 0, MEM_RELEASE);
+}
+
+StackAllocator* StackAllocator::GetDefault() {
+  static StackAllocator default_allocator;
+  return &default_allocator;
+}
+
+}  // namespace platform
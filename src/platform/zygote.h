@@ -0,0 +1,78 @@
+#ifndef __PLATFORM_ZYGOTE_H__
+#define __PLATFORM_ZYGOTE_H__
+
+#include <sys/types.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "platform/process.h"
+#include "stdext/file_system.h"
+#include "stdext/optional.h"
+
+namespace platform {
+
+// A fork server, which starts child processes by forking an already
+// initialized copy of this process rather than by executing a program, so
+// that they do not pay for dynamic linking and static initialization.  Only
+// available on Linux.
+//
+// Creating a Zygote forks a helper process, the zygote, which then waits for
+// requests over a Unix socket.  Each request names one of the entry points
+// which the Zygote was created with, and carries the child's standard
+// streams as descriptors.  The zygote forks a child which runs the entry
+// point and exits with its result.  Children are forked with CLONE_PARENT, so
+// that they are children of this process rather than of the zygote, and are
+// returned as ordinary Processes, each leading its own process group.
+//
+// The zygote is a copy of this process as it was when the Zygote was created,
+// so it should be created before any other threads are started, and sees no
+// later changes to this process's memory.  A Zygote may be used from any
+// number of threads.
+class Zygote {
+ public:
+  // Called in the child with the arguments it was started with.  The child
+  // exits with the value returned.
+  typedef int (*EntryPoint)(const std::vector<std::string>& args);
+  typedef std::map<std::string, EntryPoint> EntryPoints;
+
+  // Starts a zygote which can run |entry_points|.  Check IsValid() to see
+  // whether this succeeded.
+  explicit Zygote(const EntryPoints& entry_points);
+  Zygote(const Zygote&) = delete;
+  Zygote& operator=(const Zygote&) = delete;
+
+  // Stops the zygote.  Children which it has started are unaffected.
+  ~Zygote();
+
+  bool IsValid() const { return socket_ >= 0; }
+
+  // Starts a child which runs the entry point |name| with |args|, with its
+  // standard streams redirected as by StartSystemCommand().  On failure,
+  // including when there is no such entry point, returns an invalid Process
+  // and sets errno.
+  Process Start(
+      const std::string& name, const std::vector<std::string>& args,
+      const stdext::optional<stdext::file_system::Path>& stdout_file,
+      const stdext::optional<stdext::file_system::Path>& stderr_file,
+      const stdext::optional<stdext::file_system::Path>& stdin_file);
+
+  // As Start(), but waits for the child to exit and returns its status as
+  // SystemCommand() does.
+  int Run(const std::string& name, const std::vector<std::string>& args,
+          const stdext::optional<stdext::file_system::Path>& stdout_file,
+          const stdext::optional<stdext::file_system::Path>& stderr_file,
+          const stdext::optional<stdext::file_system::Path>& stdin_file);
+
+ private:
+  // Serializes requests, each of which is a message and its reply.
+  std::mutex mutex_;
+  int socket_;
+  pid_t pid_;
+};
+
+}  // namespace platform
+
+#endif  // __PLATFORM_ZYGOTE_H__
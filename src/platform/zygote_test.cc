@@ -0,0 +1,186 @@
+#include "platform/zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stdext/file_system.h"
+#include "third_party/googletest/googletest/include/gtest/gtest.h"
+
+using platform::Process;
+using platform::Zygote;
+using stdext::file_system::Path;
+
+namespace {
+int g_initialized_value = 0;
+
+int ExitWithArgument(const std::vector<std::string>& args) {
+  return std::stoi(args.at(0));
+}
+
+int PrintArguments(const std::vector<std::string>& args) {
+  for (const std::string& arg : args) {
+    printf("%s\n", arg.c_str());
+  }
+  return 0;
+}
+
+int ExitWithInitializedValue(const std::vector<std::string>&) {
+  return g_initialized_value;
+}
+
+int Echo(const std::vector<std::string>&) {
+  char buffer[4096];
+  ssize_t size;
+  while ((size = read(0, buffer, sizeof(buffer))) > 0) {
+    if (write(1, buffer, size) != size) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int SleepForever(const std::vector<std::string>&) {
+  while (true) {
+    pause();
+  }
+}
+
+Zygote::EntryPoints TestEntryPoints() {
+  return Zygote::EntryPoints{
+    {"exit", &ExitWithArgument},
+    {"print", &PrintArguments},
+    {"initialized_value", &ExitWithInitializedValue},
+    {"echo", &Echo},
+    {"sleep", &SleepForever},
+  };
+}
+
+std::string ReadFile(const std::string& path) {
+  std::string contents;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return contents;
+  }
+  char buffer[4096];
+  ssize_t size;
+  while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, size);
+  }
+  close(fd);
+  return contents;
+}
+}  // namespace
+
+TEST(ZygoteTests, RunsEntryPoints) {
+  Zygote zygote(TestEntryPoints());
+  ASSERT_TRUE(zygote.IsValid());
+
+  int status = zygote.Run("exit", {"7"}, stdext::nullopt, stdext::nullopt,
+                          stdext::nullopt);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(7, WEXITSTATUS(status));
+}
+
+TEST(ZygoteTests, ChildrenSeeStateFromBeforeTheZygoteStarted) {
+  g_initialized_value = 42;
+  Zygote zygote(TestEntryPoints());
+  g_initialized_value = 0;
+
+  int status = zygote.Run("initialized_value", {}, stdext::nullopt,
+                          stdext::nullopt, stdext::nullopt);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(42, WEXITSTATUS(status));
+}
+
+TEST(ZygoteTests, RedirectsStandardStreams) {
+  stdext::file_system::TemporaryDirectory directory;
+  ASSERT_FALSE(directory.error());
+  std::string input = std::string(directory.path().c_str()) + "/in";
+  std::string output = std::string(directory.path().c_str()) + "/out";
+  int fd = open(input.c_str(), O_WRONLY | O_CREAT, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(6, write(fd, "hello\n", 6));
+  close(fd);
+
+  Zygote zygote(TestEntryPoints());
+  EXPECT_EQ(0, zygote.Run("echo", {}, Path(output), stdext::nullopt,
+                          Path(input)));
+  EXPECT_EQ("hello\n", ReadFile(output));
+
+  EXPECT_EQ(0, zygote.Run("print", {"two words", ""}, Path(output),
+                          stdext::nullopt, stdext::nullopt));
+  EXPECT_EQ("two words\n\n", ReadFile(output));
+}
+
+TEST(ZygoteTests, ReportsUnknownEntryPoints) {
+  Zygote zygote(TestEntryPoints());
+  Process process = zygote.Start("missing", {}, stdext::nullopt,
+                                 stdext::nullopt, stdext::nullopt);
+  EXPECT_FALSE(process.IsValid());
+  EXPECT_EQ(ENOENT, errno);
+
+  process = zygote.Start("exit", {"0"}, stdext::nullopt, stdext::nullopt,
+                         Path("/this/file/does/not/exist"));
+  EXPECT_FALSE(process.IsValid());
+  EXPECT_EQ(ENOENT, errno);
+
+  // The zygote is still usable afterwards.
+  EXPECT_EQ(0, zygote.Run("exit", {"0"}, stdext::nullopt, stdext::nullopt,
+                          stdext::nullopt));
+}
+
+TEST(ZygoteTests, ChildrenCanBeSignalled) {
+  Zygote zygote(TestEntryPoints());
+  Process process = zygote.Start("sleep", {}, stdext::nullopt,
+                                 stdext::nullopt, stdext::nullopt);
+  ASSERT_TRUE(process.IsValid());
+  EXPECT_FALSE(process.WaitFor(std::chrono::milliseconds(10)));
+
+  EXPECT_TRUE(process.Signal(SIGTERM));
+  int status = process.Wait();
+  ASSERT_TRUE(WIFSIGNALED(status));
+  EXPECT_EQ(SIGTERM, WTERMSIG(status));
+}
+
+TEST(ZygoteTests, ChildrenOutliveTheZygote) {
+  Process process;
+  {
+    Zygote zygote(TestEntryPoints());
+    process = zygote.Start("sleep", {}, stdext::nullopt, stdext::nullopt,
+                           stdext::nullopt);
+  }
+  ASSERT_TRUE(process.IsValid());
+  EXPECT_FALSE(process.Poll());
+}
+
+TEST(ZygoteTests, CanBeUsedFromManyThreads) {
+  Zygote zygote(TestEntryPoints());
+  std::atomic<int> num_ok(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&zygote, &num_ok, i]() {
+      for (int j = 0; j < 25; ++j) {
+        int status = zygote.Run("exit", {std::to_string(i + j)},
+                                stdext::nullopt, stdext::nullopt,
+                                stdext::nullopt);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == i + j) {
+          ++num_ok;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(100, num_ok.load());
+}
@@ -1,11 +1,15 @@
 #ifndef __STDEXT_FILE_SYSTEM_H__
 #define __STDEXT_FILE_SYSTEM_H__
 
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "platform/file_system.h"
+#include "stdext/span.h"
+#include "stdext/string_view.h"
 
 namespace stdext {
 namespace file_system {
@@ -80,7 +84,17 @@ inline stdext::optional<std::chrono::system_clock::time_point>
 // deleted.
 class TemporaryDirectory {
  public:
-  TemporaryDirectory() {
+  enum Deletion {
+    // The destructor deletes the directory before returning.
+    kDeleteImmediately,
+    // The destructor moves the directory aside and returns at once, leaving
+    // it to be deleted on a background thread.  See
+    // platform::RemoveDirectoryTreeInBackground().
+    kDeleteInBackground,
+  };
+
+  explicit TemporaryDirectory(Deletion deletion = kDeleteImmediately)
+      : deletion_(deletion) {
     stdext::optional<std::string> str = platform::MakeTemporaryDirectory();
     if (str.has_value()) {
       path_.emplace(std::move(*str));
@@ -88,21 +102,96 @@ class TemporaryDirectory {
   }
 
   ~TemporaryDirectory() {
-    if (path_.has_value()) {
-      if (!platform::RemoveDirectoryTree(path_->c_str())) {
-        std::cerr << "Error removing temporary directory: " << path_->c_str()
-                  << std::endl;
-      }
+    if (!path_.has_value()) {
+      return;
     }
+    std::vector<platform::RemoveDirectoryTreeError> errors;
+    bool removed =
+        deletion_ == kDeleteInBackground
+            // Only failures to remove it before returning are reported
+            // here.  Those of the background thread are left for
+            // FlushBackgroundDeletions() to report.
+            ? platform::RemoveDirectoryTreeInBackground(path_->c_str(),
+                                                        &errors)
+            : platform::RemoveDirectoryTree(
+                  path_->c_str(), platform::RemoveDirectoryTreeOptions(),
+                  &errors);
+    if (!removed) {
+      std::cerr << "Error removing temporary directory: " << path_->c_str()
+                << std::endl;
+      PrintErrors(errors);
+    }
+  }
+
+  // Waits for the directories which were left to be deleted in the
+  // background to have been, as should be done before the process exits.
+  // Returns false if any could not be.
+  static bool FlushBackgroundDeletions() {
+    std::vector<platform::RemoveDirectoryTreeError> errors;
+    if (!platform::FlushBackgroundRemovals(&errors)) {
+      std::cerr << "Error removing temporary directories in the background."
+                << std::endl;
+      PrintErrors(errors);
+      return false;
+    }
+    return true;
   }
 
   bool error() const { return !path_.has_value(); }
   const Path& path() const { return *path_; }
 
  private:
+  static void PrintErrors(
+      const std::vector<platform::RemoveDirectoryTreeError>& errors) {
+    for (const platform::RemoveDirectoryTreeError& error : errors) {
+      std::cerr << "  " << error.path << " (error " << error.error << ")"
+                << std::endl;
+    }
+  }
+
+  const Deletion deletion_;
   optional<Path> path_;
 };
 
+// The contents of a file, mapped into memory read-only so that they can be
+// parsed without being copied.  See platform::MapFile().
+class MappedFile {
+ public:
+  explicit MappedFile(
+      const PathStrRef& path,
+      const platform::MapFileOptions& options = platform::MapFileOptions())
+      : mapping_(platform::MapFile(path.c_str(), options)) {}
+  MappedFile(MappedFile&& other) : mapping_(std::move(other.mapping_)) {
+    other.mapping_.reset();
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (mapping_.has_value()) {
+      platform::UnmapFile(*mapping_);
+    }
+  }
+
+  bool error() const { return !mapping_.has_value(); }
+
+  // Valid for as long as the MappedFile is.
+  string_view str() const {
+    return string_view(mapping_->data, mapping_->size);
+  }
+  span<const uint8_t> bytes() const {
+    return span<const uint8_t>(
+        reinterpret_cast<const uint8_t*>(mapping_->data), mapping_->size);
+  }
+  size_t size() const { return mapping_->size; }
+
+  // Whether the contents are mapped, rather than read into a buffer.
+  bool is_mapped() const { return mapping_->mapped; }
+
+ private:
+  optional<platform::FileMapping> mapping_;
+};
+
 inline Path GetThisModulePath() {
   return Path(platform::GetThisModulePath());
 }
@@ -169,3 +169,63 @@ TEST(FileSystemTests, CanGetSelfModuleFilePath) {
           stdext::file_system::GetThisModulePath());
   EXPECT_TRUE(this_exe_modification_time.has_value());
 }
+
+TEST(FileSystemTests, TemporaryDirectoryCanBeDeletedInBackground) {
+  std::string path;
+  {
+    stdext::file_system::TemporaryDirectory temp_dir(
+        stdext::file_system::TemporaryDirectory::kDeleteInBackground);
+    ASSERT_FALSE(temp_dir.error());
+    path = temp_dir.path().str();
+    std::ofstream out(Join(temp_dir.path(), PathStrRef("foo.txt")).str());
+    out << "bar";
+  }
+
+  // The directory is gone at once, even if its contents are not yet.
+  EXPECT_FALSE(stdext::file_system::GetLastModificationTime(path.c_str())
+                   .has_value());
+  EXPECT_TRUE(
+      stdext::file_system::TemporaryDirectory::FlushBackgroundDeletions());
+}
+
+TEST(FileSystemTests, MappedFileViewsContents) {
+  stdext::file_system::TemporaryDirectory temp_dir;
+  Path temp_file = Join(temp_dir.path(), PathStrRef("foo.txt"));
+  {
+    std::ofstream out(temp_file.str(), std::ofstream::binary);
+    out << "bar";
+    out.put('\0');
+    out << "\xff";
+  }
+
+  stdext::file_system::MappedFile file(temp_file);
+  ASSERT_FALSE(file.error());
+  EXPECT_TRUE(file.is_mapped());
+  EXPECT_EQ(5u, file.size());
+  EXPECT_EQ(std::string("bar\0\xff", 5),
+            std::string(file.str().data(), file.str().size()));
+  EXPECT_EQ(0xffu, file.bytes()[4]);
+
+  // Moving the file keeps the same view.
+  const char* data = file.str().data();
+  stdext::file_system::MappedFile moved(std::move(file));
+  EXPECT_EQ(data, moved.str().data());
+}
+
+TEST(FileSystemTests, MappedFileOfEmptyFile) {
+  stdext::file_system::TemporaryDirectory temp_dir;
+  Path temp_file = Join(temp_dir.path(), PathStrRef("foo.txt"));
+  { std::ofstream out(temp_file.str()); }
+
+  stdext::file_system::MappedFile file(temp_file);
+  ASSERT_FALSE(file.error());
+  EXPECT_EQ(0u, file.size());
+  EXPECT_EQ(0u, file.str().size());
+}
+
+TEST(FileSystemTests, MappedFileOfMissingFile) {
+  stdext::file_system::TemporaryDirectory temp_dir;
+  stdext::file_system::MappedFile file(
+      Join(temp_dir.path(), PathStrRef("foo.txt")));
+  EXPECT_TRUE(file.error());
+}
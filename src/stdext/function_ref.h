@@ -0,0 +1,66 @@
+#ifndef __STDEXT_FUNCTION_REF_H__
+#define __STDEXT_FUNCTION_REF_H__
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace stdext {
+
+// A non-owning reference to a callable, for passing callbacks to functions
+// which call them before returning.  It is two pointers in size and never
+// allocates.  The referenced callable must outlive the function_ref.
+template <typename Signature>
+class function_ref;
+
+template <typename R, typename... Args>
+class function_ref<R(Args...)> {
+ public:
+  function_ref(R (*function)(Args...))
+      : invoke_(&function_ref::invoke_function) {
+    callable_.function = function;
+  }
+
+  template <typename F,
+            typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type,
+                              function_ref>::value &&
+                !std::is_function<
+                    typename std::remove_reference<F>::type>::value>::type>
+  function_ref(F&& callable)
+      : invoke_(&function_ref::invoke_object<
+                    typename std::remove_reference<F>::type>) {
+    callable_.object = const_cast<void*>(
+        static_cast<const void*>(std::addressof(callable)));
+  }
+
+  function_ref(const function_ref& other) = default;
+  function_ref& operator=(const function_ref& other) = default;
+
+  R operator()(Args... args) const {
+    return invoke_(callable_, std::forward<Args>(args)...);
+  }
+
+ private:
+  union Callable {
+    void* object;
+    R (*function)(Args...);
+  };
+
+  template <typename T>
+  static R invoke_object(Callable callable, Args&&... args) {
+    return static_cast<R>((*static_cast<T*>(callable.object))(
+        std::forward<Args>(args)...));
+  }
+
+  static R invoke_function(Callable callable, Args&&... args) {
+    return callable.function(std::forward<Args>(args)...);
+  }
+
+  Callable callable_;
+  R (*invoke_)(Callable callable, Args&&... args);
+};
+
+}  // namespace stdext
+
+#endif  // __STDEXT_FUNCTION_REF_H__
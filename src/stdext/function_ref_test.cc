@@ -0,0 +1,41 @@
+#include "stdext/function_ref.h"
+
+#include <gtest/gtest.h>
+
+namespace stdext {
+
+namespace {
+int AddOne(int x) { return x + 1; }
+
+int CallWithTwo(function_ref<int(int)> function) { return function(2); }
+}  // namespace
+
+TEST(FunctionRefTests, CallsFunctionPointers) {
+  EXPECT_EQ(3, CallWithTwo(AddOne));
+  EXPECT_EQ(3, CallWithTwo(&AddOne));
+}
+
+TEST(FunctionRefTests, CallsLambdas) {
+  int offset = 5;
+  EXPECT_EQ(7, CallWithTwo([offset](int x) { return x + offset; }));
+}
+
+TEST(FunctionRefTests, RefersToTheOriginalCallable) {
+  int calls = 0;
+  auto counter = [&calls](int x) {
+    ++calls;
+    return x;
+  };
+  function_ref<int(int)> function(counter);
+  function_ref<int(int)> copy(function);
+
+  function(1);
+  copy(1);
+  EXPECT_EQ(2, calls);
+}
+
+TEST(FunctionRefTests, IsTwoPointersInSize) {
+  EXPECT_EQ(2 * sizeof(void*), sizeof(function_ref<void()>));
+}
+
+}  // namespace stdext
@@ -0,0 +1,232 @@
+#ifndef __STDEXT_GENERATOR_H__
+#define __STDEXT_GENERATOR_H__
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "platform/context.h"
+#include "platform/stack_allocator.h"
+
+namespace stdext {
+
+// A sequence of values produced by a body function running on its own stack.
+// The body is called with a yielder, and each call to the yielder suspends
+// the body and hands the consumer a reference to the yielded value, which
+// stays valid until the consumer asks for the next one.  Values are never
+// copied, and each yield or resume is a single context switch which does not
+// allocate.
+//
+//   generator<int> counter([](generator<int>::yielder& yield) {
+//     for (int i = 0; ; ++i) {
+//       if (!yield(i)) return;
+//     }
+//   });
+//   for (int& i : counter) { ... }
+//
+// A generator may be destroyed before its body has finished, in which case
+// the body is resumed one last time with every yield returning false
+// immediately, so that it can return and unwind its stack normally.  Bodies
+// should therefore return as soon as a yield returns false.  A body which
+// keeps yielding regardless is abandoned after kMaxYieldsAfterCancel more
+// yields, and its stack, along with everything on it, is leaked.
+//
+// Nested generators can be run on the same stack with yielder::from(), which
+// calls another body directly, with its values going straight to the
+// consumer.
+template <typename T>
+class generator {
+ public:
+  typedef typename std::remove_reference<T>::type value_type;
+
+  static const size_t kDefaultStackSize = 64 * 1024;
+  static const int kMaxYieldsAfterCancel = 1024;
+
+  class yielder {
+   public:
+    yielder(const yielder&) = delete;
+    yielder& operator=(const yielder&) = delete;
+
+    // Suspends the body until the consumer has finished with |value|.
+    // Returns false if the generator is being destroyed.
+    bool operator()(value_type& value) { return yield(&value); }
+    bool operator()(value_type&& value) { return yield(&value); }
+
+    // Runs |body|, another generator body taking a yielder, on this stack
+    // and with this yielder.  Returns false if the generator is being
+    // destroyed.
+    template <typename Body>
+    bool from(Body&& body) {
+      if (!cancelled_) {
+        body(*this);
+      }
+      return !cancelled_;
+    }
+
+   private:
+    friend class generator;
+
+    explicit yielder(platform::Context* consumer)
+        : consumer_(consumer), current_(nullptr), cancelled_(false),
+          yields_after_cancel_(0) {}
+
+    bool yield(value_type* value) {
+      if (cancelled_) {
+        if (yields_after_cancel_++ < kMaxYieldsAfterCancel) {
+          return false;
+        }
+        // The body is not going to return, so give up on it.  The consumer
+        // never resumes it.
+        platform::SwitchToContext(consumer_, nullptr);
+      }
+      current_ = value;
+      consumer_ = platform::SwitchToContext(consumer_, nullptr);
+      return !cancelled_;
+    }
+
+    platform::Context* consumer_;
+    value_type* current_;
+    bool cancelled_;
+    int yields_after_cancel_;
+  };
+
+  class iterator {
+   public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef typename std::remove_cv<typename generator::value_type>::type
+        value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef typename generator::value_type* pointer;
+    typedef typename generator::value_type& reference;
+
+    iterator() : generator_(nullptr) {}
+
+    reference operator*() const { return *generator_->yielder_->current_; }
+    pointer operator->() const { return generator_->yielder_->current_; }
+
+    iterator& operator++() {
+      generator_->resume();
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    bool operator==(const iterator& other) const {
+      return at_end() == other.at_end();
+    }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class generator;
+
+    explicit iterator(generator* owner) : generator_(owner) {}
+
+    bool at_end() const { return !generator_ || generator_->done(); }
+
+    generator* generator_;
+  };
+
+  // Creates a generator which runs |body| on a stack of at least
+  // |stack_size| bytes from |stack_allocator|.  The body is moved onto the
+  // new stack, but does not start running until begin() is called.
+  template <typename Body,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<Body>::type, generator>::value>::type>
+  explicit generator(
+      Body&& body, size_t stack_size = kDefaultStackSize,
+      platform::StackAllocator* stack_allocator =
+          platform::StackAllocator::GetDefault())
+      : yielder_(nullptr), started_(false) {
+    yielder** yielder_out = &yielder_;
+    context_ = platform::SwitchToNewContext(
+        stack_allocator, stack_size, nullptr,
+        [&body, yielder_out](platform::Context* consumer) {
+          typename std::decay<Body>::type local_body(
+              std::forward<Body>(body));
+          yielder yield(consumer);
+          *yielder_out = &yield;
+          // Park until the first resume.  The generator may have been moved
+          // by then, but it no longer needs to be reached from here.
+          yield.consumer_ =
+              platform::SwitchToContext(yield.consumer_, nullptr);
+          if (!yield.cancelled_) {
+            local_body(yield);
+          }
+          return yield.consumer_;
+        });
+  }
+
+  generator(generator&& other)
+      : context_(other.context_), yielder_(other.yielder_),
+        started_(other.started_) {
+    other.context_ = nullptr;
+    other.yielder_ = nullptr;
+  }
+
+  generator& operator=(generator&& other) {
+    if (this != &other) {
+      cancel();
+      context_ = other.context_;
+      yielder_ = other.yielder_;
+      started_ = other.started_;
+      other.context_ = nullptr;
+      other.yielder_ = nullptr;
+    }
+    return *this;
+  }
+
+  generator(const generator&) = delete;
+  generator& operator=(const generator&) = delete;
+
+  ~generator() { cancel(); }
+
+  // Runs the body up to its first yield, if it has not been started yet.
+  iterator begin() {
+    if (!started_ && context_) {
+      started_ = true;
+      resume();
+    }
+    return iterator(this);
+  }
+  iterator end() { return iterator(); }
+
+  // Returns true if the body has returned, or could not be started.
+  bool done() const { return context_ == nullptr; }
+
+ private:
+  void resume() {
+    assert(context_);
+    context_ = platform::SwitchToContext(context_, nullptr);
+    if (!context_) {
+      yielder_ = nullptr;
+    }
+  }
+
+  void cancel() {
+    if (context_) {
+      yielder_->cancelled_ = true;
+      resume();
+      if (context_) {
+        // Abandoned by the body, see kMaxYieldsAfterCancel.
+        context_ = nullptr;
+        yielder_ = nullptr;
+      }
+    }
+  }
+
+  // The body's suspended context, or null once the body has returned.
+  platform::Context* context_;
+  // Lives on the body's stack.
+  yielder* yielder_;
+  bool started_;
+};
+
+template <typename T>
+const size_t generator<T>::kDefaultStackSize;
+template <typename T>
+const int generator<T>::kMaxYieldsAfterCancel;
+
+}  // namespace stdext
+
+#endif  // __STDEXT_GENERATOR_H__
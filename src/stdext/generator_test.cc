@@ -0,0 +1,200 @@
+#include "stdext/generator.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace stdext {
+
+namespace {
+generator<int> Range(int begin, int end) {
+  return generator<int>([begin, end](generator<int>::yielder& yield) {
+    for (int i = begin; i < end; ++i) {
+      if (!yield(i)) {
+        return;
+      }
+    }
+  });
+}
+
+std::vector<int> Collect(generator<int>* values) {
+  std::vector<int> result;
+  for (int value : *values) {
+    result.push_back(value);
+  }
+  return result;
+}
+}  // namespace
+
+TEST(GeneratorTests, YieldsValuesInOrder) {
+  generator<int> range = Range(0, 5);
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4}), Collect(&range));
+  EXPECT_TRUE(range.done());
+}
+
+TEST(GeneratorTests, EmptyBody) {
+  generator<int> empty([](generator<int>::yielder&) {});
+  EXPECT_EQ(empty.end(), empty.begin());
+  EXPECT_TRUE(empty.done());
+}
+
+TEST(GeneratorTests, BodyDoesNotRunUntilBegin) {
+  bool started = false;
+  generator<int> values([&started](generator<int>::yielder& yield) {
+    started = true;
+    yield(1);
+  });
+  EXPECT_FALSE(started);
+  EXPECT_EQ(1, *values.begin());
+  EXPECT_TRUE(started);
+}
+
+TEST(GeneratorTests, YieldsByReference) {
+  std::string value("hello");
+  std::string* yielded = nullptr;
+  generator<std::string> values(
+      [&value](generator<std::string>::yielder& yield) {
+        yield(value);
+        // The consumer may modify the value in place.
+        EXPECT_EQ("hello world", value);
+      });
+  for (std::string& s : values) {
+    yielded = &s;
+    s += " world";
+  }
+  EXPECT_EQ(&value, yielded);
+}
+
+TEST(GeneratorTests, YieldsMoveOnlyTemporaries) {
+  generator<std::unique_ptr<int>> values(
+      [](generator<std::unique_ptr<int>>::yielder& yield) {
+        for (int i = 0; i < 3; ++i) {
+          yield(std::unique_ptr<int>(new int(i)));
+        }
+      });
+  std::vector<std::unique_ptr<int>> taken;
+  for (std::unique_ptr<int>& value : values) {
+    taken.push_back(std::move(value));
+  }
+  ASSERT_EQ(3u, taken.size());
+  EXPECT_EQ(2, *taken[2]);
+}
+
+TEST(GeneratorTests, IteratorInterface) {
+  generator<const int> values([](generator<const int>::yielder& yield) {
+    const int first = 10;
+    yield(first);
+    yield(20);
+  });
+  generator<const int>::iterator it = values.begin();
+  EXPECT_NE(values.end(), it);
+  EXPECT_EQ(10, *it);
+  ++it;
+  EXPECT_EQ(20, *it);
+  it++;
+  EXPECT_EQ(values.end(), it);
+}
+
+TEST(GeneratorTests, NestedBodiesRunOnTheSameStack) {
+  generator<int> values([](generator<int>::yielder& yield) {
+    char outer_local;
+    uintptr_t outer_frame = reinterpret_cast<uintptr_t>(&outer_local);
+    yield(0);
+    yield.from([outer_frame](generator<int>::yielder& inner_yield) {
+      // The inner body is called directly, so its locals are on the same
+      // stack, close to the outer body's.
+      char inner_local;
+      uintptr_t inner_frame = reinterpret_cast<uintptr_t>(&inner_local);
+      EXPECT_GT(4096u, inner_frame > outer_frame ? inner_frame - outer_frame
+                                                 : outer_frame - inner_frame);
+      inner_yield(1);
+      inner_yield(2);
+    });
+    yield(3);
+  });
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3}), Collect(&values));
+}
+
+TEST(GeneratorTests, GeneratorsCanConsumeGenerators) {
+  generator<int> doubled([](generator<int>::yielder& yield) {
+    generator<int> inner = Range(0, 4);
+    for (int value : inner) {
+      if (!yield(value * 2)) {
+        return;
+      }
+    }
+  });
+  EXPECT_EQ(std::vector<int>({0, 2, 4, 6}), Collect(&doubled));
+}
+
+TEST(GeneratorTests, EarlyDestructionUnwindsTheBody) {
+  auto resource = std::make_shared<int>(0);
+  bool body_returned = false;
+  {
+    generator<int> values(
+        [resource, &body_returned](generator<int>::yielder& yield) {
+          std::shared_ptr<int> local = resource;
+          for (int i = 0; yield(i); ++i) {
+          }
+          body_returned = true;
+        });
+    EXPECT_EQ(0, *values.begin());
+    EXPECT_EQ(3, resource.use_count());
+  }
+  EXPECT_TRUE(body_returned);
+  EXPECT_EQ(1, resource.use_count());
+}
+
+TEST(GeneratorTests, BodiesWhichIgnoreYieldResultsAreAbandoned) {
+  int num_yields = 0;
+  {
+    generator<int> values([&num_yields](generator<int>::yielder& yield) {
+      for (int i = 0;; ++i) {
+        ++num_yields;
+        yield(i);
+      }
+    });
+    EXPECT_EQ(0, *values.begin());
+  }
+  // The first yield, the ignored ones, and the one which gave up.
+  EXPECT_EQ(1 + generator<int>::kMaxYieldsAfterCancel + 1, num_yields);
+}
+
+TEST(GeneratorTests, DestructionBeforeStarting) {
+  auto resource = std::make_shared<int>(0);
+  bool body_ran = false;
+  {
+    generator<int> values(
+        [resource, &body_ran](generator<int>::yielder&) {
+          body_ran = true;
+        });
+    EXPECT_EQ(2, resource.use_count());
+  }
+  EXPECT_FALSE(body_ran);
+  EXPECT_EQ(1, resource.use_count());
+}
+
+TEST(GeneratorTests, MovedGeneratorsKeepRunning) {
+  generator<int> first = Range(0, 4);
+  generator<int>::iterator it = first.begin();
+  EXPECT_EQ(0, *it);
+
+  generator<int> second(std::move(first));
+  EXPECT_TRUE(first.done());
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), [&second]() {
+    std::vector<int> rest;
+    generator<int>::iterator it = second.begin();
+    for (++it; it != second.end(); ++it) {
+      rest.push_back(*it);
+    }
+    return rest;
+  }());
+
+  first = Range(5, 7);
+  EXPECT_EQ(std::vector<int>({5, 6}), Collect(&first));
+}
+
+}  // namespace stdext
@@ -0,0 +1,132 @@
+#ifndef __STDEXT_INPLACE_FUNCTION_H__
+#define __STDEXT_INPLACE_FUNCTION_H__
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "stdext/align.h"
+
+namespace stdext {
+
+namespace internal {
+
+template <typename R, typename... Args>
+struct inplace_function_ops {
+  R (*invoke)(void* callable, Args&&... args);
+  // Move constructs the callable at |source| into |destination|, and then
+  // destroys the one at |source|.
+  void (*relocate)(void* destination, void* source);
+  void (*destroy)(void* callable);
+};
+
+template <typename Callable, typename R, typename... Args>
+struct inplace_function_ops_for {
+  static R invoke(void* callable, Args&&... args) {
+    return static_cast<R>((*static_cast<Callable*>(callable))(
+        std::forward<Args>(args)...));
+  }
+  static void relocate(void* destination, void* source) {
+    Callable* source_callable = static_cast<Callable*>(source);
+    new (destination) Callable(std::move(*source_callable));
+    source_callable->~Callable();
+  }
+  static void destroy(void* callable) {
+    static_cast<Callable*>(callable)->~Callable();
+  }
+
+  static const inplace_function_ops<R, Args...> value;
+};
+
+template <typename Callable, typename R, typename... Args>
+const inplace_function_ops<R, Args...>
+    inplace_function_ops_for<Callable, R, Args...>::value = {
+      &inplace_function_ops_for::invoke,
+      &inplace_function_ops_for::relocate,
+      &inplace_function_ops_for::destroy,
+    };
+
+}  // namespace internal
+
+// A replacement for std::function which stores the callable inside of itself,
+// in a buffer of CAPACITY bytes, and never allocates memory.  Callables which
+// do not fit are rejected at compile time.  Unlike std::function, it is
+// move-only, and so can hold move-only callables.
+template <typename Signature, size_t CAPACITY = 4 * sizeof(void*),
+          size_t ALIGNMENT = alignof(std::max_align_t)>
+class inplace_function;
+
+template <typename R, typename... Args, size_t CAPACITY, size_t ALIGNMENT>
+class inplace_function<R(Args...), CAPACITY, ALIGNMENT> {
+ public:
+  inplace_function() : ops_(nullptr) {}
+  inplace_function(std::nullptr_t) : ops_(nullptr) {}
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, inplace_function>::value>::type>
+  inplace_function(F&& function) {
+    typedef typename std::decay<F>::type Callable;
+    static_assert(sizeof(Callable) <= CAPACITY,
+                  "The callable does not fit in the inplace_function.");
+    static_assert(ALIGNMENT % alignof(Callable) == 0,
+                  "The callable is over-aligned for the inplace_function.");
+    new (storage_.get()) Callable(std::forward<F>(function));
+    ops_ = &internal::inplace_function_ops_for<Callable, R, Args...>::value;
+  }
+
+  inplace_function(inplace_function&& other) : ops_(other.ops_) {
+    if (ops_) {
+      ops_->relocate(storage_.get(), other.storage_.get());
+      other.ops_ = nullptr;
+    }
+  }
+
+  inplace_function(const inplace_function&) = delete;
+  inplace_function& operator=(const inplace_function&) = delete;
+
+  ~inplace_function() { reset(); }
+
+  inplace_function& operator=(inplace_function&& other) {
+    if (this != &other) {
+      reset();
+      if (other.ops_) {
+        other.ops_->relocate(storage_.get(), other.storage_.get());
+        ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  inplace_function& operator=(std::nullptr_t) {
+    reset();
+    return *this;
+  }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  // As with std::function, this is const even though the callable is not.
+  R operator()(Args... args) const {
+    assert(ops_);
+    return ops_->invoke(const_cast<void*>(storage_.get()),
+                        std::forward<Args>(args)...);
+  }
+
+ private:
+  void reset() {
+    if (ops_) {
+      ops_->destroy(storage_.get());
+      ops_ = nullptr;
+    }
+  }
+
+  internal::aligned_memory<CAPACITY, ALIGNMENT> storage_;
+  const internal::inplace_function_ops<R, Args...>* ops_;
+};
+
+}  // namespace stdext
+
+#endif  // __STDEXT_INPLACE_FUNCTION_H__
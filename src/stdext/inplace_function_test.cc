@@ -0,0 +1,89 @@
+#include "stdext/inplace_function.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+
+namespace stdext {
+
+namespace {
+// Counts how many instances are alive, to check that inplace_function
+// destroys what it constructs.
+struct InstanceCounter {
+  explicit InstanceCounter(int* count) : count(count) { ++*count; }
+  InstanceCounter(const InstanceCounter& other) : count(other.count) {
+    ++*count;
+  }
+  ~InstanceCounter() { --*count; }
+
+  int operator()(int x) const { return x + 1; }
+
+  int* count;
+};
+}  // namespace
+
+TEST(InplaceFunctionTests, DefaultConstructedIsEmpty) {
+  inplace_function<void()> function;
+  EXPECT_FALSE(function);
+
+  inplace_function<void()> null_function(nullptr);
+  EXPECT_FALSE(null_function);
+}
+
+TEST(InplaceFunctionTests, CallsLambdaWithCaptures) {
+  int a = 1;
+  int b = 2;
+  inplace_function<int(int)> function = [a, &b](int c) { return a + b + c; };
+  ASSERT_TRUE(function);
+
+  EXPECT_EQ(6, function(3));
+  b = 3;
+  EXPECT_EQ(7, function(3));
+}
+
+TEST(InplaceFunctionTests, CanHoldMoveOnlyCallables) {
+  std::unique_ptr<int> value(new int(5));
+  inplace_function<int()> function = [value = std::move(value)]() {
+    return *value;
+  };
+  EXPECT_EQ(5, function());
+
+  inplace_function<int()> moved(std::move(function));
+  EXPECT_FALSE(function);
+  EXPECT_EQ(5, moved());
+}
+
+TEST(InplaceFunctionTests, DestroysTheCallable) {
+  int count = 0;
+  {
+    inplace_function<int(int)> function = InstanceCounter(&count);
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(2, function(1));
+
+    inplace_function<int(int)> moved;
+    moved = std::move(function);
+    EXPECT_EQ(1, count);
+
+    moved = nullptr;
+    EXPECT_EQ(0, count);
+
+    moved = InstanceCounter(&count);
+    EXPECT_EQ(1, count);
+  }
+  EXPECT_EQ(0, count);
+}
+
+TEST(InplaceFunctionTests, CapacityIsConfigurable) {
+  char large[100] = {42};
+  inplace_function<int(), 128> function = [large]() { return large[0]; };
+  EXPECT_EQ(42, function());
+  EXPECT_GE(sizeof(function), 128u);
+}
+
+TEST(InplaceFunctionTests, ConvertsReturnValueToVoid) {
+  int calls = 0;
+  inplace_function<void()> function = [&calls]() { return ++calls; };
+  function();
+  EXPECT_EQ(1, calls);
+}
+
+}  // namespace stdext
@@ -0,0 +1,145 @@
+#ifndef __STDEXT_WORK_STEALING_DEQUE_H__
+#define __STDEXT_WORK_STEALING_DEQUE_H__
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace stdext {
+
+// A Chase-Lev work-stealing deque, following "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (Le et al., 2013).  A single owner
+// thread may push() and pop() at the bottom of the deque, while any number of
+// other threads may concurrently steal() from the top.  T must be trivially
+// copyable and small enough to be lock-free atomic, typically a pointer.
+//
+// The deque grows as needed.  Buffers that have been grown out of are kept
+// alive until the deque is destroyed, since a thief may still be reading
+// from them.
+template <typename T>
+class work_stealing_deque {
+ public:
+  explicit work_stealing_deque(size_t initial_capacity = 256)
+      : top_(0), bottom_(0) {
+    assert(initial_capacity > 0 &&
+           (initial_capacity & (initial_capacity - 1)) == 0);
+    buffers_.emplace_back(new Buffer(initial_capacity));
+    buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+  }
+
+  work_stealing_deque(const work_stealing_deque&) = delete;
+  work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+  // Adds an item to the bottom of the deque.  Must only be called by the
+  // owner.
+  void push(T item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    if (bottom - top > static_cast<int64_t>(buffer->capacity) - 1) {
+      buffer = Grow(buffer, top, bottom);
+    }
+    buffer->Put(bottom, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  // Removes the most recently pushed item from the bottom of the deque.
+  // Returns false if the deque was empty.  Must only be called by the owner.
+  bool pop(T* item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    *item = buffer->Get(bottom);
+    if (top == bottom) {
+      // This is the last item, so we race with thieves for it.
+      bool won = top_.compare_exchange_strong(
+          top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Removes the least recently pushed item from the top of the deque.
+  // Returns false if the deque was empty or if another thread won the race
+  // for the item.  May be called from any thread.
+  bool steal(T* item) {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+
+    if (top >= bottom) {
+      return false;
+    }
+
+    Buffer* buffer = buffer_.load(std::memory_order_acquire);
+    T stolen = buffer->Get(top);
+    if (!top_.compare_exchange_strong(
+            top, top + 1, std::memory_order_seq_cst,
+            std::memory_order_relaxed)) {
+      return false;
+    }
+    *item = stolen;
+    return true;
+  }
+
+  // Returns true if the deque appeared empty at the time of the call.
+  bool empty() const {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    return top >= bottom;
+  }
+
+ private:
+  struct Buffer {
+    explicit Buffer(size_t capacity)
+        : capacity(capacity), items(new std::atomic<T>[capacity]) {}
+
+    T Get(int64_t index) const {
+      return items[index & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+    void Put(int64_t index, T item) {
+      items[index & (capacity - 1)].store(item, std::memory_order_relaxed);
+    }
+
+    const size_t capacity;
+    std::unique_ptr<std::atomic<T>[]> items;
+  };
+
+  Buffer* Grow(Buffer* buffer, int64_t top, int64_t bottom) {
+    buffers_.emplace_back(new Buffer(buffer->capacity * 2));
+    Buffer* new_buffer = buffers_.back().get();
+    for (int64_t i = top; i < bottom; ++i) {
+      new_buffer->Put(i, buffer->Get(i));
+    }
+    buffer_.store(new_buffer, std::memory_order_release);
+    return new_buffer;
+  }
+
+  // Thieves contend on |top_| while the owner mostly touches |bottom_|, so
+  // keep them on separate cache lines.
+  static const size_t kCacheLineSize = 64;
+  std::atomic<int64_t> top_;
+  char padding_[kCacheLineSize - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> bottom_;
+  std::atomic<Buffer*> buffer_;
+
+  // All buffers ever used by this deque, only accessed by the owner.
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+}  // namespace stdext
+
+#endif  // __STDEXT_WORK_STEALING_DEQUE_H__
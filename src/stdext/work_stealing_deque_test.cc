@@ -0,0 +1,106 @@
+#include "stdext/work_stealing_deque.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace stdext {
+
+TEST(WorkStealingDequeTests, EmptyDequeHasNothingToPopOrSteal) {
+  work_stealing_deque<int*> deque;
+  int* item;
+  EXPECT_TRUE(deque.empty());
+  EXPECT_FALSE(deque.pop(&item));
+  EXPECT_FALSE(deque.steal(&item));
+}
+
+TEST(WorkStealingDequeTests, PopIsLifoAndStealIsFifo) {
+  int values[3];
+  work_stealing_deque<int*> deque;
+  deque.push(&values[0]);
+  deque.push(&values[1]);
+  deque.push(&values[2]);
+
+  int* item;
+  ASSERT_TRUE(deque.pop(&item));
+  EXPECT_EQ(&values[2], item);
+  ASSERT_TRUE(deque.steal(&item));
+  EXPECT_EQ(&values[0], item);
+  ASSERT_TRUE(deque.pop(&item));
+  EXPECT_EQ(&values[1], item);
+  EXPECT_TRUE(deque.empty());
+}
+
+TEST(WorkStealingDequeTests, GrowsPastInitialCapacity) {
+  const int kNumItems = 1000;
+  std::vector<int> values(kNumItems);
+  work_stealing_deque<int*> deque(4);
+  for (int i = 0; i < kNumItems; ++i) {
+    deque.push(&values[i]);
+  }
+  for (int i = kNumItems - 1; i >= 0; --i) {
+    int* item;
+    ASSERT_TRUE(deque.pop(&item));
+    EXPECT_EQ(&values[i], item);
+  }
+  EXPECT_TRUE(deque.empty());
+}
+
+TEST(WorkStealingDequeTests, EveryItemIsTakenExactlyOnce) {
+  const int kNumItems = 200000;
+  const int kNumThieves = 4;
+  std::vector<int> values(kNumItems);
+  std::vector<std::atomic<int>> taken_counts(kNumItems);
+  for (auto& count : taken_counts) {
+    count.store(0);
+  }
+
+  work_stealing_deque<int*> deque(16);
+  std::atomic<bool> done(false);
+  std::atomic<int> num_taken(0);
+
+  auto take = [&](int* item) {
+    taken_counts[item - values.data()].fetch_add(1);
+    num_taken.fetch_add(1);
+  };
+
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < kNumThieves; ++i) {
+    thieves.emplace_back([&]() {
+      while (!done.load()) {
+        int* item;
+        if (deque.steal(&item)) {
+          take(item);
+        }
+      }
+    });
+  }
+
+  for (int i = 0; i < kNumItems; ++i) {
+    deque.push(&values[i]);
+    if (i % 3 == 0) {
+      int* item;
+      if (deque.pop(&item)) {
+        take(item);
+      }
+    }
+  }
+  int* item;
+  while (deque.pop(&item)) {
+    take(item);
+  }
+  while (num_taken.load() < kNumItems) {
+    std::this_thread::yield();
+  }
+  done.store(true);
+  for (auto& thief : thieves) {
+    thief.join();
+  }
+
+  for (int i = 0; i < kNumItems; ++i) {
+    EXPECT_EQ(1, taken_counts[i].load());
+  }
+}
+
+}  // namespace stdext